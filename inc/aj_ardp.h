@@ -50,7 +50,8 @@ extern "C" {
 #define UDP_MINIMUM_TIMEOUT 100 /**< The minimum amount of time between calls to ARDP_Recv, should not be greater than any of the timeout values above */
 
 #define UDP_SEGBMAX 1472  /**< Maximum size of an ARDP segment (quantum of reliable transmission) */
-#define UDP_SEGMAX ((AJ_TX_DATA_SIZE  + UDP_SEGBMAX - 1) / UDP_SEGBMAX + 1)  /**< Maximum number of ARDP segments in-flight (bandwidth-delay product sizing) */
+#define UDP_SEGMAX ((AJ_TX_DATA_SIZE  + UDP_SEGBMAX - 1) / UDP_SEGBMAX + 1)  /**< Segments needed for a full transmit buffer, the smallest ARDP window and the most segments sent in one batch */
+#define UDP_RECV_BATCH 8  /**< Maximum number of datagrams handed to ARDP by one batched receive */
 
 
 /* Protocol specific values */
@@ -79,21 +80,23 @@ AJ_Status AJ_ARDP_Connect(uint8_t* data, uint16_t dataLen, void* context, AJ_Net
 
 /*
  *      Disconnect is used to actively close the connection.
+ *          context (IN) - the transport context the connection was established on
  *          forced (IN) - if set to TRUE, the connection should be torn down regardless
  *                        of whether there are pending data retransmits. Otherwise, the
  *                        callee should check the value of returned error code.
  */
-void AJ_ARDP_Disconnect(uint8_t forced);
+void AJ_ARDP_Disconnect(void* context, uint8_t forced);
 
 /*
  *      StartMsgSend informs the ARDP protocol that next chunk of data to be sent
- *      is a beginning of anew message with a specified TTL.
+ *      on the connection for the transport context is a beginning of anew message
+ *      with a specified TTL.
  *      Returns error code:
  *         AJ_OK - all is good
  *         AJ_ERR_ARDP_TTL_EXPIRED - Discard this message. TTL is less than 1/2 estimated roundtrip time.
  *         AJ_ERR_ARDP_INVALID_CONNECTION - Connection does not exist (effectively connection record is NULL)
  */
-AJ_Status AJ_ARDP_StartMsgSend(uint32_t ttl);
+AJ_Status AJ_ARDP_StartMsgSend(void* context, uint32_t ttl);
 
 /**
  * AJ_ARDP_Send will attempt to send the data in buf.  It will attempt to send the message, waiting for
@@ -156,6 +159,63 @@ typedef AJ_Status (*SendFunction)(void* context, uint8_t* buf, size_t len, size_
 
 void AJ_ARDP_InitFunctions(ReceiveFunction recv, SendFunction send);
 
+/**
+ *  A pointer to the function used by ARDP to receive several datagrams from a socket at once
+ *
+ *  @param context - (IN)  The context pointer
+ *  @param bufs    - (OUT) Pointers to the datagrams received, valid until the next call
+ *  @param recved  - (OUT) The number of bytes in each datagram
+ *  @param segsz   - (OUT) For a datagram the platform coalesced from several segments (e.g. UDP GRO)
+ *                         the size of each segment, the last one may be shorter. 0 for a single segment.
+ *  @param max     - (IN)  The maximum number of datagrams to return
+ *  @param count   - (OUT) The number of datagrams returned
+ *  @param timeout - (IN)  The timeout for the first datagram
+ *
+ *  @return error code as for ReceiveFunction
+ */
+typedef AJ_Status (*ReceiveBatchFunction)(void* context, uint8_t** bufs, uint32_t* recved, uint16_t* segsz, uint16_t max, uint16_t* count, uint32_t timeout);
+
+/**
+ *  A pointer to the function used by ARDP to send several segments to a socket at once. All the
+ *  segments of a message are the same size except the last, so the platform may hand a run of
+ *  them to the network stack as one buffer to be segmented (e.g. UDP GSO).
+ *
+ *  @param context - (IN)  The context pointer
+ *  @param bufs    - (IN)  Pointers to the segments to send
+ *  @param lens    - (IN)  The length of each segment
+ *  @param count   - (IN)  The number of segments
+ *  @param sent    - (OUT) The number of segments actually sent
+ *  @param confirm - (IN)  The indicator whether MSG_CONFIRM flag should be set
+ *
+ *  @return error code
+ *      AJ_OK               if all the segments were sent
+ *      AJ_ERR_WRITE        if an error has occured
+ */
+typedef AJ_Status (*SendBatchFunction)(void* context, uint8_t** bufs, uint16_t* lens, uint16_t count, uint16_t* sent, uint8_t confirm);
+
+/**
+ * Set functions that move several segments with one call. This is optional, without them
+ * ARDP receives and sends one segment per call with the functions set by AJ_ARDP_InitFunctions().
+ *
+ * @param recv  Batched receive function or NULL
+ * @param send  Batched send function or NULL
+ */
+void AJ_ARDP_InitBatchFunctions(ReceiveBatchFunction recv, SendBatchFunction send);
+
+#ifndef NDEBUG
+/**
+ * Get the send window of a connection, for unit tests
+ *
+ * @param context  The connection context
+ * @param size     Returns the number of send buffers, the SEGMAX negotiated with the remote
+ * @param cwnd     Returns the congestion window
+ * @param ssthresh Returns the slow start threshold
+ *
+ * @return AJ_OK or AJ_ERR_DISALLOWED if there is no connection
+ */
+AJ_Status AJ_ARDP_GetSendWindow(void* context, uint16_t* size, uint16_t* cwnd, uint16_t* ssthresh);
+#endif
+
 #ifdef __cplusplus
 }
 #endif
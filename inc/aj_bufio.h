@@ -70,7 +70,8 @@ typedef AJ_Status (*AJ_RxFunc)(struct _AJ_IOBuffer* buf, uint32_t len, uint32_t
 typedef struct _AJ_IOBuffer {
     uint8_t direction;  /**< I/O buffer is either a Tx buffer or an Rx buffer */
     uint8_t flags;      /**< ports to send to or receive on */
-    uint16_t bufSize;   /**< Size of the data buffer */
+    uint32_t bufSize;   /**< Size of the data buffer */
+    uint32_t bufMax;    /**< Size the data buffer can grow to, zero if it can't be reallocated */
     uint8_t* bufStart;  /**< Start for the data buffer */
     uint8_t* readPtr;   /**< Current position in buf for reading data */
     uint8_t* writePtr;  /**< Current position in buf for writing data */
@@ -111,7 +112,8 @@ typedef struct _AJ_IOBuffer {
     } while (0)
 
 /**
- * Initialize an I/O Buffer.
+ * Initialize an I/O Buffer. The buffer has a fixed size, a transport that allocates the data
+ * buffer with AJ_Malloc() and frees bufStart can set bufMax to allow resizing.
  *
  * @param ioBuf     The I/O buffer to initialize
  * @param buffer    The data buffer to use
@@ -129,6 +131,35 @@ void AJ_IOBufInit(AJ_IOBuffer* ioBuf, uint8_t* buffer, uint32_t bufLen, uint8_t
  */
 void AJ_IOBufRebase(AJ_IOBuffer* ioBuf, size_t preserve);
 
+/**
+ * Reallocate the data buffer of an I/O buffer, keeping any unconsumed data.
+ *
+ * @param ioBuf    The I/O buffer
+ * @param size     The new size, zero to keep the current size
+ * @param bufMax   The size the data buffer can grow to on demand
+ *
+ * @return
+ *         - AJ_OK if the buffer was resized
+ *         - AJ_ERR_DISALLOWED if the data buffer can't be reallocated
+ *         - AJ_ERR_RESOURCES if the allocation failed
+ */
+AJ_Status AJ_IOBufResize(AJ_IOBuffer* ioBuf, uint32_t size, uint32_t bufMax);
+
+/**
+ * Grow an I/O buffer so it can hold at least the requested number of bytes. The read and write
+ * pointers are moved with the data, any other pointers into the buffer must be adjusted by the
+ * caller.
+ *
+ * @param ioBuf    The I/O buffer
+ * @param size     The number of bytes the buffer must hold
+ *
+ * @return
+ *         - AJ_OK if the buffer is large enough
+ *         - AJ_ERR_RESOURCES if the buffer has a fixed size, size is larger than the maximum or
+ *           the allocation failed
+ */
+AJ_Status AJ_IOBufGrow(AJ_IOBuffer* ioBuf, uint32_t size);
+
 #ifdef __cplusplus
 }
 #endif
@@ -131,6 +131,7 @@ typedef struct _AJ_BusAttachment {
     AJ_Session* sessions;                           /**< Linked list describing all ongoing sessions this bus attachment is involved in */
     AJ_StartManagementFunc startManagementCallback; /**< Callback for the start of a security management session */
     AJ_EndManagementFunc endManagementCallback;     /**< Callback for the end of a security management session */
+    uint8_t fastHandshake;                          /**< Offer and accept the reduced round-trip authentication handshake */
 } AJ_BusAttachment;
 
 /**
@@ -646,6 +647,40 @@ AJ_Status AJ_BusPropSet(AJ_Message* msg, AJ_BusPropSetCallback callback, void* c
  */
 AJ_Status AJ_BusEnableSecurity(AJ_BusAttachment* bus, const uint32_t* suites, size_t numsuites);
 
+/**
+ * Function to opt in to the reduced round-trip authentication handshake. When
+ * both peers have enabled it the suite is chosen during the GUID exchange and
+ * group keys are exchanged with the session key, saving up to three round
+ * trips. Peers that don't support it are authenticated the usual way.
+ *
+ * @param bus       The bus attachment struct
+ * @param enable    TRUE to offer and accept the fast handshake, FALSE to disable it
+ */
+void AJ_BusEnableFastHandshake(AJ_BusAttachment* bus, uint8_t enable);
+
+/**
+ * Resize the network buffers of a connected bus attachment. Connections start with buffers of
+ * AJ_RX_DATA_SIZE and AJ_TX_DATA_SIZE bytes, call this after AJ_FindBusAndConnect() and
+ * between messages to change them. Only targets that allocate the buffers on connect support
+ * this, on other targets change AJ_RX_DATA_SIZE and AJ_TX_DATA_SIZE at build time.
+ *
+ * When maxSize is larger than a buffer, a message that doesn't fit grows the buffer up to
+ * maxSize instead of failing with AJ_ERR_RESOURCES. Grown buffers keep their size until they
+ * are resized again or the bus is disconnected.
+ *
+ * @param bus       The bus attachment struct
+ * @param rxSize    Size of the receive buffer, zero to keep the current size
+ * @param txSize    Size of the transmit buffer, zero to keep the current size
+ * @param maxSize   Size the buffers can grow to, zero if they don't grow
+ *
+ * @return
+ *         - AJ_OK if the buffers were resized
+ *         - AJ_ERR_DISALLOWED if a buffer can't be resized, the transmit buffer of a UDP
+ *           connection has a fixed size because it sizes the send window
+ *         - AJ_ERR_RESOURCES if the buffers could not be allocated
+ */
+AJ_Status AJ_BusSetBufferSizes(AJ_BusAttachment* bus, uint32_t rxSize, uint32_t txSize, uint32_t maxSize);
+
 #ifdef __cplusplus
 }
 #endif
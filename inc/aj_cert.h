@@ -220,6 +220,13 @@ AJ_Status AJ_X509SelfVerify(const X509Certificate* certificate);
  */
 AJ_Status AJ_X509Verify(const X509Certificate* certificate, const AJ_ECCPublicKey* key);
 
+/**
+ * Forget all previously verified certificate signatures.
+ * Successful AJ_X509Verify results are cached (see AJ_CERT_VERIFY_CACHE_SIZE);
+ * this must be called whenever the security policy changes.
+ */
+void AJ_X509ClearVerifyCache(void);
+
 /**
  * Verify a chain of X.509 certificates.
  * Root certificate is first.
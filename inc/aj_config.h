@@ -37,12 +37,24 @@ extern "C" {
 #define AJ_DUMP_BYTE_SIZE           16          //aj_debug.c
 
 /* Network options */
+#if !defined(AJ_CONNECT_LOCALHOST)
 #define AJ_CONNECT_LOCALHOST        0           //Enable to bypass discovery and connect locally
+#endif
+#if !defined(AJ_ROUTING_NODE_UNIX_PATH)
+#define AJ_ROUTING_NODE_UNIX_PATH   "@alljoyn"  //Unix domain socket of a local routing node, '@' for the abstract namespace, "" to use TCP
+#endif
 #define AJ_MAX_TIMERS               4           //maximum number of timers              (aj_helper.c)
 #define AJ_ROUTING_NODE_BLACKLIST_SIZE 16       //maximum number of blacklisted routing nodes
 #define AJ_ROUTING_NODE_RESPONSELIST_SIZE 3     //maximum number of routing node responses to track
-#define AJ_TX_DATA_SIZE             5000        //minimum size of network transmit buffer
-#define AJ_RX_DATA_SIZE             5000        //minimum size of network receive buffer
+#if !defined(AJ_TX_DATA_SIZE)
+#define AJ_TX_DATA_SIZE             5000        //default size of network transmit buffer, see AJ_BusSetBufferSizes()
+#endif
+#if !defined(AJ_RX_DATA_SIZE)
+#define AJ_RX_DATA_SIZE             5000        //default size of network receive buffer, see AJ_BusSetBufferSizes()
+#endif
+#if !defined(AJ_ARDP_SEGMAX)
+#define AJ_ARDP_SEGMAX              32          //ARDP window in segments, offered to the routing node and the largest send window (aj_ardp.c)
+#endif
 
 /* Auth options */
 #define AJ_NONCE_LEN                28          //Length of the nonce.
@@ -52,10 +64,27 @@ extern "C" {
 #define AJ_SESSION_KEY_LEN          16          //Length of the session key (for AES128-CCM)
 #define AJ_ADHOC_LEN                16          //AD-HOC maximal passcode length        (aj_auth.h)
 #define AJ_NAME_MAP_GUID_SIZE       4           //aj_guid.c
-#define AJ_MAX_CREDS                40          //Max number of credentials that can store credentials (aj_creds.h)
+#if !defined(AJ_MAX_PEER_HANDSHAKES)
+#define AJ_MAX_PEER_HANDSHAKES      4           //maximum number of authentication handshakes in progress at once (aj_peer.c)
+#endif
+#if !defined(AJ_NAME_MAP_MAX_PEERS)
+#define AJ_NAME_MAP_MAX_PEERS       256         //maximum number of peers in the GUID map, allocated in blocks of AJ_NAME_MAP_GUID_SIZE (aj_guid.c)
+#endif
+#if !defined(AJ_MAX_CREDS)
+#define AJ_MAX_CREDS                64          //Max number of credentials that can be stored, up to 4094 (aj_creds.c)
+#endif
 #define AJ_LOCAL_GUID_NV_ID         AJ_NVRAM_ID_CREDS_BEGIN
 #define AJ_CREDS_NV_ID_BEGIN        (AJ_LOCAL_GUID_NV_ID + 1)
 #define AJ_CREDS_NV_ID_END          (AJ_CREDS_NV_ID_BEGIN + AJ_MAX_CREDS)
+#if !defined(AJ_NVRAM_COMPACT_THRESHOLD)
+#define AJ_NVRAM_COMPACT_THRESHOLD  (AJ_NVRAM_SIZE / 8) //bytes of deleted NVRAM entries that start background compaction (aj_nvram.c)
+#endif
+#if !defined(AJ_NVRAM_COMPACT_STEP)
+#define AJ_NVRAM_COMPACT_STEP       512         //bytes of NVRAM moved by each background compaction step (aj_nvram.c)
+#endif
+#if !defined(AJ_PEER_CACHE_SIZE)
+#define AJ_PEER_CACHE_SIZE          (8)         //number of peer master secrets and thumbprints kept in RAM, 0 to disable (aj_creds.c)
+#endif
 
 
 /* Timeouts */
@@ -85,6 +114,12 @@ extern "C" {
 
 /* Crypto */
 #define AJ_CCM_TRACE                0           //Enables fine-grained tracing for debugging new implementations.
+#if !defined(AJ_CERT_VERIFY_CACHE_SIZE)
+#define AJ_CERT_VERIFY_CACHE_SIZE   (4)         //number of verified certificate signatures to remember, 0 to disable (aj_cert.c)
+#endif
+#if !defined(AJ_CERT_VERIFY_CACHE_TTL)
+#define AJ_CERT_VERIFY_CACHE_TTL    (60 * 60 * 1000ul) //lifetime of a remembered certificate verification (aj_cert.c)
+#endif
 
 #define _SO_REUSEPORT               0       //Linux target
 
@@ -169,6 +169,13 @@ AJ_Status AJ_CredentialSetPeer(uint16_t type, const AJ_GUID* guid, uint32_t expi
  */
 AJ_Status AJ_CredentialGetPeer(uint16_t type, const AJ_GUID* guid, uint32_t* expiration, AJ_CredField* data);
 
+/**
+ * Write peer credentials held in RAM by AJ_CredentialSetPeer() to NVRAM.
+ * Until then they are lost on a restart, and the peer will have to
+ * authenticate from scratch.
+ */
+void AJ_CredentialFlushPeers(void);
+
 /**
  * Set the credential for an ECC public key
  *
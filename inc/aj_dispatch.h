@@ -0,0 +1,143 @@
+#ifndef _AJ_DISPATCH_H
+#define _AJ_DISPATCH_H
+
+/**
+ * @file aj_dispatch.h
+ * @defgroup aj_dispatch Worker Pool Dispatch
+ * @{
+ */
+/******************************************************************************
+ * Copyright AllSeen Alliance. All rights reserved.
+ *
+ *    Permission to use, copy, modify, and/or distribute this software for any
+ *    purpose with or without fee is hereby granted, provided that the above
+ *    copyright notice and this permission notice appear in all copies.
+ *
+ *    THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ *    WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ *    MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ *    ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ *    WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ *    ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ *    OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ ******************************************************************************/
+#include <ajtcl/aj_target.h>
+#include <ajtcl/aj_status.h>
+#include <ajtcl/aj_bus.h>
+#include <ajtcl/aj_msg.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Handlers for a method call or signal that is run on a worker pool. Only available on targets
+ * with threads.
+ *
+ * The message itself can only be accessed on the bus thread, so a handler is split in three:
+ * Unmarshal copies the arguments out of the message on the bus thread, Run does the slow work
+ * on a worker thread and Complete marshals the reply on the bus thread, from
+ * AJ_DispatchCompletions(). Run must not call into the bus attachment.
+ */
+typedef struct _AJ_DispatchHandler {
+    uint32_t msgId;     /**< The method call or signal, zero terminates a handler list */
+
+    /**
+     * Unmarshal the arguments into a work item
+     *
+     * @param msg   The method call or signal
+     * @param work  Returns the work item passed to Run and Complete
+     *
+     * @return  AJ_OK to queue the work, any other status is returned to the caller as an error reply
+     */
+    AJ_Status (*Unmarshal)(AJ_Message* msg, void** work);
+
+    /**
+     * Do the work, called on a worker thread
+     *
+     * @param work  The work item
+     *
+     * @return  The status passed to Complete
+     */
+    AJ_Status (*Run)(void* work);
+
+    /**
+     * Marshal and deliver the reply with AJ_MarshalReplyMsgAsync() or AJ_MarshalStatusMsgAsync()
+     * and release the work item. The reply context is cleared if no reply is expected. If NULL
+     * an empty reply, or an error reply for the status, is sent.
+     *
+     * @param replyCtx  The reply context for the method call
+     * @param work      The work item
+     * @param status    The status returned by Run
+     *
+     * @return  Return AJ_Status
+     */
+    AJ_Status (*Complete)(AJ_MsgReplyContext* replyCtx, void* work, AJ_Status status);
+} AJ_DispatchHandler;
+
+/**
+ * Opaque type for a dispatcher
+ */
+typedef struct _AJ_Dispatcher AJ_Dispatcher;
+
+/**
+ * Create a dispatcher that runs handlers for a bus attachment on a pool of worker threads.
+ * Work for the same object runs one item at a time in the order the messages were received
+ * so replies for an object are never reordered. Work for different objects runs concurrently.
+ *
+ * @param bus         The bus attachment
+ * @param handlers    Handler list terminated by an entry with msgId zero
+ * @param numWorkers  Number of worker threads
+ *
+ * @return  The dispatcher or NULL if it could not be created
+ */
+AJ_Dispatcher* AJ_CreateDispatcher(AJ_BusAttachment* bus, const AJ_DispatchHandler* handlers, uint8_t numWorkers);
+
+/**
+ * Stop the worker threads and free the dispatcher. Work in progress is allowed to finish, work
+ * that has not started is completed with AJ_ERR_INTERRUPTED. No replies are sent for either.
+ *
+ * @param dispatcher  The dispatcher
+ */
+void AJ_DestroyDispatcher(AJ_Dispatcher* dispatcher);
+
+/**
+ * Hand a received message to the worker pool. Call from the bus thread after AJ_UnmarshalMsg().
+ *
+ * @param dispatcher  The dispatcher
+ * @param msg         The message, closed if it was dispatched
+ *
+ * @return
+ *         - AJ_OK if the message was dispatched or answered with an error reply
+ *         - AJ_ERR_NO_MATCH if there is no handler, the application should handle the message
+ */
+AJ_Status AJ_DispatchMsg(AJ_Dispatcher* dispatcher, AJ_Message* msg);
+
+/**
+ * Send the replies for work that has finished. Call from the bus thread, for example each time
+ * AJ_UnmarshalMsg() returns.
+ *
+ * @param dispatcher  The dispatcher
+ *
+ * @return  Return AJ_Status
+ */
+AJ_Status AJ_DispatchCompletions(AJ_Dispatcher* dispatcher);
+
+/**
+ * Get a file descriptor that becomes readable when there is finished work, for application
+ * event loops that use AJ_GetEventFd(). Completing work also interrupts a bus thread blocked
+ * in AJ_UnmarshalMsg() on the network.
+ *
+ * @param dispatcher  The dispatcher
+ *
+ * @return  The file descriptor
+ */
+int AJ_GetDispatcherFd(AJ_Dispatcher* dispatcher);
+
+#ifdef __cplusplus
+}
+#endif
+/**
+ * @}
+ */
+#endif
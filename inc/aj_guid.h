@@ -160,7 +160,10 @@ AJ_Status AJ_SetGroupKey(const char* uniqueName, const uint8_t* key);
 AJ_Status AJ_GetSessionKey(const char* name, uint8_t* key, uint8_t* role, uint32_t* authVersion);
 
 /**
- * Gets the peer index in the name map, used for access control list
+ * Gets the peer index in the name map, used for access control list.
+ * The index is a stable handle for the peer until its name mapping is
+ * deleted and can be passed to the AJ_GetPeer* functions below to avoid
+ * further name lookups.
  *
  * @param name  The unique or well-known name for a remote peer
  * @param peer  The peer index
@@ -171,6 +174,44 @@ AJ_Status AJ_GetSessionKey(const char* name, uint8_t* key, uint8_t* role, uint32
  */
 AJ_Status AJ_GetPeerIndex(const char* name, uint32_t* peer);
 
+/**
+ * Gets a session key for a peer index
+ *
+ * @param peer  The peer index from AJ_GetPeerIndex()
+ * @param key   Buffer to receive the 16 byte session key
+ * @param role  Indicates which peer initiated the session key
+ * @param authVersion   Indicates the authentication version associated with this key
+ *
+ * @return  Return AJ_Status
+ *          - AJ_OK if the key was obtained
+ *          - AJ_ERR_NO_MATCH if the index is not in use
+ */
+AJ_Status AJ_GetPeerSessionKey(uint32_t peer, uint8_t* key, uint8_t* role, uint32_t* authVersion);
+
+/**
+ * Gets a group key for a peer index
+ *
+ * @param peer  The peer index from AJ_GetPeerIndex()
+ * @param key   Buffer to receive the 16 byte group key
+ *
+ * @return  Return AJ_Status
+ *          - AJ_OK if the key was obtained
+ *          - AJ_ERR_NO_MATCH if the index is not in use
+ */
+AJ_Status AJ_GetPeerGroupKey(uint32_t peer, uint8_t* key);
+
+/**
+ * Gets serial numbers for a peer index
+ *
+ * @param peer      The peer index from AJ_GetPeerIndex()
+ * @param incoming  The incoming serial numbers
+ *
+ * @return  Return AJ_Status
+ *          - AJ_OK if the information was obtained
+ *          - AJ_ERR_NO_MATCH if the index is not in use
+ */
+AJ_Status AJ_GetPeerSerialNumbers(uint32_t peer, AJ_SerialNum** incoming);
+
 /**
  * Gets serial numbers for an entry from the GUID map
  *
@@ -481,9 +481,11 @@ AJ_Status AJ_SetProxyObjectPath(AJ_Object* proxyObjects, uint32_t msgId, const c
 AJ_Status AJ_AllocReplyContext(AJ_Message* msg, uint32_t timeout);
 
 /**
- * Internal function to release all reply contexts. Called when disconnecting from the bus.
+ * Internal function to release all reply contexts for a bus attachment. Called when disconnecting from the bus.
+ *
+ * @param bus  The bus attachment that is disconnecting
  */
-void AJ_ReleaseReplyContexts(void);
+void AJ_ReleaseReplyContexts(AJ_BusAttachment* bus);
 
 /**
  * Internal function to check for timed out method calls. Returns TRUE and sets some information in
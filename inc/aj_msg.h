@@ -132,7 +132,7 @@ struct _AJ_Arg {
 
     uint8_t typeId;    /**< the argument type */
     uint8_t flags;     /**< non-zero if the value is a variant - values > 1 indicate variant-of-variant etc. */
-    uint16_t len;      /**< length of a string or array in bytes */
+    uint32_t len;      /**< length of a string or array in bytes */
 
     /*
      * Union of the various argument values.
@@ -196,12 +196,13 @@ struct _AJ_Message {
      */
     uint8_t sigOffset;         /**< Offset to current position in the signature */
     uint8_t varOffset;         /**< For variant marshalling/unmarshalling - Offset to start of variant signature */
-    uint16_t bodyBytes;        /**< Running count of the number body bytes written */
+    uint32_t bodyBytes;        /**< Running count of the number body bytes written */
     AJ_BusAttachment* bus;     /**< Bus attachment for this message */
     struct _AJ_Arg* outer;     /**< Container arg current being marshaled */
     uint32_t timeout;          /**< Remaining time to wait for all bytes of this message */
     uint32_t authVersion;      /**< Authentication version used */
     uint8_t expired;           /**< For indicating whether the Rx message has expired */
+    uint16_t peer;             /**< Name map index + 1 of the remote peer, 0 if not looked up */
     AJ_MsgHeader raw;          /**< The raw original message header (before endian swaps) */
 };
 
@@ -237,6 +238,25 @@ typedef struct _AJ_MsgReplyContext {
 AJ_EXPORT
 AJ_Status AJ_UnmarshalMsg(AJ_BusAttachment* bus, AJ_Message* msg, uint32_t timeout);
 
+/**
+ * Non-blocking variant of AJ_UnmarshalMsg() for applications that run their own event loop. The
+ * application waits for the file descriptor returned by AJ_GetEventFd() to become readable, on
+ * targets that provide one, and then calls this function until it returns AJ_ERR_TIMEOUT. A
+ * message is only unmarshaled once all of it has been received so this call does not wait for
+ * data, unless the message is larger than the receive buffer.
+ *
+ * @param bus     The bus attachment
+ * @param msg     Pointer to a structure to receive the unmarshalled message
+ *
+ * @return
+ *          - AJ_OK if a message header was succesfully unmarshaled, the message must be closed
+ *            with AJ_CloseMsg() as for AJ_UnmarshalMsg()
+ *          - AJ_ERR_TIMEOUT if there is no complete message to unmarshal
+ *          - Any other error returned by AJ_UnmarshalMsg()
+ */
+AJ_EXPORT
+AJ_Status AJ_ProcessEvents(AJ_BusAttachment* bus, AJ_Message* msg);
+
 /**
  * Unmarshals the next argument from a message or next element in a container (array, struct,
  * dictionary entry, or variant).
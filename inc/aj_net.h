@@ -36,6 +36,8 @@ extern "C" {
 #define AJ_ADDR_TCP4  0x04      /**< TCP ip4 address */
 #define AJ_ADDR_TCP6  0x08      /**< TCP ip6 address */
 
+#define AJ_ADDR_UNIX  0x10      /**< Unix domain socket of a routing node on the same host */
+
 struct _AJ_Service;
 struct _AJ_BusAttachment;
 
@@ -59,6 +61,21 @@ AJ_Status AJ_Net_Connect(struct _AJ_BusAttachment* bus, const struct _AJ_Service
  */
 void AJ_Net_Disconnect(AJ_NetSocket* netSock);
 
+/**
+ * Send the NUL byte that starts SASL authentication with the credentials of the process
+ * attached, so the routing node can authenticate the connection with the EXTERNAL mechanism.
+ * Only available on Linux.
+ *
+ * @param netSock  The connected socket
+ * @param uid      Returns the user id that was sent
+ *
+ * @return
+ *         - AJ_OK if the credentials were sent
+ *         - AJ_ERR_DISALLOWED if the socket is not a unix domain socket, nothing was sent
+ *         - AJ_ERR_WRITE if the send failed
+ */
+AJ_Status AJ_Net_SendCredentials(AJ_NetSocket* netSock, uint32_t* uid);
+
 /**
  * Send from an I/O buffer
  *
@@ -99,6 +116,165 @@ void AJ_Net_MCastDown(AJ_MCastSocket* mcastSock);
  */
 void AJ_Net_Interrupt(void);
 
+/**
+ * Hand the transport of a connected bus attachment to a dedicated I/O thread. The thread reads
+ * the socket and queues complete messages while the application is busy in message handlers,
+ * and writes messages marshalled by the application without the marshalling thread waiting on
+ * the socket. Messages are passed over lock-free queues. Only available on targets with
+ * threads.
+ *
+ * AJ_UnmarshalMsg() and AJ_ProcessEvents() are used as before from a single thread per bus
+ * attachment. Messages may be marshalled on any thread, but marshalling a message uses the bus
+ * attachment's transmit buffer so one message must be delivered before the next is started.
+ *
+ * @param bus  The connected bus attachment, TCP transport only
+ *
+ * @return
+ *         - AJ_OK if the I/O thread was started
+ *         - AJ_ERR_DISALLOWED if the transport can't be handed off or the thread is running already
+ *         - AJ_ERR_RESOURCES if the thread could not be started
+ */
+AJ_Status AJ_StartIOThread(struct _AJ_BusAttachment* bus);
+
+/**
+ * Stop the I/O thread and give the transport back to the bus attachment. Outbound messages
+ * are flushed first and received data that was not unmarshalled yet is moved into the bus
+ * attachment's receive buffer, which is grown if needed. AJ_Disconnect() stops the thread if
+ * it is still running.
+ *
+ * @param bus  The bus attachment
+ *
+ * @return
+ *         - AJ_OK if the thread was stopped or was not running
+ *         - AJ_ERR_RESOURCES if the received data doesn't fit in the receive buffer, the thread
+ *           keeps running and the call can be retried after unmarshalling more messages
+ */
+AJ_Status AJ_StopIOThread(struct _AJ_BusAttachment* bus);
+
+/**
+ * Internal function called by AJ_Net_Disconnect() to stop the I/O thread for a socket
+ *
+ * @param netSock  The socket being disconnected
+ */
+void _AJ_StopIOThread(AJ_NetSocket* netSock);
+
+/**
+ * Internal function called by AJ_Net_Interrupt() to wake reads waiting on an I/O thread
+ *
+ * @param netSock  Only wake a read on this socket, NULL for all
+ */
+void _AJ_IOThreadInterrupt(AJ_NetSocket* netSock);
+
+/**
+ * Create the shared memory for a transport between two bus attachments on the same host
+ * without a routing node. The memory holds a ring for each direction, the file descriptor
+ * can be passed to a child process or over a unix domain socket. Only available on Linux.
+ *
+ * @param ringSize  Size in bytes of each ring, rounded up to a power of two
+ *
+ * @return  A memfd for the shared memory or -1 if it could not be created
+ */
+int AJ_ShmCreate(uint32_t ringSize);
+
+/**
+ * Attach a bus attachment to one end of a shared memory transport. The first bus attachment
+ * to attach sends on one ring and the second on the other. Messages are exchanged directly
+ * so there is no authentication or Hello; the caller sets the unique names. The peer is only
+ * woken when a ring it is waiting on becomes non-empty or stops being full. Only available
+ * on Linux.
+ *
+ * @param bus    The bus attachment
+ * @param memFd  File descriptor returned by AJ_ShmCreate()
+ *
+ * @return
+ *         - AJ_OK if the bus attachment was attached
+ *         - AJ_ERR_DISALLOWED if both ends are attached already
+ *         - AJ_ERR_CONNECT if the memory could not be mapped
+ *         - AJ_ERR_RESOURCES if the buffers could not be allocated
+ */
+AJ_Status AJ_ShmConnect(struct _AJ_BusAttachment* bus, int memFd);
+
+/**
+ * Internal function called by AJ_Net_Disconnect() to detach a shared memory transport
+ *
+ * @param netSock  The socket being disconnected
+ */
+void _AJ_ShmDisconnect(AJ_NetSocket* netSock);
+
+/**
+ * Internal function called by AJ_Net_Interrupt() to wake reads blocked on shared memory
+ *
+ * @param netSock  Only wake a read on this socket, NULL for all
+ */
+void _AJ_ShmInterrupt(AJ_NetSocket* netSock);
+
+/**
+ * Internal function that interrupts a read blocked on one bus attachment's socket, like
+ * AJ_Net_Interrupt() does for all of them. It may be called from any thread, also while the
+ * socket is being disconnected.
+ *
+ * @param netSock  The bus attachment's socket
+ */
+void _AJ_Net_InterruptSock(AJ_NetSocket* netSock);
+
+#ifdef AJ_IO_URING
+/**
+ * An io_uring that receives from a connected socket with a multishot receive into a ring of
+ * kernel-selected buffers. Internal to the Linux network layer.
+ */
+typedef struct _AJ_Uring AJ_Uring;
+
+/**
+ * Internal function to set up an io_uring for a connected socket
+ *
+ * @param sock         The connected TCP, unix or UDP socket
+ * @param interruptFd  Eventfd written by AJ_Net_Interrupt()
+ * @param timerFd      Timerfd whose ticks are consumed while waiting
+ * @param bufSize      Size of each receive buffer, a whole datagram for UDP
+ *
+ * @return  The ring or NULL if the kernel doesn't support the features needed
+ */
+AJ_Uring* _AJ_UringCreate(int sock, int interruptFd, int timerFd, uint32_t bufSize);
+
+/**
+ * Internal function to get received data, waiting up to timeout for it to arrive. The data
+ * stays valid until the next call.
+ *
+ * @param ring     The ring
+ * @param data     Returns the received data that has not been consumed
+ * @param len      Returns the length of the data
+ * @param timeout  Timeout in milliseconds
+ *
+ * @return  AJ_OK, AJ_ERR_TIMEOUT, AJ_ERR_INTERRUPTED or AJ_ERR_READ
+ */
+AJ_Status _AJ_UringRecv(AJ_Uring* ring, uint8_t** data, uint32_t* len, uint32_t timeout);
+
+/**
+ * Internal function to mark received data returned by _AJ_UringRecv() as consumed
+ *
+ * @param ring  The ring
+ * @param len   Number of bytes consumed
+ */
+void _AJ_UringConsume(AJ_Uring* ring, uint32_t len);
+
+/**
+ * Internal function to get the ring's file descriptor to register with a reactor. It is
+ * readable while received data is waiting.
+ *
+ * @param ring  The ring
+ *
+ * @return  The file descriptor
+ */
+int _AJ_UringFd(AJ_Uring* ring);
+
+/**
+ * Internal function to cancel outstanding requests and free a ring
+ *
+ * @param ring  The ring
+ */
+void _AJ_UringDestroy(AJ_Uring* ring);
+#endif
+
 #ifdef __cplusplus
 }
 #endif
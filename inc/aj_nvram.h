@@ -177,6 +177,47 @@ AJ_Status AJ_NVRAM_SecureDelete(uint16_t id);
  */
 AJ_Status AJ_NVRAM_Delete(uint16_t id);
 
+/**
+ * Reclaim some of the space held by deleted data sets, moving at most about
+ * AJ_NVRAM_COMPACT_STEP bytes. Compaction starts once deleted data sets hold
+ * AJ_NVRAM_COMPACT_THRESHOLD bytes and then runs until all the space is reclaimed.
+ * It only runs on targets that support transactions and while no data sets are open.
+ * AJ_RunAllJoynService() calls this when it is idle, applications with their own
+ * message loop should do the same.
+ *
+ * @return TRUE if there is more space to reclaim
+ */
+uint8_t AJ_NVRAM_CompactStep(void);
+
+/**
+ * Start a transaction. Changes to NVRAM made until the transaction is committed are
+ * written out together by AJ_NVRAM_CommitTransaction() so that either all or none of
+ * them survive a crash. Transactions nest, only the outermost commit writes. On targets
+ * that don't support transactions this returns an error and changes are written as they
+ * are made; AJ_NVRAM_CommitTransaction() and AJ_NVRAM_AbortTransaction() then do nothing.
+ *
+ * @return AJ_OK if the transaction was started
+ *         AJ_ERR_UNEXPECTED if the target doesn't support transactions.
+ */
+AJ_Status AJ_NVRAM_BeginTransaction(void);
+
+/**
+ * Commit a transaction started by AJ_NVRAM_BeginTransaction()
+ *
+ * @return AJ_OK if the changes were written or there was no transaction to commit
+ *         AJ_ERR_NVRAM_WRITE if the changes could not be written
+ *         AJ_ERR_FAILURE if the transaction was aborted by a nested transaction
+ */
+AJ_Status AJ_NVRAM_CommitTransaction(void);
+
+/**
+ * Abort a transaction started by AJ_NVRAM_BeginTransaction(), discarding all changes made
+ * since the outermost transaction started. After a nested abort the outer transactions stay
+ * open, changes made until the outermost commit or abort are also discarded and the outermost
+ * commit fails. Data sets must not be left open across an abort.
+ */
+void AJ_NVRAM_AbortTransaction(void);
+
 #ifdef __cplusplus
 }
 #endif
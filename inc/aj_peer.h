@@ -117,6 +117,8 @@ typedef void (*AJ_PeerAuthenticateCallback)(const void* context, AJ_Status statu
  *
  * @return   Return AJ_Status
  *         - AJ_OK if the request was sent
+ *         - AJ_ERR_RESOURCES if a handshake with this peer is in progress or
+ *           AJ_MAX_PEER_HANDSHAKES handshakes are already in progress
  *         - An error status otherwise
  */
 AJ_Status AJ_PeerAuthenticate(AJ_BusAttachment* bus, const char* peerName, AJ_PeerAuthenticateCallback callback, void* cbContext);
@@ -260,12 +262,12 @@ AJ_Status AJ_PeerHandleSendMembershipsReply(AJ_Message* msg);
 AJ_Status AJ_PeerSendManifests(AJ_Message* msg, uint8_t outgoing);
 
 /**
- * Clear the authentication handshake context
+ * Clear the authentication handshake contexts of all peers
  */
 void AJ_ClearAuthContext();
 
 /**
- * Clear the flag that determines if we've sent manifests to the peer
+ * Clear the flags that determine if we've sent manifests to the peers
  */
 void AJ_ClearSentManifests();
 
@@ -203,10 +203,44 @@ uint8_t AJSVC_PropertyStore_GetNumberOfLanguages();
 AJ_Status AJSVC_PropertyStore_LoadAll();
 
 /**
- * Save all persisted values.
+ * Save all persisted values that changed since they were last loaded or saved.
  * @return aj_status
  */
 AJ_Status AJSVC_PropertyStore_SaveAll();
 
+/**
+ * Time in milliseconds a scheduled save is held back so that changes made in quick
+ * succession are written to NVRAM together.
+ */
+#ifndef AJSVC_PROPERTY_STORE_SAVE_DELAY
+#define AJSVC_PROPERTY_STORE_SAVE_DELAY 1000
+#endif
+
+/**
+ * Schedule the changed values to be saved. The save happens on the first call to
+ * AJSVC_PropertyStore_SaveScheduled() after AJSVC_PROPERTY_STORE_SAVE_DELAY has expired.
+ */
+void AJSVC_PropertyStore_ScheduleSave();
+
+/**
+ * Save the changed values if a save was scheduled and is due. Should be called when the
+ * application is idle and before disconnecting or rebooting.
+ * @param force  TRUE to save a scheduled save immediately
+ * @return aj_status
+ */
+AJ_Status AJSVC_PropertyStore_SaveScheduled(uint8_t force);
+
+/**
+ * Start a group of updates that can be discarded as a whole with
+ * AJSVC_PropertyStore_EndUpdates().
+ */
+void AJSVC_PropertyStore_BeginUpdates();
+
+/**
+ * End a group of updates started with AJSVC_PropertyStore_BeginUpdates().
+ * @param keep  TRUE to keep the updates, FALSE to restore the values they replaced
+ */
+void AJSVC_PropertyStore_EndUpdates(uint8_t keep);
+
 /** @} */ //End of group 'PropertyStore'
  #endif /* _PROPERTY_STORE_H_ */
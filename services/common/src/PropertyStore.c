@@ -75,6 +75,40 @@ static const char* defaultLanguagesKeyName = { AJ_SUPPORTED_LANGUAGES_STR };
 
 static uint8_t numberOfLanguages = 0;
 
+/*
+ * Runtime fields changed in RAM since they were last loaded from or saved to NVRAM
+ */
+static uint8_t propertyStoreDirty[AJSVC_PROPERTY_STORE_NUMBER_OF_RUNTIME_KEYS];
+
+/*
+ * Bumped on every change to a runtime value so cached ReadAll snapshots can be revalidated
+ */
+static uint16_t propertyStoreGeneration = 0;
+
+/*
+ * The fields and values ReadAll marshals for a filter and language, reused until a value changes
+ */
+typedef struct _ReadAllSnapshot {
+    uint8_t valid;
+    uint8_t filter;
+    int8_t langIndex;
+    uint16_t generation;
+    const char* values[AJSVC_PROPERTY_STORE_NUMBER_OF_KEYS];
+} ReadAllSnapshot;
+
+#define READ_ALL_SNAPSHOT_ABOUT    0
+#define READ_ALL_SNAPSHOT_CONFIG   1
+#define READ_ALL_SNAPSHOT_ANNOUNCE 2
+#define READ_ALL_SNAPSHOTS         3
+
+static ReadAllSnapshot readAllSnapshots[READ_ALL_SNAPSHOTS];
+
+static void MarkFieldChanged(int8_t fieldIndex)
+{
+    propertyStoreDirty[fieldIndex] = TRUE;
+    propertyStoreGeneration++;
+}
+
 uint8_t AJSVC_PropertyStore_GetNumberOfLanguages()
 {
     return numberOfLanguages;
@@ -202,9 +236,12 @@ uint8_t AJSVC_PropertyStore_SetValueForLang(int8_t fieldIndex, int8_t langIndex,
     var_size = propertyStoreRuntimeValues[fieldIndex].size;
     //Check that the field we are trying to write into is not actually the same value.
     //On Darwin this will fail per the strncpy function definition
-    if (propertyStoreRuntimeValues[fieldIndex].value[langIndex] != value) {
+    //Unchanged values are not copied so they are not written to NVRAM again
+    if (propertyStoreRuntimeValues[fieldIndex].value[langIndex] != value &&
+        strncmp(propertyStoreRuntimeValues[fieldIndex].value[langIndex], value, var_size - 1)) {
         strncpy(propertyStoreRuntimeValues[fieldIndex].value[langIndex], value, var_size - 1);
         (propertyStoreRuntimeValues[fieldIndex].value[langIndex])[var_size - 1] = '\0';
+        MarkFieldChanged(fieldIndex);
     }
 
     return TRUE;
@@ -240,6 +277,7 @@ static void ClearPropertiesInRAM()
                     buf = propertyStoreRuntimeValues[fieldIndex].value[langIndex];
                     if (buf) {
                         memset(buf, 0, propertyStoreRuntimeValues[fieldIndex].size);
+                        MarkFieldChanged(fieldIndex);
                     }
                 }
             }
@@ -265,6 +303,7 @@ static void InitMandatoryPropertiesInRAM()
         status = AJ_GetLocalGUID(&theAJ_GUID);
         if (status == AJ_OK) {
             AJ_GUID_ToString(&theAJ_GUID, machineIdValue, propertyStoreRuntimeValues[AJSVC_PROPERTY_STORE_APP_ID].size);
+            MarkFieldChanged(AJSVC_PROPERTY_STORE_APP_ID);
         }
     }
     if (currentDeviceIdValue == NULL || currentDeviceIdValue[0] == '\0') {
@@ -337,6 +376,19 @@ AJ_Status PropertyStore_Init()
 }
 
 #ifdef CONFIG_SERVICE
+/*
+ * Pending save requested with AJSVC_PropertyStore_ScheduleSave()
+ */
+static uint8_t saveScheduled = FALSE;
+static AJ_Time saveTimer;
+
+/*
+ * Copy of the runtime values taken by AJSVC_PropertyStore_BeginUpdates()
+ */
+static uint8_t* updatesBackup = NULL;
+static uint8_t updatesBackupDirty[AJSVC_PROPERTY_STORE_NUMBER_OF_RUNTIME_KEYS];
+static uint8_t updatesReload = FALSE;
+
 static AJ_Status PropertyStore_ReadConfig(uint16_t index, void* ptr, uint16_t size)
 {
     AJ_Status status = AJ_OK;
@@ -391,11 +443,21 @@ AJ_Status AJSVC_PropertyStore_LoadAll()
             if (buf) {
                 size = propertyStoreRuntimeValues[fieldIndex].size;
                 entry = (int)fieldIndex + (int)langIndex * (int)AJSVC_PROPERTY_STORE_NUMBER_OF_RUNTIME_KEYS;
-                status = PropertyStore_ReadConfig(AJ_PROPERTIES_NV_ID_BEGIN + entry, buf, size);
+                if (AJ_NVRAM_Exist(AJ_PROPERTIES_NV_ID_BEGIN + entry)) {
+                    status = PropertyStore_ReadConfig(AJ_PROPERTIES_NV_ID_BEGIN + entry, buf, size);
+                } else {
+                    memset(buf, 0, size); // Only changed fields are saved, a field never saved has its default value
+                }
                 AJ_InfoPrintf(("nvram read fieldIndex=%d [%s] langIndex=%d [%s] entry=%d val=%s size=%u status=%s\n", (int)fieldIndex, propertyStoreProperties[fieldIndex].keyName, (int)langIndex, propertyStoreDefaultLanguages[langIndex], (int)entry, propertyStoreRuntimeValues[fieldIndex].value[langIndex], (int)size, AJ_StatusText(status)));
             }
         }
     }
+    /*
+     * RAM now matches NVRAM, any unsaved changes are gone
+     */
+    memset(propertyStoreDirty, 0, sizeof(propertyStoreDirty));
+    propertyStoreGeneration++;
+    saveScheduled = FALSE;
 
     return status;
 }
@@ -409,9 +471,12 @@ AJ_Status AJSVC_PropertyStore_SaveAll()
     uint16_t size = 0;
     uint16_t entry;
 
-    for (langIndex = 0; langIndex < AJSVC_PROPERTY_STORE_NUMBER_OF_LANGUAGES; langIndex++) {
-        for (fieldIndex = 0; fieldIndex < AJSVC_PROPERTY_STORE_NUMBER_OF_RUNTIME_KEYS; fieldIndex++) {
+    /* Save all changed fields or none of them */
+    AJ_NVRAM_BeginTransaction();
+    for (langIndex = 0; (AJ_OK == status) && (langIndex < AJSVC_PROPERTY_STORE_NUMBER_OF_LANGUAGES); langIndex++) {
+        for (fieldIndex = 0; (AJ_OK == status) && (fieldIndex < AJSVC_PROPERTY_STORE_NUMBER_OF_RUNTIME_KEYS); fieldIndex++) {
             if (propertyStoreRuntimeValues[fieldIndex].value == NULL ||
+                !propertyStoreDirty[fieldIndex] ||
                 !propertyStoreProperties[fieldIndex].mode0Write ||
                 (langIndex != AJSVC_PROPERTY_STORE_NO_LANGUAGE_INDEX && !propertyStoreProperties[fieldIndex].mode2MultiLng)) {
                 continue;
@@ -425,11 +490,109 @@ AJ_Status AJSVC_PropertyStore_SaveAll()
             }
         }
     }
+    if (AJ_OK == status) {
+        status = AJ_NVRAM_CommitTransaction();
+    } else {
+        AJ_NVRAM_AbortTransaction();
+    }
+    if (AJ_OK == status) {
+        memset(propertyStoreDirty, 0, sizeof(propertyStoreDirty));
+        saveScheduled = FALSE;
+    }
     AJ_AboutSetShouldAnnounce(); // Set flag for sending an updated Announcement
 
     return status;
 }
 
+void AJSVC_PropertyStore_ScheduleSave()
+{
+    /*
+     * The delay runs from the first unsaved change so a steady stream of updates
+     * cannot hold back the save indefinitely
+     */
+    if (!saveScheduled) {
+        AJ_InitTimer(&saveTimer);
+        saveScheduled = TRUE;
+    }
+}
+
+AJ_Status AJSVC_PropertyStore_SaveScheduled(uint8_t force)
+{
+    if (!saveScheduled) {
+        return AJ_OK;
+    }
+    if (!force && AJ_GetElapsedTime(&saveTimer, TRUE) < AJSVC_PROPERTY_STORE_SAVE_DELAY) {
+        return AJ_OK;
+    }
+    return AJSVC_PropertyStore_SaveAll();
+}
+
+/*
+ * Copy every runtime value buffer to or from the backup, returns the size of the backup.
+ * Nothing is copied if backup is NULL.
+ */
+static size_t CopyPropertiesInRAM(uint8_t* backup, uint8_t toBackup)
+{
+    int8_t fieldIndex;
+    int8_t langIndex;
+    size_t offset = 0;
+    size_t size;
+    char* buf;
+
+    for (fieldIndex = 0; fieldIndex < AJSVC_PROPERTY_STORE_NUMBER_OF_RUNTIME_KEYS; fieldIndex++) {
+        if (propertyStoreRuntimeValues[fieldIndex].value) {
+            size = propertyStoreRuntimeValues[fieldIndex].size;
+            for (langIndex = 0; langIndex < AJSVC_PROPERTY_STORE_NUMBER_OF_LANGUAGES; langIndex++) {
+                buf = propertyStoreRuntimeValues[fieldIndex].value[langIndex];
+                if (buf && (propertyStoreProperties[fieldIndex].mode2MultiLng || langIndex == AJSVC_PROPERTY_STORE_NO_LANGUAGE_INDEX)) {
+                    if (backup && toBackup) {
+                        memcpy(backup + offset, buf, size);
+                    } else if (backup) {
+                        memcpy(buf, backup + offset, size);
+                    }
+                    offset += size;
+                }
+            }
+        }
+    }
+    return offset;
+}
+
+void AJSVC_PropertyStore_BeginUpdates()
+{
+    AJ_Free(updatesBackup);
+    updatesBackup = (uint8_t*)AJ_Malloc(CopyPropertiesInRAM(NULL, TRUE));
+    if (updatesBackup) {
+        CopyPropertiesInRAM(updatesBackup, TRUE);
+        memcpy(updatesBackupDirty, propertyStoreDirty, sizeof(propertyStoreDirty));
+        updatesReload = FALSE;
+    } else {
+        /*
+         * Without a backup the updates can only be discarded by reloading from NVRAM
+         * so earlier changes must be saved first
+         */
+        AJ_WarnPrintf(("AJSVC_PropertyStore_BeginUpdates(): No memory for backup\n"));
+        AJSVC_PropertyStore_SaveAll();
+        updatesReload = TRUE;
+    }
+}
+
+void AJSVC_PropertyStore_EndUpdates(uint8_t keep)
+{
+    if (!keep) {
+        if (updatesBackup) {
+            CopyPropertiesInRAM(updatesBackup, FALSE);
+            memcpy(propertyStoreDirty, updatesBackupDirty, sizeof(propertyStoreDirty));
+            propertyStoreGeneration++;
+        } else if (updatesReload) {
+            AJSVC_PropertyStore_LoadAll();
+        }
+    }
+    AJ_Free(updatesBackup);
+    updatesBackup = NULL;
+    updatesReload = FALSE;
+}
+
 static uint8_t UpdateFieldInRAM(int8_t fieldIndex, int8_t langIndex, const char* fieldValue)
 {
     uint8_t ret = FALSE;
@@ -449,6 +612,51 @@ static uint8_t DeleteFieldFromRAM(AJSVC_PropertyStoreFieldIndices fieldIndex, in
 }
 #endif
 
+/*
+ * Resolve which fields ReadAll marshals for the filter and language and the value of each.
+ * Fields that are skipped get a NULL value.
+ */
+static AJ_Status BuildReadAllSnapshot(ReadAllSnapshot* snapshot, AJSVC_PropertyStoreCategoryFilter filter, int8_t langIndex)
+{
+    const char* value;
+    int8_t fieldIndex;
+
+    snapshot->valid = FALSE;
+    for (fieldIndex = 0; fieldIndex < AJSVC_PROPERTY_STORE_NUMBER_OF_KEYS; fieldIndex++) {
+        snapshot->values[fieldIndex] = NULL;
+#ifdef CONFIG_SERVICE
+        if (propertyStoreProperties[fieldIndex].mode7Public && (filter.bit0About || (filter.bit1Config && propertyStoreProperties[fieldIndex].mode0Write) || (filter.bit2Announce && propertyStoreProperties[fieldIndex].mode1Announce))) {
+#else
+        if (propertyStoreProperties[fieldIndex].mode7Public && (filter.bit0About || (filter.bit2Announce && propertyStoreProperties[fieldIndex].mode1Announce))) {
+#endif
+            value = AJSVC_PropertyStore_GetValueForLang(fieldIndex, langIndex);
+
+            if (value == NULL && (int8_t)fieldIndex >= (int8_t)AJSVC_PROPERTY_STORE_NUMBER_OF_MANDATORY_KEYS) {     // Non existing values are skipped!
+                AJ_WarnPrintf(("PropertyStore_ReadAll - Failed to get value for field=(name=%s, index=%d) and language=(name=%s, index=%d), skipping.\n", AJSVC_PropertyStore_GetFieldName(fieldIndex), (int)fieldIndex, AJSVC_PropertyStore_GetLanguageName(langIndex), (int)langIndex));
+                continue;
+            }
+#ifdef CONFIG_SERVICE
+            if (fieldIndex == AJSVC_PROPERTY_STORE_MAX_LENGTH) {
+                value = propertyStoreProperties[fieldIndex].keyName; // Marshaled as a number, the value only marks the field as present
+            }
+#endif
+            if (fieldIndex == AJSVC_PROPERTY_STORE_AJ_SOFTWARE_VERSION) {
+                value = AJ_GetVersion();
+            }
+            if (value == NULL) {
+                AJ_ErrPrintf(("PropertyStore_ReadAll - Failed to get value for mandatory field=(name=%s, index=%d) and language=(name=%s, index=%d), aborting.\n", AJSVC_PropertyStore_GetFieldName(fieldIndex), (int)fieldIndex, AJSVC_PropertyStore_GetLanguageName(langIndex), (int)langIndex));
+                return AJ_ERR_NULL;
+            }
+            snapshot->values[fieldIndex] = value;
+        }
+    }
+    snapshot->valid = TRUE;
+    snapshot->langIndex = langIndex;
+    snapshot->generation = propertyStoreGeneration;
+
+    return AJ_OK;
+}
+
 AJ_Status AJSVC_PropertyStore_ReadAll(AJ_Message* msg, AJSVC_PropertyStoreCategoryFilter filter, int8_t langIndex)
 {
     AJ_Status status = AJ_OK;
@@ -457,77 +665,66 @@ AJ_Status AJSVC_PropertyStore_ReadAll(AJ_Message* msg, AJSVC_PropertyStoreCatego
     AJ_Arg dict;
     const char* value;
     uint8_t index;
-    const char* ajVersion;
     int8_t fieldIndex;
+    ReadAllSnapshot* snapshot;
+    uint8_t filterBits = (filter.bit0About ? 1 : 0) | (filter.bit1Config ? 2 : 0) | (filter.bit2Announce ? 4 : 0);
 
     AJ_InfoPrintf(("PropertyStore_ReadAll()\n"));
 
+    if (filter.bit0About) {
+        snapshot = &readAllSnapshots[READ_ALL_SNAPSHOT_ABOUT];
+    } else if (filter.bit1Config) {
+        snapshot = &readAllSnapshots[READ_ALL_SNAPSHOT_CONFIG];
+    } else {
+        snapshot = &readAllSnapshots[READ_ALL_SNAPSHOT_ANNOUNCE];
+    }
+    if (!snapshot->valid || snapshot->filter != filterBits || snapshot->langIndex != langIndex || snapshot->generation != propertyStoreGeneration) {
+        snapshot->filter = filterBits;
+        status = BuildReadAllSnapshot(snapshot, filter, langIndex);
+        if (status != AJ_OK) {
+            return status;
+        }
+    }
+
     status = AJ_MarshalContainer(msg, &array, AJ_ARG_ARRAY);
     if (status != AJ_OK) {
         return status;
     }
 
     for (fieldIndex = 0; fieldIndex < AJSVC_PROPERTY_STORE_NUMBER_OF_KEYS; fieldIndex++) {
+        value = snapshot->values[fieldIndex];
+        if (value == NULL) {
+            continue;
+        }
+        if (fieldIndex == AJSVC_PROPERTY_STORE_APP_ID) {
+            status = AJ_MarshalContainer(msg, &dict, AJ_ARG_DICT_ENTRY);
+            if (status != AJ_OK) {
+                return status;
+            }
+            status = AJ_MarshalArgs(msg, "s", propertyStoreProperties[fieldIndex].keyName);
+            if (status != AJ_OK) {
+                return status;
+            }
+            status = AJSVC_MarshalAppIdAsVariant(msg, value);
+            if (status != AJ_OK) {
+                return status;
+            }
+            status = AJ_MarshalCloseContainer(msg, &dict);
+            if (status != AJ_OK) {
+                return status;
+            }
 #ifdef CONFIG_SERVICE
-        if (propertyStoreProperties[fieldIndex].mode7Public && (filter.bit0About || (filter.bit1Config && propertyStoreProperties[fieldIndex].mode0Write) || (filter.bit2Announce && propertyStoreProperties[fieldIndex].mode1Announce))) {
-#else
-        if (propertyStoreProperties[fieldIndex].mode7Public && (filter.bit0About || (filter.bit2Announce && propertyStoreProperties[fieldIndex].mode1Announce))) {
-#endif
-            value = AJSVC_PropertyStore_GetValueForLang(fieldIndex, langIndex);
-
-            if (value == NULL && (int8_t)fieldIndex >= (int8_t)AJSVC_PROPERTY_STORE_NUMBER_OF_MANDATORY_KEYS) {     // Non existing values are skipped!
-                AJ_WarnPrintf(("PropertyStore_ReadAll - Failed to get value for field=(name=%s, index=%d) and language=(name=%s, index=%d), skipping.\n", AJSVC_PropertyStore_GetFieldName(fieldIndex), (int)fieldIndex, AJSVC_PropertyStore_GetLanguageName(langIndex), (int)langIndex));
-            } else {
-                if (fieldIndex == AJSVC_PROPERTY_STORE_APP_ID) {
-                    if (value == NULL) {
-                        AJ_ErrPrintf(("PropertyStore_ReadAll - Failed to get value for mandatory field=(name=%s, index=%d) and language=(name=%s, index=%d), aborting.\n", AJSVC_PropertyStore_GetFieldName(fieldIndex), (int)fieldIndex, AJSVC_PropertyStore_GetLanguageName(langIndex), (int)langIndex));
-                        return AJ_ERR_NULL;
-                    }
-                    status = AJ_MarshalContainer(msg, &dict, AJ_ARG_DICT_ENTRY);
-                    if (status != AJ_OK) {
-                        return status;
-                    }
-                    status = AJ_MarshalArgs(msg, "s", propertyStoreProperties[fieldIndex].keyName);
-                    if (status != AJ_OK) {
-                        return status;
-                    }
-                    status = AJSVC_MarshalAppIdAsVariant(msg, value);
-                    if (status != AJ_OK) {
-                        return status;
-                    }
-                    status = AJ_MarshalCloseContainer(msg, &dict);
-                    if (status != AJ_OK) {
-                        return status;
-                    }
-#ifdef CONFIG_SERVICE
-                } else if (fieldIndex == AJSVC_PROPERTY_STORE_MAX_LENGTH) {
-                    status = AJ_MarshalArgs(msg, "{sv}", propertyStoreProperties[fieldIndex].keyName, "q", DEVICE_NAME_VALUE_LENGTH);
-                    if (status != AJ_OK) {
-                        return status;
-                    }
-                    AJ_InfoPrintf(("Has key [%s] runtime Value [%d]\n", propertyStoreProperties[AJSVC_PROPERTY_STORE_MAX_LENGTH].keyName, DEVICE_NAME_VALUE_LENGTH));
+        } else if (fieldIndex == AJSVC_PROPERTY_STORE_MAX_LENGTH) {
+            status = AJ_MarshalArgs(msg, "{sv}", propertyStoreProperties[fieldIndex].keyName, "q", DEVICE_NAME_VALUE_LENGTH);
+            if (status != AJ_OK) {
+                return status;
+            }
+            AJ_InfoPrintf(("Has key [%s] runtime Value [%d]\n", propertyStoreProperties[AJSVC_PROPERTY_STORE_MAX_LENGTH].keyName, DEVICE_NAME_VALUE_LENGTH));
 #endif
-                } else if (fieldIndex == AJSVC_PROPERTY_STORE_AJ_SOFTWARE_VERSION) {
-                    ajVersion = AJ_GetVersion();
-                    if (ajVersion == NULL) {
-                        AJ_ErrPrintf(("PropertyStore_ReadAll - Failed to get value for mandatory field=(name=%s, index=%d) and language=(name=%s, index=%d), aborting.\n", AJSVC_PropertyStore_GetFieldName(fieldIndex), (int)fieldIndex, AJSVC_PropertyStore_GetLanguageName(langIndex), (int)langIndex));
-                        return AJ_ERR_NULL;
-                    }
-                    status = AJ_MarshalArgs(msg, "{sv}", propertyStoreProperties[fieldIndex].keyName, "s", ajVersion);
-                    if (status != AJ_OK) {
-                        return status;
-                    }
-                    AJ_InfoPrintf(("Has key [%s] runtime Value [%s]\n", propertyStoreProperties[AJSVC_PROPERTY_STORE_AJ_SOFTWARE_VERSION].keyName, ajVersion));
-                } else {
-                    if (value == NULL) {
-                        AJ_ErrPrintf(("PropertyStore_ReadAll - Failed to get value for mandatory field=(name=%s, index=%d) and language=(name=%s, index=%d), aborting.\n", AJSVC_PropertyStore_GetFieldName(fieldIndex), (int)fieldIndex, AJSVC_PropertyStore_GetLanguageName(langIndex), (int)langIndex));
-                        return AJ_ERR_NULL;
-                    }
-                    status = AJ_MarshalArgs(msg, "{sv}", propertyStoreProperties[fieldIndex].keyName, "s", value);
-                    if (status != AJ_OK) {
-                        return status;
-                    }
-                }
+        } else {
+            status = AJ_MarshalArgs(msg, "{sv}", propertyStoreProperties[fieldIndex].keyName, "s", value);
+            if (status != AJ_OK) {
+                return status;
             }
         }
     }
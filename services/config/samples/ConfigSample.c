@@ -338,8 +338,10 @@ static AJ_Status SetPasscode(const char* daemonRealm, const uint8_t* newPasscode
     if (status != AJ_OK) {
         return status;
     }
+    AJSVC_PropertyStore_BeginUpdates();
     if (AJSVC_PropertyStore_SetValue(AJSVC_PROPERTY_STORE_REALM_NAME, daemonRealm) && AJSVC_PropertyStore_SetValue(AJSVC_PROPERTY_STORE_PASSCODE, newStringPasscode)) {
 
+        AJSVC_PropertyStore_EndUpdates(TRUE);
         status = AJSVC_PropertyStore_SaveAll();
         if (status != AJ_OK) {
             return status;
@@ -348,10 +350,7 @@ static AJ_Status SetPasscode(const char* daemonRealm, const uint8_t* newPasscode
         status = AJ_ERR_READ;     //Force disconnect of AJ and services to refresh current sessions
     } else {
 
-        status = AJSVC_PropertyStore_LoadAll();
-        if (status != AJ_OK) {
-            return status;
-        }
+        AJSVC_PropertyStore_EndUpdates(FALSE);
     }
 
     return status;
@@ -418,6 +417,7 @@ int AJ_Main(void)
                 if (AJ_ERR_LINK_TIMEOUT == AJ_BusLinkStateProc(&busAttachment)) {
                     status = AJ_ERR_READ;             // something's not right. force disconnect
                 }
+                AJSVC_PropertyStore_SaveScheduled(FALSE); // Persist configuration updates once they settle
             }
 
             if (isUnmarshalingSuccessful) {
@@ -246,6 +246,7 @@ AJ_Status AJCFG_UpdateConfigurationsHandler(AJ_Message* msg)
     AJ_InfoPrintf(("Lang=%s\n", language));
     errorReply = !AJSVC_IsLanguageSupported(msg, &reply, language, &langIndex);
     if (!errorReply) {
+        AJSVC_PropertyStore_BeginUpdates();
         status = AJ_UnmarshalContainer(msg, &array, AJ_ARG_ARRAY);
         if (status != AJ_OK) {
             goto Exit;
@@ -312,13 +313,10 @@ AJ_Status AJCFG_UpdateConfigurationsHandler(AJ_Message* msg)
 
 Exit:
 
-    if (numOfUpdatedItems) {
-        if (errorReply) {
-            AJSVC_PropertyStore_LoadAll(); // Discard partial successful updates
-        } else {
-            AJSVC_PropertyStore_SaveAll();
-            AJ_AboutSetShouldAnnounce();
-        }
+    AJSVC_PropertyStore_EndUpdates(!errorReply); // Discard partial successful updates on error
+    if (numOfUpdatedItems && !errorReply) {
+        AJSVC_PropertyStore_ScheduleSave(); // Saved together with any other changes made shortly after
+        AJ_AboutSetShouldAnnounce();
     }
 
     return status;
@@ -344,6 +342,7 @@ AJ_Status AJCFG_ResetConfigurationsHandler(AJ_Message* msg)
     AJ_InfoPrintf(("Lang=%s\n", language));
     errorReply = !AJSVC_IsLanguageSupported(msg, &reply, language, &langIndex);
     if (!errorReply) {
+        AJSVC_PropertyStore_BeginUpdates();
         status = AJ_UnmarshalContainer(msg, &array, AJ_ARG_ARRAY);
         if (status != AJ_OK) {
             goto Exit;
@@ -390,13 +389,10 @@ AJ_Status AJCFG_ResetConfigurationsHandler(AJ_Message* msg)
 
 Exit:
 
-    if (numOfDeletedItems) {
-        if (errorReply) {
-            AJSVC_PropertyStore_LoadAll(); // Discard partial successful deletions
-        } else {
-            AJSVC_PropertyStore_SaveAll();
-            AJ_AboutSetShouldAnnounce();
-        }
+    AJSVC_PropertyStore_EndUpdates(!errorReply); // Discard partial successful deletions on error
+    if (numOfDeletedItems && !errorReply) {
+        AJSVC_PropertyStore_ScheduleSave(); // Saved together with any other changes made shortly after
+        AJ_AboutSetShouldAnnounce();
     }
 
     return status;
@@ -510,5 +506,5 @@ AJSVC_ServiceStatus AJCFG_MessageProcessor(AJ_BusAttachment* bus, AJ_Message* ms
 
 AJ_Status AJCFG_DisconnectHandler(AJ_BusAttachment* busAttachment)
 {
-    return AJ_OK;
+    return AJSVC_PropertyStore_SaveScheduled(TRUE); // Don't lose scheduled changes on restart
 }
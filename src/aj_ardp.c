@@ -82,6 +82,14 @@ uint8_t dbgARDP = 0;
 /* ARDP backpressure relief maximum number of retries */
 #define ARDP_MAX_BACKPRESSURE_RETRIES ((UDP_LINK_TIMEOUT) / (ARDP_BACKPRESSURE_INTERVAL))
 
+/*
+ * The window never shrinks below what a full transmit buffer needs, ARDP_Send() must be able
+ * to queue it when nothing is in flight
+ */
+#if AJ_ARDP_SEGMAX < UDP_SEGMAX
+#error "AJ_ARDP_SEGMAX must be at least UDP_SEGMAX"
+#endif
+
 #define MIN(a, b) ((a) < (b) ? (a) : (b))
 #define MAX(a, b) ((a) > (b) ? (a) : (b))
 #define ABS(a) ((a) >= 0 ? (a) : -(a))
@@ -146,12 +154,16 @@ struct ArdpSnd {
     uint32_t LCS;         /* Sequence number of last consumed segment (we get this form them) */
     uint32_t DACKT;       /* Delayed ACK timeout from the other side */
     uint32_t SEGMAX;      /* The maximum number of unacknowledged segments that can be sent */
-    ArdpSBuf buf[UDP_SEGMAX]; /* Array holding in-flight sent  buffers. */
+    uint16_t CWND;        /* Congestion window, the number of segments that may be in flight */
+    uint16_t SSTHRESH;    /* Slow start threshold, above it the window grows by one segment per window acknowledged */
+    uint16_t acked;       /* Segments acknowledged since the window last grew above SSTHRESH */
+    uint16_t size;        /* Number of send buffers, SEGMAX negotiated with the remote */
+    ArdpSBuf* buf;        /* Array holding in-flight sent  buffers. */
     uint32_t msgTTL;      /* TTL associated with the most recent outbound message */
     uint32_t msgLenTotal; /* Length of the most recent outbound message */
     uint32_t msgLenSent;  /* Cumulative length of all the segments that has been sent so far for the most recent outbound message */
     uint32_t msgSOM;      /* Sequence number of the first segment in the most recent outbound message */
-    uint8_t pending;      /* Number of unacknowledged sent buffers */
+    uint16_t pending;     /* Number of unacknowledged sent buffers */
     uint8_t newMsg;       /* Indicates that the next call to ARDP_Send() will carry new AllJoyn message */
 };
 
@@ -162,7 +174,8 @@ struct ArdpSnd {
 struct ArdpRcv {
     uint32_t CUR;             /* The sequence number of the last segment received correctly and in sequence */
     uint32_t LCS;             /* LCS - Last "in-order" consumed segment.*/
-    ArdpRBuf buf[UDP_SEGMAX]; /* Array holding received buffers not consumed by the app */
+    uint16_t size;            /* Number of receive buffers, the SEGMAX offered to the remote */
+    ArdpRBuf* buf;            /* Array holding received buffers not consumed by the app */
     uint8_t pending;          /* Number of unacknowledged received buffers */
 };
 
@@ -211,6 +224,13 @@ struct AJ_ARDP_Syn_Hdr {
     uint16_t options;   /* Options for the connection.  Always Sequenced Delivery Mode (SDM). */
 };
 
+/* Housekeeping for data (inside ARDP rBuf) that have been received and potentially not consumed */
+struct ArdpRecvState {
+    uint8_t* readBuf;     /* Pointer to current unconsumed data */
+    uint16_t dataLen;     /* How many bytes are left to read */
+    ArdpRBuf* rxContext;  /* Pointer to ARDP rBuf from where the data are being currently consumed */
+};
+
 /**
  * A connection record describing each "connection."  This acts as a containter
  * to hold all of the interesting information about a reliable link between
@@ -234,8 +254,15 @@ struct ArdpConnection {
     uint32_t rttMeanUnit;   /* Smoothed RTT value per UDP MTU */
     uint8_t rttInit;        /* Flag indicating that the first RTT was measured and SRTT calculation applies */
     uint8_t confirm;        /* Flag to indicate that progress happened, do not send ARP re-probe */
+    struct ArdpRecvState recvState; /* Received data not yet consumed by the message layer */
+    struct ArdpConnection* next;    /* Next connection record, one per bus attachment */
 };
 
+/*
+ * All open connections, and the one selected by the transport context passed in to
+ * the current API call.
+ */
+static struct ArdpConnection* connections = NULL;
 static struct ArdpConnection* conn = NULL;
 
 /*
@@ -254,16 +281,10 @@ static struct ArdpConnection* conn = NULL;
                                   (((tp) ((beg) + (sz)) < (beg)) && !(((p) < (beg)) && (p) >= (tp) ((beg) + (sz)))))
 
 
-/* Housekeeping for data (inside ARDP rBuf) that have been received and potentially not consumed */
-static struct {
-    uint8_t* readBuf;     /* Pointer to current unconsumed data */
-    uint16_t dataLen;     /* How many bytes are left to read */
-    ArdpRBuf* rxContext;  /* Pointer to ARDP rBuf from where the data are being currently consumed */
-} UDP_Recv_State;
-
-
 static ReceiveFunction recvFunction;
 static SendFunction sendFunction;
+static ReceiveBatchFunction recvBatchFunction;
+static SendBatchFunction sendBatchFunction;
 
 /**************
  * End of definitions
@@ -275,6 +296,57 @@ void AJ_ARDP_InitFunctions(ReceiveFunction rcvFunc, SendFunction sndFunc)
     sendFunction = sndFunc;
 }
 
+void AJ_ARDP_InitBatchFunctions(ReceiveBatchFunction rcvFunc, SendBatchFunction sndFunc)
+{
+    recvBatchFunction = rcvFunc;
+    sendBatchFunction = sndFunc;
+}
+
+/*
+ * Make the connection record for the given transport context the current one
+ */
+static struct ArdpConnection* SelectConnection(void* context)
+{
+    for (conn = connections; conn != NULL; conn = conn->next) {
+        if (conn->context == context) {
+            break;
+        }
+    }
+    return conn;
+}
+
+/*
+ * Unlink and free the current connection record
+ */
+static void ReleaseConnection()
+{
+    struct ArdpConnection** link = &connections;
+
+    while (*link) {
+        if (*link == conn) {
+            *link = conn->next;
+            break;
+        }
+        link = &(*link)->next;
+    }
+    AJ_Free(conn->snd.buf);
+    AJ_Free(conn->rcv.buf);
+    AJ_Free(conn);
+    conn = NULL;
+}
+
+/*
+ * Link the send buffers into a ring
+ */
+static void LinkSndBuffers()
+{
+    uint32_t i;
+
+    for (i = 0; i < conn->snd.size; i++) {
+        conn->snd.buf[i].next = &conn->snd.buf[(i + 1) % conn->snd.size];
+    }
+}
+
 static AJ_Status InitConnection()
 {
     uint32_t rand32;
@@ -285,6 +357,19 @@ static AJ_Status InitConnection()
         return AJ_ERR_RESOURCES;
     }
     memset(conn, 0, sizeof(struct ArdpConnection));
+    conn->snd.buf = (ArdpSBuf*) AJ_Malloc(AJ_ARDP_SEGMAX * sizeof(ArdpSBuf));
+    conn->rcv.buf = (ArdpRBuf*) AJ_Malloc(AJ_ARDP_SEGMAX * sizeof(ArdpRBuf));
+    if (!conn->snd.buf || !conn->rcv.buf) {
+        AJ_Free(conn->snd.buf);
+        AJ_Free(conn->rcv.buf);
+        AJ_Free(conn);
+        conn = NULL;
+        return AJ_ERR_RESOURCES;
+    }
+    memset(conn->snd.buf, 0, AJ_ARDP_SEGMAX * sizeof(ArdpSBuf));
+    memset(conn->rcv.buf, 0, AJ_ARDP_SEGMAX * sizeof(ArdpRBuf));
+    conn->next = connections;
+    connections = conn;
 
     AJ_RandBytes((uint8_t*) &rand32, sizeof(uint32_t));
     conn->local = (rand32 % 65534) + 1;  /* Allocate an "ephemeral" source port */
@@ -295,12 +380,13 @@ static AJ_Status InitConnection()
     conn->snd.UNA = conn->snd.ISS;     /* The oldest unacknowledged segment is the ISS */
     conn->snd.LCS = conn->snd.ISS;     /* The most recently consumed segment (we keep this in sync with the other side) */
 
-    for (i = 0; i < UDP_SEGMAX; i++) {
-        conn->snd.buf[i].next = &conn->snd.buf[(i + 1) % UDP_SEGMAX];
-    }
+    /* The send buffers are trimmed to the remote's SEGMAX when the connection opens */
+    conn->snd.size = AJ_ARDP_SEGMAX;
+    LinkSndBuffers();
 
-    for (i = 0; i < UDP_SEGMAX; i++) {
-        conn->rcv.buf[i].next = &conn->rcv.buf[(i + 1) % UDP_SEGMAX];
+    conn->rcv.size = AJ_ARDP_SEGMAX;
+    for (i = 0; i < conn->rcv.size; i++) {
+        conn->rcv.buf[i].next = &conn->rcv.buf[(i + 1) % conn->rcv.size];
     }
 
     conn->rttInit = FALSE;
@@ -366,7 +452,7 @@ static AJ_Status SendSyn(uint16_t dataLen)
     *((uint16_t*) (txbuf + DLEN_OFFSET)) = htons(dataLen);
     *((uint32_t*) (txbuf + SEQ_OFFSET)) = htonl(conn->snd.ISS);
     *((uint32_t*) (txbuf + ACK_OFFSET)) = 0; /* optional , can be removed to reduce code size*/
-    *((uint16_t*) (txbuf + SEGMAX_OFFSET)) = htons(UDP_SEGMAX);
+    *((uint16_t*) (txbuf + SEGMAX_OFFSET)) = htons(conn->rcv.size);
     *((uint16_t*) (txbuf + SEGBMAX_OFFSET)) = htons(UDP_SEGBMAX);
     *((uint32_t*) (txbuf + DACKT_OFFSET)) = htonl(UDP_DELAYED_ACK_TIMEOUT);
     *((uint16_t*) (txbuf + OPTIONS_OFFSET)) = htons(ARDP_FLAG_SIMPLE_MODE | ARDP_FLAG_SDM);
@@ -413,8 +499,7 @@ static AJ_Status ConnectTimerHandler()
         conn->state = CLOSED;
         conn->connectTimer.retry = 0;
         AJ_ErrPrintf(("ConnectTimerHandler(): %s\n", AJ_StatusText(status)));
-        AJ_Free(conn);
-        conn = NULL;
+        ReleaseConnection();
         return AJ_ERR_CONNECT;
     } else {
         return AJ_OK;
@@ -426,7 +511,7 @@ static uint32_t GetDataTimeout()
     uint32_t timeout = UDP_TOTAL_DATA_RETRY_TIMEOUT;
 
     if (conn->rttInit) {
-        timeout = MAX(timeout, (UDP_SEGMAX * UDP_SEGBMAX * (conn->rttMean >> 1)) / UDP_MTU);
+        timeout = MAX(timeout, (conn->snd.size * UDP_SEGBMAX * (conn->rttMean >> 1)) / UDP_MTU);
     }
     return timeout;
 }
@@ -440,60 +525,129 @@ static uint32_t GetRTO()
     return MIN(MAX(ms, conn->snd.DACKT), (uint32_t)ARDP_MAX_RTO);
 }
 
+/*
+ * Grow the congestion window for segments acknowledged: by one segment for each one
+ * acknowledged in slow start, then by one segment for each window acknowledged
+ */
+static void OpenWindow(uint16_t acked)
+{
+    if (conn->snd.CWND < conn->snd.SSTHRESH) {
+        conn->snd.CWND += acked;
+    } else {
+        conn->snd.acked += acked;
+        if (conn->snd.acked >= conn->snd.CWND) {
+            conn->snd.acked -= conn->snd.CWND;
+            conn->snd.CWND++;
+        }
+    }
+    conn->snd.CWND = MIN(conn->snd.CWND, conn->snd.size);
+    AJ_InfoPrintf(("OpenWindow: acked %u, cwnd %u, ssthresh %u\n", acked, conn->snd.CWND, conn->snd.SSTHRESH));
+}
+
+/*
+ * A retransmit timeout halves the threshold and restarts slow start from the smallest window
+ */
+static void CloseWindow()
+{
+    conn->snd.SSTHRESH = MAX(conn->snd.pending >> 1, UDP_SEGMAX);
+    conn->snd.CWND = UDP_SEGMAX;
+    conn->snd.acked = 0;
+    AJ_InfoPrintf(("CloseWindow: cwnd %u, ssthresh %u\n", conn->snd.CWND, conn->snd.SSTHRESH));
+}
+
+/*
+ * Send segments that are already marshalled in the send window, with one call if the
+ * platform can send a batch
+ */
+static AJ_Status SendSegments(uint8_t** segs, uint16_t* lens, uint16_t count)
+{
+    AJ_Status status = AJ_OK;
+    uint16_t sent = 0;
+
+    if (sendBatchFunction) {
+        status = (*sendBatchFunction)(conn->context, segs, lens, count, &sent, conn->confirm);
+    } else {
+        while ((status == AJ_OK) && (sent < count)) {
+            size_t n;
+            status = (*sendFunction)(conn->context, segs[sent], lens[sent], &n, conn->confirm);
+            if (status == AJ_OK) {
+                ++sent;
+            }
+        }
+    }
+    if (sent) {
+        AJ_InfoPrintf(("SendSegments: sent %u of %u, cancel ackTimer\n", sent, count));
+        conn->ackTimer.retry = 0;
+        conn->rcv.pending = 0;
+        conn->confirm = FALSE;
+    }
+    return status;
+}
+
 static AJ_Status DataTimerHandler(ArdpSBuf* sBuf)
 {
-    AJ_Status status;
+    AJ_Status status = AJ_OK;
     struct ArdpTimer* timer = &sBuf->timer;
     uint32_t msElapsed = AJ_GetElapsedTime(&sBuf->tStart, FALSE);
     uint32_t timeout = GetDataTimeout();
     ArdpSBuf* startBuf = sBuf;
+    uint8_t* segs[UDP_SEGMAX];
+    uint16_t lens[UDP_SEGMAX];
+    uint16_t count = 0;
 
-    sBuf->retransmits++;
-
-    do {
+    if ((msElapsed >= timeout) && (timer->retry > UDP_MIN_DATA_RETRIES)) {
+        AJ_ErrPrintf(("DataTimerHandler(): hit timeout for %u\n", ntohl(*(uint32_t*)((uint8_t*)sBuf->data + SEQ_OFFSET))));
+        return AJ_ERR_TIMEOUT;
+    }
 
-#ifndef NDEBUG
-        uint32_t seq = ntohl(*(uint32_t*)((uint8_t*)sBuf->data + SEQ_OFFSET));
-#endif
+    /*
+     * All segments in flight are retransmitted with this one and marked as such, so the
+     * window only shrinks when a segment times out that wasn't already retransmitted
+     */
+    if (sBuf->retransmits == 0) {
+        CloseWindow();
+    }
+    conn->backoff = MAX(conn->backoff, timer->retry);
 
-        if ((msElapsed >= timeout) && (timer->retry > UDP_MIN_DATA_RETRIES)) {
-            AJ_ErrPrintf(("DataTimerHandler(): hit timeout for %u\n", seq));
-            status = AJ_ERR_TIMEOUT;
-        } else {
-            size_t sent;
-            uint8_t* txbuf = (uint8_t*) sBuf->data;
-            uint16_t len = sBuf->dataLen + ARDP_HEADER_SIZE;
+    /*
+     * Segments are collected and retransmitted in batches. If the send fails the connection
+     * is torn down so the timers can be updated before the send.
+     */
+    do {
+        uint8_t* txbuf = (uint8_t*) sBuf->data;
+        uint16_t len = sBuf->dataLen + ARDP_HEADER_SIZE;
 
-            /* Currently, we do not check TTL for in-flight SND packets */
+        /* Currently, we do not check TTL for in-flight SND packets */
 
-            *((uint32_t*) (txbuf + ACK_OFFSET)) = htonl(conn->rcv.CUR);
-            *((uint32_t*) (txbuf + LCS_OFFSET)) = htonl(conn->rcv.LCS);
-            *((uint32_t*) (txbuf + ACKNXT_OFFSET)) = htonl(conn->snd.UNA);
+        *((uint32_t*) (txbuf + ACK_OFFSET)) = htonl(conn->rcv.CUR);
+        *((uint32_t*) (txbuf + LCS_OFFSET)) = htonl(conn->rcv.LCS);
+        *((uint32_t*) (txbuf + ACKNXT_OFFSET)) = htonl(conn->snd.UNA);
 
-            AJ_InfoPrintf(("DataTimerHandler: send %d bytes (seq %u, ack %u)\n", len, seq, conn->rcv.CUR));
-            status =  (*sendFunction)(conn->context, (uint8_t*) sBuf->data, len, &sent, conn->confirm);
-            AJ_InitTimer(&sBuf->timer.tStart);
+        AJ_InfoPrintf(("DataTimerHandler: send %d bytes (seq %u, ack %u)\n", len, ntohl(*(uint32_t*)(txbuf + SEQ_OFFSET)), conn->rcv.CUR));
+        segs[count] = txbuf;
+        lens[count] = len;
+        ++count;
 
-            if (status == AJ_OK) {
-                conn->backoff = MAX(conn->backoff, timer->retry);
-                if (conn->rttInit) {
-                    timer->delta = GetRTO();
-                } else {
-                    timer->delta = MIN(UDP_INITIAL_DATA_TIMEOUT << conn->backoff, (uint32_t)ARDP_MAX_RTO);
-                }
-                AJ_InfoPrintf(("DataTimerHandler: backoff %u, delta %u\n", conn->backoff, timer->delta));
+        timer = &sBuf->timer;
+        AJ_InitTimer(&timer->tStart);
+        if (conn->rttInit) {
+            timer->delta = GetRTO();
+        } else {
+            timer->delta = MIN(UDP_INITIAL_DATA_TIMEOUT << conn->backoff, (uint32_t)ARDP_MAX_RTO);
+        }
+        AJ_InfoPrintf(("DataTimerHandler: backoff %u, delta %u\n", conn->backoff, timer->delta));
+        timer->retry++;
+        sBuf->retransmits++;
 
-                timer->retry++;
-                AJ_InfoPrintf(("DataTimerHandler: cancel ackTimer\n"));
-                conn->ackTimer.retry = 0;
-                conn->rcv.pending = 0;
-                conn->confirm = FALSE;
-            } else {
+        sBuf = sBuf->next;
+        if ((count == UDP_SEGMAX) || (sBuf->timer.retry == 0) || (sBuf == startBuf)) { /* Here "retry" check equates checking for "in flight" */
+            status = SendSegments(segs, lens, count);
+            if (status != AJ_OK) {
                 AJ_ErrPrintf(("DataTimerHandler():Write to Socket went bad"));
             }
+            count = 0;
         }
-        sBuf = sBuf->next;
-    } while (status == AJ_OK && (sBuf->timer.retry != 0) && (sBuf != startBuf)); /* Here "retry" check equates checking for "in flight" */
+    } while ((status == AJ_OK) && (sBuf->timer.retry != 0) && (sBuf != startBuf));
 
     return status;
 }
@@ -503,7 +657,7 @@ static AJ_Status CheckDataTimers()
     uint32_t idx;
 
     /* Check data retransmit timer */
-    idx = conn->snd.UNA % UDP_SEGMAX;
+    idx = conn->snd.UNA % conn->snd.size;
     if (conn->snd.buf[idx].timer.retry != 0 &&
         AJ_GetElapsedTime(&conn->snd.buf[idx].timer.tStart, TRUE) >= conn->snd.buf[idx].timer.delta) {
         AJ_InfoPrintf(("CheckDataTimers: Fire data timer\n"));
@@ -573,6 +727,21 @@ static AJ_Status UnmarshalSynSegment(uint8_t* buf, struct ArdpSeg* seg)
     }
 
     conn->snd.SEGMAX = segmax;
+
+    /*
+     * Only the SYN is in the send buffers, which are trimmed to what the remote can buffer
+     */
+    if (segmax < conn->snd.size) {
+        ArdpSBuf* sBuf = (ArdpSBuf*) AJ_Realloc(conn->snd.buf, segmax * sizeof(ArdpSBuf));
+        if (sBuf) {
+            conn->snd.buf = sBuf;
+        }
+        conn->snd.size = segmax;
+        LinkSndBuffers();
+    }
+    conn->snd.CWND = UDP_SEGMAX;
+    conn->snd.SSTHRESH = conn->snd.size;
+
     AJ_InfoPrintf(("UnmarshalSynSegment: segmax=%d, segbmax=%d\n", segmax, segbmax));
     conn->rcv.CUR = seg->SEQ;
     conn->rcv.LCS = seg->SEQ;
@@ -590,8 +759,7 @@ static AJ_Status RecvValidateSegment(uint8_t* rxbuf, uint16_t len, struct ArdpSe
     if (seg->FLG & ARDP_FLAG_RST) {
         /* This is a disconnect from the remote, no checks are needed */
         AJ_WarnPrintf(("Receive: Remote disconnect RST\n"));
-        AJ_Free(conn);
-        conn = NULL;
+        ReleaseConnection();
         return AJ_ERR_ARDP_REMOTE_CONNECTION_RESET;
     }
 
@@ -599,8 +767,9 @@ static AJ_Status RecvValidateSegment(uint8_t* rxbuf, uint16_t len, struct ArdpSe
 
     hdrSz = (seg->FLG & ARDP_FLAG_SYN) ? ARDP_SYN_HEADER_SIZE : ARDP_HEADER_SIZE;
 
-    /* Perform length validation checks */
-    if (((seg->HLEN * 2) < hdrSz) || (len < hdrSz) || (seg->DLEN + (seg->HLEN * 2)) != len) {
+    /* Perform length validation checks, the payload has to fit a receive buffer */
+    if ((len > UDP_SEGBMAX) || (seg->DLEN > sizeof(conn->rcv.buf->data)) ||
+        ((seg->HLEN * 2) < hdrSz) || (len < hdrSz) || (seg->DLEN + (seg->HLEN * 2)) != len) {
         AJ_ErrPrintf(("Receive: length check failed len = %u, seg->hlen = %u, seg->dlen = %u\n",
                       len, (seg->HLEN * 2), seg->DLEN));
         return AJ_ERR_INVALID;
@@ -638,7 +807,7 @@ static AJ_Status RecvValidateSegment(uint8_t* rxbuf, uint16_t len, struct ArdpSe
      * SEQ and ACKNXT must fall within receive window.
      */
     if ((SEQ32_LT(seg->SEQ, seg->ACKNXT)) ||
-        ((seg->DLEN != 0) && ((seg->SEQ - seg->ACKNXT) >= UDP_SEGMAX))) {
+        ((seg->DLEN != 0) && ((seg->SEQ - seg->ACKNXT) >= conn->rcv.size))) {
         AJ_ErrPrintf(("Receive: incorrect sequence numbers seg->seq = %u, seg->acknxt = %u\n",
                       seg->SEQ, seg->ACKNXT));
         return AJ_ERR_INVALID;
@@ -701,8 +870,9 @@ static void AdjustRTT(ArdpSBuf* sBuf)
 
 static void UpdateSndSegments(uint32_t ack)
 {
-    uint16_t idx = ack % UDP_SEGMAX;
+    uint16_t idx = ack % conn->snd.size;
     ArdpSBuf* sBuf = &conn->snd.buf[idx];
+    uint16_t acked = 0;
     uint32_t i;
 
     /* Nothing to clean up */
@@ -720,7 +890,7 @@ static void UpdateSndSegments(uint32_t ack)
     sBuf = &conn->snd.buf[0];
 
     /* Cycle through all the buffers */
-    for (i = 0; i < UDP_SEGMAX; i++) {
+    for (i = 0; i < conn->snd.size; i++) {
         uint32_t seq = ntohl(*(uint32_t*)((uint8_t*)(sBuf->data) + SEQ_OFFSET));
 
         if (SEQ32_LET(seq, ack) && (sBuf->inFlight != 0)) {
@@ -732,6 +902,7 @@ static void UpdateSndSegments(uint32_t ack)
             sBuf->inFlight = 0;
             sBuf->retransmits = 0;
             conn->snd.pending--;
+            acked++;
         }
 
         if (conn->snd.pending == 0) {
@@ -739,11 +910,12 @@ static void UpdateSndSegments(uint32_t ack)
         }
         sBuf = sBuf->next;
     }
+    OpenWindow(acked);
 }
 
 static void FlushExpiredRcvMessages(uint32_t seq, uint32_t ackNXT)
 {
-    uint32_t idx =  conn->rcv.CUR % UDP_SEGMAX;
+    uint32_t idx =  conn->rcv.CUR % conn->rcv.size;
     ArdpRBuf* rBuf = &conn->rcv.buf[idx];
 
     AJ_InfoPrintf(("FlushExpiredRcvMessages: seq = %u, expected %u got %u\n",
@@ -761,17 +933,17 @@ static void FlushExpiredRcvMessages(uint32_t seq, uint32_t ackNXT)
      * reset Rx context to NULL.
      */
     if (rBuf->dataLen != 0) {
-        UDP_Recv_State.readBuf = rBuf->data;
-        UDP_Recv_State.dataLen = rBuf->dataLen;
-        UDP_Recv_State.rxContext = (void*) rBuf;
+        conn->recvState.readBuf = rBuf->data;
+        conn->recvState.dataLen = rBuf->dataLen;
+        conn->recvState.rxContext = (void*) rBuf;
     } else {
-        UDP_Recv_State.rxContext = NULL;
+        conn->recvState.rxContext = NULL;
     }
 }
 
 static void AddRcvBuffer(struct ArdpSeg* seg, uint8_t* rxBuf, uint16_t dataOffset)
 {
-    uint32_t idx = seg->SEQ % UDP_SEGMAX;
+    uint32_t idx = seg->SEQ % conn->rcv.size;
 
     AJ_InfoPrintf(("AddRcvBuffer: seq=%u\n", seg->SEQ));
     AJ_ASSERT(conn->rcv.buf[idx].fcnt == 0);
@@ -782,10 +954,10 @@ static void AddRcvBuffer(struct ArdpSeg* seg, uint8_t* rxBuf, uint16_t dataOffse
     conn->rcv.buf[idx].dataLen = seg->DLEN;
     memcpy(conn->rcv.buf[idx].data, rxBuf + dataOffset, seg->DLEN);
 
-    if (UDP_Recv_State.rxContext == NULL) {
-        UDP_Recv_State.readBuf = conn->rcv.buf[idx].data;
-        UDP_Recv_State.dataLen = seg->DLEN;
-        UDP_Recv_State.rxContext = (void*) &conn->rcv.buf[idx];
+    if (conn->recvState.rxContext == NULL) {
+        conn->recvState.readBuf = conn->rcv.buf[idx].data;
+        conn->recvState.dataLen = seg->DLEN;
+        conn->recvState.rxContext = (void*) &conn->rcv.buf[idx];
     }
 }
 
@@ -953,9 +1125,9 @@ static void RecvReady(void* rxContext)
     }
 }
 
-AJ_Status AJ_ARDP_StartMsgSend(uint32_t ttl)
+AJ_Status AJ_ARDP_StartMsgSend(void* context, uint32_t ttl)
 {
-    if (conn == NULL) {
+    if (SelectConnection(context) == NULL) {
         return AJ_ERR_DISALLOWED;
     }
 
@@ -989,6 +1161,9 @@ static AJ_Status ARDP_Send(uint8_t* txBuf, uint16_t len)
     uint16_t fcnt;
     uint16_t offset;
     AJ_Status status;
+    uint8_t* segs[UDP_SEGMAX];
+    uint16_t lens[UDP_SEGMAX];
+    uint16_t count = 0;
 
     AJ_InfoPrintf(("ARDP_Send: buf=%p, len=%d ((nxt %u, lcs %u))\n", txBuf, len, conn->snd.NXT, conn->snd.LCS));
 
@@ -1002,11 +1177,11 @@ static AJ_Status ARDP_Send(uint8_t* txBuf, uint16_t len)
     }
 
     pending = (conn->snd.NXT - conn->snd.LCS) - 1;
-    sBuf = &(conn->snd.buf[conn->snd.NXT % UDP_SEGMAX]);
+    sBuf = &(conn->snd.buf[conn->snd.NXT % conn->snd.size]);
 
-    AJ_ASSERT(conn->snd.pending <= UDP_SEGMAX);
-    if (conn->snd.pending == UDP_SEGMAX) {
-        AJ_InfoPrintf(("ARDP_Send: backpressure, all (%u) SND buffers are in flight\n", conn->snd.pending));
+    AJ_ASSERT(conn->snd.pending <= conn->snd.size);
+    if (conn->snd.pending >= conn->snd.CWND) {
+        AJ_InfoPrintf(("ARDP_Send: backpressure, the window (%u) is in flight\n", conn->snd.CWND));
         return AJ_ERR_ARDP_BACKPRESSURE;
     }
     AJ_ASSERT(sBuf->inFlight == 0);
@@ -1027,8 +1202,8 @@ static AJ_Status ARDP_Send(uint8_t* txBuf, uint16_t len)
      * Check whether there is enough local buffer space to fit the data.
      * Also, check if the remote side can currently accept these data.
      */
-    if (((len + offset) > (ARDP_MAX_DLEN * (UDP_SEGMAX - conn->snd.pending))) || ((len + offset) > (ARDP_MAX_DLEN * (conn->snd.SEGMAX - pending)))) {
-        AJ_InfoPrintf(("ARDP_Send: backpressure, cannot send %u (%u + %u): local send pending %u, remote consume pending %u\n", len + offset, len, offset, conn->snd.pending, pending));
+    if (((len + offset) > (ARDP_MAX_DLEN * (conn->snd.CWND - conn->snd.pending))) || ((len + offset) > (ARDP_MAX_DLEN * (conn->snd.SEGMAX - pending)))) {
+        AJ_InfoPrintf(("ARDP_Send: backpressure, cannot send %u (%u + %u): window %u, local send pending %u, remote consume pending %u\n", len + offset, len, offset, conn->snd.CWND, conn->snd.pending, pending));
         return AJ_ERR_ARDP_BACKPRESSURE;
     }
 
@@ -1050,9 +1225,11 @@ static AJ_Status ARDP_Send(uint8_t* txBuf, uint16_t len)
 
     AJ_ASSERT(fcnt > 0);
 
+    /*
+     * The segments of the message are queued up and sent together at the end
+     */
     do {
         uint16_t dataLen;
-        size_t sent;
         uint32_t timeout;
 
         /* Check whether the current buffer is not in a process of being populated with fragmented data */
@@ -1079,17 +1256,10 @@ static AJ_Status ARDP_Send(uint8_t* txBuf, uint16_t len)
         MarshalHeader(sBuf->data, ARDP_FLAG_ACK | ARDP_FLAG_VER, dataLen, ttl, conn->snd.msgSOM, fcnt);
 
         AJ_InfoPrintf(("ARDP_Send(): send %d bytes (seq %u, ack %u, lcs %u)\n", ARDP_HEADER_SIZE + dataLen, conn->snd.NXT, conn->rcv.CUR, conn->rcv.LCS));
-        status = (*sendFunction)(conn->context, (uint8_t*) sBuf->data, ARDP_HEADER_SIZE + dataLen, &sent, conn->confirm);
-
-        if (status != AJ_OK) {
-            AJ_ErrPrintf(("ARDP_Send(): %s\n", AJ_StatusText(status)));
-            return status;
-        }
-
-        AJ_InfoPrintf(("ArdpSend(): cancel ackTimer\n"));
-        conn->ackTimer.retry = 0;
-        conn->rcv.pending = 0;
-        conn->confirm = FALSE;
+        AJ_ASSERT(count < UDP_SEGMAX);
+        segs[count] = (uint8_t*) sBuf->data;
+        lens[count] = ARDP_HEADER_SIZE + dataLen;
+        ++count;
 
         len -= (dataLen - offset);
 
@@ -1110,6 +1280,13 @@ static AJ_Status ARDP_Send(uint8_t* txBuf, uint16_t len)
 
     } while (len != 0);
 
+    if (count) {
+        status = SendSegments(segs, lens, count);
+        if (status != AJ_OK) {
+            AJ_ErrPrintf(("ARDP_Send(): %s\n", AJ_StatusText(status)));
+            return status;
+        }
+    }
     return AJ_OK;
 }
 
@@ -1117,8 +1294,6 @@ AJ_Status AJ_ARDP_Connect(uint8_t* data, uint16_t dataLen, void* context, AJ_Net
 {
     AJ_Status status;
 
-    memset(&UDP_Recv_State, 0, sizeof(UDP_Recv_State));
-
     status = InitConnection();
 
     if (status != AJ_OK) {
@@ -1134,7 +1309,7 @@ AJ_Status AJ_ARDP_Connect(uint8_t* data, uint16_t dataLen, void* context, AJ_Net
     status = SendSyn(dataLen);
 
     if (status != AJ_OK) {
-        AJ_Free(conn);
+        ReleaseConnection();
     } else {
         InitTimer(&conn->connectTimer, UDP_CONNECT_TIMEOUT, UDP_CONNECT_RETRIES);
         conn->state = SYN_SENT;
@@ -1143,10 +1318,10 @@ AJ_Status AJ_ARDP_Connect(uint8_t* data, uint16_t dataLen, void* context, AJ_Net
     return status;
 }
 
-void AJ_ARDP_Disconnect(uint8_t forced)
+void AJ_ARDP_Disconnect(void* context, uint8_t forced)
 {
     AJ_WarnPrintf(("ARDP Disconnect Request (local)\n"));
-    if (conn == NULL) {
+    if (SelectConnection(context) == NULL) {
         return;
     }
 
@@ -1167,8 +1342,7 @@ void AJ_ARDP_Disconnect(uint8_t forced)
     AJ_WarnPrintf(("ARDP_Disconnect: Send RST\n"));
     SendHeader(ARDP_FLAG_RST | ARDP_FLAG_ACK | ARDP_FLAG_VER);
 
-    AJ_Free(conn);
-    conn = NULL;
+    ReleaseConnection();
 }
 
 AJ_Status AJ_ARDP_Send(AJ_IOBuffer* buf)
@@ -1179,7 +1353,7 @@ AJ_Status AJ_ARDP_Send(AJ_IOBuffer* buf)
 
     AJ_InfoPrintf(("AJ_ARDP_Send(buf=0x%p)\n", buf));
 
-    if (conn == NULL) {
+    if (SelectConnection(buf->context) == NULL) {
         return AJ_ERR_DISALLOWED;
     }
 
@@ -1233,8 +1407,8 @@ static void UpdateReadBuffer(AJ_IOBuffer* rxBuf, uint32_t len) {
 
     AJ_InfoPrintf(("UpdateRead: rxBuf %p, len %u\n", rxBuf, len));
 
-    while ((UDP_Recv_State.rxContext != NULL) && (UDP_Recv_State.readBuf != NULL) && (len != 0)) {
-        ArdpRBuf* rBuf = UDP_Recv_State.rxContext;
+    while ((conn->recvState.rxContext != NULL) && (conn->recvState.readBuf != NULL) && (len != 0)) {
+        ArdpRBuf* rBuf = conn->recvState.rxContext;
         size_t rx = AJ_IO_BUF_SPACE(rxBuf);
         uint32_t consumed;
 
@@ -1242,15 +1416,15 @@ static void UpdateReadBuffer(AJ_IOBuffer* rxBuf, uint32_t len) {
         rx = min(rx, len);
 
         /* How much we can consume from the current rBuf */
-        consumed = min(rx, UDP_Recv_State.dataLen);
+        consumed = min(rx, conn->recvState.dataLen);
 
-        memcpy(rxBuf->writePtr, UDP_Recv_State.readBuf, consumed);
+        memcpy(rxBuf->writePtr, conn->recvState.readBuf, consumed);
 
         /* Advance the write pointer */
         rxBuf->writePtr += consumed;
         len -= consumed;
 
-        if (consumed == UDP_Recv_State.dataLen) {
+        if (consumed == conn->recvState.dataLen) {
             /*
              * We are done with the current rBuf. Release and potentially
              * move on to next rBuf.
@@ -1261,17 +1435,17 @@ static void UpdateReadBuffer(AJ_IOBuffer* rxBuf, uint32_t len) {
             /* Advance to the next rBuf */
             if (rBuf->next->dataLen) {
                 AJ_InfoPrintf(("UpdateRead: Start reading from next RCV\n"));
-                UDP_Recv_State.readBuf = rBuf->next->data;
-                UDP_Recv_State.dataLen = rBuf->next->dataLen;
-                UDP_Recv_State.rxContext = rBuf->next;
+                conn->recvState.readBuf = rBuf->next->data;
+                conn->recvState.dataLen = rBuf->next->dataLen;
+                conn->recvState.rxContext = rBuf->next;
             } else {
                 AJ_InfoPrintf(("UpdateRead: Nothing in next RCV\n"));
-                memset(&UDP_Recv_State, 0, sizeof(UDP_Recv_State));
+                memset(&conn->recvState, 0, sizeof(conn->recvState));
             }
         } else {
             /* No more space to write data. Update the internal read state and return */
-            UDP_Recv_State.readBuf += rx;
-            UDP_Recv_State.dataLen -= rx;
+            conn->recvState.readBuf += rx;
+            conn->recvState.dataLen -= rx;
             return;
         }
     }
@@ -1286,22 +1460,30 @@ AJ_Status AJ_ARDP_Recv(AJ_IOBuffer* rxBuf, uint32_t len, uint32_t timeout)
 
     AJ_InfoPrintf(("AJ_ARDP_Recv(rxBuf=%p, len=%u, timeout=%u)\n", rxBuf, len, timeout));
 
-    if (conn == NULL) {
+    if (SelectConnection(rxBuf->context) == NULL) {
         return AJ_ERR_READ;
     }
 
     AJ_InitTimer(&end);
     AJ_TimeAddOffset(&end, timeout);
 
-    if ((len != 0) && (UDP_Recv_State.rxContext != NULL)) {
+    if ((len != 0) && (conn->recvState.rxContext != NULL)) {
         timeout2 = 0;
     }
 
     do {
-        uint32_t received = 0;
-        uint8_t* buf = NULL;
-
-        status = (*recvFunction)(rxBuf->context, &buf, &received, timeout2);
+        uint32_t received[UDP_RECV_BATCH];
+        uint8_t* buf[UDP_RECV_BATCH];
+        uint16_t segsz[UDP_RECV_BATCH];
+        uint16_t count = 1;
+        uint16_t i;
+
+        segsz[0] = 0;
+        if (recvBatchFunction) {
+            status = (*recvBatchFunction)(rxBuf->context, buf, received, segsz, UDP_RECV_BATCH, &count, timeout2);
+        } else {
+            status = (*recvFunction)(rxBuf->context, &buf[0], &received[0], timeout2);
+        }
 
         localStatus = CheckTimers();
 
@@ -1315,8 +1497,8 @@ AJ_Status AJ_ARDP_Recv(AJ_IOBuffer* rxBuf, uint32_t len, uint32_t timeout)
         switch (status) {
         case AJ_ERR_TIMEOUT:
             AJ_InfoPrintf(("AJ_ARDP_Recv status %s, len = %u, rxContext = %p\n", AJ_StatusText(status),
-                           len, UDP_Recv_State.rxContext));
-            if ((len != 0) && (UDP_Recv_State.rxContext != NULL)) {
+                           len, conn->recvState.rxContext));
+            if ((len != 0) && (conn->recvState.rxContext != NULL)) {
                 status = AJ_OK;
                 AJ_InitTimer(&conn->probeTimer.tStart);
                 goto UPDATE_READ;
@@ -1324,7 +1506,21 @@ AJ_Status AJ_ARDP_Recv(AJ_IOBuffer* rxBuf, uint32_t len, uint32_t timeout)
             break;
 
         case AJ_OK:
-            status = ARDP_Recv(buf, received);
+            /*
+             * Every datagram of a batch is processed before the data is handed up. A datagram
+             * coalesced by the platform is split back into its segments.
+             */
+            for (i = 0; (i < count) && (status == AJ_OK); ++i) {
+                uint32_t offset = 0;
+                do {
+                    uint32_t segLen = received[i] - offset;
+                    if (segsz[i] && (segLen > segsz[i])) {
+                        segLen = segsz[i];
+                    }
+                    status = ARDP_Recv(buf[i] + offset, segLen);
+                    offset += segLen;
+                } while ((status == AJ_OK) && (offset < received[i]));
+            }
 
             if (status == AJ_OK) {
                 goto UPDATE_READ;
@@ -1340,7 +1536,7 @@ AJ_Status AJ_ARDP_Recv(AJ_IOBuffer* rxBuf, uint32_t len, uint32_t timeout)
                 break;
             } else if ((status != AJ_ERR_ARDP_REMOTE_CONNECTION_RESET) && (conn->state != CLOSE_WAIT)) {
                 AJ_WarnPrintf(("AJ_ARDP_Recv: received bad data, disconnecting\n"));
-                AJ_ARDP_Disconnect(TRUE);
+                AJ_ARDP_Disconnect(rxBuf->context, TRUE);
             }
             status = AJ_ERR_READ;
 
@@ -1360,7 +1556,7 @@ AJ_Status AJ_ARDP_Recv(AJ_IOBuffer* rxBuf, uint32_t len, uint32_t timeout)
     } while (AJ_CompareTime(now, end) < 0);
 
 UPDATE_READ:
-    if ((len != 0) && (UDP_Recv_State.rxContext != NULL)) {
+    if ((len != 0) && (conn->recvState.rxContext != NULL)) {
         UpdateReadBuffer(rxBuf, len);
         // can't possibly time out if data was recved!
         return AJ_OK;
@@ -1371,6 +1567,19 @@ UPDATE_READ:
     return AJ_ERR_TIMEOUT;
 }
 
+#ifndef NDEBUG
+AJ_Status AJ_ARDP_GetSendWindow(void* context, uint16_t* size, uint16_t* cwnd, uint16_t* ssthresh)
+{
+    if (SelectConnection(context) == NULL) {
+        return AJ_ERR_DISALLOWED;
+    }
+    *size = conn->snd.size;
+    *cwnd = conn->snd.CWND;
+    *ssthresh = conn->snd.SSTHRESH;
+    return AJ_OK;
+}
+#endif
+
 #ifdef __cplusplus
 }
 #endif
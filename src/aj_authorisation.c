@@ -90,32 +90,128 @@ Policy g_policy = { { 0, NULL }, NULL };
 #define MANIFEST_OUTGOING           (MANIFEST_METHOD_OUTGOING | MANIFEST_PRPSET_OUTGOING)
 #define POLICY_ACCESS               (POLICY_INCOMING | POLICY_OUTGOING)
 #define MANIFEST_ACCESS             (MANIFEST_INCOMING | MANIFEST_OUTGOING)
+/* Only used in compiled policy rows, which never hold manifest bits */
+#define POLICY_DENY                 0x80
 
 /*
  * The main access control structure.
- * Maps message ids to peer's access.
+ * Maps message ids to the names used when applying policy.
  */
 typedef struct _AccessControlMember {
     uint32_t id;
     const char* obj;
     const char* ifn;
     const char* mbr;
-    uint8_t deny[AJ_NAME_MAP_GUID_SIZE];
-    uint8_t allow[AJ_NAME_MAP_GUID_SIZE];
-    struct _AccessControlMember* next;
+    uint8_t list;
 } AccessControlMember;
 
+/*
+ * Location of an interface's members in the member table.
+ * The DBus.Properties GetAll member (if any) follows the last member.
+ */
+typedef struct _AccessControlInterface {
+    uint16_t first;
+    uint8_t count;
+    uint8_t getAll;
+    uint32_t hash;
+} AccessControlInterface;
+
+/*
+ * Access control table for one object list.
+ * The members are stored contiguously in registration order so a
+ * message id can be decoded straight into a table index:
+ * members[ifaces[objects[o] + i].first + m]
+ * Peer access is stored by peer index (from AJ_GetPeerIndex) then
+ * member, and grows as peers with higher indices are authenticated.
+ */
+typedef struct _AccessControlTable {
+    AccessControlMember* members;
+    AccessControlInterface* ifaces;
+    uint16_t* objects;
+    uint16_t* access;
+    uint16_t numMembers;
+    uint16_t numObjects;
+    uint16_t numPeers;
+} AccessControlTable;
+
+/* Stored alongside the allowed access bits of a member */
+#define ACCESS_DENY                 0x100
+
 static AJ_PermissionRule* g_manifestRules = NULL;
-static AccessControlMember* g_access = NULL;
+static AccessControlTable g_access[AJ_MAX_OBJECT_LISTS];
+
+/*
+ * The loaded policy compiled against the access control table.
+ * Each ACL has a row holding the access its rules grant every member,
+ * in AccessControlNext() order, so applying an ACL to a peer doesn't
+ * need any name matching. Rows are keyed by a digest of the ACL rules
+ * and survive the policy being unloaded, so reloading or updating the
+ * policy only recompiles the ACLs whose rules changed.
+ */
+typedef struct _CompiledPolicy {
+    uint8_t* digests;
+    uint8_t* access;
+    uint16_t numRows;
+    uint16_t numMembers;
+    uint8_t current;
+} CompiledPolicy;
+static CompiledPolicy g_compiled = { NULL, NULL, 0, 0, FALSE };
+
+static void PolicyCompiledFree(void)
+{
+    /* Digests and access rows share a single allocation */
+    AJ_Free(g_compiled.digests);
+    memset(&g_compiled, 0, sizeof (CompiledPolicy));
+}
+
+/*
+ * FNV-1a hash of an interface name, used to skip string compares
+ * when looking up the GetAll member for an interface.
+ */
+static uint32_t InterfaceHash(const uint8_t* ifn, size_t len)
+{
+    uint32_t hash = 2166136261U;
+
+    while (len--) {
+        hash ^= *ifn++;
+        hash *= 16777619U;
+    }
+    return hash;
+}
+
+static uint8_t SecureInterface(const AJ_Object* obj, const char* ifn)
+{
+    uint8_t secure;
+
+    secure = obj->flags & AJ_OBJ_FLAG_SECURE;
+    secure |= (SECURE_TRUE == *ifn);
+    secure &= ~(SECURE_OFF == *ifn);
+    return secure;
+}
+
+static void AccessControlDeregister(uint8_t l)
+{
+    AccessControlTable* table;
+
+    if (l >= AJ_MAX_OBJECT_LISTS) {
+        return;
+    }
+    table = &g_access[l];
+    if (table->members) {
+        AJ_InfoPrintf(("AccessControlDeregister: list %x members %u\n", l, table->numMembers));
+        /* Members, interfaces and objects share a single allocation */
+        AJ_Free(table->members);
+        AJ_Free(table->access);
+    }
+    memset(table, 0, sizeof (AccessControlTable));
+}
 
 static void AccessControlClose(void)
 {
-    AccessControlMember* member;
+    uint8_t l;
 
-    while (g_access) {
-        member = g_access;
-        g_access = g_access->next;
-        AJ_Free(member);
+    for (l = 0; l < AJ_MAX_OBJECT_LISTS; l++) {
+        AccessControlDeregister(l);
     }
 }
 
@@ -137,6 +233,11 @@ static AJ_Status AccessControlRegister(const AJ_Object* list, uint8_t l)
     uint8_t secure;
     uint8_t i, m;
     uint16_t n = 0;
+    uint16_t numIfaces = 0;
+    uint16_t numMembers = 0;
+    size_t size;
+    AccessControlTable* table;
+    AccessControlInterface* ifc;
     AccessControlMember* member;
     uint32_t properties;
 
@@ -146,120 +247,229 @@ static AJ_Status AccessControlRegister(const AJ_Object* list, uint8_t l)
         /* Nothing to add to the list */
         return AJ_OK;
     }
+    if (l >= AJ_MAX_OBJECT_LISTS) {
+        return AJ_ERR_RANGE;
+    }
 
+    /* First pass sizes the table */
     while (list[n].path) {
         obj = &list[n++];
         interfaces = obj->interfaces;
         if (!interfaces) {
             continue;
         }
-        i = 0;
-        properties = FALSE;
         while (*interfaces) {
             iface = *interfaces++;
             ifn = *iface++;
             AJ_ASSERT(ifn);
-            secure = obj->flags & AJ_OBJ_FLAG_SECURE;
-            secure |= (SECURE_TRUE == *ifn);
-            secure &= ~(SECURE_OFF == *ifn);
+            numIfaces++;
+            secure = SecureInterface(obj, ifn);
+            if (secure) {
+                properties = FALSE;
+                while (*iface) {
+                    properties |= (PROPERTY == MEMBER_TYPE(**iface));
+                    iface++;
+                    numMembers++;
+                }
+                numMembers += properties;
+            }
+        }
+    }
+    if (!numMembers) {
+        return AJ_OK;
+    }
+
+    table = &g_access[l];
+    size = numMembers * sizeof (AccessControlMember) + numIfaces * sizeof (AccessControlInterface) + (n + 1) * sizeof (uint16_t);
+    table->members = (AccessControlMember*) AJ_Malloc(size);
+    if (NULL == table->members) {
+        AJ_WarnPrintf(("AccessControlRegister(list=%p, l=%x): AJ_ERR_RESOURCES\n", list, l));
+        return AJ_ERR_RESOURCES;
+    }
+    memset(table->members, 0, size);
+    table->ifaces = (AccessControlInterface*) (table->members + numMembers);
+    table->objects = (uint16_t*) (table->ifaces + numIfaces);
+    table->numObjects = n;
+
+    /* Second pass fills it in */
+    member = table->members;
+    ifc = table->ifaces;
+    n = 0;
+    while (list[n].path) {
+        obj = &list[n++];
+        table->objects[n - 1] = (uint16_t) (ifc - table->ifaces);
+        interfaces = obj->interfaces;
+        if (!interfaces) {
+            continue;
+        }
+        i = 0;
+        while (*interfaces) {
+            iface = *interfaces++;
+            ifn = *iface++;
+            secure = SecureInterface(obj, ifn);
+            ifc->first = (uint16_t) (member - table->members);
             /* Only access control secure objects/interfaces */
             if (secure) {
                 m = 0;
+                properties = FALSE;
                 while (*iface) {
                     mbr = *iface++;
-                    member = (AccessControlMember*) AJ_Malloc(sizeof (AccessControlMember));
-                    if (NULL == member) {
-                        AJ_WarnPrintf(("AccessControlRegister(list=%p, l=%x): AJ_ERR_RESOURCES\n", list, l));
-                        goto Exit;
-                    }
-                    memset(member, 0, sizeof (AccessControlMember));
                     member->obj = obj->path;
                     member->ifn = ifn;
                     member->mbr = mbr;
+                    member->list = l;
                     member->id = AJ_ENCODE_MESSAGE_ID(l, n - 1, i, m);
-                    member->next = g_access;
-                    g_access = member;
                     properties |= (PROPERTY == MEMBER_TYPE(*mbr));
                     AJ_InfoPrintf(("AccessControlRegister: id 0x%08X obj %s ifn %s mbr %s\n", member->id, obj->path, ifn, mbr));
+                    member++;
                     m++;
                 }
+                ifc->count = m;
                 if (properties) {
                     /* Add special member to handle DBus.Properties GetAll method */
-                    member = (AccessControlMember*) AJ_Malloc(sizeof (AccessControlMember));
-                    if (NULL == member) {
-                        AJ_WarnPrintf(("AccessControlRegister(list=%p, l=%x): AJ_ERR_RESOURCES\n", list, l));
-                        goto Exit;
-                    }
-                    memset(member, 0, sizeof (AccessControlMember));
                     member->obj = obj->path;
                     member->ifn = ifn;
                     /* Setting the member to "@" will match an PROPERTY with wildcard for member name */
                     member->mbr = "@";
+                    member->list = l;
                     member->id = AJ_INVALID_MSG_ID;
-                    member->next = g_access;
-                    g_access = member;
-                    AJ_InfoPrintf(("AccessControlRegister: id 0x%08X obj %s ifn %s mbr %s\n", member->id, obj->path, ifn, member->mbr));
+                    /* Skip over secure annotation */
+                    if ((SECURE_TRUE == *ifn) || (SECURE_OFF == *ifn)) {
+                        ifn++;
+                    }
+                    ifc->getAll = TRUE;
+                    ifc->hash = InterfaceHash((const uint8_t*) ifn, strlen(ifn));
+                    AJ_InfoPrintf(("AccessControlRegister: id 0x%08X obj %s ifn %s mbr %s\n", member->id, obj->path, member->ifn, member->mbr));
+                    member++;
                 }
             }
+            ifc++;
             i++;
         }
     }
+    table->objects[n] = (uint16_t) (ifc - table->ifaces);
+    table->numMembers = numMembers;
 
     return AJ_OK;
-
-Exit:
-    return AJ_ERR_RESOURCES;
 }
 
-static void AccessControlDeregister(uint8_t l)
+/*
+ * Iterates over every member of every access control table
+ */
+static AccessControlMember* AccessControlNext(AccessControlMember* acm)
 {
-    AccessControlMember* node;
-    AccessControlMember* head = g_access;
+    uint8_t l = 0;
 
-    /* Remove nodes from beginning of the list */
-    while (NULL != head) {
-        if (l == (head->id >> 24)) {
-            AJ_InfoPrintf(("AccessControlDeregister: id 0x%08X obj %s ifn %s mbr %s\n", head->id, head->obj, head->ifn, head->mbr));
-            node = head;
-            head = head->next;
-            AJ_Free(node);
-        } else {
-            break;
+    if (acm) {
+        l = acm->list;
+        if (++acm < g_access[l].members + g_access[l].numMembers) {
+            return acm;
         }
+        l++;
     }
-    g_access = head;
-    if (NULL == g_access) {
-        return;
+    for (; l < AJ_MAX_OBJECT_LISTS; l++) {
+        if (g_access[l].numMembers) {
+            return g_access[l].members;
+        }
     }
-    /* Remove nodes from rest of the list */
-    while (NULL != head->next) {
-        if (l == (head->next->id >> 24)) {
-            AJ_InfoPrintf(("AccessControlDeregister: id 0x%08X obj %s ifn %s mbr %s\n", head->next->id, head->next->obj, head->next->ifn, head->next->mbr));
-            node = head->next;
-            head->next = node->next;
-            AJ_Free(node);
-        } else {
-            head = head->next;
+    return NULL;
+}
+
+/*
+ * Makes room in every table for the access of a peer index
+ */
+static AJ_Status AccessControlGrow(uint32_t peer)
+{
+    AccessControlTable* table;
+    uint16_t* access;
+    uint16_t numPeers;
+    uint8_t l;
+
+    for (l = 0; l < AJ_MAX_OBJECT_LISTS; l++) {
+        table = &g_access[l];
+        if (!table->numMembers || (peer < table->numPeers)) {
+            continue;
+        }
+        /* Grow in the same sized blocks as the name map */
+        numPeers = (uint16_t) ((peer / AJ_NAME_MAP_GUID_SIZE + 1) * AJ_NAME_MAP_GUID_SIZE);
+        access = (uint16_t*) AJ_Realloc(table->access, numPeers * table->numMembers * sizeof (uint16_t));
+        if (!access) {
+            AJ_WarnPrintf(("AccessControlGrow(peer=%u): AJ_ERR_RESOURCES\n", peer));
+            return AJ_ERR_RESOURCES;
         }
+        memset(access + table->numPeers * table->numMembers, 0, (numPeers - table->numPeers) * table->numMembers * sizeof (uint16_t));
+        table->access = access;
+        table->numPeers = numPeers;
+    }
+    return AJ_OK;
+}
+
+/*
+ * Returns a peer's access entry for a member, NULL if the peer has never had access applied
+ */
+static uint16_t* MemberAccess(const AccessControlMember* acm, uint32_t peer)
+{
+    const AccessControlTable* table = &g_access[acm->list];
+
+    if (peer >= table->numPeers) {
+        return NULL;
+    }
+    return &table->access[peer * table->numMembers + (acm - table->members)];
+}
+
+static uint8_t MemberAllowed(const AccessControlMember* acm, uint32_t peer)
+{
+    const uint16_t* access = MemberAccess(acm, peer);
+
+    if (!access || (ACCESS_DENY & *access)) {
+        return 0;
+    }
+    return (uint8_t) *access;
+}
+
+/*
+ * Uses the peer index the message layer already looked up for this
+ * message, which is the remote end (sender or destination) of the message.
+ */
+static AJ_Status MessagePeer(const AJ_Message* msg, const char* name, uint32_t* peer)
+{
+    if (msg->peer && ((name == msg->sender) || (name == msg->destination))) {
+        *peer = msg->peer - 1;
+        return AJ_OK;
     }
+    if (!name) {
+        return AJ_ERR_NO_MATCH;
+    }
+    return AJ_GetPeerIndex(name, peer);
 }
 
 static AccessControlMember* FindAccessControlMember(uint32_t id)
 {
-    AccessControlMember* mbr;
+    const AccessControlTable* table;
+    const AccessControlInterface* ifc;
+    uint32_t l = id >> 24;
+    uint32_t o = (id >> 16) & 0xFF;
+    uint32_t i = (id >> 8) & 0xFF;
+    uint32_t m = id & 0xFF;
 
-    if (!g_access) {
+    /* Reply ids and unregistered lists fall outside the table */
+    if (l >= AJ_MAX_OBJECT_LISTS) {
+        return NULL;
+    }
+    table = &g_access[l];
+    if (!table->members) {
         AJ_WarnPrintf(("FindAccessControlMember(id=0x%08X): Access table not initialised\n", id));
         return NULL;
     }
-
-    // This linked list is a reverse ordered list
-    mbr = g_access;
-    while (mbr && (id != mbr->id)) {
-        mbr = mbr->next;
+    if ((o >= table->numObjects) || (i >= (uint32_t) (table->objects[o + 1] - table->objects[o]))) {
+        return NULL;
+    }
+    ifc = &table->ifaces[table->objects[o] + i];
+    if (m >= ifc->count) {
+        return NULL;
     }
 
-    return mbr;
+    return &table->members[ifc->first + m];
 }
 
 static uint32_t IsInterface(const char* std, const char* ifn)
@@ -291,20 +501,33 @@ static uint32_t StandardInterface(const char* ifn)
 
 static AccessControlMember* FindGetAllMember(const void* buf, size_t len)
 {
-    AccessControlMember* acm = g_access;
+    const AccessControlTable* table;
+    const AccessControlInterface* ifc;
     const char* ifn;
+    uint32_t hash = InterfaceHash((const uint8_t*) buf, len);
+    uint8_t l;
+    uint16_t k;
 
-    while (acm) {
-        ifn = acm->ifn;
-        /* Skip over secure annotation */
-        if ((SECURE_TRUE == *ifn) || (SECURE_OFF == *ifn)) {
-            ifn++;
+    for (l = 0; l < AJ_MAX_OBJECT_LISTS; l++) {
+        table = &g_access[l];
+        if (!table->members) {
+            continue;
         }
-        if ((AJ_INVALID_MSG_ID == acm->id) && (len == strlen(ifn) && (0 == AJ_Crypto_Compare(buf, acm->ifn, len)))) {
-            /* Same interface */
-            return acm;
+        for (k = 0; k < table->objects[table->numObjects]; k++) {
+            ifc = &table->ifaces[k];
+            if (!ifc->getAll || (hash != ifc->hash)) {
+                continue;
+            }
+            ifn = table->members[ifc->first].ifn;
+            /* Skip over secure annotation */
+            if ((SECURE_TRUE == *ifn) || (SECURE_OFF == *ifn)) {
+                ifn++;
+            }
+            if ((len == strlen(ifn)) && (0 == AJ_Crypto_Compare(buf, ifn, len))) {
+                /* Same interface */
+                return &table->members[ifc->first + ifc->count];
+            }
         }
-        acm = acm->next;
     }
 
     return NULL;
@@ -334,12 +557,11 @@ static AJ_Status PropertiesInterfaceCheck(const AJ_Message* msg, uint8_t directi
     buf += sizeof (uint32_t);
     acm = FindGetAllMember(buf, len);
     if (acm) {
-        acc = acm->deny[peer] ? 0 : acm->allow[peer];
+        acc = MemberAllowed(acm, peer);
         if ((POLICY_PRPALL_OUTGOING & acc) && (MANIFEST_PRPALL_OUTGOING & acc)) {
             return AJ_OK;
         }
     }
-    acm = acm->next;
 
     return AJ_ERR_ACCESS;
 }
@@ -364,7 +586,7 @@ AJ_Status AJ_AccessControlCheckMessage(const AJ_Message* msg, const char* name,
     }
 
     /* Check Peer.Authentication before this because we don't have a peer entry yet */
-    status = AJ_GetPeerIndex(name, &peer);
+    status = MessagePeer(msg, name, &peer);
     if (AJ_OK != status) {
         return AJ_ERR_ACCESS;
     }
@@ -382,7 +604,7 @@ AJ_Status AJ_AccessControlCheckMessage(const AJ_Message* msg, const char* name,
     }
 
     status = AJ_ERR_ACCESS;
-    acc = mbr->deny[peer] ? 0 : mbr->allow[peer];
+    acc = MemberAllowed(mbr, peer);
     switch (direction) {
     case AJ_ACCESS_INCOMING:
         if ((POLICY_METHOD_INCOMING & acc) && (MANIFEST_METHOD_INCOMING & acc)) {
@@ -410,7 +632,7 @@ AJ_Status AJ_AccessControlCheckProperty(const AJ_Message* msg, uint32_t id, cons
 
     AJ_InfoPrintf(("AJ_AccessControlCheckProperty(msg=%p, id=0x%08X, name=%s, direction=%x)\n", msg, id, name, direction));
 
-    status = AJ_GetPeerIndex(name, &peer);
+    status = MessagePeer(msg, name, &peer);
     if (AJ_OK != status) {
         AJ_WarnPrintf(("AccessControlCheckProperty(msg=%p, id=0x%08X, name=%s, direction=%x): Peer not in table\n", msg, id, name, direction));
         return AJ_ERR_ACCESS;
@@ -423,7 +645,7 @@ AJ_Status AJ_AccessControlCheckProperty(const AJ_Message* msg, uint32_t id, cons
     }
 
     status = AJ_ERR_ACCESS;
-    acc = mbr->deny[peer] ? 0 : mbr->allow[peer];
+    acc = MemberAllowed(mbr, peer);
     switch (direction) {
     case AJ_ACCESS_INCOMING:
         switch (msg->msgId & 0xFF) {
@@ -488,8 +710,9 @@ AJ_Status AJ_AccessControlCheckProperty(const AJ_Message* msg, uint32_t id, cons
 AJ_Status AJ_AccessControlReset(const char* name)
 {
     AJ_Status status;
-    AccessControlMember* node = g_access;
+    AccessControlTable* table;
     uint32_t peer;
+    uint8_t l;
 
     AJ_InfoPrintf(("AJ_AccessControlReset(name=%s)\n", name));
 
@@ -498,10 +721,15 @@ AJ_Status AJ_AccessControlReset(const char* name)
         AJ_WarnPrintf(("AJ_AccessControlReset(name=%s): Peer not in table\n", name));
         return status;
     }
-    while (node) {
-        node->allow[peer] = 0;
-        node->deny[peer] = 0;
-        node = node->next;
+    status = AccessControlGrow(peer);
+    if (AJ_OK != status) {
+        return status;
+    }
+    for (l = 0; l < AJ_MAX_OBJECT_LISTS; l++) {
+        table = &g_access[l];
+        if (table->numMembers) {
+            memset(&table->access[peer * table->numMembers], 0, table->numMembers * sizeof (uint16_t));
+        }
     }
 
     return AJ_OK;
@@ -1372,6 +1600,8 @@ void AJ_PolicyUnload(void)
     g_policy.buffer.data = NULL;
     AJ_PolicyFree(g_policy.policy);
     g_policy.policy = NULL;
+    /* Keep the compiled rows, the next policy probably shares most of them */
+    g_compiled.current = FALSE;
 }
 
 AJ_Status AJ_PolicyLoad(void)
@@ -1417,6 +1647,8 @@ AJ_Status AJ_AuthorisationRegister(const AJ_Object* list, uint8_t l)
 {
     /* Register objects on the access control list, deregister any old entries first */
     AccessControlDeregister(l);
+    /* Compiled policy rows are laid out by member, so they are now stale */
+    PolicyCompiledFree();
     return AccessControlRegister(list, l);
 }
 
@@ -1424,6 +1656,7 @@ void AJ_AuthorisationClose(void)
 {
     /* Unload access control list */
     AccessControlClose();
+    PolicyCompiledFree();
     /* Unload policy (if not unloaded during last handshake) */
     AJ_PolicyUnload();
 }
@@ -1471,9 +1704,14 @@ static uint8_t MemberType(uint8_t a, uint8_t b)
     return 0;
 }
 
-static uint8_t PermissionRuleAccess(AJ_PermissionRule* rule, AccessControlMember* acm, uint32_t peer, uint8_t with_public_key)
+/*
+ * Returns the policy access the rules grant a member.
+ * POLICY_DENY is set if an all wildcard deny rule matched, the caller
+ * decides whether it applies to the peer.
+ */
+static uint8_t PermissionRuleAccess(const AJ_PermissionRule* rule, const AccessControlMember* acm)
 {
-    AJ_PermissionMember* member;
+    const AJ_PermissionMember* member;
     uint8_t type;
     const char* obj;
     const char* ifn;
@@ -1532,10 +1770,10 @@ static uint8_t PermissionRuleAccess(AJ_PermissionRule* rule, AccessControlMember
                         }
                         break;
                     }
-                    /* Only apply DENY if WITH_PUBLIC_KEY and rule is all wildcard */
-                    if (with_public_key && ('*' == rule->obj[0]) && ('*' == rule->ifn[0]) && ('*' == member->mbr[0]) && (0 == member->action)) {
+                    /* DENY is only applied if WITH_PUBLIC_KEY and rule is all wildcard */
+                    if (('*' == rule->obj[0]) && ('*' == rule->ifn[0]) && ('*' == member->mbr[0]) && (0 == member->action)) {
                         /* Explicit deny both directions */
-                        acm->deny[peer] = 1;
+                        acc |= POLICY_DENY;
                     }
                 }
                 member = member->next;
@@ -1547,6 +1785,150 @@ static uint8_t PermissionRuleAccess(AJ_PermissionRule* rule, AccessControlMember
     return acc;
 }
 
+static uint16_t AccessControlCount(void)
+{
+    uint16_t count = 0;
+    uint8_t l;
+
+    for (l = 0; l < AJ_MAX_OBJECT_LISTS; l++) {
+        count += g_access[l].numMembers;
+    }
+    return count;
+}
+
+static AJ_Status PermissionRuleDigest(const AJ_PermissionRule* rule, uint8_t* digest)
+{
+    const AJ_PermissionMember* member;
+    AJ_SHA256_Context* ctx;
+
+    ctx = AJ_SHA256_Init();
+    if (!ctx) {
+        return AJ_ERR_RESOURCES;
+    }
+    while (rule) {
+        /* Names are hashed with their terminators so adjacent fields can't run together */
+        AJ_SHA256_Update(ctx, (const uint8_t*) rule->obj, strlen(rule->obj) + 1);
+        AJ_SHA256_Update(ctx, (const uint8_t*) rule->ifn, strlen(rule->ifn) + 1);
+        member = rule->members;
+        while (member) {
+            AJ_SHA256_Update(ctx, (const uint8_t*) member->mbr, strlen(member->mbr) + 1);
+            AJ_SHA256_Update(ctx, &member->type, 1);
+            AJ_SHA256_Update(ctx, &member->action, 1);
+            member = member->next;
+        }
+        /* Rule separator */
+        AJ_SHA256_Update(ctx, (const uint8_t*) "", 1);
+        rule = rule->next;
+    }
+    return AJ_SHA256_Final(ctx, digest);
+}
+
+/*
+ * Returns the compiled row for each ACL of the loaded policy,
+ * compiling any rows that aren't already known. Returns NULL if there
+ * is nothing to compile, or with g_compiled.current clear if it failed.
+ */
+static const uint8_t* PolicyCompiled(void)
+{
+    AJ_Status status;
+    const AJ_PermissionACL* acl;
+    AccessControlMember* acm;
+    uint16_t numRows = 0;
+    uint16_t numMembers = AccessControlCount();
+    uint8_t* digests;
+    uint8_t* access;
+    uint8_t* row;
+    uint16_t prevRows;
+    uint16_t i, j, k;
+
+    if (g_compiled.current) {
+        return g_compiled.access;
+    }
+    if (!g_policy.policy) {
+        return NULL;
+    }
+    for (acl = g_policy.policy->acls; acl; acl = acl->next) {
+        numRows++;
+    }
+    if (!numRows || !numMembers) {
+        PolicyCompiledFree();
+        g_compiled.current = TRUE;
+        return NULL;
+    }
+    digests = (uint8_t*) AJ_Malloc(numRows * (AJ_SHA256_DIGEST_LENGTH + numMembers));
+    if (!digests) {
+        return NULL;
+    }
+    access = digests + numRows * AJ_SHA256_DIGEST_LENGTH;
+    /* Previous rows can only be reused if the member layout is unchanged */
+    prevRows = (numMembers == g_compiled.numMembers) ? g_compiled.numRows : 0;
+    for (i = 0, acl = g_policy.policy->acls; acl; i++, acl = acl->next) {
+        row = access + i * numMembers;
+        status = PermissionRuleDigest(acl->rules, digests + i * AJ_SHA256_DIGEST_LENGTH);
+        if (AJ_OK != status) {
+            AJ_Free(digests);
+            return NULL;
+        }
+        /* Reuse the previous compilation if these rules haven't changed */
+        for (j = 0; j < prevRows; j++) {
+            if (0 == memcmp(digests + i * AJ_SHA256_DIGEST_LENGTH, g_compiled.digests + j * AJ_SHA256_DIGEST_LENGTH, AJ_SHA256_DIGEST_LENGTH)) {
+                memcpy(row, g_compiled.access + j * numMembers, numMembers);
+                break;
+            }
+        }
+        if (j < prevRows) {
+            continue;
+        }
+        AJ_InfoPrintf(("PolicyCompiled(): Compiling ACL %u\n", i));
+        k = 0;
+        acm = AccessControlNext(NULL);
+        while (acm) {
+            row[k++] = PermissionRuleAccess(acl->rules, acm);
+            acm = AccessControlNext(acm);
+        }
+    }
+    PolicyCompiledFree();
+    g_compiled.digests = digests;
+    g_compiled.access = access;
+    g_compiled.numRows = numRows;
+    g_compiled.numMembers = numMembers;
+    g_compiled.current = TRUE;
+
+    return g_compiled.access;
+}
+
+/*
+ * Grants a peer the access in a compiled policy row
+ */
+static void PolicyRowApply(const uint8_t* row, uint32_t peer, uint8_t with_public_key, uint8_t manifest)
+{
+    AccessControlMember* acm;
+    uint16_t* access;
+    uint8_t acc;
+
+    acm = AccessControlNext(NULL);
+    while (acm) {
+        access = MemberAccess(acm, peer);
+        AJ_ASSERT(access);
+        acc = *row++;
+        if (with_public_key && (POLICY_DENY & acc)) {
+            *access |= ACCESS_DENY;
+        }
+        acc &= POLICY_ACCESS;
+        if (manifest) {
+            /* We don't receive a manifest, so switch those bits on too */
+            acc |= (acc << 4);
+        }
+#ifndef NDEBUG
+        if (acc) {
+            AJ_InfoPrintf(("Access: 0x%08X %s %s %s %x\n", acm->id, acm->obj, acm->ifn, acm->mbr, acc));
+        }
+#endif
+        *access |= acc;
+        acm = AccessControlNext(acm);
+    }
+}
+
 AJ_Status AJ_ManifestApply(AJ_Manifest* manifest, const char* name, AJ_AuthenticationContext* ctx)
 {
     AJ_Status status;
@@ -1653,14 +2035,18 @@ AJ_Status AJ_ManifestApply(AJ_Manifest* manifest, const char* name, AJ_Authentic
         AJ_WarnPrintf(("AJ_ManifestApply(manifest=%p, name=%s): Peer not in table\n", manifest, name));
         return AJ_ERR_ACCESS;
     }
+    status = AccessControlGrow(peer);
+    if (AJ_OK != status) {
+        return status;
+    }
 
 #ifndef NDEBUG
     ManifestDump(manifest);
 #endif
 
-    acm = g_access;
+    acm = AccessControlNext(NULL);
     while (acm) {
-        acc = PermissionRuleAccess(manifest->rules, acm, peer, FALSE);
+        acc = PermissionRuleAccess(manifest->rules, acm) & POLICY_ACCESS;
         /* Manifest permissions are stored in the most significant part of the byte */
         acc <<= 4;
 #ifndef NDEBUG
@@ -1668,8 +2054,8 @@ AJ_Status AJ_ManifestApply(AJ_Manifest* manifest, const char* name, AJ_Authentic
             AJ_InfoPrintf(("Access: 0x%08X %s %s %s %x\n", acm->id, acm->obj, acm->ifn, acm->mbr, acc));
         }
 #endif
-        acm->allow[peer] |= acc;
-        acm = acm->next;
+        *MemberAccess(acm, peer) |= acc;
+        acm = AccessControlNext(acm);
     }
 
     return AJ_OK;
@@ -1728,9 +2114,11 @@ AJ_Status AJ_PolicyApply(AJ_AuthenticationContext* ctx, const char* name)
     AJ_Status status;
     Policy* policy = &g_policy;
     uint32_t peer;
-    uint8_t acc;
     AccessControlMember* acm;
+    uint16_t* access;
     AJ_PermissionACL* acl;
+    const uint8_t* rows;
+    uint16_t row;
     uint16_t state;
     uint16_t capabilities;
     uint16_t info;
@@ -1744,9 +2132,19 @@ AJ_Status AJ_PolicyApply(AJ_AuthenticationContext* ctx, const char* name)
         AJ_WarnPrintf(("AJ_PolicyApply(ctx=%p, name=%s): Peer not in table\n", ctx, name));
         return AJ_ERR_ACCESS;
     }
+    status = AccessControlGrow(peer);
+    if (AJ_OK != status) {
+        return status;
+    }
 
     if (policy->policy) {
+        rows = PolicyCompiled();
+        if (!rows && !g_compiled.current) {
+            AJ_WarnPrintf(("AJ_PolicyApply(ctx=%p, name=%s): Policy compilation failed\n", ctx, name));
+            return AJ_ERR_RESOURCES;
+        }
         acl = policy->policy->acls;
+        row = 0;
         while (acl) {
             found = 0;
             /* Look for a match in the peer list */
@@ -1764,31 +2162,20 @@ AJ_Status AJ_PolicyApply(AJ_AuthenticationContext* ctx, const char* name)
                     found |= PermissionPeerFind(acl->peers, AJ_PEER_TYPE_FROM_CA, &ctx->kactx.ecdsa.key[i], NULL);
                 }
             }
-            if (found) {
-                acm = g_access;
-                while (acm) {
-                    acc = PermissionRuleAccess(acl->rules, acm, peer, found >> 1);
-                    if (AUTH_SUITE_ECDHE_ECDSA != ctx->suite) {
-                        /* We don't receive a manifest, so switch those bits on too */
-                        acc |= (acc << 4);
-                    }
-#ifndef NDEBUG
-                    if (acc) {
-                        AJ_InfoPrintf(("Access: 0x%08X %s %s %s %x\n", acm->id, acm->obj, acm->ifn, acm->mbr, acc));
-                    }
-#endif
-                    acm->allow[peer] |= acc;
-                    acm = acm->next;
-                }
+            if (found && rows) {
+                PolicyRowApply(rows + row * g_compiled.numMembers, peer, found >> 1, AUTH_SUITE_ECDHE_ECDSA != ctx->suite);
             }
             acl = acl->next;
+            row++;
         }
     } else {
         AJ_InfoPrintf(("AJ_PolicyApply(ctx=%p, name=%p): No stored policy\n", ctx, name));
         /* Initial restricted access rights */
-        acm = g_access;
+        acm = AccessControlNext(NULL);
         while (acm) {
-            acm->allow[peer] = 0;
+            access = MemberAccess(acm, peer);
+            AJ_ASSERT(access);
+            *access &= ACCESS_DENY;
             switch (acm->id) {
             case AJ_METHOD_SECURITY_GET_PROP:
             case AJ_PROPERTY_SEC_VERSION:
@@ -1800,7 +2187,7 @@ AJ_Status AJ_PolicyApply(AJ_AuthenticationContext* ctx, const char* name)
             case AJ_PROPERTY_SEC_CLAIM_CAPABILITIES:
             case AJ_PROPERTY_SEC_CLAIM_CAPABILITIES_INFO:
             case AJ_PROPERTY_CLAIMABLE_VERSION:
-                acm->allow[peer] = POLICY_INCOMING | MANIFEST_INCOMING;
+                *access |= POLICY_INCOMING | MANIFEST_INCOMING;
                 break;
 
             case AJ_METHOD_CLAIMABLE_CLAIM:
@@ -1808,13 +2195,13 @@ AJ_Status AJ_PolicyApply(AJ_AuthenticationContext* ctx, const char* name)
                 AJ_SecurityGetClaimConfig(&state, &capabilities, &info);
                 if (APP_STATE_CLAIMABLE == state) {
                     if ((CLAIM_CAPABILITY_ECDHE_NULL & capabilities) && (AUTH_SUITE_ECDHE_NULL == ctx->suite)) {
-                        acm->allow[peer] = POLICY_INCOMING | MANIFEST_INCOMING;
+                        *access |= POLICY_INCOMING | MANIFEST_INCOMING;
                     } else if ((CLAIM_CAPABILITY_ECDHE_PSK & capabilities) && (AUTH_SUITE_ECDHE_PSK == ctx->suite)) {
-                        acm->allow[peer] = POLICY_INCOMING | MANIFEST_INCOMING;
+                        *access |= POLICY_INCOMING | MANIFEST_INCOMING;
                     } else if ((CLAIM_CAPABILITY_ECDHE_SPEKE & capabilities) && (AUTH_SUITE_ECDHE_SPEKE == ctx->suite)) {
-                        acm->allow[peer] = POLICY_INCOMING | MANIFEST_INCOMING;
+                        *access |= POLICY_INCOMING | MANIFEST_INCOMING;
                     } else if ((CLAIM_CAPABILITY_ECDHE_ECDSA & capabilities) && (AUTH_SUITE_ECDHE_ECDSA == ctx->suite)) {
-                        acm->allow[peer] = POLICY_INCOMING | MANIFEST_INCOMING;
+                        *access |= POLICY_INCOMING | MANIFEST_INCOMING;
                     }
                 }
                 break;
@@ -1842,9 +2229,9 @@ AJ_Status AJ_PolicyApply(AJ_AuthenticationContext* ctx, const char* name)
 
             default:
                 /* All allowed incoming and outgoing (Security 1.0) */
-                acm->allow[peer] = POLICY_ACCESS | MANIFEST_ACCESS;
+                *access |= POLICY_ACCESS | MANIFEST_ACCESS;
             }
-            acm = acm->next;
+            acm = AccessControlNext(acm);
         }
     }
 
@@ -1856,9 +2243,9 @@ AJ_Status AJ_MembershipApply(X509CertificateChain* root, AJ_ECCPublicKey* issuer
     AJ_Status status;
     Policy* policy = &g_policy;
     uint32_t peer;
-    uint8_t acc;
-    AccessControlMember* acm;
     AJ_PermissionACL* acl;
+    const uint8_t* rows;
+    uint16_t row;
     uint8_t found;
 
     AJ_InfoPrintf(("AJ_MembershipApply(root=%p, issuer=%p, group=%p, name=%s)\n", root, issuer, group, name));
@@ -1868,9 +2255,19 @@ AJ_Status AJ_MembershipApply(X509CertificateChain* root, AJ_ECCPublicKey* issuer
         AJ_WarnPrintf(("AJ_MembershipApply(root=%p, issuer=%p, group=%p, name=%s): Peer not in table\n", root, issuer, group, name));
         return AJ_ERR_ACCESS;
     }
+    status = AccessControlGrow(peer);
+    if (AJ_OK != status) {
+        return status;
+    }
 
     if (policy->policy) {
+        rows = PolicyCompiled();
+        if (!rows && !g_compiled.current) {
+            AJ_WarnPrintf(("AJ_MembershipApply(root=%p, issuer=%p, group=%p, name=%s): Policy compilation failed\n", root, issuer, group, name));
+            return AJ_ERR_RESOURCES;
+        }
         acl = policy->policy->acls;
+        row = 0;
         while (acl) {
             found = 0;
             /* Check if root issuer is in the peer list */
@@ -1884,20 +2281,11 @@ AJ_Status AJ_MembershipApply(X509CertificateChain* root, AJ_ECCPublicKey* issuer
                     root = root->next;
                 }
             }
-            if (found) {
-                acm = g_access;
-                while (acm) {
-                    acc = PermissionRuleAccess(acl->rules, acm, peer, FALSE);
-#ifndef NDEBUG
-                    if (acc) {
-                        AJ_InfoPrintf(("Access: 0x%08X %s %s %s %x\n", acm->id, acm->obj, acm->ifn, acm->mbr, acc));
-                    }
-#endif
-                    acm->allow[peer] |= acc;
-                    acm = acm->next;
-                }
+            if (found && rows) {
+                PolicyRowApply(rows + row * g_compiled.numMembers, peer, FALSE, FALSE);
             }
             acl = acl->next;
+            row++;
         }
     }
 
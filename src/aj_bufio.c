@@ -27,6 +27,7 @@
 #include <ajtcl/aj_status.h>
 #include <ajtcl/aj_bufio.h>
 #include <ajtcl/aj_debug.h>
+#include <ajtcl/aj_util.h>
 
 /**
  * Turn on per-module debug printing by setting this variable to non-zero value
@@ -40,6 +41,7 @@ void AJ_IOBufInit(AJ_IOBuffer* ioBuf, uint8_t* buffer, uint32_t bufLen, uint8_t
 {
     ioBuf->bufStart = buffer;
     ioBuf->bufSize = bufLen;
+    ioBuf->bufMax = 0;
     ioBuf->readPtr = buffer;
     ioBuf->writePtr = buffer;
     ioBuf->direction = direction;
@@ -59,3 +61,70 @@ void AJ_IOBufRebase(AJ_IOBuffer* ioBuf, size_t preserve)
     ioBuf->readPtr = ioBuf->bufStart + preserve;
     ioBuf->writePtr = ioBuf->bufStart + preserve + unconsumed;
 }
+
+AJ_Status AJ_IOBufResize(AJ_IOBuffer* ioBuf, uint32_t size, uint32_t bufMax)
+{
+    uint8_t* buffer;
+    uint32_t avail;
+
+    if (!ioBuf->bufMax) {
+        return size ? AJ_ERR_DISALLOWED : AJ_OK;
+    }
+    if (!size) {
+        size = ioBuf->bufSize;
+    }
+    AJ_IOBufRebase(ioBuf, 0);
+    avail = AJ_IO_BUF_AVAIL(ioBuf);
+    if (size < avail) {
+        size = avail;
+    }
+    if (size != ioBuf->bufSize) {
+        buffer = (uint8_t*)AJ_Realloc(ioBuf->bufStart, size);
+        if (!buffer) {
+            AJ_ErrPrintf(("AJ_IOBufResize(): AJ_ERR_RESOURCES\n"));
+            return AJ_ERR_RESOURCES;
+        }
+        ioBuf->bufStart = buffer;
+        ioBuf->bufSize = size;
+        ioBuf->readPtr = buffer;
+        ioBuf->writePtr = buffer + avail;
+    }
+    ioBuf->bufMax = (bufMax > size) ? bufMax : size;
+    return AJ_OK;
+}
+
+AJ_Status AJ_IOBufGrow(AJ_IOBuffer* ioBuf, uint32_t size)
+{
+    uint8_t* buffer;
+    size_t readOffset;
+    size_t writeOffset;
+    uint32_t newSize;
+
+    if (size <= ioBuf->bufSize) {
+        return AJ_OK;
+    }
+    if (size > ioBuf->bufMax) {
+        AJ_ErrPrintf(("AJ_IOBufGrow(): %u bytes exceeds the maximum of %u\n", size, ioBuf->bufMax));
+        return AJ_ERR_RESOURCES;
+    }
+    /*
+     * Grow geometrically so a run of slightly larger messages doesn't reallocate every time
+     */
+    newSize = (ioBuf->bufSize > (ioBuf->bufMax / 2)) ? ioBuf->bufMax : ioBuf->bufSize * 2;
+    if (newSize < size) {
+        newSize = size;
+    }
+    readOffset = ioBuf->readPtr - ioBuf->bufStart;
+    writeOffset = ioBuf->writePtr - ioBuf->bufStart;
+    buffer = (uint8_t*)AJ_Realloc(ioBuf->bufStart, newSize);
+    if (!buffer) {
+        AJ_ErrPrintf(("AJ_IOBufGrow(): AJ_ERR_RESOURCES\n"));
+        return AJ_ERR_RESOURCES;
+    }
+    AJ_InfoPrintf(("AJ_IOBufGrow(): grew buffer from %u to %u bytes\n", ioBuf->bufSize, newSize));
+    ioBuf->bufStart = buffer;
+    ioBuf->bufSize = newSize;
+    ioBuf->readPtr = buffer + readOffset;
+    ioBuf->writePtr = buffer + writeOffset;
+    return AJ_OK;
+}
@@ -915,6 +915,26 @@ AJ_Status AJ_BusEnableSecurity(AJ_BusAttachment* bus, const uint32_t* suites, si
     return AJ_SecurityInit(bus);
 }
 
+void AJ_BusEnableFastHandshake(AJ_BusAttachment* bus, uint8_t enable)
+{
+    AJ_InfoPrintf(("AJ_BusEnableFastHandshake(bus=0x%p, enable=%u)\n", bus, enable));
+
+    bus->fastHandshake = enable ? TRUE : FALSE;
+}
+
+AJ_Status AJ_BusSetBufferSizes(AJ_BusAttachment* bus, uint32_t rxSize, uint32_t txSize, uint32_t maxSize)
+{
+    AJ_Status status;
+
+    AJ_InfoPrintf(("AJ_BusSetBufferSizes(bus=0x%p, rxSize=%u, txSize=%u, maxSize=%u)\n", bus, rxSize, txSize, maxSize));
+
+    status = AJ_IOBufResize(&bus->sock.rx, rxSize, maxSize);
+    if (status == AJ_OK) {
+        status = AJ_IOBufResize(&bus->sock.tx, txSize, maxSize);
+    }
+    return status;
+}
+
 AJ_Session* AJ_BusGetOngoingSession(AJ_BusAttachment* bus, uint32_t sessionId)
 {
     AJ_Session* iter;
@@ -26,6 +26,7 @@
 #include <stdarg.h>
 #include <ajtcl/aj_debug.h>
 #include <ajtcl/aj_cert.h>
+#include <ajtcl/aj_crypto_sha2.h>
 #include <ajtcl/aj_util.h>
 
 /**
@@ -909,10 +910,109 @@ AJ_Status AJ_X509SelfVerify(const X509Certificate* certificate)
     return AJ_X509Verify(certificate, &certificate->tbs.publickey);
 }
 
+#if AJ_CERT_VERIFY_CACHE_SIZE > 0
+/*
+ * Cache of successful certificate signature verifications, so that peers
+ * presenting the same certificate chains on every reconnect do not pay for
+ * the ECDSA verifications again. An entry is the SHA-256 digest of the
+ * verification key, the raw TBS section and the signature: a hit means this
+ * exact certificate has already been verified with this exact key.
+ * Entries are kept in most recently used order and expire after
+ * AJ_CERT_VERIFY_CACHE_TTL milliseconds.
+ */
+typedef struct _VerifyCacheEntry {
+    uint8_t digest[AJ_SHA256_DIGEST_LENGTH];
+    AJ_Time added;
+} VerifyCacheEntry;
+
+static VerifyCacheEntry verifyCache[AJ_CERT_VERIFY_CACHE_SIZE];
+static size_t verifyCacheCount = 0;
+
+static AJ_Status VerifyCacheDigest(const X509Certificate* certificate, const AJ_ECCPublicKey* key, uint8_t* digest)
+{
+    AJ_SHA256_Context* ctx;
+
+    ctx = AJ_SHA256_Init();
+    if (!ctx) {
+        return AJ_ERR_RESOURCES;
+    }
+    AJ_SHA256_Update(ctx, (const uint8_t*) key, sizeof (AJ_ECCPublicKey));
+    AJ_SHA256_Update(ctx, certificate->raw.data, certificate->raw.size);
+    AJ_SHA256_Update(ctx, (const uint8_t*) &certificate->signature, sizeof (AJ_ECCSignature));
+    return AJ_SHA256_Final(ctx, digest);
+}
+
+static uint8_t VerifyCacheLookup(const uint8_t* digest)
+{
+    size_t i;
+    VerifyCacheEntry entry;
+
+    for (i = 0; i < verifyCacheCount; i++) {
+        if (0 == memcmp(verifyCache[i].digest, digest, AJ_SHA256_DIGEST_LENGTH)) {
+            break;
+        }
+    }
+    if (i == verifyCacheCount) {
+        return FALSE;
+    }
+    if (AJ_GetElapsedTime(&verifyCache[i].added, TRUE) > AJ_CERT_VERIFY_CACHE_TTL) {
+        /* Expired, remove the entry */
+        memmove(&verifyCache[i], &verifyCache[i + 1], (verifyCacheCount - i - 1) * sizeof (VerifyCacheEntry));
+        verifyCacheCount--;
+        return FALSE;
+    }
+    /* Move the entry to the front */
+    entry = verifyCache[i];
+    memmove(&verifyCache[1], &verifyCache[0], i * sizeof (VerifyCacheEntry));
+    verifyCache[0] = entry;
+    return TRUE;
+}
+
+static void VerifyCacheInsert(const uint8_t* digest)
+{
+    /* Drop the least recently used entry if full */
+    if (verifyCacheCount < AJ_CERT_VERIFY_CACHE_SIZE) {
+        verifyCacheCount++;
+    }
+    memmove(&verifyCache[1], &verifyCache[0], (verifyCacheCount - 1) * sizeof (VerifyCacheEntry));
+    memcpy(verifyCache[0].digest, digest, AJ_SHA256_DIGEST_LENGTH);
+    AJ_InitTimer(&verifyCache[0].added);
+}
+#endif
+
+void AJ_X509ClearVerifyCache(void)
+{
+#if AJ_CERT_VERIFY_CACHE_SIZE > 0
+    AJ_InfoPrintf(("AJ_X509ClearVerifyCache()\n"));
+    memset(verifyCache, 0, sizeof (verifyCache));
+    verifyCacheCount = 0;
+#endif
+}
+
 AJ_Status AJ_X509Verify(const X509Certificate* certificate, const AJ_ECCPublicKey* key)
 {
+    AJ_Status status;
+#if AJ_CERT_VERIFY_CACHE_SIZE > 0
+    uint8_t digest[AJ_SHA256_DIGEST_LENGTH];
+    uint8_t cacheable;
+#endif
+
     AJ_InfoPrintf(("AJ_X509Verify(certificate=%p, key=%p)\n", certificate, key));
-    return AJ_ECDSAVerify(certificate->raw.data, certificate->raw.size, &certificate->signature, key);
+
+#if AJ_CERT_VERIFY_CACHE_SIZE > 0
+    cacheable = (AJ_OK == VerifyCacheDigest(certificate, key, digest));
+    if (cacheable && VerifyCacheLookup(digest)) {
+        AJ_InfoPrintf(("AJ_X509Verify(certificate=%p, key=%p): Previously verified\n", certificate, key));
+        return AJ_OK;
+    }
+#endif
+    status = AJ_ECDSAVerify(certificate->raw.data, certificate->raw.size, &certificate->signature, key);
+#if AJ_CERT_VERIFY_CACHE_SIZE > 0
+    if ((AJ_OK == status) && cacheable) {
+        VerifyCacheInsert(digest);
+    }
+#endif
+    return status;
 }
 
 AJ_Status AJ_X509VerifyChain(const X509CertificateChain* root, const AJ_ECCPublicKey* key, uint32_t type)
@@ -151,21 +151,50 @@ static AJ_Status WriteLine(AJ_IOBuffer* txBuf, const char* line)
     return txBuf->send(txBuf);
 }
 
+/*
+ * Send the NUL byte that starts the SASL exchange and choose the mechanism. Over a unix domain
+ * socket the NUL byte carries our credentials and we authenticate with EXTERNAL.
+ */
+static AJ_Status SendNulByte(AJ_BusAttachment* bus, char* mechanism)
+{
+#if defined(__linux) && defined(AJ_TCP)
+    uint32_t uid;
+    AJ_Status status = AJ_Net_SendCredentials(&bus->sock, &uid);
+
+    if (status != AJ_ERR_DISALLOWED) {
+        if (status == AJ_OK) {
+            /* The EXTERNAL response is the user id as a decimal string, hex encoded */
+            char id[11];
+            snprintf(id, sizeof(id), "%u", uid);
+            strcpy(mechanism, "AUTH EXTERNAL ");
+            AJ_RawToHex((const uint8_t*)id, strlen(id), mechanism + strlen(mechanism), 2 * sizeof(id), TRUE);
+            strcat(mechanism, "\n");
+        }
+        return status;
+    }
+#endif
+    strcpy(mechanism, "AUTH ANONYMOUS\n");
+    bus->sock.tx.writePtr[0] = 0;
+    bus->sock.tx.writePtr += 1;
+    return bus->sock.tx.send(&bus->sock.tx);
+}
+
 /**
  * Since the routing node expects any of its clients to use SASL with Anonymous
  * or PINX in order to connect, this method will send the necessary SASL
  * Anonymous exchange in order to connect.  PINX is no longer supported on the
  * Thin Client.  All thin clients will connect as untrusted clients to the
- * routing node.
+ * routing node, except over a unix domain socket where the routing node
+ * authenticates the client with EXTERNAL from the credentials it was sent.
  */
-static AJ_Status AnonymousAuthAdvance(AJ_IOBuffer* rxBuf, AJ_IOBuffer* txBuf)
+static AJ_Status AuthAdvance(AJ_IOBuffer* rxBuf, AJ_IOBuffer* txBuf, const char* mechanism)
 {
     AJ_Status status = AJ_OK;
     AJ_GUID localGuid;
     char buf[40];
 
-    /* initiate the SASL exchange with AUTH ANONYMOUS */
-    status = WriteLine(txBuf, "AUTH ANONYMOUS\n");
+    /* initiate the SASL exchange with AUTH ANONYMOUS or AUTH EXTERNAL */
+    status = WriteLine(txBuf, mechanism);
     ResetRead(rxBuf);
 
     if (status == AJ_OK) {
@@ -197,7 +226,7 @@ static AJ_Status AnonymousAuthAdvance(AJ_IOBuffer* rxBuf, AJ_IOBuffer* txBuf)
     if (status == AJ_OK) {
         routingProtoVersion = atoi((const char*)(rxBuf->readPtr + strlen("INFORM_PROTO_VERSION") + 1));
         if (routingProtoVersion < AJ_GetMinProtoVersion()) {
-            AJ_InfoPrintf(("AnonymousAuthAdvance():: Found version %u but minimum %u required", routingProtoVersion, AJ_GetMinProtoVersion()));
+            AJ_InfoPrintf(("AuthAdvance():: Found version %u but minimum %u required", routingProtoVersion, AJ_GetMinProtoVersion()));
             status = AJ_ERR_OLD_VERSION;
         }
     }
@@ -213,7 +242,7 @@ static AJ_Status AnonymousAuthAdvance(AJ_IOBuffer* rxBuf, AJ_IOBuffer* txBuf)
     }
 
     if (status != AJ_OK) {
-        AJ_ErrPrintf(("AnonymousAuthAdvance(): status=%s\n", AJ_StatusText(status)));
+        AJ_ErrPrintf(("AuthAdvance(): status=%s\n", AJ_StatusText(status)));
     }
 
     return status;
@@ -273,6 +302,9 @@ AJ_Status AJ_Authenticate(AJ_BusAttachment* bus)
 {
     AJ_Status status = AJ_OK;
     AJ_Message helloResponse;
+#if defined(AJ_TCP) || defined(AJ_SERIAL_CONNECTION)
+    char mechanism[40];
+#endif
 
     if (bus->isAuthenticated) {
         // ARDP does not do SASL and it sends BusHello as part of the SYN message.
@@ -285,16 +317,14 @@ AJ_Status AJ_Authenticate(AJ_BusAttachment* bus)
     /*
      * Send initial NUL byte
      */
-    bus->sock.tx.writePtr[0] = 0;
-    bus->sock.tx.writePtr += 1;
-    status = bus->sock.tx.send(&bus->sock.tx);
+    status = SendNulByte(bus, mechanism);
     if (status != AJ_OK) {
         AJ_ErrPrintf(("AJ_Authenticate(): status=%s\n", AJ_StatusText(status)));
         goto ExitConnect;
     }
 
-    /* Use SASL Anonymous to connect to routing node */
-    status = AnonymousAuthAdvance(&bus->sock.rx, &bus->sock.tx);
+    /* Use SASL to connect to routing node */
+    status = AuthAdvance(&bus->sock.rx, &bus->sock.tx, mechanism);
     if (status == AJ_OK) {
         status = SendHello(bus);
     }
@@ -384,7 +414,10 @@ AJ_Status AJ_FindBusAndConnect(AJ_BusAttachment* bus, const char* serviceName, u
 #if HOST_IS_BIG_ENDIAN
         service.ipv4 = 0x7f000001; // 127.0.0.1
 #endif
-        service.addrTypes = AJ_ADDR_TCP4;
+        /*
+         * Prefer the routing node's unix domain socket on targets that support it
+         */
+        service.addrTypes = AJ_ADDR_UNIX | AJ_ADDR_TCP4;
 #elif defined(ARDUINO)
         service.ipv4port = 9955;
         service.ipv4 = 0x6501A8C0; // 192.168.1.101
@@ -597,7 +630,7 @@ void AJ_Disconnect(AJ_BusAttachment* bus)
     /*
      * We won't be getting any more method replies.
      */
-    AJ_ReleaseReplyContexts();
+    AJ_ReleaseReplyContexts(bus);
 
     /*
      * Disconnect the network closing sockets etc.
@@ -616,6 +649,11 @@ void AJ_Disconnect(AJ_BusAttachment* bus)
      */
     AJ_ClearAuthContext();
 
+    /*
+     * Persist peer secrets that were only saved in RAM
+     */
+    AJ_CredentialFlushPeers();
+
     /*
      * Clear sent manifests flag
      */
@@ -32,6 +32,7 @@
 #include <ajtcl/aj_config.h>
 #include <ajtcl/aj_crypto_sha2.h>
 #include <ajtcl/aj_cert.h>
+#include "aj_target_nvram.h"
 
 /**
  * Turn on per-module debug printing by setting this variable to non-zero value
@@ -41,6 +42,283 @@
 uint8_t dbgCREDS = 0;
 #endif
 
+#if AJ_PEER_CACHE_SIZE > 0
+/*
+ * Session resumption reads the peer master secret and identity thumbprint.
+ * Recently used ones are kept in RAM, along with knowing that a peer has none,
+ * so resuming a session with a recent peer doesn't scan NVRAM. Writes are
+ * deferred until an entry is evicted or AJ_CredentialFlushPeers() is called.
+ */
+typedef struct _PeerCacheEntry {
+    uint16_t type;                       /* Credential type, zero if unused */
+    uint16_t size;                       /* Data size, zero if the peer has no such credential */
+    uint32_t expiration;
+    uint8_t dirty;                       /* Not yet written to NVRAM */
+    AJ_GUID guid;
+    uint8_t data[AJ_MASTER_SECRET_LEN];
+} PeerCacheEntry;
+
+/* Most recently used first */
+static PeerCacheEntry peerCache[AJ_PEER_CACHE_SIZE];
+static uint32_t peerCacheGeneration;
+
+static uint8_t PeerCacheable(uint16_t type, const AJ_CredField* id)
+{
+    if ((NULL == id) || (sizeof (AJ_GUID) != id->size)) {
+        return FALSE;
+    }
+    return ((AJ_GENERIC_MASTER_SECRET | AJ_CRED_TYPE_GENERIC) == type) ||
+           ((AJ_GENERIC_ECDSA_THUMBPRINT | AJ_CRED_TYPE_GENERIC) == type);
+}
+
+/*
+ * Entries only hold what NVRAM held, or will hold once written back. If NVRAM
+ * was cleared, reloaded or a transaction aborted they are all stale, so forget
+ * them without writing anything back.
+ */
+static void PeerCacheSync(void)
+{
+    if (peerCacheGeneration != _AJ_NVRAM_Generation()) {
+        AJ_MemZeroSecure(peerCache, sizeof (peerCache));
+        peerCacheGeneration = _AJ_NVRAM_Generation();
+    }
+}
+
+/*
+ * Move entry i to the front, shifting the more recently used ones down
+ */
+static PeerCacheEntry* PeerCacheTouch(size_t i)
+{
+    PeerCacheEntry entry;
+
+    if (i) {
+        memcpy(&entry, &peerCache[i], sizeof (entry));
+        memmove(&peerCache[1], &peerCache[0], i * sizeof (PeerCacheEntry));
+        memcpy(&peerCache[0], &entry, sizeof (entry));
+        AJ_MemZeroSecure(&entry, sizeof (entry));
+    }
+    return &peerCache[0];
+}
+
+static PeerCacheEntry* PeerCacheFind(uint16_t type, const AJ_CredField* id)
+{
+    size_t i;
+
+    PeerCacheSync();
+    for (i = 0; i < ArraySize(peerCache); i++) {
+        if ((type == peerCache[i].type) && (0 == memcmp(&peerCache[i].guid, id->data, sizeof (AJ_GUID)))) {
+            return PeerCacheTouch(i);
+        }
+    }
+    return NULL;
+}
+
+static AJ_Status PeerCacheWriteBack(PeerCacheEntry* entry)
+{
+    AJ_Status status = AJ_OK;
+    AJ_CredField id;
+    AJ_CredField data;
+
+    if (entry->dirty) {
+        id.size = sizeof (AJ_GUID);
+        id.data = (uint8_t*) &entry->guid;
+        data.size = entry->size;
+        data.data = entry->data;
+        status = AJ_CredentialSet(entry->type, &id, entry->expiration, &data);
+        if (AJ_OK == status) {
+            entry->dirty = FALSE;
+        } else {
+            AJ_WarnPrintf(("PeerCacheWriteBack(entry=%p): Write failed %s\n", entry, AJ_StatusText(status)));
+        }
+    }
+    return status;
+}
+
+static PeerCacheEntry* PeerCacheInsert(uint16_t type, const AJ_CredField* id)
+{
+    PeerCacheEntry* entry;
+    size_t i;
+
+    /*
+     * Use a free entry, or evict the least recently used one that is clean or can be
+     * written back. A secret that can't be written stays cached and nothing is inserted.
+     */
+    PeerCacheSync();
+    for (i = 0; i < ArraySize(peerCache); i++) {
+        if (!peerCache[i].type) {
+            break;
+        }
+    }
+    if (i == ArraySize(peerCache)) {
+        while (i && (AJ_OK != PeerCacheWriteBack(&peerCache[i - 1]))) {
+            --i;
+        }
+        if (!i) {
+            AJ_WarnPrintf(("PeerCacheInsert(): No entry can be evicted\n"));
+            return NULL;
+        }
+        --i;
+    }
+    entry = PeerCacheTouch(i);
+    AJ_MemZeroSecure(entry, sizeof (PeerCacheEntry));
+    entry->type = type;
+    memcpy(&entry->guid, id->data, sizeof (AJ_GUID));
+    return entry;
+}
+
+/*
+ * Forget entries matching type (0 for all) and id (NULL for all)
+ */
+static void PeerCacheDrop(uint16_t type, const AJ_CredField* id)
+{
+    size_t i;
+
+    PeerCacheSync();
+    for (i = 0; i < ArraySize(peerCache); i++) {
+        if (!peerCache[i].type) {
+            continue;
+        }
+        if (type && (type != peerCache[i].type)) {
+            continue;
+        }
+        if (id && ((sizeof (AJ_GUID) != id->size) || memcmp(&peerCache[i].guid, id->data, sizeof (AJ_GUID)))) {
+            continue;
+        }
+        AJ_MemZeroSecure(&peerCache[i], sizeof (PeerCacheEntry));
+    }
+}
+#endif
+
+/*
+ * RAM index of the credential slots holding the type, a hash of the id and
+ * the expiration of each credential. Lookups only open the slots that match
+ * the type and id hash, eviction and free slot search don't touch NVRAM.
+ * Occupied slots are chained in hash buckets, free slots in a free list.
+ * The index is built on first use and rebuilt if the NVRAM is cleared or
+ * reloaded behind our back.
+ */
+typedef struct _CredIndexEntry {
+    uint16_t type;             /* Credential type, zero if the slot is free */
+    uint16_t next;             /* Index + 1 of the next entry in the bucket or free list */
+    uint32_t hash;             /* Hash of the credential id */
+    uint32_t expiration;
+} CredIndexEntry;
+
+#define CRED_INDEX_BUCKETS 16
+#define CRED_TYPE_UNKNOWN  0xFFFF  /* Slot exists but can't be read */
+
+static CredIndexEntry credIndex[AJ_MAX_CREDS];
+static uint16_t credBuckets[CRED_INDEX_BUCKETS];
+static uint16_t credFree;
+static uint8_t credIndexValid = FALSE;
+static uint32_t credGeneration;
+
+static AJ_Status CredFieldRead(AJ_CredField* field, AJ_NV_DATASET* handle);
+
+static uint32_t CredIndexHash(const AJ_CredField* id)
+{
+    uint32_t hash = 2166136261u;
+    uint16_t i;
+
+    if (id) {
+        for (i = 0; i < id->size; i++) {
+            hash = (hash ^ id->data[i]) * 16777619u;
+        }
+    }
+    return hash;
+}
+
+static uint16_t* CredIndexBucket(uint16_t type, uint32_t hash)
+{
+    return &credBuckets[(hash ^ type) % CRED_INDEX_BUCKETS];
+}
+
+/*
+ * Unlink entry i from whichever list it is on
+ */
+static void CredIndexUnlink(uint16_t i)
+{
+    uint16_t* link;
+
+    if (credIndex[i].type) {
+        link = CredIndexBucket(credIndex[i].type, credIndex[i].hash);
+    } else {
+        link = &credFree;
+    }
+    while (*link && (*link != i + 1)) {
+        link = &credIndex[*link - 1].next;
+    }
+    if (*link) {
+        *link = credIndex[i].next;
+    }
+    credIndex[i].next = 0;
+}
+
+static void CredIndexLink(uint16_t i)
+{
+    uint16_t* link;
+
+    if (credIndex[i].type) {
+        link = CredIndexBucket(credIndex[i].type, credIndex[i].hash);
+    } else {
+        link = &credFree;
+    }
+    credIndex[i].next = *link;
+    *link = i + 1;
+}
+
+static void CredIndexSet(uint16_t slot, uint16_t type, uint32_t hash, uint32_t expiration)
+{
+    uint16_t i = slot - AJ_CREDS_NV_ID_BEGIN;
+
+    if (credIndexValid && (i < AJ_MAX_CREDS)) {
+        CredIndexUnlink(i);
+        credIndex[i].type = type;
+        credIndex[i].hash = hash;
+        credIndex[i].expiration = expiration;
+        CredIndexLink(i);
+    }
+}
+
+static void CredIndexSync(void)
+{
+    AJ_NV_DATASET* handle;
+    AJ_CredField id;
+    uint16_t i;
+
+    if (credIndexValid && (credGeneration == _AJ_NVRAM_Generation())) {
+        return;
+    }
+    AJ_InfoPrintf(("CredIndexSync(): Building credential index\n"));
+    memset(credBuckets, 0, sizeof (credBuckets));
+    credFree = 0;
+    /* Walk backwards so lists hand out the lowest slots first */
+    for (i = AJ_MAX_CREDS; i-- > 0;) {
+        memset(&credIndex[i], 0, sizeof (CredIndexEntry));
+        if (AJ_NVRAM_Exist(AJ_CREDS_NV_ID_BEGIN + i)) {
+            credIndex[i].type = CRED_TYPE_UNKNOWN;
+            handle = AJ_NVRAM_Open(AJ_CREDS_NV_ID_BEGIN + i, "r", 0);
+            if (handle) {
+                id.size = 0;
+                id.data = NULL;
+                if ((sizeof (uint16_t) == AJ_NVRAM_Read(&credIndex[i].type, sizeof (uint16_t), handle)) &&
+                    (AJ_OK == CredFieldRead(&id, handle)) &&
+                    (sizeof (uint32_t) == AJ_NVRAM_Read(&credIndex[i].expiration, sizeof (uint32_t), handle))) {
+                    credIndex[i].hash = CredIndexHash(&id);
+                }
+                AJ_CredFieldFree(&id);
+                AJ_NVRAM_Close(handle);
+            }
+            if (!credIndex[i].type) {
+                credIndex[i].type = CRED_TYPE_UNKNOWN;
+            }
+        }
+        CredIndexLink(i);
+    }
+    credGeneration = _AJ_NVRAM_Generation();
+    credIndexValid = TRUE;
+}
+
 static AJ_Status CredValueRead(uint8_t* data, size_t size, AJ_NV_DATASET* handle)
 {
     return (size == AJ_NVRAM_Read(data, size, handle)) ? AJ_OK : AJ_ERR_FAILURE;
@@ -137,93 +415,101 @@ static uint16_t CredentialSize(uint16_t type, const AJ_CredField* id, uint32_t e
 
 static uint16_t FindCredsEmptySlot()
 {
-    uint16_t id = AJ_CREDS_NV_ID_BEGIN;
-
-    for (; id < AJ_CREDS_NV_ID_END; id++) {
-        if (!AJ_NVRAM_Exist(id)) {
-            return id;
-        }
-    }
-
-    return 0;
+    CredIndexSync();
+    return credFree ? AJ_CREDS_NV_ID_BEGIN + credFree - 1 : 0;
 }
 
-static uint16_t CredentialFind(uint16_t type, const AJ_CredField* id, uint32_t* expiration, AJ_CredField* data, uint16_t slot)
+/*
+ * Check the credential in a slot whose type and id hash match, reading the
+ * requested fields. Returns AJ_ERR_NO_MATCH if the id differs.
+ */
+static AJ_Status CredentialMatch(uint16_t slot, const AJ_CredField* id, uint32_t* expiration, AJ_CredField* data)
 {
     AJ_Status status;
     AJ_NV_DATASET* handle;
     uint32_t exp;
     uint16_t value;
     AJ_CredField field;
-    uint8_t found;
 
-    for (; slot < AJ_CREDS_NV_ID_END; slot++) {
-        if (!AJ_NVRAM_Exist(slot)) {
-            continue;
-        }
-        handle = AJ_NVRAM_Open(slot, "r", 0);
-        if (!handle) {
-            continue;
+    handle = AJ_NVRAM_Open(slot, "r", 0);
+    if (!handle) {
+        return AJ_ERR_NO_MATCH;
+    }
+    /* Skip type */
+    status = CredValueRead((uint8_t*) &value, sizeof (uint16_t), handle);
+    if (AJ_OK != status) {
+        goto Exit;
+    }
+    /* Read id */
+    field.data = NULL;
+    status = CredFieldRead(&field, handle);
+    if (AJ_OK != status) {
+        goto Exit;
+    }
+    /* Compare id */
+    if (id) {
+        if ((field.size != id->size) || (0 != memcmp(field.data, id->data, field.size))) {
+            status = AJ_ERR_NO_MATCH;
         }
-        /* Read type */
-        status = CredValueRead((uint8_t*) &value, sizeof (uint16_t), handle);
-        if (AJ_OK != status) {
-            AJ_NVRAM_Close(handle);
-            return 0;
+    }
+    AJ_CredFieldFree(&field);
+    if ((AJ_OK != status) || ((NULL == expiration) && (NULL == data))) {
+        goto Exit;
+    }
+    status = CredValueRead((uint8_t*) &exp, sizeof (uint32_t), handle);
+    if (AJ_OK != status) {
+        goto Exit;
+    }
+    if (expiration) {
+        *expiration = exp;
+    }
+    if (data) {
+        status = CredFieldRead(data, handle);
+    }
+
+Exit:
+    AJ_NVRAM_Close(handle);
+    return status;
+}
+
+static uint16_t CredentialFind(uint16_t type, const AJ_CredField* id, uint32_t* expiration, AJ_CredField* data, uint16_t slot)
+{
+    AJ_Status status;
+    uint32_t hash = CredIndexHash(id);
+    uint8_t chained;
+    uint16_t i;
+    uint16_t next = 0;
+
+    CredIndexSync();
+    if (slot < AJ_CREDS_NV_ID_BEGIN) {
+        slot = AJ_CREDS_NV_ID_BEGIN;
+    }
+    /* A search from the start for an id only needs the id's bucket */
+    chained = id && (AJ_CREDS_NV_ID_BEGIN == slot);
+    if (chained) {
+        next = *CredIndexBucket(type, hash);
+    }
+    while (chained ? (next != 0) : (slot < AJ_CREDS_NV_ID_END)) {
+        if (chained) {
+            i = next - 1;
+            next = credIndex[i].next;
+        } else {
+            i = slot++ - AJ_CREDS_NV_ID_BEGIN;
         }
-        /* Compare type */
-        if (value != type) {
-            AJ_NVRAM_Close(handle);
+        if ((credIndex[i].type != type) || (id && (credIndex[i].hash != hash))) {
             continue;
         }
         if ((NULL == id) && (NULL == expiration) && (NULL == data)) {
             /* No more fields requested */
-            AJ_NVRAM_Close(handle);
-            return slot;
-        }
-        /* Read id */
-        field.data = NULL;
-        status = CredFieldRead(&field, handle);
-        if (AJ_OK != status) {
-            AJ_NVRAM_Close(handle);
-            return 0;
-        }
-        /* Compare id */
-        found = 1;
-        if (id) {
-            if ((field.size != id->size) || (0 != memcmp(field.data, id->data, field.size))) {
-                found = 0;
-            }
-        }
-        AJ_CredFieldFree(&field);
-        if (!found) {
-            AJ_NVRAM_Close(handle);
-            continue;
-        }
-        if ((NULL == expiration) && (NULL == data)) {
-            /* No more fields requested */
-            AJ_NVRAM_Close(handle);
-            return slot;
-        }
-        status = CredValueRead((uint8_t*) &exp, sizeof (uint32_t), handle);
-        if (AJ_OK != status) {
-            AJ_NVRAM_Close(handle);
-            return 0;
+            return AJ_CREDS_NV_ID_BEGIN + i;
         }
-        if (expiration) {
-            *expiration = exp;
-        }
-        if (NULL == data) {
-            /* No more fields requested */
-            AJ_NVRAM_Close(handle);
-            return slot;
+        status = CredentialMatch(AJ_CREDS_NV_ID_BEGIN + i, id, expiration, data);
+        if (AJ_OK == status) {
+            return AJ_CREDS_NV_ID_BEGIN + i;
         }
-        status = CredFieldRead(data, handle);
-        AJ_NVRAM_Close(handle);
-        if (AJ_OK != status) {
+        if (AJ_ERR_NO_MATCH != status) {
             return 0;
         }
-        return slot;
     }
 
     return 0; /* not found */
@@ -231,58 +517,28 @@ static uint16_t CredentialFind(uint16_t type, const AJ_CredField* id, uint32_t*
 
 static AJ_Status DeleteOldestCredential(uint16_t* deleted)
 {
-    AJ_Status status = AJ_ERR_INVALID;
-    AJ_NV_DATASET* handle;
-    uint16_t slot = AJ_CREDS_NV_ID_BEGIN;
+    AJ_Status status;
+    uint16_t i;
     uint16_t oldestslot = 0;
     uint32_t oldestexp = 0xFFFFFFFF;
-    uint16_t type;
-    AJ_CredField id;
-    uint32_t expiration;
 
     AJ_InfoPrintf(("DeleteOldestCredential(deleted=%p)\n", deleted));
 
-    for (; slot < AJ_CREDS_NV_ID_END; slot++) {
-        if (!AJ_NVRAM_Exist(slot)) {
-            continue;
-        }
-        handle = AJ_NVRAM_Open(slot, "r", 0);
-        if (!handle) {
-            continue;
-        }
-        status = CredValueRead((uint8_t*) &type, sizeof (uint16_t), handle);
-        if (AJ_OK != status) {
-            AJ_NVRAM_Close(handle);
-            continue;
-        }
-        if (AJ_CRED_TYPE_GENERIC != type) {
-            AJ_NVRAM_Close(handle);
-            continue;
-        }
-        /* Read id */
-        id.size = 0;
-        id.data = NULL;
-        status = CredFieldRead(&id, handle);
-        AJ_CredFieldFree(&id);
-        if (AJ_OK != status) {
-            AJ_NVRAM_Close(handle);
-            continue;
-        }
-        status = CredValueRead((uint8_t*) &expiration, sizeof (uint32_t), handle);
-        if (AJ_OK != status) {
-            AJ_NVRAM_Close(handle);
+    CredIndexSync();
+    for (i = 0; i < AJ_MAX_CREDS; i++) {
+        if (AJ_CRED_TYPE_GENERIC != credIndex[i].type) {
             continue;
         }
         /* If older */
-        if (expiration <= oldestexp) {
-            oldestexp = expiration;
-            oldestslot = slot;
+        if (credIndex[i].expiration <= oldestexp) {
+            oldestexp = credIndex[i].expiration;
+            oldestslot = AJ_CREDS_NV_ID_BEGIN + i;
         }
     }
 
     if (oldestslot) {
         AJ_InfoPrintf(("DeleteOldestCredential(deleted=%p): slot=%d exp=%08X\n", deleted, oldestslot, oldestexp));
-        status = AJ_CredentialDeleteSlot(type, oldestslot);
+        status = AJ_CredentialDeleteSlot(AJ_CRED_TYPE_GENERIC, oldestslot);
         if (AJ_OK != status) {
             AJ_ErrPrintf(("AJ_CredentialDeleteSlot() failed, status=%s\n", AJ_StatusText(status)));
         } else {
@@ -303,8 +559,11 @@ static AJ_Status CredentialWrite(uint16_t type, const AJ_CredField* id, uint32_t
     AJ_InfoPrintf(("CredentialWrite(type=%04x, id=%p, expiration=%08x, data=%p, slot=%d)\n", type, id, expiration, data, slot));
 
     size = CredentialSize(type, id, expiration, data);
+    /* A credential is written field by field, make the fields land together */
+    AJ_NVRAM_BeginTransaction();
     handle = AJ_NVRAM_Open(slot, "w", size);
     if (!handle) {
+        AJ_NVRAM_AbortTransaction();
         return AJ_ERR_FAILURE;
     }
     status = CredValueWrite((uint8_t*) &type, sizeof (uint16_t), handle);
@@ -326,6 +585,17 @@ static AJ_Status CredentialWrite(uint16_t type, const AJ_CredField* id, uint32_t
 
 Exit:
     AJ_NVRAM_Close(handle);
+    if (AJ_OK == status) {
+        status = AJ_NVRAM_CommitTransaction();
+    } else {
+        AJ_NVRAM_AbortTransaction();
+    }
+    if (AJ_OK == status) {
+        CredIndexSet(slot, type, CredIndexHash(id), expiration);
+    } else {
+        /* The slot is in an unknown state */
+        credIndexValid = FALSE;
+    }
 
     return status;
 }
@@ -337,6 +607,9 @@ AJ_Status AJ_CredentialRead(uint16_t* type, AJ_CredField* id, uint32_t* expirati
 
     AJ_InfoPrintf(("AJ_CredentialRead(type=%p, id=%p, expiration=%p, data=%p, slot=%d)\n", type, id, expiration, data, slot));
 
+    /* Slots are only meaningful once deferred writes are in NVRAM */
+    AJ_CredentialFlushPeers();
+
     handle = AJ_NVRAM_Open(slot, "r", 0);
     if (!handle) {
         return AJ_ERR_FAILURE;
@@ -404,6 +677,7 @@ AJ_Status AJ_CredentialGet(uint16_t type, const AJ_CredField* id, uint32_t* expi
 AJ_Status AJ_CredentialGetNext(uint16_t type, const AJ_CredField* id, uint32_t* expiration, AJ_CredField* data, uint16_t* slot)
 {
     AJ_InfoPrintf(("AJ_CredentialGet(type=%04x, id=%p, expiration=%p, data=%p)\n", type, id, expiration, data));
+    AJ_CredentialFlushPeers();
     *slot = CredentialFind(type, id, expiration, data, *slot);
     return *slot ? AJ_OK : AJ_ERR_UNKNOWN;
 }
@@ -479,11 +753,31 @@ AJ_Status AJ_CredentialSetPeer(uint16_t type, const AJ_GUID* guid, uint32_t expi
     AJ_CredField id;
     AJ_CredField data;
     AJ_Status status;
+#if AJ_PEER_CACHE_SIZE > 0
+    PeerCacheEntry* entry;
+#endif
 
     AJ_InfoPrintf(("AJ_CredentialSetPeer(guid=%p, expiration=%08X, secret=%p, size=%d)\n", guid, expiration, secret, size));
 
     id.size = sizeof (AJ_GUID);
     id.data = (uint8_t*) guid;
+#if AJ_PEER_CACHE_SIZE > 0
+    if (PeerCacheable(type | AJ_CRED_TYPE_GENERIC, &id) && size && (size <= sizeof (entry->data))) {
+        entry = PeerCacheFind(type | AJ_CRED_TYPE_GENERIC, &id);
+        if (NULL == entry) {
+            entry = PeerCacheInsert(type | AJ_CRED_TYPE_GENERIC, &id);
+        }
+        if (entry) {
+            entry->size = size;
+            entry->expiration = expiration;
+            memcpy(entry->data, secret, size);
+            entry->dirty = TRUE;
+            return AJ_OK;
+        }
+    }
+    /* Not cached, make sure a stale entry doesn't shadow it */
+    PeerCacheDrop(type | AJ_CRED_TYPE_GENERIC, &id);
+#endif
     data.size = size;
     data.data = (uint8_t*) secret;
     status = AJ_CredentialSet(type | AJ_CRED_TYPE_GENERIC, &id, expiration, &data);
@@ -494,13 +788,75 @@ AJ_Status AJ_CredentialSetPeer(uint16_t type, const AJ_GUID* guid, uint32_t expi
 AJ_Status AJ_CredentialGetPeer(uint16_t type, const AJ_GUID* guid, uint32_t* expiration, AJ_CredField* data)
 {
     AJ_CredField id;
+#if AJ_PEER_CACHE_SIZE > 0
+    AJ_Status status;
+    PeerCacheEntry* entry;
+    uint32_t exp;
+#endif
 
     id.size = sizeof (AJ_GUID);
     id.data = (uint8_t*) guid;
 
+#if AJ_PEER_CACHE_SIZE > 0
+    if (PeerCacheable(type | AJ_CRED_TYPE_GENERIC, &id)) {
+        entry = PeerCacheFind(type | AJ_CRED_TYPE_GENERIC, &id);
+        if (NULL == entry) {
+            status = AJ_CredentialGet(type | AJ_CRED_TYPE_GENERIC, &id, &exp, data);
+            if ((AJ_OK == status) && expiration) {
+                *expiration = exp;
+            }
+            /* Remember what NVRAM holds, including that it holds nothing */
+            if (data && ((AJ_ERR_UNKNOWN == status) || ((AJ_OK == status) && data->size && (data->size <= sizeof (entry->data))))) {
+                entry = PeerCacheInsert(type | AJ_CRED_TYPE_GENERIC, &id);
+                if (entry && (AJ_OK == status)) {
+                    entry->size = data->size;
+                    entry->expiration = exp;
+                    memcpy(entry->data, data->data, data->size);
+                }
+            }
+            return status;
+        }
+        if (!entry->size) {
+            return AJ_ERR_UNKNOWN;
+        }
+        if (expiration) {
+            *expiration = entry->expiration;
+        }
+        if (data) {
+            if (NULL == data->data) {
+                data->data = (uint8_t*) AJ_Malloc(entry->size);
+                if (NULL == data->data) {
+                    return AJ_ERR_RESOURCES;
+                }
+                data->size = entry->size;
+            }
+            if (data->size < entry->size) {
+                return AJ_ERR_RESOURCES;
+            }
+            memcpy(data->data, entry->data, entry->size);
+            data->size = entry->size;
+        }
+        return AJ_OK;
+    }
+#endif
+
     return AJ_CredentialGet(type | AJ_CRED_TYPE_GENERIC, &id, expiration, data);
 }
 
+void AJ_CredentialFlushPeers(void)
+{
+#if AJ_PEER_CACHE_SIZE > 0
+    size_t i;
+
+    PeerCacheSync();
+    for (i = 0; i < ArraySize(peerCache); i++) {
+        if (peerCache[i].type) {
+            PeerCacheWriteBack(&peerCache[i]);
+        }
+    }
+#endif
+}
+
 AJ_Status AJ_CredentialSetECCPublicKey(uint16_t type, const AJ_CredField* id, uint32_t expiration, const AJ_ECCPublicKey* pub)
 {
     AJ_CredField data;
@@ -541,10 +897,37 @@ AJ_Status AJ_CredentialGetECCPrivateKey(uint16_t type, const AJ_CredField* id, u
     return AJ_CredentialGet(type | AJ_CRED_TYPE_PRIVATE, id, NULL, &data);
 }
 
+#if AJ_PEER_CACHE_SIZE > 0
+/*
+ * Forget the cached copy of the peer credential held in a slot
+ */
+static void PeerCacheDropSlot(uint16_t slot)
+{
+    AJ_NV_DATASET* handle;
+    AJ_GUID guid;
+    AJ_CredField id;
+    uint16_t type;
+
+    handle = AJ_NVRAM_Open(slot, "r", 0);
+    if (handle) {
+        id.size = sizeof (AJ_GUID);
+        id.data = (uint8_t*) &guid;
+        if ((AJ_OK == CredValueRead((uint8_t*) &type, sizeof (uint16_t), handle)) &&
+            (AJ_OK == CredFieldRead(&id, handle)) && PeerCacheable(type, &id)) {
+            PeerCacheDrop(type, &id);
+        }
+        AJ_NVRAM_Close(handle);
+    }
+}
+#endif
+
 AJ_Status AJ_CredentialDeleteSlot(uint16_t type, uint16_t slot)
 {
     AJ_Status status = AJ_ERR_FAILURE;
     if (slot > 0) {
+#if AJ_PEER_CACHE_SIZE > 0
+        PeerCacheDropSlot(slot);
+#endif
         if ((type == AJ_CRED_TYPE_AES) ||
             (type == AJ_CRED_TYPE_PRIVATE) ||
             (type == AJ_GENERIC_MASTER_SECRET) ||
@@ -553,6 +936,9 @@ AJ_Status AJ_CredentialDeleteSlot(uint16_t type, uint16_t slot)
         } else {
             status = AJ_NVRAM_Delete(slot);
         }
+        if (AJ_OK == status) {
+            CredIndexSet(slot, 0, 0, 0);
+        }
     }
     return status;
 }
@@ -560,9 +946,15 @@ AJ_Status AJ_CredentialDeleteSlot(uint16_t type, uint16_t slot)
 AJ_Status AJ_CredentialDelete(uint16_t type, const AJ_CredField* id)
 {
     AJ_Status status = AJ_ERR_FAILURE;
-    uint16_t slot = CredentialFind(type, id, NULL, NULL, AJ_CREDS_NV_ID_BEGIN);
+    uint16_t slot;
 
     AJ_InfoPrintf(("AJ_CredentialDelete(type=%04x, id=%p)\n", type, id));
+#if AJ_PEER_CACHE_SIZE > 0
+    if (PeerCacheable(type, id)) {
+        PeerCacheDrop(type, id);
+    }
+#endif
+    slot = CredentialFind(type, id, NULL, NULL, AJ_CREDS_NV_ID_BEGIN);
     status = AJ_CredentialDeleteSlot(type, slot);
 
     return status;
@@ -581,38 +973,28 @@ void AJ_CredentialDeletePeer(const AJ_GUID* guid)
 
 AJ_Status AJ_ClearCredentials(uint16_t type)
 {
-    AJ_Status status = AJ_OK;
-    uint16_t slot = AJ_CREDS_NV_ID_BEGIN;
-    uint16_t test;
-    AJ_NV_DATASET* handle;
+    uint16_t i;
 
     AJ_InfoPrintf(("AJ_ClearCredentials(type=%04x)\n", type));
 
-    for (; slot < AJ_CREDS_NV_ID_END; ++slot) {
-        if (!AJ_NVRAM_Exist(slot)) {
+#if AJ_PEER_CACHE_SIZE > 0
+    PeerCacheDrop(type, NULL);
+#endif
+
+    CredIndexSync();
+    for (i = 0; i < AJ_MAX_CREDS; ++i) {
+        if (!credIndex[i].type) {
             continue;
         }
-        if (type) {
-            handle = AJ_NVRAM_Open(slot, "r", 0);
-            if (!handle) {
-                AJ_WarnPrintf(("AJ_ClearCredentials(type=%04x): Error opening slot %d\n", type, slot));
-                continue;
-            }
-            status = CredValueRead((uint8_t*) &test, sizeof (uint16_t), handle);
-            if (AJ_OK != status) {
-                AJ_WarnPrintf(("AJ_ClearCredentials(type=%04x): Error reading slot %d\n", type, slot));
-                AJ_NVRAM_Close(handle);
-                continue;
-            }
-            AJ_NVRAM_Close(handle);
-            if (test != type) {
-                continue;
-            }
+        if (type && (credIndex[i].type != type)) {
+            continue;
+        }
+        if (AJ_OK == AJ_NVRAM_Delete(AJ_CREDS_NV_ID_BEGIN + i)) {
+            CredIndexSet(AJ_CREDS_NV_ID_BEGIN + i, 0, 0, 0);
         }
-        AJ_NVRAM_Delete(slot);
     }
 
-    return status;
+    return AJ_OK;
 }
 
 AJ_Status AJ_CredentialExpired(uint32_t expiration)
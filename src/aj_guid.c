@@ -50,11 +50,34 @@ typedef struct _NameToGUID {
     uint32_t replySerial;
     uint32_t authVersion;
     AJ_SerialNum incoming;
+    uint32_t uniqueHash;
+    uint32_t serviceHash;
 } NameToGUID;
 
 static uint8_t localGroupKey[AJ_SESSION_KEY_LEN];
 
+/*
+ * The name map grows in blocks of AJ_NAME_MAP_GUID_SIZE entries. The
+ * first block is static, further blocks are allocated as peers are
+ * added. Entries never move so a peer's index is a stable handle and
+ * pointers into an entry remain valid until the mapping is deleted.
+ */
+#define NAME_MAP_BLOCKS ((AJ_NAME_MAP_MAX_PEERS + AJ_NAME_MAP_GUID_SIZE - 1) / AJ_NAME_MAP_GUID_SIZE)
+
 static NameToGUID nameMap[AJ_NAME_MAP_GUID_SIZE];
+static NameToGUID* nameBlocks[NAME_MAP_BLOCKS] = { nameMap };
+static uint16_t nameMapSize = AJ_NAME_MAP_GUID_SIZE;
+
+/*
+ * Open addressed hash index over the unique and service names.
+ * Each slot holds an entry index + 1, zero marks an empty slot.
+ * There are four slots per entry so probe sequences stay short.
+ */
+static uint16_t nameIndexBase[4 * AJ_NAME_MAP_GUID_SIZE];
+static uint16_t* nameIndex = nameIndexBase;
+static uint16_t nameIndexSize = 4 * AJ_NAME_MAP_GUID_SIZE;
+
+#define NAME_ENTRY(i) (&nameBlocks[(i) / AJ_NAME_MAP_GUID_SIZE][(i) % AJ_NAME_MAP_GUID_SIZE])
 
 static AJ_Status SetNameOwnerChangedRule(AJ_BusAttachment* bus, const char* oldOwner, uint8_t rule, uint32_t* serialNum);
 static AJ_Status NameHasOwner(AJ_Message* msg, const char* name, uint32_t* serialNum);
@@ -69,35 +92,146 @@ AJ_Status AJ_GUID_FromString(AJ_GUID* guid, const char* str)
     return AJ_HexToRaw(str, 2 * AJ_GUID_LEN, guid->val, AJ_GUID_LEN);
 }
 
-static NameToGUID* LookupName(const char* name)
+/*
+ * FNV-1a hash of a bus name
+ */
+static uint32_t NameHash(const char* name)
 {
-    uint32_t i;
-    AJ_InfoPrintf(("LookupName(name=\"%s\")\n", name));
+    uint32_t hash = 2166136261U;
+
+    while (*name) {
+        hash ^= (uint8_t) *name++;
+        hash *= 16777619U;
+    }
+    return hash;
+}
 
-    for (i = 0; i < AJ_NAME_MAP_GUID_SIZE; ++i) {
-        if (strcmp(nameMap[i].uniqueName, name) == 0) {
-            return &nameMap[i];
+static void NameIndexInsert(uint32_t hash, uint16_t i)
+{
+    uint16_t slot = hash % nameIndexSize;
+
+    while (nameIndex[slot]) {
+        slot = (slot + 1) % nameIndexSize;
+    }
+    nameIndex[slot] = i + 1;
+}
+
+/*
+ * Rebuilds the hash index, this is only needed when an entry is deleted
+ * or the map grows, both of which are rare compared to lookups.
+ */
+static void NameIndexRebuild(void)
+{
+    NameToGUID* mapping;
+    uint16_t i;
+
+    memset(nameIndex, 0, nameIndexSize * sizeof (uint16_t));
+    for (i = 0; i < nameMapSize; ++i) {
+        mapping = NAME_ENTRY(i);
+        if (mapping->uniqueName[0]) {
+            NameIndexInsert(mapping->uniqueHash, i);
+            if (mapping->serviceName) {
+                NameIndexInsert(mapping->serviceHash, i);
+            }
         }
-        if (nameMap[i].serviceName && (strcmp(nameMap[i].serviceName, name)) == 0) {
-            return &nameMap[i];
+    }
+}
+
+static NameToGUID* LookupEntry(const char* name, uint32_t* peer)
+{
+    NameToGUID* mapping;
+    uint32_t hash;
+    uint16_t slot;
+
+    AJ_InfoPrintf(("LookupName(name=\"%s\")\n", name));
+
+    if (*name) {
+        hash = NameHash(name);
+        slot = hash % nameIndexSize;
+        while (nameIndex[slot]) {
+            mapping = NAME_ENTRY(nameIndex[slot] - 1);
+            if ((hash == mapping->uniqueHash) && (strcmp(mapping->uniqueName, name) == 0)) {
+                *peer = nameIndex[slot] - 1;
+                return mapping;
+            }
+            if (mapping->serviceName && (hash == mapping->serviceHash) && (strcmp(mapping->serviceName, name) == 0)) {
+                *peer = nameIndex[slot] - 1;
+                return mapping;
+            }
+            slot = (slot + 1) % nameIndexSize;
         }
     }
     AJ_InfoPrintf(("LookupName(): NULL\n"));
     return NULL;
 }
 
+static NameToGUID* LookupName(const char* name)
+{
+    uint32_t peer;
+
+    return LookupEntry(name, &peer);
+}
+
 static NameToGUID* LookupReplySerial(uint32_t replySerial)
 {
     uint32_t i;
 
-    for (i = 0; i < AJ_NAME_MAP_GUID_SIZE; ++i) {
-        if (nameMap[i].replySerial == replySerial) {
-            return &nameMap[i];
+    for (i = 0; i < nameMapSize; ++i) {
+        if (NAME_ENTRY(i)->replySerial == replySerial) {
+            return NAME_ENTRY(i);
         }
     }
     return NULL;
 }
 
+/*
+ * Adds another block of entries to the name map
+ */
+static AJ_Status NameMapGrow(void)
+{
+    uint16_t block = nameMapSize / AJ_NAME_MAP_GUID_SIZE;
+    uint16_t* index;
+
+    if (block >= NAME_MAP_BLOCKS) {
+        return AJ_ERR_RESOURCES;
+    }
+    nameBlocks[block] = (NameToGUID*) AJ_Malloc(AJ_NAME_MAP_GUID_SIZE * sizeof (NameToGUID));
+    if (!nameBlocks[block]) {
+        return AJ_ERR_RESOURCES;
+    }
+    index = (uint16_t*) AJ_Malloc(4 * (nameMapSize + AJ_NAME_MAP_GUID_SIZE) * sizeof (uint16_t));
+    if (!index) {
+        AJ_Free(nameBlocks[block]);
+        nameBlocks[block] = NULL;
+        return AJ_ERR_RESOURCES;
+    }
+    memset(nameBlocks[block], 0, AJ_NAME_MAP_GUID_SIZE * sizeof (NameToGUID));
+    if (nameIndex != nameIndexBase) {
+        AJ_Free(nameIndex);
+    }
+    nameIndex = index;
+    nameMapSize += AJ_NAME_MAP_GUID_SIZE;
+    nameIndexSize = 4 * nameMapSize;
+    NameIndexRebuild();
+    AJ_InfoPrintf(("NameMapGrow(): %u entries\n", nameMapSize));
+    return AJ_OK;
+}
+
+static NameToGUID* AllocEntry(void)
+{
+    uint16_t i;
+
+    for (i = 0; i < nameMapSize; ++i) {
+        if (!NAME_ENTRY(i)->uniqueName[0]) {
+            return NAME_ENTRY(i);
+        }
+    }
+    if (AJ_OK != NameMapGrow()) {
+        return NULL;
+    }
+    return NAME_ENTRY(i);
+}
+
 AJ_Status AJ_GUID_AddNameMapping(AJ_BusAttachment* bus, const AJ_GUID* guid, const char* uniqueName, const char* serviceName)
 {
     AJ_Status status;
@@ -110,8 +244,8 @@ AJ_Status AJ_GUID_AddNameMapping(AJ_BusAttachment* bus, const AJ_GUID* guid, con
 
     mapping = LookupName(uniqueName);
     isNew = !mapping;
-    if (isNew) {
-        mapping = LookupName("");
+    if (isNew && (len <= AJ_MAX_NAME_SIZE)) {
+        mapping = AllocEntry();
     }
     if (mapping && (len <= AJ_MAX_NAME_SIZE)) {
         if (isNew && (AJ_GetRoutingProtoVersion() >= 11)) {
@@ -125,9 +259,13 @@ AJ_Status AJ_GUID_AddNameMapping(AJ_BusAttachment* bus, const AJ_GUID* guid, con
         }
         memcpy(&mapping->guid, guid, sizeof(AJ_GUID));
         memcpy(&mapping->uniqueName, uniqueName, len + 1);
+        mapping->uniqueHash = NameHash(uniqueName);
         mapping->serviceName = serviceName;
+        mapping->serviceHash = serviceName ? NameHash(serviceName) : 0;
         mapping->incoming.serial = 0;
         mapping->incoming.offset = 0;
+        /* Existing entries may have changed their service name */
+        NameIndexRebuild();
         return AJ_OK;
     } else {
         AJ_ErrPrintf(("AJ_GUID_AddNameMapping(): AJ_ERR_RESOURCES\n"));
@@ -150,6 +288,7 @@ void AJ_GUID_DeleteNameMapping(AJ_BusAttachment* bus, const char* uniqueName)
             }
         }
         memset(mapping, 0, sizeof(NameToGUID));
+        NameIndexRebuild();
     }
 }
 
@@ -164,8 +303,22 @@ const AJ_GUID* AJ_GUID_Find(const char* name)
 
 void AJ_GUID_ClearNameMap(void)
 {
+    uint16_t block;
+
     AJ_InfoPrintf(("AJ_GUID_ClearNameMap()\n"));
+    /* Release all but the static block */
+    for (block = 1; block < NAME_MAP_BLOCKS; ++block) {
+        AJ_Free(nameBlocks[block]);
+        nameBlocks[block] = NULL;
+    }
+    if (nameIndex != nameIndexBase) {
+        AJ_Free(nameIndex);
+        nameIndex = nameIndexBase;
+    }
     memset(nameMap, 0, sizeof(nameMap));
+    memset(nameIndexBase, 0, sizeof(nameIndexBase));
+    nameMapSize = AJ_NAME_MAP_GUID_SIZE;
+    nameIndexSize = 4 * AJ_NAME_MAP_GUID_SIZE;
 }
 
 AJ_Status AJ_SetGroupKey(const char* uniqueName, const uint8_t* key)
@@ -226,10 +379,9 @@ AJ_Status AJ_GetPeerIndex(const char* name, uint32_t* peer)
 
     AJ_InfoPrintf(("AJ_GetPeerIndex(name=\"%s\", peer=%p)\n", name, peer));
 
-    mapping = LookupName(name);
+    mapping = LookupEntry(name, peer);
     if (mapping) {
-        *peer = (mapping - nameMap);
-        AJ_ASSERT(*peer < AJ_NAME_MAP_GUID_SIZE);
+        AJ_ASSERT(*peer < nameMapSize);
         return AJ_OK;
     } else {
         AJ_WarnPrintf(("AJ_GetPeerIndex(name=\"%s\"): AJ_ERR_NO_MATCH\n", name));
@@ -237,6 +389,50 @@ AJ_Status AJ_GetPeerIndex(const char* name, uint32_t* peer)
     }
 }
 
+static NameToGUID* PeerEntry(uint32_t peer)
+{
+    if ((peer < nameMapSize) && NAME_ENTRY(peer)->uniqueName[0]) {
+        return NAME_ENTRY(peer);
+    }
+    AJ_WarnPrintf(("PeerEntry(peer=%u): AJ_ERR_NO_MATCH\n", peer));
+    return NULL;
+}
+
+AJ_Status AJ_GetPeerSessionKey(uint32_t peer, uint8_t* key, uint8_t* role, uint32_t* authVersion)
+{
+    NameToGUID* mapping = PeerEntry(peer);
+
+    if (!mapping) {
+        return AJ_ERR_NO_MATCH;
+    }
+    *role = mapping->keyRole;
+    *authVersion = mapping->authVersion;
+    memcpy(key, mapping->sessionKey, AJ_SESSION_KEY_LEN);
+    return AJ_OK;
+}
+
+AJ_Status AJ_GetPeerGroupKey(uint32_t peer, uint8_t* key)
+{
+    NameToGUID* mapping = PeerEntry(peer);
+
+    if (!mapping) {
+        return AJ_ERR_NO_MATCH;
+    }
+    memcpy(key, mapping->groupKey, AJ_SESSION_KEY_LEN);
+    return AJ_OK;
+}
+
+AJ_Status AJ_GetPeerSerialNumbers(uint32_t peer, AJ_SerialNum** incoming)
+{
+    NameToGUID* mapping = PeerEntry(peer);
+
+    if (!mapping) {
+        return AJ_ERR_NO_MATCH;
+    }
+    *incoming = &mapping->incoming;
+    return AJ_OK;
+}
+
 AJ_Status AJ_GetSerialNumbers(const char* name, AJ_SerialNum** incoming)
 {
     NameToGUID* mapping;
@@ -168,6 +168,8 @@ AJ_Status AJ_RunAllJoynService(AJ_BusAttachment* bus, AllJoynConfiguration* conf
         }
 
         if (status == AJ_ERR_TIMEOUT) {
+            // use the idle time to reclaim NVRAM so it isn't compacted in the middle of a write
+            AJ_NVRAM_CompactStep();
             // go back around and handle the expired timers
             continue;
         }
@@ -75,6 +75,7 @@ typedef struct _ReplyContext {
     uint32_t serial;     /**< Serial number for the reply message */
     uint32_t messageId;  /**< The unique message id for the call */
     char uniqueName[AJ_MAX_NAME_SIZE + 1]; /**< Reply sender's unique name */
+    AJ_BusAttachment* bus; /**< The bus attachment the method call was sent on */
 } ReplyContext;
 
 static ReplyContext replyContexts[AJ_NUM_REPLY_CONTEXTS];
@@ -1254,10 +1255,13 @@ static AJ_Status CheckReturnSignature(AJ_Message* msg, uint32_t msgId)
     return status;
 }
 
-static ReplyContext* FindReplyContext(uint32_t serial) {
+/*
+ * Serial numbers are per bus attachment, a serial of zero finds a free context.
+ */
+static ReplyContext* FindReplyContext(AJ_BusAttachment* bus, uint32_t serial) {
     size_t i;
     for (i = 0; i < ArraySize(replyContexts); ++i) {
-        if (replyContexts[i].serial == serial) {
+        if ((replyContexts[i].serial == serial) && (!serial || (replyContexts[i].bus == bus))) {
             return &replyContexts[i];
         }
     }
@@ -1494,7 +1498,7 @@ AJ_Status AJ_IdentifyMessage(AJ_Message* msg)
             AJ_CloseMsg(msg);
         }
     } else {
-        ReplyContext* repCtx = FindReplyContext(msg->replySerial);
+        ReplyContext* repCtx = FindReplyContext(msg->bus, msg->replySerial);
         if (repCtx) {
             status = CheckReturnSignature(msg, repCtx->messageId);
 
@@ -1585,7 +1589,7 @@ AJ_Status AJ_AllocReplyContext(AJ_Message* msg, uint32_t timeout)
          */
         return AJ_OK;
     } else {
-        ReplyContext* repCtx = FindReplyContext(0);
+        ReplyContext* repCtx = FindReplyContext(msg->bus, 0);
 
         AJ_ASSERT(msg->hdr->msgType == AJ_MSG_METHOD_CALL);
 
@@ -1594,6 +1598,7 @@ AJ_Status AJ_AllocReplyContext(AJ_Message* msg, uint32_t timeout)
             const char* unique;
 
             repCtx->serial = msg->hdr->serialNum;
+            repCtx->bus = msg->bus;
             repCtx->messageId = msg->msgId;
             repCtx->timeout = timeout ? timeout : AJ_DEFAULT_REPLY_TIMEOUT;
             AJ_InitTimer(&repCtx->callTime);
@@ -1617,7 +1622,7 @@ AJ_Status AJ_AllocReplyContext(AJ_Message* msg, uint32_t timeout)
 void AJ_ReleaseReplyContext(AJ_Message* msg)
 {
     if (msg->hdr->msgType == AJ_MSG_METHOD_CALL) {
-        ReplyContext* repCtx = FindReplyContext(msg->hdr->serialNum);
+        ReplyContext* repCtx = FindReplyContext(msg->bus, msg->hdr->serialNum);
         if (repCtx) {
             repCtx->serial = 0;
         }
@@ -1629,7 +1634,7 @@ uint8_t AJ_TimedOutMethodCall(AJ_Message* msg)
     ReplyContext* repCtx = replyContexts;
     size_t i;
     for (i = 0; i < ArraySize(replyContexts); ++i, ++repCtx) {
-        if (repCtx->serial && (AJ_GetElapsedTime(&repCtx->callTime, TRUE) > repCtx->timeout)) {
+        if (repCtx->serial && (repCtx->bus == msg->bus) && (AJ_GetElapsedTime(&repCtx->callTime, TRUE) > repCtx->timeout)) {
             /*
              * Set the reply serial and message id for the timeout error
              */
@@ -1645,9 +1650,14 @@ uint8_t AJ_TimedOutMethodCall(AJ_Message* msg)
     return FALSE;
 }
 
-void AJ_ReleaseReplyContexts(void)
+void AJ_ReleaseReplyContexts(AJ_BusAttachment* bus)
 {
-    memset(replyContexts, 0, sizeof(replyContexts));
+    size_t i;
+    for (i = 0; i < ArraySize(replyContexts); ++i) {
+        if (replyContexts[i].bus == bus) {
+            memset(&replyContexts[i], 0, sizeof(ReplyContext));
+        }
+    }
 }
 
 AJ_Status AJ_SetObjectFlags(const char* objPath, uint8_t setFlags, uint8_t clearFlags)
@@ -446,6 +446,24 @@ static AJ_Status InitNonce(AJ_Message* msg, uint8_t role, uint8_t* nonce, uint32
     return AJ_OK;
 }
 
+/*
+ * Looks up the remote peer once so the key, serial number and
+ * access control checks for this message don't repeat it
+ */
+static AJ_Status LookupPeer(AJ_Message* msg, const char* name)
+{
+    AJ_Status status = AJ_ERR_NO_MATCH;
+    uint32_t peer;
+
+    if (name) {
+        status = AJ_GetPeerIndex(name, &peer);
+    }
+    if (AJ_OK == status) {
+        msg->peer = (uint16_t) (peer + 1);
+    }
+    return status;
+}
+
 static AJ_Status DecryptMessage(AJ_Message* msg)
 {
     AJ_IOBuffer* ioBuf = &msg->bus->sock.rx;
@@ -464,17 +482,20 @@ static AJ_Status DecryptMessage(AJ_Message* msg)
     /*
      * Use the group key for multicast and broadcast signals the session key otherwise.
      */
-    if ((msg->hdr->msgType == AJ_MSG_SIGNAL) && !msg->destination) {
-        status = AJ_GetGroupKey(msg->sender, key);
+    status = LookupPeer(msg, msg->sender);
+    if (AJ_OK != status) {
+        /* Not a known peer */
+    } else if ((msg->hdr->msgType == AJ_MSG_SIGNAL) && !msg->destination) {
+        status = AJ_GetPeerGroupKey(msg->peer - 1, key);
         msg->authVersion = MIN_AUTH_FALLBACK_VERSION;
     } else {
-        status = AJ_GetSessionKey(msg->sender, key, &role, &msg->authVersion);
+        status = AJ_GetPeerSessionKey(msg->peer - 1, key, &role, &msg->authVersion);
         /*
          * We use the oppsite role when decrypting.
          */
         role ^= 3;
         if (AJ_OK == status) {
-            status = AJ_GetSerialNumbers(msg->sender, &incoming);
+            status = AJ_GetPeerSerialNumbers(msg->peer - 1, &incoming);
         }
     }
     if (status != AJ_OK) {
@@ -500,6 +521,43 @@ static AJ_Status DecryptMessage(AJ_Message* msg)
     return status;
 }
 
+/*
+ * Grow the transmit buffer so a message that doesn't fit can be marshaled in one piece, moving
+ * the pointers into the buffer that are held while the message is being marshaled.
+ */
+static AJ_Status GrowTxBuffer(AJ_Message* msg, size_t numBytes)
+{
+    AJ_IOBuffer* ioBuf = &msg->bus->sock.tx;
+    uint8_t* bufStart = ioBuf->bufStart;
+    uint8_t* bufEnd = ioBuf->writePtr;
+    size_t needed = (ioBuf->writePtr - ioBuf->bufStart) + numBytes;
+    AJ_Status status;
+    AJ_Arg* arg;
+
+    if (!ioBuf->bufMax || (needed > ioBuf->bufMax)) {
+        return AJ_ERR_RESOURCES;
+    }
+    status = AJ_IOBufGrow(ioBuf, (uint32_t)needed);
+    if ((status == AJ_OK) && (ioBuf->bufStart != bufStart)) {
+        msg->hdr = (AJ_MsgHeader*)ioBuf->bufStart;
+        for (arg = msg->outer; arg != NULL; arg = arg->container) {
+            /*
+             * Open arrays hold a pointer to their length field
+             */
+            if (arg->typeId == AJ_ARG_ARRAY) {
+                arg->val.v_data = ioBuf->bufStart + ((uint8_t*)arg->val.v_data - bufStart);
+            }
+            /*
+             * Containers inside a variant get their signature from the buffer
+             */
+            if (((const uint8_t*)arg->sigPtr >= bufStart) && ((const uint8_t*)arg->sigPtr < bufEnd)) {
+                arg->sigPtr = (const char*)ioBuf->bufStart + ((const uint8_t*)arg->sigPtr - bufStart);
+            }
+        }
+    }
+    return status;
+}
+
 static AJ_Status EncryptMessage(AJ_Message* msg)
 {
     AJ_IOBuffer* ioBuf = &msg->bus->sock.tx;
@@ -522,6 +580,8 @@ static AJ_Status EncryptMessage(AJ_Message* msg)
         if (AJ_OK == status) {
             msg->authVersion = MIN_AUTH_FALLBACK_VERSION;
         }
+    } else if (msg->peer) {
+        status = AJ_GetPeerSessionKey(msg->peer - 1, key, &role, &msg->authVersion);
     } else {
         status = AJ_GetSessionKey(msg->destination, key, &role, &msg->authVersion);
     }
@@ -535,7 +595,7 @@ static AJ_Status EncryptMessage(AJ_Message* msg)
         /*
          * Check there is room to append the MAC and Nonce
          */
-        if (AJ_IO_BUF_SPACE(ioBuf) < cryptoValsLen) {
+        if ((AJ_IO_BUF_SPACE(ioBuf) < cryptoValsLen) && (GrowTxBuffer(msg, cryptoValsLen) != AJ_OK)) {
             AJ_ErrPrintf(("EncryptMessage(): AJ_ERR_RESOURCES\n"));
             AJ_MemZeroSecure(key, 16);
             return AJ_ERR_RESOURCES;
@@ -598,6 +658,8 @@ AJ_Status AJ_DeliverMsg(AJ_Message* msg)
         msg->hdr->bodyLen = msg->bodyBytes;
         AJ_DumpMsg("SENDING", msg, TRUE);
         if (msg->hdr->flags & AJ_FLAG_ENCRYPTED) {
+            /* Group signals have no peer, missing peers are reported below */
+            LookupPeer(msg, msg->destination);
             status = AuthoriseOutgoingMessage(msg);
             if (AJ_OK == status) {
                 status = EncryptMessage(msg);
@@ -628,21 +690,21 @@ AJ_Status AJ_DeliverMsg(AJ_Message* msg)
 /*
  * Make sure we have the required number of bytes in the I/O buffer
  */
-static AJ_Status LoadBytes(AJ_IOBuffer* ioBuf, uint16_t numBytes, uint8_t pad, AJ_Message* msg)
+static AJ_Status LoadBytes(AJ_IOBuffer* ioBuf, uint32_t numBytes, uint8_t pad, AJ_Message* msg)
 {
     AJ_Status status = AJ_OK;
     AJ_Time msgTimer;
     uint32_t* timeout = &msg->timeout;
 
     AJ_InitTimer(&msgTimer);
-    numBytes += pad;
     /*
      * Needs to be enough headroom in the buffer to satisfy the read
      */
-    if (numBytes > (ioBuf->bufSize - AJ_IO_BUF_CONSUMED(ioBuf))) {
+    if ((numBytes > ioBuf->bufSize) || ((numBytes + pad) > (ioBuf->bufSize - AJ_IO_BUF_CONSUMED(ioBuf)))) {
         AJ_ErrPrintf(("LoadBytes(): AJ_ERR_RESOURCES\n"));
         return AJ_ERR_RESOURCES;
     }
+    numBytes += pad;
 
     AJ_InfoPrintf(("LoadBytes(): Start loop numBytes=%u, ioBufBytes=%u\n", numBytes, AJ_IO_BUF_AVAIL(ioBuf)));
     while (AJ_IO_BUF_AVAIL(ioBuf) < numBytes) {
@@ -704,11 +766,14 @@ static AJ_Status WriteBytes(AJ_Message* msg, const void* data, size_t numBytes,
         size_t canWrite = AJ_IO_BUF_SPACE(ioBuf);
         if ((numBytes + pad) > canWrite) {
             /*
-             * If we have already marshaled the header we can write what we have in the buffer
+             * If we have already marshaled the header we can write what we have in the buffer,
+             * otherwise the whole message has to fit so try to grow the buffer.
              */
             if (msg->hdr) {
-                AJ_ErrPrintf(("WriteBytes(): AJ_ERR_RESOURCES\n"));
-                status = AJ_ERR_RESOURCES;
+                status = GrowTxBuffer(msg, numBytes + pad);
+                if (status != AJ_OK) {
+                    AJ_ErrPrintf(("WriteBytes(): AJ_ERR_RESOURCES\n"));
+                }
             } else {
                 //#pragma calls = AJ_Net_Send
                 status = ioBuf->send(ioBuf);
@@ -757,7 +822,7 @@ AJ_Status AJ_CloseMsg(AJ_Message* msg)
              * Skip any unconsumed bytes
              */
             while (msg->bodyBytes) {
-                uint16_t sz = AJ_IO_BUF_AVAIL(ioBuf);
+                uint32_t sz = AJ_IO_BUF_AVAIL(ioBuf);
                 sz = min(sz, msg->bodyBytes);
                 if (!sz) {
                     AJ_IO_BUF_RESET(ioBuf);
@@ -1256,6 +1321,16 @@ AJ_Status AJ_UnmarshalMsg(AJ_BusAttachment* bus, AJ_Message* msg, uint32_t timeo
      * The header is null-padded to an 8-byte boundary
      */
     hdrPad = HEADERPAD(msg->hdr->headerLen);
+    /*
+     * If the buffer can grow make room for the entire message, messages that are still too large
+     * are unmarshaled as they arrive.
+     */
+    if (ioBuf->bufMax) {
+        uint64_t msgLen = (uint64_t)sizeof(AJ_MsgHeader) + msg->hdr->headerLen + hdrPad + msg->hdr->bodyLen;
+        if ((msgLen > ioBuf->bufSize) && (msgLen <= ioBuf->bufMax) && (AJ_IOBufGrow(ioBuf, (uint32_t)msgLen) == AJ_OK)) {
+            msg->hdr = (AJ_MsgHeader*)ioBuf->bufStart;
+        }
+    }
     /*
      * Make sure the header (plus pad) isn't going to overrun the buffer
      * and that the total header length doesn't overflow.
@@ -1500,6 +1575,58 @@ AJ_Status AJ_UnmarshalMsg(AJ_BusAttachment* bus, AJ_Message* msg, uint32_t timeo
     return status;
 }
 
+AJ_Status AJ_ProcessEvents(AJ_BusAttachment* bus, AJ_Message* msg)
+{
+    AJ_Status status;
+    AJ_IOBuffer* ioBuf = &bus->sock.rx;
+    AJ_MsgHeader* hdr;
+    uint32_t headerLen;
+    uint32_t bodyLen;
+
+    if (!ioBuf->recv) {
+        return AJ_ERR_READ;
+    }
+    /*
+     * Pull in whatever has already arrived without waiting
+     */
+    AJ_IOBufRebase(ioBuf, 0);
+    if (AJ_IO_BUF_SPACE(ioBuf)) {
+        status = ioBuf->recv(ioBuf, AJ_IO_BUF_SPACE(ioBuf), 0);
+        if ((status != AJ_OK) && (status != AJ_ERR_TIMEOUT) && (status != AJ_ERR_INTERRUPTED)) {
+            return status;
+        }
+    }
+    if (AJ_IO_BUF_AVAIL(ioBuf) < sizeof(AJ_MsgHeader)) {
+        /*
+         * Doesn't block, but reports method calls that have timed out
+         */
+        return AJ_UnmarshalMsg(bus, msg, 0);
+    }
+    hdr = (AJ_MsgHeader*)ioBuf->readPtr;
+    headerLen = hdr->headerLen;
+    bodyLen = hdr->bodyLen;
+    if (hdr->endianess != HOST_ENDIANESS) {
+        headerLen = ENDSWAP32(headerLen);
+        bodyLen = ENDSWAP32(bodyLen);
+    }
+    if (ioBuf->bufMax) {
+        uint64_t msgLen = (uint64_t)sizeof(AJ_MsgHeader) + headerLen + HEADERPAD(headerLen) + bodyLen;
+        if ((msgLen > ioBuf->bufSize) && (msgLen <= ioBuf->bufMax)) {
+            AJ_IOBufGrow(ioBuf, (uint32_t)msgLen);
+        }
+    }
+    /*
+     * Wait for the rest of a message that fits in the buffer. Messages that don't fit, or have
+     * a corrupt header, are left to AJ_UnmarshalMsg() to stream in or reject.
+     */
+    if ((headerLen < ioBuf->bufSize) && (bodyLen < ioBuf->bufSize) &&
+        ((sizeof(AJ_MsgHeader) + headerLen + HEADERPAD(headerLen) + bodyLen) <= ioBuf->bufSize) &&
+        ((sizeof(AJ_MsgHeader) + headerLen + HEADERPAD(headerLen) + bodyLen) > AJ_IO_BUF_AVAIL(ioBuf))) {
+        return AJ_ERR_TIMEOUT;
+    }
+    return AJ_UnmarshalMsg(bus, msg, AJ_UNMARSHAL_TIMEOUT);
+}
+
 AJ_Status AJ_SkipArg(AJ_Message* msg)
 {
     AJ_Status status;
@@ -1596,7 +1723,7 @@ AJ_Status AJ_UnmarshalArg(AJ_Message* msg, AJ_Arg* arg)
         status = Unmarshal(msg, &sig, arg);
     } else if (container) {
         if (container->typeId == AJ_ARG_ARRAY) {
-            size_t len = (uint16_t)(ioBuf->readPtr - (uint8_t*)container->val.v_data);
+            size_t len = (size_t)(ioBuf->readPtr - (uint8_t*)container->val.v_data);
             /*
              * Return an error status if there are no more array elements.
              */
@@ -1631,7 +1758,7 @@ AJ_Status AJ_UnmarshalArg(AJ_Message* msg, AJ_Arg* arg)
         AJ_ErrPrintf(("AJ_UnmarshalArg(): AJ_ERR_READ\n"));
         status = AJ_ERR_READ;
     } else {
-        msg->bodyBytes -= (uint16_t)consumed;
+        msg->bodyBytes -= (uint32_t)consumed;
     }
     return status;
 }
@@ -1826,7 +1953,7 @@ AJ_Status AJ_UnmarshalRaw(AJ_Message* msg, const void** data, size_t len, size_t
      * If we try to load more than the available space we will get an error
      */
     len = min(len, AJ_IO_BUF_SPACE(ioBuf));
-    status = LoadBytes(ioBuf, (uint16_t)len, 0, msg);
+    status = LoadBytes(ioBuf, (uint32_t)len, 0, msg);
     if (status == AJ_OK) {
         sz = AJ_IO_BUF_AVAIL(ioBuf);
         if (sz < len) {
@@ -1835,7 +1962,7 @@ AJ_Status AJ_UnmarshalRaw(AJ_Message* msg, const void** data, size_t len, size_t
         *data = ioBuf->readPtr;
         *actual = len;
         ioBuf->readPtr += len;
-        msg->bodyBytes -= (uint16_t)len;
+        msg->bodyBytes -= (uint32_t)len;
     }
     return status;
 }
@@ -1873,7 +2000,7 @@ AJ_Status AJ_UnmarshalCloseContainer(AJ_Message* msg, AJ_Arg* arg)
         /*
          * Check that all the array elements have been unmarshaled
          */
-        size_t len = (uint16_t)(ioBuf->readPtr - (uint8_t*)arg->val.v_data);
+        size_t len = (size_t)(ioBuf->readPtr - (uint8_t*)arg->val.v_data);
         if (len != arg->len) {
             AJ_ErrPrintf(("AJ_UnmarshalCloseContainer(): AJ_ERR_UNMARSHAL\n"));
             return AJ_ERR_UNMARSHAL;
@@ -1915,28 +2042,43 @@ static AJ_Status MarshalContainer(AJ_Message* msg, const char** sig, AJ_Arg* arg
 {
     AJ_Status status;
     AJ_IOBuffer* ioBuf = &msg->bus->sock.tx;
+    size_t sigOffset = 0;
+    size_t sigLen;
 
     *sig -= 1;
-    arg->sigPtr = *sig + 1;
+    sigLen = CompleteTypeSigLen(*sig);
+    /*
+     * Inside a variant the signature is in the buffer which can move while we write the padding
+     */
+    if (((const uint8_t*)*sig >= ioBuf->bufStart) && ((const uint8_t*)*sig < ioBuf->writePtr)) {
+        sigOffset = (const uint8_t*)*sig - ioBuf->bufStart;
+    }
     if (**sig == AJ_ARG_ARRAY) {
         /*
          * Reserve space for the length and save a pointer to it
          */
+        char elemType = (*sig)[1];
+        size_t lenOffset;
         status = WriteBytes(msg, NULL, 0, pad + 4);
-        arg->val.v_data = ioBuf->writePtr - 4;
+        lenOffset = (ioBuf->writePtr - ioBuf->bufStart) - 4;
         /*
          * Might need to pad if the elements align on an 8 byte boundary
          */
         if (status == AJ_OK) {
-            status = WritePad(msg, PadForType(arg->sigPtr[0], ioBuf));
+            status = WritePad(msg, PadForType(elemType, ioBuf));
         }
+        arg->val.v_data = ioBuf->bufStart + lenOffset;
     } else {
         status = WritePad(msg, pad);
     }
+    if (sigOffset) {
+        *sig = (const char*)ioBuf->bufStart + sigOffset;
+    }
+    arg->sigPtr = *sig + 1;
     /*
      * Consume container signature
      */
-    *sig += CompleteTypeSigLen(*sig);
+    *sig += sigLen;
     return status;
 }
 
@@ -2039,7 +2181,7 @@ static AJ_Status MarshalMsg(AJ_Message* msg, uint8_t msgType, uint32_t msgId, ui
         return AJ_ERR_IO_BUFFER;
     }
 #ifdef AJ_ARDP
-    status = AJ_ARDP_StartMsgSend(msg->ttl);
+    status = AJ_ARDP_StartMsgSend(ioBuf->context, msg->ttl);
 #endif
 
     /*
@@ -2197,30 +2339,32 @@ AJ_Status AJ_MarshalArg(AJ_Message* msg, AJ_Arg* arg)
 {
     AJ_Status status;
     AJ_IOBuffer* ioBuf = &msg->bus->sock.tx;
-    uint8_t* argStart = ioBuf->writePtr;
+    size_t argStart = ioBuf->writePtr - ioBuf->bufStart;
 
     if (msg->varOffset) {
         /*
          * Marshaling a variant - get the signature from the I/O buffer
          */
-        const char* sig = (const char*)(argStart - msg->varOffset);
+        const char* sig = (const char*)(ioBuf->bufStart + argStart - msg->varOffset);
         msg->varOffset = 0;
         status = Marshal(msg, &sig, arg);
     } else if (msg->outer) {
         /*
          * Marshaling a component of a container use the container's signature
          */
-        const char* sig = msg->outer->sigPtr;
+        const char* start = msg->outer->sigPtr;
+        const char* sig = start;
         if (!*sig) {
             AJ_ErrPrintf(("AJ_MarshalArg(): AJ_ERR_END_OF_DATA\n"));
             return AJ_ERR_END_OF_DATA;
         }
         status = Marshal(msg, &sig, arg);
         /*
-         * Only advance the signature for struct elements
+         * Only advance the signature for struct elements. The signature may have moved with the
+         * buffer so advance it by the length consumed.
          */
         if (msg->outer->typeId != AJ_ARG_ARRAY) {
-            msg->outer->sigPtr = sig;
+            msg->outer->sigPtr += sig - start;
         }
     } else {
         const char* sig = msg->signature + msg->sigOffset;
@@ -2235,7 +2379,7 @@ AJ_Status AJ_MarshalArg(AJ_Message* msg, AJ_Arg* arg)
         msg->sigOffset = (uint8_t)(sig - msg->signature);
     }
     if (status == AJ_OK) {
-        msg->bodyBytes += (uint16_t)(ioBuf->writePtr - argStart);
+        msg->bodyBytes += (uint32_t)((ioBuf->writePtr - ioBuf->bufStart) - argStart);
     } else {
         AJ_ReleaseReplyContext(msg);
     }
@@ -2250,7 +2394,7 @@ AJ_Arg* AJ_InitArg(AJ_Arg* arg, uint8_t typeId, uint8_t flags, const void* val,
     } else {
         arg->typeId = typeId;
         arg->flags = flags;
-        arg->len = (uint16_t)len;
+        arg->len = (uint32_t)len;
         arg->val.v_data = (void*)val;
         arg->sigPtr = NULL;
         arg->container = NULL;
@@ -2471,7 +2615,7 @@ AJ_Status AJ_MarshalCloseContainer(AJ_Message* msg, AJ_Arg* arg)
         /*
          * The length we marshal does not include the length field itself.
          */
-        arg->len = (uint16_t)(ioBuf->writePtr - (uint8_t*)arg->val.v_data) - 4;
+        arg->len = (uint32_t)(ioBuf->writePtr - (uint8_t*)arg->val.v_data) - 4;
         /*
          * If the array element is 8 byte aligned and the array is not empty check if there was
          * padding after the length. The length we marshal should not include the padding.
@@ -2730,12 +2874,14 @@ void AJ_LocalMsg(AJ_BusAttachment* bus, AJ_MsgHeader* hdr, AJ_Message* msg, cons
     bus->sock.rx.direction = AJ_IO_BUF_RX;
     bus->sock.rx.recv = rx_noop;
     bus->sock.rx.bufSize = size;
+    bus->sock.rx.bufMax = 0;
     bus->sock.rx.bufStart = data;
     bus->sock.rx.readPtr = bus->sock.rx.bufStart;
     bus->sock.rx.writePtr = bus->sock.rx.bufStart;
     bus->sock.tx.direction = AJ_IO_BUF_TX;
     bus->sock.tx.send = tx_noop;
     bus->sock.tx.bufSize = size;
+    bus->sock.tx.bufMax = 0;
     bus->sock.tx.bufStart = data;
     bus->sock.tx.readPtr = bus->sock.tx.bufStart;
     bus->sock.tx.writePtr = bus->sock.tx.bufStart;
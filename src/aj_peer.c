@@ -62,18 +62,26 @@ uint8_t dbgPEER = 0;
 
 #define REQUIRED_AUTH_VERSION  (((uint32_t)MAX_AUTH_VERSION << 16) | MIN_KEYGEN_VERSION)
 
+/*
+ * Reduced round-trip handshake. The client offers it, together with the
+ * suites it has enabled, in the keygen half of the ExchangeGuids version.
+ * Peers that don't know it see an unsupported keygen version and answer with
+ * their own version, so the handshake falls back to the usual sequence.
+ * A server that accepts answers with the one suite it picked.
+ */
+#define FAST_HANDSHAKE   0x8000
+#define FAST_SUITE_MASK  0x000F
+
+/*
+ * In a fast handshake each GenSessionKey nonce is followed by the sender's
+ * group key, wrapped with a key derived from the master secret
+ */
+#define FOLDED_NONCE_LEN  (2 * (AJ_NONCE_LEN + AJ_SESSION_KEY_LEN))
+
 #define SEND_MEMBERSHIPS_NONE  0
 #define SEND_MEMBERSHIPS_MORE  1
 #define SEND_MEMBERSHIPS_LAST  2
 
-static AJ_Status SaveMasterSecret(const AJ_GUID* peerGuid, uint32_t expiration);
-static AJ_Status SaveECDSAContext(const AJ_GUID* peerGuid, uint32_t expiration);
-static AJ_Status ExchangeSuites(AJ_Message* msg);
-static AJ_Status KeyExchange(AJ_BusAttachment* bus);
-static AJ_Status KeyAuthentication(AJ_Message* msg);
-static AJ_Status GenSessionKey(AJ_Message* msg);
-static AJ_Status SendMemberships(AJ_Message* msg);
-
 typedef enum {
     AJ_AUTH_NONE,
     AJ_AUTH_EXCHANGED,
@@ -87,12 +95,56 @@ typedef struct _PeerContext {
     const AJ_GUID* peerGuid;         /* GUID pointer for the currently authenticating peer */
     const char* peerName;            /* Name of the peer being authenticated */
     AJ_Time timer;                   /* Timer for detecting failed authentication attempts */
-    char nonce[2 * AJ_NONCE_LEN + 1];   /* Nonce as ascii hex */
+    char nonce[FOLDED_NONCE_LEN + 1];   /* Nonce as ascii hex, followed by the folded group key in fast mode */
+    uint32_t serial;                 /* Serial number of our ExchangeGuids call (client only) */
+    uint16_t fastOffer;              /* Suites offered for a fast handshake */
+    uint16_t fastAnswer;             /* Suite accepted for a fast handshake, zero if not fast */
+    uint8_t sentManifests;           /* Manifests already sent to this peer */
+    AJ_AuthenticationContext authContext;
 } PeerContext;
 
-static PeerContext peerContext;
-static AJ_AuthenticationContext authContext = { 0 };
-static uint8_t sentManifests = FALSE;
+static AJ_Status SaveMasterSecret(PeerContext* peer, uint32_t expiration);
+static AJ_Status SaveECDSAContext(PeerContext* peer, uint32_t expiration);
+static AJ_Status ExchangeSuites(PeerContext* peer, AJ_Message* msg);
+static AJ_Status KeyExchange(PeerContext* peer);
+static AJ_Status KeyAuthentication(PeerContext* peer, AJ_Message* msg);
+static AJ_Status GenSessionKey(PeerContext* peer, AJ_Message* msg);
+static AJ_Status SendMemberships(PeerContext* peer, AJ_Message* msg);
+
+/*
+ * Handshake state is kept per peer, one slot for each handshake in progress,
+ * so handshakes with different peers can interleave. A slot is in use while
+ * its authContext.bus is set; once the peer GUID is known the slot is found
+ * by the GUID pointer from the name map.
+ */
+static PeerContext peerContexts[AJ_MAX_PEER_HANDSHAKES];
+
+static PeerContext* FindPeerContext(const AJ_GUID* peerGuid)
+{
+    size_t i;
+
+    if (NULL == peerGuid) {
+        return NULL;
+    }
+    for (i = 0; i < ArraySize(peerContexts); i++) {
+        if (peerContexts[i].authContext.bus && (peerGuid == peerContexts[i].peerGuid)) {
+            return &peerContexts[i];
+        }
+    }
+    return NULL;
+}
+
+static uint8_t HandshakeInProgress()
+{
+    size_t i;
+
+    for (i = 0; i < ArraySize(peerContexts); i++) {
+        if (peerContexts[i].authContext.bus) {
+            return TRUE;
+        }
+    }
+    return FALSE;
+}
 
 static uint32_t GetAcceptableVersion(uint32_t srcV)
 {
@@ -115,7 +167,83 @@ static uint32_t GetAcceptableVersion(uint32_t srcV)
     return REQUIRED_AUTH_VERSION;
 }
 
-static AJ_Status KeyGen(const char* peerName, uint8_t role, const char* nonce1, const char* nonce2, uint8_t* outBuf, uint32_t len)
+static uint16_t FastSuites(AJ_BusAttachment* bus, uint32_t version)
+{
+    static const uint32_t suites[] = { AUTH_SUITE_ECDHE_NULL, AUTH_SUITE_ECDHE_PSK, AUTH_SUITE_ECDHE_ECDSA, AUTH_SUITE_ECDHE_SPEKE };
+    uint16_t mask = 0;
+    size_t i;
+
+    if (bus->fastHandshake) {
+        for (i = 0; i < ArraySize(suites); i++) {
+            if (AJ_IsSuiteEnabled(bus, suites[i], AJ_UNPACK_AUTH_VERSION(version))) {
+                mask |= (uint16_t)(suites[i] & FAST_SUITE_MASK);
+            }
+        }
+    }
+    return mask;
+}
+
+static AJ_Status FoldGroupKey(PeerContext* peer, const char* nonce, uint8_t* key)
+{
+    AJ_Status status;
+    const uint8_t* data[3];
+    uint8_t lens[3];
+    uint8_t mask[AJ_SESSION_KEY_LEN];
+    size_t i;
+
+    /*
+     * The wrapping key is bound to the nonce, and the whole string goes
+     * into KeyGen, so a tampered group key also breaks the session key
+     */
+    data[0] = peer->authContext.mastersecret;
+    lens[0] = (uint32_t)AJ_MASTER_SECRET_LEN;
+    data[1] = (uint8_t*)"group key";
+    lens[1] = 9;
+    data[2] = (uint8_t*)nonce;
+    lens[2] = 2 * AJ_NONCE_LEN;
+
+    status = AJ_Crypto_PRF_SHA256(data, lens, ArraySize(data), mask, sizeof (mask));
+    if (AJ_OK == status) {
+        for (i = 0; i < sizeof (mask); i++) {
+            key[i] ^= mask[i];
+        }
+    }
+    AJ_MemZeroSecure(mask, sizeof (mask));
+    return status;
+}
+
+static AJ_Status AppendGroupKey(PeerContext* peer)
+{
+    AJ_Status status;
+    uint8_t key[AJ_SESSION_KEY_LEN];
+
+    status = AJ_GetGroupKey(NULL, key);
+    if (AJ_OK == status) {
+        status = FoldGroupKey(peer, peer->nonce, key);
+    }
+    if (AJ_OK == status) {
+        status = AJ_RawToHex(key, sizeof (key), peer->nonce + 2 * AJ_NONCE_LEN, sizeof (peer->nonce) - 2 * AJ_NONCE_LEN, FALSE);
+    }
+    AJ_MemZeroSecure(key, sizeof (key));
+    return status;
+}
+
+static AJ_Status ExtractGroupKey(PeerContext* peer, const char* nonce, uint8_t* key)
+{
+    AJ_Status status;
+
+    if (strlen(nonce) != FOLDED_NONCE_LEN) {
+        AJ_WarnPrintf(("ExtractGroupKey(): Group key missing\n"));
+        return AJ_ERR_INVALID;
+    }
+    status = AJ_HexToRaw(nonce + 2 * AJ_NONCE_LEN, 2 * AJ_SESSION_KEY_LEN, key, AJ_SESSION_KEY_LEN);
+    if (AJ_OK == status) {
+        status = FoldGroupKey(peer, nonce, key);
+    }
+    return status;
+}
+
+static AJ_Status KeyGen(PeerContext* peer, const char* peerName, uint8_t role, const char* nonce1, const char* nonce2, uint8_t* outBuf, uint32_t len)
 {
     AJ_Status status;
     const uint8_t* data[4];
@@ -130,7 +258,7 @@ static AJ_Status KeyGen(const char* peerName, uint8_t role, const char* nonce1,
         return AJ_ERR_UNEXPECTED;
     }
 
-    data[0] = authContext.mastersecret;
+    data[0] = peer->authContext.mastersecret;
     lens[0] = (uint32_t)AJ_MASTER_SECRET_LEN;
     data[1] = (uint8_t*)"session key";
     lens[1] = 11;
@@ -153,7 +281,7 @@ static AJ_Status KeyGen(const char* peerName, uint8_t role, const char* nonce1,
      * Store the session key and compose the verifier string.
      */
     if (status == AJ_OK) {
-        status = AJ_SetSessionKey(peerName, outBuf, role, authContext.version);
+        status = AJ_SetSessionKey(peerName, outBuf, role, peer->authContext.version);
     }
     if (status == AJ_OK) {
         memmove(outBuf, outBuf + AJ_SESSION_KEY_LEN, AJ_VERIFIER_LEN);
@@ -165,52 +293,67 @@ static AJ_Status KeyGen(const char* peerName, uint8_t role, const char* nonce1,
 
 void AJ_ClearSentManifests()
 {
-    sentManifests = FALSE;
+    size_t i;
+
+    for (i = 0; i < ArraySize(peerContexts); i++) {
+        peerContexts[i].sentManifests = FALSE;
+    }
 }
 
-void AJ_ClearAuthContext()
+static void ClearPeerContext(PeerContext* peer)
 {
     /* Free issuers, hash, and PSK */
-    AJ_Free(authContext.kactx.ecdsa.key);
-    if (authContext.hash) {
-        AJ_SHA256_Final(authContext.hash, NULL);
+    AJ_Free(peer->authContext.kactx.ecdsa.key);
+    if (peer->authContext.hash) {
+        AJ_SHA256_Final(peer->authContext.hash, NULL);
     }
-    AJ_ASSERT(((NULL == authContext.kactx.psk.hint) && (authContext.kactx.psk.hintSize == 0)) ||
-              ((NULL != authContext.kactx.psk.hint) && (authContext.kactx.psk.hintSize > 0)));
-    AJ_Free(authContext.kactx.psk.hint);
-    if (NULL != authContext.kactx.psk.key) {
-        AJ_ASSERT(authContext.kactx.psk.keySize > 0);
-        AJ_MemZeroSecure(authContext.kactx.psk.key, authContext.kactx.psk.keySize);
-        AJ_Free(authContext.kactx.psk.key);
+    AJ_ASSERT(((NULL == peer->authContext.kactx.psk.hint) && (peer->authContext.kactx.psk.hintSize == 0)) ||
+              ((NULL != peer->authContext.kactx.psk.hint) && (peer->authContext.kactx.psk.hintSize > 0)));
+    AJ_Free(peer->authContext.kactx.psk.hint);
+    if (NULL != peer->authContext.kactx.psk.key) {
+        AJ_ASSERT(peer->authContext.kactx.psk.keySize > 0);
+        AJ_MemZeroSecure(peer->authContext.kactx.psk.key, peer->authContext.kactx.psk.keySize);
+        AJ_Free(peer->authContext.kactx.psk.key);
     }
 
-    memset(&peerContext, 0, sizeof (PeerContext));
-    memset(&authContext, 0, sizeof (AJ_AuthenticationContext));
+    AJ_MemZeroSecure(peer, sizeof (PeerContext));
 }
 
-static void HandshakeComplete(AJ_Status status)
+void AJ_ClearAuthContext()
 {
-    AJ_InfoPrintf(("HandshakeComplete(status=%d.)\n", status));
+    size_t i;
+
+    for (i = 0; i < ArraySize(peerContexts); i++) {
+        ClearPeerContext(&peerContexts[i]);
+    }
+}
+
+static void HandshakeComplete(PeerContext* peer, AJ_Status status)
+{
+    AJ_BusAuthPeerCallback callback;
+    void* cbContext;
+
+    AJ_InfoPrintf(("HandshakeComplete(peer=%p, status=%d.)\n", peer, status));
 
     /* If ECDSA/PSK failed, try NULL */
     if ((AJ_OK != status) &&
-        (AUTH_SUITE_ECDHE_NULL != authContext.suite) &&
-        AJ_IsSuiteEnabled(authContext.bus, AUTH_SUITE_ECDHE_NULL, AJ_UNPACK_AUTH_VERSION(authContext.version))) {
-        if (AUTH_CLIENT == authContext.role) {
-            authContext.suite = AUTH_SUITE_ECDHE_NULL;
-            KeyExchange(authContext.bus);
+        (AUTH_SUITE_ECDHE_NULL != peer->authContext.suite) &&
+        AJ_IsSuiteEnabled(peer->authContext.bus, AUTH_SUITE_ECDHE_NULL, AJ_UNPACK_AUTH_VERSION(peer->authContext.version))) {
+        if (AUTH_CLIENT == peer->authContext.role) {
+            peer->authContext.suite = AUTH_SUITE_ECDHE_NULL;
+            KeyExchange(peer);
         }
         return;
     }
 
-    if ((AJ_OK == status) && authContext.expiration) {
-        status = SaveMasterSecret(peerContext.peerGuid, authContext.expiration);
+    if ((AJ_OK == status) && peer->authContext.expiration) {
+        status = SaveMasterSecret(peer, peer->authContext.expiration);
         if (AJ_OK != status) {
             AJ_WarnPrintf(("HandshakeComplete(status=%d): Save master secret error\n", status));
             goto Exit;
         }
-        if (AUTH_SUITE_ECDHE_ECDSA == authContext.suite) {
-            status = SaveECDSAContext(peerContext.peerGuid, authContext.expiration);
+        if (AUTH_SUITE_ECDHE_ECDSA == peer->authContext.suite) {
+            status = SaveECDSAContext(peer, peer->authContext.expiration);
             if (AJ_OK != status) {
                 AJ_WarnPrintf(("HandshakeComplete(status=%d): Save ecdsa context error\n", status));
                 goto Exit;
@@ -219,17 +362,42 @@ static void HandshakeComplete(AJ_Status status)
     }
 
 Exit:
-    /* Policy no longer needed in memory */
-    AJ_PolicyUnload();
-    if (peerContext.callback) {
-        peerContext.callback(peerContext.cbContext, status);
+    callback = peer->callback;
+    cbContext = peer->cbContext;
+    ClearPeerContext(peer);
+    /* Policy no longer needed in memory once no handshake is using it */
+    if (!HandshakeInProgress()) {
+        AJ_PolicyUnload();
+    }
+    if (callback) {
+        callback(cbContext, status);
     }
-    AJ_ClearAuthContext();
 }
 
-static AJ_Status SaveMasterSecret(const AJ_GUID* peerGuid, uint32_t expiration)
+/*
+ * Abandon a handshake without falling back to the NULL suite
+ */
+static void HandshakeAbort(PeerContext* peer, AJ_Status status)
+{
+    peer->authContext.suite = AUTH_SUITE_ECDHE_NULL;
+    HandshakeComplete(peer, status);
+}
+
+/*
+ * Free a slot without reporting to the application
+ */
+static void ReleasePeerContext(PeerContext* peer)
+{
+    ClearPeerContext(peer);
+    if (!HandshakeInProgress()) {
+        AJ_PolicyUnload();
+    }
+}
+
+static AJ_Status SaveMasterSecret(PeerContext* peer, uint32_t expiration)
 {
     AJ_Status status;
+    const AJ_GUID* peerGuid = peer->peerGuid;
 
     AJ_InfoPrintf(("SaveMasterSecret(peerGuid=%p, expiration=%d)\n", peerGuid, expiration));
 
@@ -240,8 +408,8 @@ static AJ_Status SaveMasterSecret(const AJ_GUID* peerGuid, uint32_t expiration)
      * If the authentication was succesful write the credentials for the authenticated peer to
      * NVRAM otherwise delete any stale credentials that might be stored.
      */
-    if (AJ_AUTH_SUCCESS == peerContext.state) {
-        status = AJ_CredentialSetPeer(AJ_GENERIC_MASTER_SECRET, peerGuid, expiration, authContext.mastersecret, AJ_MASTER_SECRET_LEN);
+    if (AJ_AUTH_SUCCESS == peer->state) {
+        status = AJ_CredentialSetPeer(AJ_GENERIC_MASTER_SECRET, peerGuid, expiration, peer->authContext.mastersecret, AJ_MASTER_SECRET_LEN);
     } else {
         AJ_WarnPrintf(("SaveMasterSecret(peerGuid=%p, expiration=%d): Invalid state\n", peerGuid, expiration));
         AJ_CredentialDeletePeer(peerGuid);
@@ -250,11 +418,12 @@ static AJ_Status SaveMasterSecret(const AJ_GUID* peerGuid, uint32_t expiration)
     return status;
 }
 
-static AJ_Status LoadMasterSecret(const AJ_GUID* peerGuid)
+static AJ_Status LoadMasterSecret(PeerContext* peer)
 {
     AJ_Status status;
     uint32_t expiration;
     AJ_CredField data;
+    const AJ_GUID* peerGuid = peer->peerGuid;
 
     AJ_InfoPrintf(("LoadMasterSecret(peerGuid=%p)\n", peerGuid));
 
@@ -263,7 +432,7 @@ static AJ_Status LoadMasterSecret(const AJ_GUID* peerGuid)
     }
     /* Write directly to mastersecret buffer */
     data.size = AJ_MASTER_SECRET_LEN;
-    data.data = authContext.mastersecret;
+    data.data = peer->authContext.mastersecret;
     status = AJ_CredentialGetPeer(AJ_GENERIC_MASTER_SECRET, peerGuid, &expiration, &data);
     if (AJ_OK != status) {
         return status;
@@ -273,9 +442,10 @@ static AJ_Status LoadMasterSecret(const AJ_GUID* peerGuid)
     return status;
 }
 
-static AJ_Status SaveECDSAContext(const AJ_GUID* peerGuid, uint32_t expiration)
+static AJ_Status SaveECDSAContext(PeerContext* peer, uint32_t expiration)
 {
     AJ_Status status;
+    const AJ_GUID* peerGuid = peer->peerGuid;
 
     AJ_InfoPrintf(("SaveECDSAContext(peerGuid=%p, expiration=%d)\n", peerGuid, expiration));
 
@@ -283,12 +453,12 @@ static AJ_Status SaveECDSAContext(const AJ_GUID* peerGuid, uint32_t expiration)
         return AJ_ERR_SECURITY;
     }
 
-    if ((AJ_AUTH_SUCCESS == peerContext.state) && (authContext.kactx.ecdsa.thumbprintSize > 0)) {
-        status = AJ_CredentialSetPeer(AJ_GENERIC_ECDSA_THUMBPRINT, peerGuid, expiration, authContext.kactx.ecdsa.thumbprint, (uint16_t)authContext.kactx.ecdsa.thumbprintSize);
+    if ((AJ_AUTH_SUCCESS == peer->state) && (peer->authContext.kactx.ecdsa.thumbprintSize > 0)) {
+        status = AJ_CredentialSetPeer(AJ_GENERIC_ECDSA_THUMBPRINT, peerGuid, expiration, peer->authContext.kactx.ecdsa.thumbprint, (uint16_t)peer->authContext.kactx.ecdsa.thumbprintSize);
         if (AJ_OK != status) {
             return status;
         }
-        status = AJ_CredentialSetPeer(AJ_GENERIC_ECDSA_KEYS, peerGuid, expiration, (uint8_t*) authContext.kactx.ecdsa.key, (uint16_t) (authContext.kactx.ecdsa.num * sizeof (AJ_ECCPublicKey)));
+        status = AJ_CredentialSetPeer(AJ_GENERIC_ECDSA_KEYS, peerGuid, expiration, (uint8_t*) peer->authContext.kactx.ecdsa.key, (uint16_t) (peer->authContext.kactx.ecdsa.num * sizeof (AJ_ECCPublicKey)));
         if (AJ_OK != status) {
             return status;
         }
@@ -297,28 +467,29 @@ static AJ_Status SaveECDSAContext(const AJ_GUID* peerGuid, uint32_t expiration)
     return status;
 }
 
-static AJ_Status LoadECDSAContext(const AJ_GUID* peerGuid)
+static AJ_Status LoadECDSAContext(PeerContext* peer)
 {
     AJ_Status status;
     AJ_CredField data;
+    const AJ_GUID* peerGuid = peer->peerGuid;
 
     AJ_InfoPrintf(("LoadECDSAContext(peerGuid=%p)\n", peerGuid));
 
     /* Check if we have a stored identity thumbprint */
     data.size = AJ_SHA256_DIGEST_LENGTH;
-    data.data = authContext.kactx.ecdsa.thumbprint;
+    data.data = peer->authContext.kactx.ecdsa.thumbprint;
     status = AJ_CredentialGetPeer(AJ_GENERIC_ECDSA_THUMBPRINT, peerGuid, NULL, &data);
     if (AJ_OK == status) {
-        authContext.kactx.ecdsa.thumbprintSize = data.size;
+        peer->authContext.kactx.ecdsa.thumbprintSize = data.size;
     } else {
-        peerContext.state = AJ_AUTH_SUCCESS;
+        peer->state = AJ_AUTH_SUCCESS;
         return AJ_OK;
     }
 
     /* If we have an identity certificate thumbprint, we require stored public keys */
     data.size = 0;
     /* Keys is NULL, AJ_CredentialGetPeer will allocate the memory */
-    data.data = (uint8_t*) authContext.kactx.ecdsa.key;
+    data.data = (uint8_t*) peer->authContext.kactx.ecdsa.key;
     status = AJ_CredentialGetPeer(AJ_GENERIC_ECDSA_KEYS, peerGuid, NULL, &data);
     if (AJ_OK != status) {
         return status;
@@ -327,71 +498,94 @@ static AJ_Status LoadECDSAContext(const AJ_GUID* peerGuid)
         /* Keys corrupted */
         return AJ_ERR_INVALID;
     }
-    authContext.kactx.ecdsa.key = (AJ_ECCPublicKey*) data.data;
-    authContext.kactx.ecdsa.num = data.size / (sizeof (AJ_ECCPublicKey));
-    authContext.suite = AUTH_SUITE_ECDHE_ECDSA;
+    peer->authContext.kactx.ecdsa.key = (AJ_ECCPublicKey*) data.data;
+    peer->authContext.kactx.ecdsa.num = data.size / (sizeof (AJ_ECCPublicKey));
+    peer->authContext.suite = AUTH_SUITE_ECDHE_ECDSA;
     /* Set expiration to zero so we don't resave the credential */
-    authContext.expiration = 0;
-    peerContext.state = AJ_AUTH_SUCCESS;
+    peer->authContext.expiration = 0;
+    peer->state = AJ_AUTH_SUCCESS;
 
     return status;
 }
 
-static AJ_Status HandshakeTimeout() {
+static AJ_Status HandshakeTimeout(PeerContext* peer) {
     uint8_t zero[sizeof (AJ_GUID)];
     memset(zero, 0, sizeof (zero));
     /*
      * If handshake started, check peer is still around
      * If peer disappeared, AJ_GUID_DeleteNameMapping writes zeros
      */
-    if (peerContext.peerGuid) {
-        if (0 == memcmp(peerContext.peerGuid, zero, sizeof (zero))) {
+    if (peer->peerGuid) {
+        if (0 == memcmp(peer->peerGuid, zero, sizeof (zero))) {
             AJ_WarnPrintf(("AJ_HandshakeTimeout(): Peer disappeared\n"));
-            peerContext.peerGuid = NULL;
-            HandshakeComplete(AJ_ERR_TIMEOUT);
+            peer->peerGuid = NULL;
+            HandshakeAbort(peer, AJ_ERR_TIMEOUT);
             return AJ_ERR_TIMEOUT;
         }
     }
-    if (AJ_GetElapsedTime(&peerContext.timer, TRUE) >= AJ_MAX_AUTH_TIME) {
+    if (AJ_GetElapsedTime(&peer->timer, TRUE) >= AJ_MAX_AUTH_TIME) {
         AJ_WarnPrintf(("AJ_HandshakeTimeout(): AJ_ERR_TIMEOUT\n"));
-        HandshakeComplete(AJ_ERR_TIMEOUT);
+        HandshakeComplete(peer, AJ_ERR_TIMEOUT);
         return AJ_ERR_TIMEOUT;
     }
     return AJ_OK;
 }
 
-static AJ_Status HandshakeValid(const AJ_GUID* peerGuid)
+static PeerContext* AllocPeerContext(AJ_BusAttachment* bus, uint8_t role)
+{
+    size_t i;
+    PeerContext* peer;
+
+    /* Reclaim slots held by handshakes that have stalled */
+    for (i = 0; i < ArraySize(peerContexts); i++) {
+        if (peerContexts[i].authContext.bus) {
+            HandshakeTimeout(&peerContexts[i]);
+        }
+    }
+    for (i = 0; i < ArraySize(peerContexts); i++) {
+        peer = &peerContexts[i];
+        if (NULL == peer->authContext.bus) {
+            memset(peer, 0, sizeof (PeerContext));
+            AJ_InitTimer(&peer->timer);
+            peer->authContext.bus = bus;
+            peer->authContext.role = role;
+            return peer;
+        }
+    }
+    AJ_WarnPrintf(("AllocPeerContext(bus=%p, role=%d.): No free handshake slot\n", bus, role));
+    return NULL;
+}
+
+static AJ_Status HandshakeValid(const AJ_GUID* peerGuid, PeerContext** peer)
 {
+    *peer = FindPeerContext(peerGuid);
     /*
-     * Handshake not yet started
+     * Handshake not yet started with this peer
      */
-    if (!peerContext.peerGuid) {
+    if (NULL == *peer) {
         AJ_InfoPrintf(("AJ_HandshakeValid(peerGuid=%p): Invalid peer guid\n", peerGuid));
         return AJ_ERR_SECURITY;
     }
     /*
      * Handshake timed out
      */
-    if (AJ_OK != HandshakeTimeout()) {
+    if (AJ_OK != HandshakeTimeout(*peer)) {
         AJ_InfoPrintf(("AJ_HandshakeValid(peerGuid=%p): Handshake timed out\n", peerGuid));
+        *peer = NULL;
         return AJ_ERR_TIMEOUT;
     }
-    /*
-     * Handshake call from different peer
-     */
-    if ((NULL == peerGuid) || (peerGuid != peerContext.peerGuid)) {
-        AJ_WarnPrintf(("AJ_HandshakeValid(peerGuid=%p): Invalid peer guid\n", peerGuid));
-        return AJ_ERR_RESOURCES;
-    }
 
     return AJ_OK;
 }
 
-static AJ_Status HashGuids(AJ_AuthenticationContext* ctx, const AJ_GUID* remoteGuid)
+static AJ_Status HashGuids(PeerContext* peer)
 {
+    AJ_AuthenticationContext* ctx = &peer->authContext;
+    const AJ_GUID* remoteGuid = peer->peerGuid;
     AJ_GUID localGuid;
     AJ_Status status;
     uint8_t authVersionLE[4];
+    uint32_t fast;
 
     AJ_ASSERT(remoteGuid != NULL);
     AJ_ASSERT(AJ_ConversationHash_IsInitialized(ctx));
@@ -413,41 +607,70 @@ static AJ_Status HashGuids(AJ_AuthenticationContext* ctx, const AJ_GUID* remoteG
         AJ_ConversationHash_Update_UInt8Array(ctx, CONVERSATION_V4, (uint8_t*)&localGuid, AJ_GUID_LEN);
     }
 
+    /* Suites negotiated in a fast handshake are not in any hashed message */
+    if (peer->fastAnswer) {
+        fast = ((uint32_t)peer->fastOffer << 16) | peer->fastAnswer;
+        HostU32ToLittleEndianU8(&fast, 1, authVersionLE);
+        AJ_ConversationHash_Update_UInt8Array(ctx, CONVERSATION_V4, authVersionLE, sizeof(authVersionLE));
+    }
+
     return AJ_OK;
 }
 
+/*
+ * Without a usable master secret, agree on a suite and exchange keys
+ */
+static AJ_Status StartKeyExchange(PeerContext* peer, AJ_Message* msg)
+{
+    if (peer->fastAnswer) {
+        /* Suite was already agreed in ExchangeGuids */
+        peer->authContext.suite = AUTH_KEYX_ECDHE | peer->fastAnswer;
+        return KeyExchange(peer);
+    }
+    return ExchangeSuites(peer, msg);
+}
+
 AJ_Status AJ_PeerAuthenticate(AJ_BusAttachment* bus, const char* peerName, AJ_PeerAuthenticateCallback callback, void* cbContext)
 {
     AJ_Status status;
     AJ_Message msg;
     char guidStr[2 * AJ_GUID_LEN + 1];
     AJ_GUID localGuid;
+    const AJ_GUID* peerGuid = AJ_GUID_Find(peerName);
+    PeerContext* peer;
+    uint32_t version;
+    size_t i;
 
     AJ_InfoPrintf(("PeerAuthenticate(bus=%p, peerName=\"%s\", callback=%p, cbContext=%p)\n",
                    bus, peerName, callback, cbContext));
 
     /*
-     * If handshake in progress and not timed-out
+     * If handshake with this peer in progress and not timed-out
      */
-    if (peerContext.peerGuid) {
-        status = HandshakeTimeout();
-        if (AJ_ERR_TIMEOUT != status) {
-            AJ_InfoPrintf(("PeerAuthenticate(): Handshake in progress\n"));
-            return AJ_ERR_RESOURCES;
+    for (i = 0; i < ArraySize(peerContexts); i++) {
+        peer = &peerContexts[i];
+        if (NULL == peer->authContext.bus) {
+            continue;
+        }
+        if ((peerGuid && (peerGuid == peer->peerGuid)) || (peer->peerName && (0 == strcmp(peerName, peer->peerName)))) {
+            if (AJ_ERR_TIMEOUT != HandshakeTimeout(peer)) {
+                AJ_InfoPrintf(("PeerAuthenticate(): Handshake in progress\n"));
+                return AJ_ERR_RESOURCES;
+            }
         }
     }
 
     /*
      * No handshake in progress or previous timed-out
      */
-    AJ_ClearAuthContext();
-    AJ_ClearSentManifests();
-    peerContext.callback = callback;
-    peerContext.cbContext = cbContext;
-    peerContext.peerName = peerName;
-    AJ_InitTimer(&peerContext.timer);
-    authContext.bus = bus;
-    authContext.role = AUTH_CLIENT;
+    peer = AllocPeerContext(bus, AUTH_CLIENT);
+    if (NULL == peer) {
+        AJ_InfoPrintf(("PeerAuthenticate(): Too many handshakes in progress\n"));
+        return AJ_ERR_RESOURCES;
+    }
+    peer->callback = callback;
+    peer->cbContext = cbContext;
+    peer->peerName = peerName;
 
     /* Load policy into memory */
     status = AJ_PolicyLoad();
@@ -464,22 +687,28 @@ AJ_Status AJ_PeerAuthenticate(AJ_BusAttachment* bus, const char* peerName, AJ_Pe
      * Kick off authentication with an ExchangeGUIDS method call
      */
     status = AJ_MarshalMethodCall(bus, &msg, AJ_METHOD_EXCHANGE_GUIDS, peerName, 0, AJ_NO_FLAGS, AJ_CALL_TIMEOUT);
-
     if (AJ_OK != status) {
-        return status;
+        goto Exit;
     }
+    /* The reply is matched back to this slot by serial number */
+    peer->serial = msg.hdr->serialNum;
     status = AJ_GetLocalGUID(&localGuid);
     if (AJ_OK != status) {
-        return status;
+        goto Exit;
     }
     status = AJ_GUID_ToString(&localGuid, guidStr, sizeof(guidStr));
     if (AJ_OK != status) {
-        return status;
+        goto Exit;
     }
-    authContext.version = REQUIRED_AUTH_VERSION;
-    status = AJ_MarshalArgs(&msg, "su", guidStr, authContext.version);
+    peer->authContext.version = REQUIRED_AUTH_VERSION;
+    version = peer->authContext.version;
+    peer->fastOffer = FastSuites(bus, version);
+    if (peer->fastOffer) {
+        version |= FAST_HANDSHAKE | peer->fastOffer;
+    }
+    status = AJ_MarshalArgs(&msg, "su", guidStr, version);
     if (AJ_OK != status) {
-        return status;
+        goto Exit;
     }
 
     /*
@@ -492,7 +721,14 @@ AJ_Status AJ_PeerAuthenticate(AJ_BusAttachment* bus, const char* peerName, AJ_Pe
      * conversation hash.
      */
 
-    return AJ_DeliverMsg(&msg);
+    status = AJ_DeliverMsg(&msg);
+    if (AJ_OK == status) {
+        return status;
+    }
+
+Exit:
+    ReleasePeerContext(peer);
+    return status;
 }
 
 AJ_Status AJ_PeerHandleExchangeGUIDs(AJ_Message* msg, AJ_Message* reply)
@@ -502,14 +738,18 @@ AJ_Status AJ_PeerHandleExchangeGUIDs(AJ_Message* msg, AJ_Message* reply)
     char* str;
     AJ_GUID remoteGuid;
     AJ_GUID localGuid;
+    PeerContext* peer;
+    uint32_t version;
+    uint16_t common;
 
     AJ_InfoPrintf(("AJ_PeerHandleExchangeGuids(msg=%p, reply=%p)\n", msg, reply));
 
     /*
-     * If handshake in progress and not timed-out
+     * If handshake with this peer in progress and not timed-out
      */
-    if (peerContext.peerGuid) {
-        status = HandshakeTimeout();
+    peer = FindPeerContext(AJ_GUID_Find(msg->sender));
+    if (peer) {
+        status = HandshakeTimeout(peer);
         if (AJ_ERR_TIMEOUT != status) {
             AJ_InfoPrintf(("AJ_PeerHandleExchangeGuids(msg=%p, reply=%p): Handshake in progress\n", msg, reply));
             return AJ_MarshalErrorMsg(msg, reply, AJ_ErrResources);
@@ -517,13 +757,13 @@ AJ_Status AJ_PeerHandleExchangeGUIDs(AJ_Message* msg, AJ_Message* reply)
     }
 
     /*
-     * No handshake in progress or previous timed-out
+     * No handshake in progress with this peer or previous timed-out
      */
-    AJ_ClearAuthContext();
-    AJ_ClearSentManifests();
-    AJ_InitTimer(&peerContext.timer);
-    authContext.bus = msg->bus;
-    authContext.role = AUTH_SERVER;
+    peer = AllocPeerContext(msg->bus, AUTH_SERVER);
+    if (NULL == peer) {
+        AJ_InfoPrintf(("AJ_PeerHandleExchangeGuids(msg=%p, reply=%p): Too many handshakes in progress\n", msg, reply));
+        return AJ_MarshalErrorMsg(msg, reply, AJ_ErrResources);
+    }
 
     /* Load policy into memory */
     status = AJ_PolicyLoad();
@@ -536,25 +776,35 @@ AJ_Status AJ_PeerHandleExchangeGUIDs(AJ_Message* msg, AJ_Message* reply)
         AJ_EnableSuite(msg->bus, AUTH_SUITE_ECDHE_SPEKE);
     }
 
-    status = AJ_UnmarshalArgs(msg, "su", &str, &authContext.version);
+    status = AJ_UnmarshalArgs(msg, "su", &str, &peer->authContext.version);
     if (AJ_OK != status) {
         AJ_InfoPrintf(("AJ_PeerHandleExchangeGuids(msg=%p, reply=%p): Unmarshal error\n", msg, reply));
-        HandshakeComplete(AJ_ERR_SECURITY);
+        HandshakeComplete(peer, AJ_ERR_SECURITY);
         return AJ_MarshalErrorMsg(msg, reply, AJ_ErrSecurityViolation);
     }
+    if (peer->authContext.version & FAST_HANDSHAKE) {
+        peer->fastOffer = (uint16_t)(peer->authContext.version & FAST_SUITE_MASK);
+        peer->authContext.version &= ~(uint32_t)(FAST_HANDSHAKE | FAST_SUITE_MASK);
+    }
     status = AJ_GUID_FromString(&remoteGuid, str);
     if (AJ_OK != status) {
         AJ_InfoPrintf(("AJ_PeerHandleExchangeGuids(msg=%p, reply=%p): Invalid GUID\n", msg, reply));
-        HandshakeComplete(AJ_ERR_SECURITY);
+        HandshakeComplete(peer, AJ_ERR_SECURITY);
         return AJ_MarshalErrorMsg(msg, reply, AJ_ErrSecurityViolation);
     }
     status = AJ_GUID_AddNameMapping(msg->bus, &remoteGuid, msg->sender, NULL);
     if (AJ_OK != status) {
         AJ_InfoPrintf(("AJ_PeerHandleExchangeGuids(msg=%p, reply=%p): Add name mapping error\n", msg, reply));
-        HandshakeComplete(AJ_ERR_RESOURCES);
+        HandshakeComplete(peer, AJ_ERR_RESOURCES);
         return AJ_MarshalErrorMsg(msg, reply, AJ_ErrResources);
     }
-    peerContext.peerGuid = AJ_GUID_Find(msg->sender);
+    if (FindPeerContext(AJ_GUID_Find(msg->sender))) {
+        /* Same peer already authenticating under another name */
+        AJ_InfoPrintf(("AJ_PeerHandleExchangeGuids(msg=%p, reply=%p): Handshake in progress\n", msg, reply));
+        HandshakeAbort(peer, AJ_ERR_RESOURCES);
+        return AJ_MarshalErrorMsg(msg, reply, AJ_ErrResources);
+    }
+    peer->peerGuid = AJ_GUID_Find(msg->sender);
     /*
      * Reset access control from previous peer
      */
@@ -563,25 +813,37 @@ AJ_Status AJ_PeerHandleExchangeGUIDs(AJ_Message* msg, AJ_Message* reply)
     /*
      * If we have a mastersecret stored - use it
      */
-    status = LoadMasterSecret(peerContext.peerGuid);
+    status = LoadMasterSecret(peer);
     if (AJ_OK == status) {
-        status = LoadECDSAContext(peerContext.peerGuid);
+        status = LoadECDSAContext(peer);
     }
     if (AJ_OK != status) {
         /* Credential expired or failed to load */
-        AJ_CredentialDeletePeer(peerContext.peerGuid);
+        AJ_CredentialDeletePeer(peer->peerGuid);
         /* Clear master secret buffer */
-        AJ_MemZeroSecure(authContext.mastersecret, AJ_MASTER_SECRET_LEN);
+        AJ_MemZeroSecure(peer->authContext.mastersecret, AJ_MASTER_SECRET_LEN);
     }
 
     /*
      * We are not currently negotiating versions so we tell the peer what version we require.
      */
-    authContext.version = GetAcceptableVersion(authContext.version);
-    if (0 == authContext.version) {
-        authContext.version = REQUIRED_AUTH_VERSION;
+    peer->authContext.version = GetAcceptableVersion(peer->authContext.version);
+    if (0 == peer->authContext.version) {
+        peer->authContext.version = REQUIRED_AUTH_VERSION;
     }
-    AJ_InfoPrintf(("AJ_PeerHandleExchangeGuids(msg=%p, reply=%p): Version %x\n", msg, reply, authContext.version));
+    version = peer->authContext.version;
+    /*
+     * Accept a fast handshake with the highest priority suite in common
+     */
+    common = peer->fastOffer & FastSuites(msg->bus, version);
+    if (common) {
+        peer->fastAnswer = FAST_SUITE_MASK + 1;
+        do {
+            peer->fastAnswer >>= 1;
+        } while (!(common & peer->fastAnswer));
+        version |= FAST_HANDSHAKE | peer->fastAnswer;
+    }
+    AJ_InfoPrintf(("AJ_PeerHandleExchangeGuids(msg=%p, reply=%p): Version %x\n", msg, reply, version));
 
     status = AJ_MarshalReplyMsg(msg, reply);
     if (AJ_OK != status) {
@@ -595,7 +857,7 @@ AJ_Status AJ_PeerHandleExchangeGUIDs(AJ_Message* msg, AJ_Message* reply)
     if (AJ_OK != status) {
         goto Exit;
     }
-    status = AJ_MarshalArgs(reply, "su", guidStr, authContext.version);
+    status = AJ_MarshalArgs(reply, "su", guidStr, version);
     if (AJ_OK != status) {
         goto Exit;
     }
@@ -603,7 +865,7 @@ AJ_Status AJ_PeerHandleExchangeGUIDs(AJ_Message* msg, AJ_Message* reply)
     return status;
 
 Exit:
-    HandshakeComplete(AJ_ERR_SECURITY);
+    HandshakeComplete(peer, AJ_ERR_SECURITY);
     return AJ_MarshalErrorMsg(msg, reply, AJ_ErrSecurityViolation);
 }
 
@@ -612,41 +874,61 @@ AJ_Status AJ_PeerHandleExchangeGUIDsReply(AJ_Message* msg)
     AJ_Status status;
     const char* guidStr;
     AJ_GUID remoteGuid;
+    PeerContext* peer = NULL;
+    size_t i;
 
     AJ_InfoPrintf(("AJ_PeerHandleExchangeGUIDsReply(msg=%p)\n", msg));
 
+    /*
+     * Find the handshake this is a reply to
+     */
+    for (i = 0; i < ArraySize(peerContexts); i++) {
+        if (peerContexts[i].authContext.bus && (AUTH_CLIENT == peerContexts[i].authContext.role) &&
+            (NULL == peerContexts[i].peerGuid) && (msg->replySerial == peerContexts[i].serial)) {
+            peer = &peerContexts[i];
+            break;
+        }
+    }
+    if (NULL == peer) {
+        AJ_WarnPrintf(("AJ_PeerHandleExchangeGUIDsReply(msg=%p): No handshake for reply\n", msg));
+        return AJ_ERR_RESOURCES;
+    }
+
     if (msg->hdr->msgType == AJ_MSG_ERROR) {
         AJ_WarnPrintf(("AJ_PeerHandleExchangeGUIDsReply(msg=%p): error=%s.\n", msg, msg->error));
         if (0 == strncmp(msg->error, AJ_ErrResources, sizeof(AJ_ErrResources))) {
+            /* Peer is busy, the application may try again later */
             status = AJ_ERR_RESOURCES;
+            ReleasePeerContext(peer);
         } else {
             status = AJ_ERR_SECURITY;
-            HandshakeComplete(status);
+            HandshakeComplete(peer, status);
         }
         return status;
     }
 
-    /*
-     * If handshake in progress and not timed-out
-     */
-    if (peerContext.peerGuid) {
-        status = HandshakeTimeout();
-        if (AJ_ERR_TIMEOUT != status) {
-            AJ_WarnPrintf(("AJ_PeerHandleExchangeGUIDsReply(msg=%p): Handshake in progress\n", msg));
-            return AJ_ERR_RESOURCES;
-        }
-    }
-
-    status = AJ_UnmarshalArgs(msg, "su", &guidStr, &authContext.version);
+    status = AJ_UnmarshalArgs(msg, "su", &guidStr, &peer->authContext.version);
     if (status != AJ_OK) {
         AJ_WarnPrintf(("AJ_PeerHandleExchangeGUIDsReply(msg=%p): Unmarshal error\n", msg));
         goto Exit;
     }
-    authContext.version = GetAcceptableVersion(authContext.version);
-    if (0 == authContext.version) {
+    if (peer->fastOffer && (peer->authContext.version & FAST_HANDSHAKE)) {
+        peer->fastAnswer = (uint16_t)(peer->authContext.version & FAST_SUITE_MASK);
+        peer->authContext.version &= ~(uint32_t)(FAST_HANDSHAKE | FAST_SUITE_MASK);
+    }
+    peer->authContext.version = GetAcceptableVersion(peer->authContext.version);
+    if (0 == peer->authContext.version) {
         AJ_WarnPrintf(("AJ_PeerHandleExchangeGUIDsReply(msg=%p): Invalid version\n", msg));
         goto Exit;
     }
+    if (peer->fastAnswer) {
+        /* Server must pick exactly one of the suites we offered */
+        if ((peer->fastAnswer & (peer->fastAnswer - 1)) ||
+            !(peer->fastAnswer & FastSuites(msg->bus, peer->authContext.version) & peer->fastOffer)) {
+            AJ_WarnPrintf(("AJ_PeerHandleExchangeGUIDsReply(msg=%p): Invalid fast handshake suite\n", msg));
+            goto Exit;
+        }
+    }
     status = AJ_GUID_FromString(&remoteGuid, guidStr);
     if (AJ_OK != status) {
         AJ_WarnPrintf(("AJ_PeerHandleExchangeGUIDsReply(msg=%p): Invalid GUID\n", msg));
@@ -656,15 +938,23 @@ AJ_Status AJ_PeerHandleExchangeGUIDsReply(AJ_Message* msg)
     /*
      * Two name mappings to add, the well known name, and the unique name from the message.
      */
-    status = AJ_GUID_AddNameMapping(msg->bus, &remoteGuid, msg->sender, peerContext.peerName);
+    status = AJ_GUID_AddNameMapping(msg->bus, &remoteGuid, msg->sender, peer->peerName);
     if (AJ_OK != status) {
         AJ_WarnPrintf(("AJ_PeerHandleExchangeGUIDsReply(msg=%p): Add name mapping error\n", msg));
         goto Exit;
     }
+    /*
+     * The peer may have started its own handshake with us in the meantime
+     */
+    if (FindPeerContext(AJ_GUID_Find(msg->sender))) {
+        AJ_WarnPrintf(("AJ_PeerHandleExchangeGUIDsReply(msg=%p): Handshake in progress\n", msg));
+        HandshakeAbort(peer, AJ_ERR_RESOURCES);
+        return AJ_ERR_RESOURCES;
+    }
     /*
      * Remember which peer is being authenticated
      */
-    peerContext.peerGuid = AJ_GUID_Find(msg->sender);
+    peer->peerGuid = AJ_GUID_Find(msg->sender);
     /*
      * Reset access control from previous peer
      */
@@ -673,32 +963,32 @@ AJ_Status AJ_PeerHandleExchangeGUIDsReply(AJ_Message* msg)
     /*
      * If we have a mastersecret stored - use it
      */
-    status = LoadMasterSecret(peerContext.peerGuid);
+    status = LoadMasterSecret(peer);
     if (AJ_OK == status) {
-        status = LoadECDSAContext(peerContext.peerGuid);
+        status = LoadECDSAContext(peer);
     }
     if (AJ_OK == status) {
-        status = GenSessionKey(msg);
+        status = GenSessionKey(peer, msg);
         return status;
     } else {
         /* Credential expired or failed to load */
-        AJ_CredentialDeletePeer(peerContext.peerGuid);
+        AJ_CredentialDeletePeer(peer->peerGuid);
         /* Clear master secret buffer */
-        AJ_MemZeroSecure(authContext.mastersecret, AJ_MASTER_SECRET_LEN);
+        AJ_MemZeroSecure(peer->authContext.mastersecret, AJ_MASTER_SECRET_LEN);
     }
 
     /*
      * Start the ALLJOYN conversation
      */
-    status = ExchangeSuites(msg);
+    status = StartKeyExchange(peer, msg);
     return status;
 
 Exit:
-    HandshakeComplete(AJ_ERR_SECURITY);
+    HandshakeComplete(peer, AJ_ERR_SECURITY);
     return AJ_ERR_SECURITY;
 }
 
-static AJ_Status ExchangeSuites(AJ_Message* msg)
+static AJ_Status ExchangeSuites(PeerContext* peer, AJ_Message* msg)
 {
     AJ_Status status;
     AJ_Message call;
@@ -707,21 +997,21 @@ static AJ_Status ExchangeSuites(AJ_Message* msg)
 
     AJ_InfoPrintf(("ExchangeSuites(msg=%p)\n", msg));
 
-    authContext.role = AUTH_CLIENT;
+    peer->authContext.role = AUTH_CLIENT;
 
     /*
      * Send suites in this priority order
      */
-    if (AJ_IsSuiteEnabled(msg->bus, AUTH_SUITE_ECDHE_ECDSA, AJ_UNPACK_AUTH_VERSION(authContext.version))) {
+    if (AJ_IsSuiteEnabled(msg->bus, AUTH_SUITE_ECDHE_ECDSA, AJ_UNPACK_AUTH_VERSION(peer->authContext.version))) {
         suites[num++] = AUTH_SUITE_ECDHE_ECDSA;
     }
-    if (AJ_IsSuiteEnabled(msg->bus, AUTH_SUITE_ECDHE_PSK, AJ_UNPACK_AUTH_VERSION(authContext.version))) {
+    if (AJ_IsSuiteEnabled(msg->bus, AUTH_SUITE_ECDHE_PSK, AJ_UNPACK_AUTH_VERSION(peer->authContext.version))) {
         suites[num++] = AUTH_SUITE_ECDHE_PSK;
     }
-    if (AJ_IsSuiteEnabled(msg->bus, AUTH_SUITE_ECDHE_SPEKE, AJ_UNPACK_AUTH_VERSION(authContext.version))) {
+    if (AJ_IsSuiteEnabled(msg->bus, AUTH_SUITE_ECDHE_SPEKE, AJ_UNPACK_AUTH_VERSION(peer->authContext.version))) {
         suites[num++] = AUTH_SUITE_ECDHE_SPEKE;
     }
-    if (AJ_IsSuiteEnabled(msg->bus, AUTH_SUITE_ECDHE_NULL, AJ_UNPACK_AUTH_VERSION(authContext.version))) {
+    if (AJ_IsSuiteEnabled(msg->bus, AUTH_SUITE_ECDHE_NULL, AJ_UNPACK_AUTH_VERSION(peer->authContext.version))) {
         suites[num++] = AUTH_SUITE_ECDHE_NULL;
     }
     if (!num) {
@@ -743,23 +1033,23 @@ static AJ_Status ExchangeSuites(AJ_Message* msg)
      * Initialize conversation hash and hash GUIDs.
      * May have already been done by GenSessionKey.
      */
-    if (!AJ_ConversationHash_IsInitialized(&authContext)) {
-        status = AJ_ConversationHash_Initialize(&authContext);
+    if (!AJ_ConversationHash_IsInitialized(&peer->authContext)) {
+        status = AJ_ConversationHash_Initialize(&peer->authContext);
         if (AJ_OK != status) {
             goto Exit;
         }
-        status = HashGuids(&authContext, peerContext.peerGuid);
+        status = HashGuids(peer);
         if (AJ_OK != status) {
             goto Exit;
         }
     }
 
-    AJ_ConversationHash_Update_Message(&authContext, CONVERSATION_V4, &call, HASH_MSG_MARSHALED);
+    AJ_ConversationHash_Update_Message(&peer->authContext, CONVERSATION_V4, &call, HASH_MSG_MARSHALED);
 
     return AJ_DeliverMsg(&call);
 
 Exit:
-    HandshakeComplete(AJ_ERR_SECURITY);
+    HandshakeComplete(peer, AJ_ERR_SECURITY);
     return AJ_ERR_SECURITY;
 }
 
@@ -771,10 +1061,11 @@ AJ_Status AJ_PeerHandleExchangeSuites(AJ_Message* msg, AJ_Message* reply)
     size_t numsuites;
     uint32_t i;
     const AJ_GUID* peerGuid = AJ_GUID_Find(msg->sender);
+    PeerContext* peer;
 
     AJ_InfoPrintf(("AJ_PeerHandleExchangeSuites(msg=%p, reply=%p)\n", msg, reply));
 
-    status = HandshakeValid(peerGuid);
+    status = HandshakeValid(peerGuid, &peer);
     if (AJ_OK != status) {
         return AJ_MarshalErrorMsg(msg, reply, AJ_ErrResources);
     }
@@ -783,21 +1074,21 @@ AJ_Status AJ_PeerHandleExchangeSuites(AJ_Message* msg, AJ_Message* reply)
      * Initialize the conversation hash and hash the GUIDs.
      * May have already been done by GenSessionKey.
      */
-    if (!AJ_ConversationHash_IsInitialized(&authContext)) {
-        status = AJ_ConversationHash_Initialize(&authContext);
+    if (!AJ_ConversationHash_IsInitialized(&peer->authContext)) {
+        status = AJ_ConversationHash_Initialize(&peer->authContext);
         if (AJ_OK != status) {
             goto Exit;
         }
-        status = HashGuids(&authContext, peerGuid);
+        status = HashGuids(peer);
         if (AJ_OK != status) {
             goto Exit;
         }
     }
 
     /* Update hash before unmarshalling (endian swaps may occur) */
-    AJ_ConversationHash_Update_Message(&authContext, CONVERSATION_V4, msg, HASH_MSG_UNMARSHALED);
+    AJ_ConversationHash_Update_Message(&peer->authContext, CONVERSATION_V4, msg, HASH_MSG_UNMARSHALED);
 
-    authContext.role = AUTH_SERVER;
+    peer->authContext.role = AUTH_SERVER;
 
     /*
      * Receive suites
@@ -824,7 +1115,7 @@ AJ_Status AJ_PeerHandleExchangeSuites(AJ_Message* msg, AJ_Message* reply)
      * If it's enabled, marshal the suite to send to the other peer.
      */
     for (i = 0; i < numsuites; i++) {
-        if (AJ_IsSuiteEnabled(msg->bus, suites[i], AJ_UNPACK_AUTH_VERSION(authContext.version))) {
+        if (AJ_IsSuiteEnabled(msg->bus, suites[i], AJ_UNPACK_AUTH_VERSION(peer->authContext.version))) {
             status = AJ_MarshalArgs(reply, "u", suites[i]);
             if (AJ_OK != status) {
                 goto Exit;
@@ -837,7 +1128,7 @@ AJ_Status AJ_PeerHandleExchangeSuites(AJ_Message* msg, AJ_Message* reply)
         goto Exit;
     }
 
-    AJ_ConversationHash_Update_Message(&authContext, CONVERSATION_V4, reply, HASH_MSG_MARSHALED);
+    AJ_ConversationHash_Update_Message(&peer->authContext, CONVERSATION_V4, reply, HASH_MSG_MARSHALED);
 
     AJ_InfoPrintf(("Exchange Suites Complete\n"));
     return status;
@@ -848,10 +1139,10 @@ Exit:
         AJ_WarnPrintf(("AJ_PeerHandleExchangeSuites(msg=%p, reply=%p): Marshal error\n", msg, reply));
     }
 
-    HandshakeComplete(AJ_ERR_SECURITY);
+    HandshakeComplete(peer, AJ_ERR_SECURITY);
     status = AJ_MarshalErrorMsg(msg, reply, AJ_ErrSecurityViolation);
     if (AJ_OK == status) {
-        AJ_ConversationHash_Update_Message(&authContext, CONVERSATION_V4, reply, HASH_MSG_MARSHALED);
+        AJ_ConversationHash_Update_Message(&peer->authContext, CONVERSATION_V4, reply, HASH_MSG_MARSHALED);
     }
     return status;
 }
@@ -863,16 +1154,17 @@ AJ_Status AJ_PeerHandleExchangeSuitesReply(AJ_Message* msg)
     size_t numsuites;
     size_t i;
     const AJ_GUID* peerGuid = AJ_GUID_Find(msg->sender);
+    PeerContext* peer;
 
     AJ_InfoPrintf(("AJ_PeerHandleExchangeSuitesReply(msg=%p)\n", msg));
 
-    status = HandshakeValid(peerGuid);
+    status = HandshakeValid(peerGuid, &peer);
     if (AJ_OK != status) {
         return status;
     }
 
     /* Update hash before unmarshalling (endian swaps may occur) */
-    AJ_ConversationHash_Update_Message(&authContext, CONVERSATION_V4, msg, HASH_MSG_UNMARSHALED);
+    AJ_ConversationHash_Update_Message(&peer->authContext, CONVERSATION_V4, msg, HASH_MSG_UNMARSHALED);
 
     if (msg->hdr->msgType == AJ_MSG_ERROR) {
         AJ_WarnPrintf(("AJ_PeerHandleExchangeSuitesReply(msg=%p): error=%s.\n", msg, msg->error));
@@ -891,14 +1183,14 @@ AJ_Status AJ_PeerHandleExchangeSuitesReply(AJ_Message* msg)
     /*
      * Double check we can support (ie. that server didn't send something bogus)
      */
-    authContext.suite = 0;
+    peer->authContext.suite = 0;
     for (i = 0; i < numsuites; i++) {
-        if (AJ_IsSuiteEnabled(msg->bus, suites[i], AJ_UNPACK_AUTH_VERSION(authContext.version))) {
+        if (AJ_IsSuiteEnabled(msg->bus, suites[i], AJ_UNPACK_AUTH_VERSION(peer->authContext.version))) {
             // Pick the highest priority suite, which happens to be the highest integer
-            authContext.suite = (suites[i] > authContext.suite) ? suites[i] : authContext.suite;
+            peer->authContext.suite = (suites[i] > peer->authContext.suite) ? suites[i] : peer->authContext.suite;
         }
     }
-    if (!authContext.suite) {
+    if (!peer->authContext.suite) {
         AJ_InfoPrintf(("AJ_PeerHandleExchangeSuitesReply(msg=%p): No common suites\n", msg));
         goto Exit;
     }
@@ -907,11 +1199,11 @@ AJ_Status AJ_PeerHandleExchangeSuitesReply(AJ_Message* msg)
      * Exchange suites complete.
      */
     AJ_InfoPrintf(("Exchange Suites Complete\n"));
-    status = KeyExchange(msg->bus);
+    status = KeyExchange(peer);
     return status;
 
 Exit:
-    HandshakeComplete(AJ_ERR_SECURITY);
+    HandshakeComplete(peer, AJ_ERR_SECURITY);
     return AJ_ERR_SECURITY;
 }
 
@@ -932,49 +1224,65 @@ static AJ_Status AJ_SetKeyAuthContext(AJ_AuthenticationContext* ctx, const char*
     return AJ_OK;
 }
 
-static AJ_Status KeyExchange(AJ_BusAttachment* bus)
+static AJ_Status KeyExchange(PeerContext* peer)
 {
+    AJ_BusAttachment* bus = peer->authContext.bus;
     AJ_Status status;
     uint8_t suiteb8[sizeof (uint32_t)];
     AJ_Message call;
 
     AJ_InfoPrintf(("KeyExchange(bus=%p)\n", bus));
 
-    AJ_InfoPrintf(("Authenticating using suite %x\n", authContext.suite));
+    AJ_InfoPrintf(("Authenticating using suite %x\n", peer->authContext.suite));
+
+    /*
+     * Initialize the conversation hash and hash the GUIDs.
+     * Already done unless ExchangeSuites was skipped in a fast handshake.
+     */
+    if (!AJ_ConversationHash_IsInitialized(&peer->authContext)) {
+        status = AJ_ConversationHash_Initialize(&peer->authContext);
+        if (AJ_OK != status) {
+            goto Exit;
+        }
+        status = HashGuids(peer);
+        if (AJ_OK != status) {
+            goto Exit;
+        }
+    }
 
     /*
      * Send suite and key material
      */
-    status = AJ_MarshalMethodCall(bus, &call, AJ_METHOD_KEY_EXCHANGE, peerContext.peerName, 0, AJ_NO_FLAGS, AJ_AUTH_CALL_TIMEOUT);
+    status = AJ_MarshalMethodCall(bus, &call, AJ_METHOD_KEY_EXCHANGE, peer->peerName, 0, AJ_NO_FLAGS, AJ_AUTH_CALL_TIMEOUT);
     if (AJ_OK != status) {
         AJ_WarnPrintf(("KeyExchange(bus=%p): Marshal error\n", bus));
         goto Exit;
     }
-    status = AJ_MarshalArgs(&call, "u", authContext.suite);
+    status = AJ_MarshalArgs(&call, "u", peer->authContext.suite);
     if (AJ_OK != status) {
         AJ_WarnPrintf(("KeyExchange(bus=%p): Marshal error\n", bus));
         goto Exit;
     }
 
-    status = AJ_SetKeyAuthContext(&authContext, peerContext.peerName);
+    status = AJ_SetKeyAuthContext(&peer->authContext, peer->peerName);
     if (AJ_OK != status) {
         goto Exit;
     }
 
-    HostU32ToBigEndianU8(&authContext.suite, sizeof (authContext.suite), suiteb8);
-    AJ_ConversationHash_Update_UInt8Array(&authContext, CONVERSATION_V1, suiteb8, sizeof (suiteb8));
-    status = AJ_KeyExchangeMarshal(&authContext, &call);
+    HostU32ToBigEndianU8(&peer->authContext.suite, sizeof (peer->authContext.suite), suiteb8);
+    AJ_ConversationHash_Update_UInt8Array(&peer->authContext, CONVERSATION_V1, suiteb8, sizeof (suiteb8));
+    status = AJ_KeyExchangeMarshal(&peer->authContext, &call);
     if (AJ_OK != status) {
         AJ_WarnPrintf(("KeyExchange(bus=%p): Key exchange marshal error\n", bus));
         goto Exit;
     }
-    AJ_ASSERT(AUTH_CLIENT == authContext.role);
-    AJ_ConversationHash_Update_Message(&authContext, CONVERSATION_V4, &call, HASH_MSG_MARSHALED);
+    AJ_ASSERT(AUTH_CLIENT == peer->authContext.role);
+    AJ_ConversationHash_Update_Message(&peer->authContext, CONVERSATION_V4, &call, HASH_MSG_MARSHALED);
 
     return AJ_DeliverMsg(&call);
 
 Exit:
-    HandshakeComplete(AJ_ERR_SECURITY);
+    HandshakeComplete(peer, AJ_ERR_SECURITY);
     return AJ_ERR_SECURITY;
 }
 
@@ -983,31 +1291,47 @@ AJ_Status AJ_PeerHandleKeyExchange(AJ_Message* msg, AJ_Message* reply)
     AJ_Status status;
     uint8_t suiteb8[sizeof (uint32_t)];
     const AJ_GUID* peerGuid = AJ_GUID_Find(msg->sender);
+    PeerContext* peer;
 
     AJ_InfoPrintf(("AJ_PeerHandleKeyExchange(msg=%p, reply=%p)\n", msg, reply));
 
-    status = HandshakeValid(peerGuid);
+    status = HandshakeValid(peerGuid, &peer);
     if (AJ_OK != status) {
         return AJ_MarshalErrorMsg(msg, reply, AJ_ErrResources);
     }
 
+    /*
+     * Initialize the conversation hash and hash the GUIDs.
+     * Already done unless ExchangeSuites was skipped in a fast handshake.
+     */
+    if (!AJ_ConversationHash_IsInitialized(&peer->authContext)) {
+        status = AJ_ConversationHash_Initialize(&peer->authContext);
+        if (AJ_OK != status) {
+            goto Exit;
+        }
+        status = HashGuids(peer);
+        if (AJ_OK != status) {
+            goto Exit;
+        }
+    }
+
     /* Update hash before unmarshalling (endian swaps may occur) */
-    AJ_ConversationHash_Update_Message(&authContext, CONVERSATION_V4, msg, HASH_MSG_UNMARSHALED);
+    AJ_ConversationHash_Update_Message(&peer->authContext, CONVERSATION_V4, msg, HASH_MSG_UNMARSHALED);
 
     /*
      * Receive suite
      */
-    status = AJ_UnmarshalArgs(msg, "u", &authContext.suite);
+    status = AJ_UnmarshalArgs(msg, "u", &peer->authContext.suite);
     if (AJ_OK != status) {
         goto Exit;
     }
-    if (!AJ_IsSuiteEnabled(msg->bus, authContext.suite, AJ_UNPACK_AUTH_VERSION(authContext.version))) {
+    if (!AJ_IsSuiteEnabled(msg->bus, peer->authContext.suite, AJ_UNPACK_AUTH_VERSION(peer->authContext.version))) {
         goto Exit;
     }
-    HostU32ToBigEndianU8(&authContext.suite, sizeof (authContext.suite), suiteb8);
-    AJ_ConversationHash_Update_UInt8Array(&authContext, CONVERSATION_V1, suiteb8, sizeof (suiteb8));
+    HostU32ToBigEndianU8(&peer->authContext.suite, sizeof (peer->authContext.suite), suiteb8);
+    AJ_ConversationHash_Update_UInt8Array(&peer->authContext, CONVERSATION_V1, suiteb8, sizeof (suiteb8));
 
-    status = AJ_SetKeyAuthContext(&authContext, msg->sender);
+    status = AJ_SetKeyAuthContext(&peer->authContext, msg->sender);
     if (AJ_OK != status) {
         goto Exit;
     }
@@ -1015,7 +1339,7 @@ AJ_Status AJ_PeerHandleKeyExchange(AJ_Message* msg, AJ_Message* reply)
     /*
      * Receive key material
      */
-    status = AJ_KeyExchangeUnmarshal(&authContext, msg);
+    status = AJ_KeyExchangeUnmarshal(&peer->authContext, msg);
     if (AJ_OK != status) {
         AJ_InfoPrintf(("AJ_PeerHandleKeyExchange(msg=%p, reply=%p): Key exchange unmarshal error\n", msg, reply));
         goto Exit;
@@ -1028,26 +1352,26 @@ AJ_Status AJ_PeerHandleKeyExchange(AJ_Message* msg, AJ_Message* reply)
     if (AJ_OK != status) {
         goto Exit;
     }
-    status = AJ_MarshalArgs(reply, "u", authContext.suite);
+    status = AJ_MarshalArgs(reply, "u", peer->authContext.suite);
     if (AJ_OK != status) {
         goto Exit;
     }
-    AJ_ConversationHash_Update_UInt8Array(&authContext, CONVERSATION_V1, (uint8_t*)suiteb8, sizeof(suiteb8));
-    status = AJ_KeyExchangeMarshal(&authContext, reply);
+    AJ_ConversationHash_Update_UInt8Array(&peer->authContext, CONVERSATION_V1, (uint8_t*)suiteb8, sizeof(suiteb8));
+    status = AJ_KeyExchangeMarshal(&peer->authContext, reply);
     if (AJ_OK != status) {
         AJ_WarnPrintf(("AJ_PeerHandleKeyExchange(msg=%p, reply=%p): Key exchange marshal error\n", msg, reply));
         goto Exit;
     }
-    AJ_ConversationHash_Update_Message(&authContext, CONVERSATION_V4, reply, HASH_MSG_MARSHALED);
-    peerContext.state = AJ_AUTH_EXCHANGED;
+    AJ_ConversationHash_Update_Message(&peer->authContext, CONVERSATION_V4, reply, HASH_MSG_MARSHALED);
+    peer->state = AJ_AUTH_EXCHANGED;
     AJ_InfoPrintf(("Key Exchange Complete\n"));
     return status;
 
 Exit:
-    HandshakeComplete(AJ_ERR_SECURITY);
+    HandshakeComplete(peer, AJ_ERR_SECURITY);
     status = AJ_MarshalErrorMsg(msg, reply, AJ_ErrSecurityViolation);
     if (AJ_OK == status) {
-        AJ_ConversationHash_Update_Message(&authContext, CONVERSATION_V4, reply, HASH_MSG_MARSHALED);
+        AJ_ConversationHash_Update_Message(&peer->authContext, CONVERSATION_V4, reply, HASH_MSG_MARSHALED);
     }
     return status;
 }
@@ -1058,6 +1382,7 @@ AJ_Status AJ_PeerHandleKeyExchangeReply(AJ_Message* msg)
     uint32_t suite;
     uint8_t suiteb8[sizeof (uint32_t)];
     const AJ_GUID* peerGuid = AJ_GUID_Find(msg->sender);
+    PeerContext* peer = FindPeerContext(peerGuid);
 
     AJ_InfoPrintf(("AJ_PeerHandleKeyExchangeReply(msg=%p)\n", msg));
 
@@ -1067,18 +1392,20 @@ AJ_Status AJ_PeerHandleKeyExchangeReply(AJ_Message* msg)
             status = AJ_ERR_RESOURCES;
         } else {
             status = AJ_ERR_SECURITY;
-            HandshakeComplete(status);
+            if (peer) {
+                HandshakeComplete(peer, status);
+            }
         }
         return status;
     }
 
-    status = HandshakeValid(peerGuid);
+    status = HandshakeValid(peerGuid, &peer);
     if (AJ_OK != status) {
         return status;
     }
 
     /* Update hash before unmarshalling (endian swaps may occur) */
-    AJ_ConversationHash_Update_Message(&authContext, CONVERSATION_V4, msg, HASH_MSG_UNMARSHALED);
+    AJ_ConversationHash_Update_Message(&peer->authContext, CONVERSATION_V4, msg, HASH_MSG_UNMARSHALED);
 
     /*
      * Receive key material
@@ -1088,13 +1415,13 @@ AJ_Status AJ_PeerHandleKeyExchangeReply(AJ_Message* msg)
         AJ_WarnPrintf(("AJ_PeerHandleKeyExchangeReply(msg=%p): Unmarshal error\n", msg));
         goto Exit;
     }
-    if (suite != authContext.suite) {
+    if (suite != peer->authContext.suite) {
         AJ_WarnPrintf(("AJ_PeerHandleKeyExchangeReply(msg=%p): Suite mismatch\n", msg));
         goto Exit;
     }
     HostU32ToBigEndianU8(&suite, sizeof (suite), suiteb8);
-    AJ_ConversationHash_Update_UInt8Array(&authContext, CONVERSATION_V1, suiteb8, sizeof(suiteb8));
-    status = AJ_KeyExchangeUnmarshal(&authContext, msg);
+    AJ_ConversationHash_Update_UInt8Array(&peer->authContext, CONVERSATION_V1, suiteb8, sizeof(suiteb8));
+    status = AJ_KeyExchangeUnmarshal(&peer->authContext, msg);
     if (AJ_OK != status) {
         AJ_WarnPrintf(("AJ_PeerHandleKeyExchangeReply(msg=%p): Key exchange unmarshal error\n", msg));
         goto Exit;
@@ -1103,17 +1430,17 @@ AJ_Status AJ_PeerHandleKeyExchangeReply(AJ_Message* msg)
     /*
      * Key exchange complete - start the authentication
      */
-    peerContext.state = AJ_AUTH_EXCHANGED;
+    peer->state = AJ_AUTH_EXCHANGED;
     AJ_InfoPrintf(("Key Exchange Complete\n"));
-    status = KeyAuthentication(msg);
+    status = KeyAuthentication(peer, msg);
     return status;
 
 Exit:
-    HandshakeComplete(AJ_ERR_SECURITY);
+    HandshakeComplete(peer, AJ_ERR_SECURITY);
     return AJ_ERR_SECURITY;
 }
 
-static AJ_Status KeyAuthentication(AJ_Message* msg)
+static AJ_Status KeyAuthentication(PeerContext* peer, AJ_Message* msg)
 {
     AJ_Status status;
     AJ_Message call;
@@ -1121,7 +1448,7 @@ static AJ_Status KeyAuthentication(AJ_Message* msg)
 
     AJ_InfoPrintf(("AJ_KeyAuthentication(msg=%p)\n", msg));
 
-    status = HandshakeValid(peerGuid);
+    status = HandshakeValid(peerGuid, &peer);
     if (AJ_OK != status) {
         return status;
     }
@@ -1137,22 +1464,22 @@ static AJ_Status KeyAuthentication(AJ_Message* msg)
         goto Exit;
     }
     /* Get the conversation digest before it's updated with this message */
-    status = AJ_ConversationHash_GetDigest(&authContext);
+    status = AJ_ConversationHash_GetDigest(&peer->authContext);
     if (AJ_OK != status) {
         goto Exit;
     }
-    status = AJ_KeyAuthenticationMarshal(&authContext, &call);
+    status = AJ_KeyAuthenticationMarshal(&peer->authContext, &call);
     if (AJ_OK != status) {
         AJ_WarnPrintf(("AJ_KeyAuthentication(msg=%p): Key authentication marshal error\n", msg));
         goto Exit;
     }
 
-    AJ_ConversationHash_Update_Message(&authContext, CONVERSATION_V4, &call, HASH_MSG_MARSHALED);
+    AJ_ConversationHash_Update_Message(&peer->authContext, CONVERSATION_V4, &call, HASH_MSG_MARSHALED);
 
     return AJ_DeliverMsg(&call);
 
 Exit:
-    HandshakeComplete(AJ_ERR_SECURITY);
+    HandshakeComplete(peer, AJ_ERR_SECURITY);
     return AJ_ERR_SECURITY;
 }
 
@@ -1160,32 +1487,33 @@ AJ_Status AJ_PeerHandleKeyAuthentication(AJ_Message* msg, AJ_Message* reply)
 {
     AJ_Status status;
     const AJ_GUID* peerGuid = AJ_GUID_Find(msg->sender);
+    PeerContext* peer;
 
     AJ_InfoPrintf(("AJ_PeerHandleKeyAuthentication(msg=%p, reply=%p)\n", msg, reply));
 
-    status = HandshakeValid(peerGuid);
+    status = HandshakeValid(peerGuid, &peer);
     if (AJ_OK != status) {
         return AJ_MarshalErrorMsg(msg, reply, AJ_ErrResources);
     }
 
-    if (AJ_AUTH_EXCHANGED != peerContext.state) {
+    if (AJ_AUTH_EXCHANGED != peer->state) {
         AJ_InfoPrintf(("AJ_PeerHandleKeyAuthentication(msg=%p, reply=%p): Invalid state\n", msg, reply));
-        AJ_ConversationHash_Update_Message(&authContext, CONVERSATION_V4, msg, HASH_MSG_UNMARSHALED);
+        AJ_ConversationHash_Update_Message(&peer->authContext, CONVERSATION_V4, msg, HASH_MSG_UNMARSHALED);
         goto Exit;
     }
 
     /* Get the conversation digest before it's updated with this message */
-    status = AJ_ConversationHash_GetDigest(&authContext);
+    status = AJ_ConversationHash_GetDigest(&peer->authContext);
     if (AJ_OK != status) {
         goto Exit;
     }
     /* Update hash before unmarshalling (endian swaps may occur) */
-    AJ_ConversationHash_Update_Message(&authContext, CONVERSATION_V4, msg, HASH_MSG_UNMARSHALED);
+    AJ_ConversationHash_Update_Message(&peer->authContext, CONVERSATION_V4, msg, HASH_MSG_UNMARSHALED);
 
     /*
      * Receive authentication material
      */
-    status = AJ_KeyAuthenticationUnmarshal(&authContext, msg);
+    status = AJ_KeyAuthenticationUnmarshal(&peer->authContext, msg);
     if (AJ_OK != status) {
         AJ_InfoPrintf(("AJ_PeerHandleKeyAuthentication(msg=%p, reply=%p): Key authentication unmarshal error\n", msg, reply));
         goto Exit;
@@ -1200,29 +1528,29 @@ AJ_Status AJ_PeerHandleKeyAuthentication(AJ_Message* msg, AJ_Message* reply)
     }
 
     /* Get the conversation digest before it's updated with this reply */
-    status = AJ_ConversationHash_GetDigest(&authContext);
+    status = AJ_ConversationHash_GetDigest(&peer->authContext);
     if (AJ_OK != status) {
         goto Exit;
     }
 
-    status = AJ_KeyAuthenticationMarshal(&authContext, reply);
+    status = AJ_KeyAuthenticationMarshal(&peer->authContext, reply);
     if (AJ_OK != status) {
         AJ_WarnPrintf(("AJ_PeerHandleKeyAuthentication(msg=%p, reply=%p): Key authentication marshal error\n", msg, reply));
         goto Exit;
     }
 
-    AJ_ConversationHash_Update_Message(&authContext, CONVERSATION_V4, reply, HASH_MSG_MARSHALED);
+    AJ_ConversationHash_Update_Message(&peer->authContext, CONVERSATION_V4, reply, HASH_MSG_MARSHALED);
 
     AJ_InfoPrintf(("Key Authentication Complete\n"));
-    peerContext.state = AJ_AUTH_SUCCESS;
+    peer->state = AJ_AUTH_SUCCESS;
 
     return status;
 
 Exit:
-    HandshakeComplete(AJ_ERR_SECURITY);
+    HandshakeComplete(peer, AJ_ERR_SECURITY);
     status = AJ_MarshalErrorMsg(msg, reply, AJ_ErrSecurityViolation);
     if (AJ_OK == status) {
-        AJ_ConversationHash_Update_Message(&authContext, CONVERSATION_V4, reply, HASH_MSG_MARSHALED);
+        AJ_ConversationHash_Update_Message(&peer->authContext, CONVERSATION_V4, reply, HASH_MSG_MARSHALED);
     }
     return status;
 }
@@ -1231,45 +1559,46 @@ AJ_Status AJ_PeerHandleKeyAuthenticationReply(AJ_Message* msg)
 {
     AJ_Status status;
     const AJ_GUID* peerGuid = AJ_GUID_Find(msg->sender);
+    PeerContext* peer;
 
     AJ_InfoPrintf(("AJ_PeerHandleKeyAuthenticationReply(msg=%p)\n", msg));
 
-    status = HandshakeValid(peerGuid);
+    status = HandshakeValid(peerGuid, &peer);
     if (AJ_OK != status) {
         return status;
     }
 
     if (msg->hdr->msgType == AJ_MSG_ERROR) {
         AJ_WarnPrintf(("AJ_PeerHandleKeyAuthenticationReply(msg=%p): error=%s.\n", msg, msg->error));
-        AJ_ConversationHash_Update_Message(&authContext, CONVERSATION_V4, msg, HASH_MSG_UNMARSHALED);
+        AJ_ConversationHash_Update_Message(&peer->authContext, CONVERSATION_V4, msg, HASH_MSG_UNMARSHALED);
         if (0 == strncmp(msg->error, AJ_ErrResources, sizeof(AJ_ErrResources))) {
             status = AJ_ERR_RESOURCES;
         } else {
             status = AJ_ERR_SECURITY;
-            HandshakeComplete(status);
+            HandshakeComplete(peer, status);
         }
         return status;
     }
 
-    if (AJ_AUTH_EXCHANGED != peerContext.state) {
+    if (AJ_AUTH_EXCHANGED != peer->state) {
         AJ_WarnPrintf(("AJ_PeerHandleKeyAuthenticationReply(msg=%p): Invalid state\n", msg));
-        AJ_ConversationHash_Update_Message(&authContext, CONVERSATION_V4, msg, HASH_MSG_UNMARSHALED);
+        AJ_ConversationHash_Update_Message(&peer->authContext, CONVERSATION_V4, msg, HASH_MSG_UNMARSHALED);
         goto Exit;
     }
 
     /* Get the conversation digest before it's updated with this message */
-    status = AJ_ConversationHash_GetDigest(&authContext);
+    status = AJ_ConversationHash_GetDigest(&peer->authContext);
     if (AJ_OK != status) {
         goto Exit;
     }
 
     /* Update hash before unmarshalling (endian swaps may occur) */
-    AJ_ConversationHash_Update_Message(&authContext, CONVERSATION_V4, msg, HASH_MSG_UNMARSHALED);
+    AJ_ConversationHash_Update_Message(&peer->authContext, CONVERSATION_V4, msg, HASH_MSG_UNMARSHALED);
 
     /*
      * Receive authentication material
      */
-    status = AJ_KeyAuthenticationUnmarshal(&authContext, msg);
+    status = AJ_KeyAuthenticationUnmarshal(&peer->authContext, msg);
     if (AJ_OK != status) {
         AJ_WarnPrintf(("AJ_PeerHandleKeyAuthenticationReply(msg=%p): Key authentication unmarshal error\n", msg));
         goto Exit;
@@ -1279,18 +1608,71 @@ AJ_Status AJ_PeerHandleKeyAuthenticationReply(AJ_Message* msg)
      * Key authentication complete - start the session
      */
     AJ_InfoPrintf(("Key Authentication Complete\n"));
-    peerContext.state = AJ_AUTH_SUCCESS;
+    peer->state = AJ_AUTH_SUCCESS;
 
-    status = GenSessionKey(msg);
+    status = GenSessionKey(peer, msg);
 
     return status;
 
 Exit:
-    HandshakeComplete(AJ_ERR_SECURITY);
+    HandshakeComplete(peer, AJ_ERR_SECURITY);
     return AJ_ERR_SECURITY;
 }
 
-static AJ_Status GenSessionKey(AJ_Message* msg)
+/*
+ * Server side completion once the peer's group key is known
+ */
+static void GroupKeysExchangedServer(PeerContext* peer, AJ_Message* msg)
+{
+    AJ_Status status;
+
+    status = AJ_PolicyApply(&peer->authContext, msg->sender);
+    if (AUTH_SUITE_ECDHE_ECDSA != peer->authContext.suite) {
+        HandshakeComplete(peer, status);
+    }
+
+    /* Search for membership certificates from the beginning */
+    peer->authContext.slot = AJ_CREDS_NV_ID_BEGIN;
+    peer->authContext.code = SEND_MEMBERSHIPS_NONE;
+    status = AJ_CredentialGetNext(AJ_CERTIFICATE_MBR_X509 | AJ_CRED_TYPE_CERTIFICATE, NULL, NULL, NULL, &peer->authContext.slot);
+    if (AJ_OK == status) {
+        /* There is at least one cert to send, we don't know if the last yet */
+        peer->authContext.code = SEND_MEMBERSHIPS_MORE;
+    }
+}
+
+/*
+ * Client side completion once the peer's group key is known
+ */
+static AJ_Status GroupKeysExchangedClient(PeerContext* peer, AJ_Message* msg)
+{
+    AJ_Status status;
+
+    status = AJ_PolicyApply(&peer->authContext, msg->sender);
+    if (AJ_OK != status) {
+        HandshakeComplete(peer, AJ_ERR_SECURITY);
+        return AJ_ERR_SECURITY;
+    }
+    if ((AUTH_SUITE_ECDHE_ECDSA == peer->authContext.suite) && (AJ_UNPACK_AUTH_VERSION(peer->authContext.version) >= CONVERSATION_V4)) {
+        /* Search for membership certificates from the beginning */
+        peer->authContext.slot = AJ_CREDS_NV_ID_BEGIN;
+        peer->authContext.code = SEND_MEMBERSHIPS_NONE;
+        status = AJ_CredentialGetNext(AJ_CERTIFICATE_MBR_X509 | AJ_CRED_TYPE_CERTIFICATE, NULL, NULL, NULL, &peer->authContext.slot);
+        AJ_InfoPrintf(("GroupKeysExchangedClient(msg=%p): Membership slot %d\n", msg, peer->authContext.slot));
+        if (AJ_OK == status) {
+            /* There is at least one certificate to send, we don't know if the last yet */
+            peer->authContext.code = SEND_MEMBERSHIPS_MORE;
+        }
+
+        status = AJ_PeerSendManifests(msg, FALSE);
+    } else {
+        HandshakeComplete(peer, status);
+    }
+
+    return status;
+}
+
+static AJ_Status GenSessionKey(PeerContext* peer, AJ_Message* msg)
 {
     AJ_Status status;
     AJ_Message call;
@@ -1318,15 +1700,21 @@ static AJ_Status GenSessionKey(AJ_Message* msg)
     if (AJ_OK != status) {
         return status;
     }
-    status = AJ_GUID_ToString(peerContext.peerGuid, guidStr, sizeof(guidStr));
+    status = AJ_GUID_ToString(peer->peerGuid, guidStr, sizeof(guidStr));
     if (AJ_OK != status) {
         return status;
     }
-    status = AJ_RandHex(peerContext.nonce, sizeof(peerContext.nonce), AJ_NONCE_LEN);
+    status = AJ_RandHex(peer->nonce, sizeof(peer->nonce), AJ_NONCE_LEN);
     if (AJ_OK != status) {
         return status;
     }
-    status = AJ_MarshalArgs(&call, "ss", guidStr, peerContext.nonce);
+    if (peer->fastAnswer) {
+        status = AppendGroupKey(peer);
+        if (AJ_OK != status) {
+            return status;
+        }
+    }
+    status = AJ_MarshalArgs(&call, "ss", guidStr, peer->nonce);
     if (AJ_OK != status) {
         return status;
     }
@@ -1335,19 +1723,19 @@ static AJ_Status GenSessionKey(AJ_Message* msg)
      * Initialize the conversation hash and hash the GUIDs.
      * May have already been done by ExchangeSuites.
      */
-    if (!AJ_ConversationHash_IsInitialized(&authContext)) {
-        status = AJ_ConversationHash_Initialize(&authContext);
+    if (!AJ_ConversationHash_IsInitialized(&peer->authContext)) {
+        status = AJ_ConversationHash_Initialize(&peer->authContext);
         if (AJ_OK != status) {
             return status;
         }
-        status = HashGuids(&authContext, peerContext.peerGuid);
+        status = HashGuids(peer);
         if (AJ_OK != status) {
             return status;
         }
     }
 
     /* Hash the message */
-    AJ_ConversationHash_Update_Message(&authContext, CONVERSATION_V4, &call, HASH_MSG_MARSHALED);
+    AJ_ConversationHash_Update_Message(&peer->authContext, CONVERSATION_V4, &call, HASH_MSG_MARSHALED);
 
     return AJ_DeliverMsg(&call);
 }
@@ -1361,6 +1749,7 @@ AJ_Status AJ_PeerHandleGenSessionKey(AJ_Message* msg, AJ_Message* reply)
     AJ_GUID guid;
     AJ_GUID localGuid;
     const AJ_GUID* peerGuid = AJ_GUID_Find(msg->sender);
+    PeerContext* peer;
 
     /*
      * For 12 bytes of verifier, we need at least 12 * 2 characters
@@ -1370,10 +1759,11 @@ AJ_Status AJ_PeerHandleGenSessionKey(AJ_Message* msg, AJ_Message* reply)
      * Hence we allocate, the maximum of (12 * 2 + 1) and (16 + 12).
      */
     char verifier[AJ_SESSION_KEY_LEN + AJ_VERIFIER_LEN];
+    uint8_t groupKey[AJ_SESSION_KEY_LEN];
 
     AJ_InfoPrintf(("AJ_PeerHandleGenSessionKey(msg=%p, reply=%p)\n", msg, reply));
 
-    status = HandshakeValid(peerGuid);
+    status = HandshakeValid(peerGuid, &peer);
     if (AJ_OK != status) {
         return AJ_MarshalErrorMsg(msg, reply, AJ_ErrResources);
     }
@@ -1382,27 +1772,27 @@ AJ_Status AJ_PeerHandleGenSessionKey(AJ_Message* msg, AJ_Message* reply)
      * Initialize conversation hash and hash GUIDs.
      * May have already been done by ExchangeSuites.
      */
-    if (!AJ_ConversationHash_IsInitialized(&authContext)) {
-        status = AJ_ConversationHash_Initialize(&authContext);
+    if (!AJ_ConversationHash_IsInitialized(&peer->authContext)) {
+        status = AJ_ConversationHash_Initialize(&peer->authContext);
         if (AJ_OK != status) {
             goto Exit;
         }
-        status = HashGuids(&authContext, peerGuid);
+        status = HashGuids(peer);
         if (AJ_OK != status) {
             goto Exit;
         }
     }
 
-    AJ_ConversationHash_Update_Message(&authContext, CONVERSATION_V4, msg, HASH_MSG_UNMARSHALED);
+    AJ_ConversationHash_Update_Message(&peer->authContext, CONVERSATION_V4, msg, HASH_MSG_UNMARSHALED);
 
-    if (AJ_AUTH_SUCCESS != peerContext.state) {
+    if (AJ_AUTH_SUCCESS != peer->state) {
         /*
          * We don't have a saved master secret and we haven't generated one yet
          */
         AJ_InfoPrintf(("AJ_PeerHandleGenSessionKey(msg=%p, reply=%p): Key not available\n", msg, reply));
         status = AJ_MarshalErrorMsg(msg, reply, AJ_ErrRejected);
         if (AJ_OK == status) {
-            AJ_ConversationHash_Update_Message(&authContext, CONVERSATION_V4, reply, HASH_MSG_MARSHALED);
+            AJ_ConversationHash_Update_Message(&peer->authContext, CONVERSATION_V4, reply, HASH_MSG_MARSHALED);
         }
         return status;
     }
@@ -1429,30 +1819,52 @@ AJ_Status AJ_PeerHandleGenSessionKey(AJ_Message* msg, AJ_Message* reply)
     if (0 != memcmp(&guid, &localGuid, sizeof(AJ_GUID))) {
         goto Exit;
     }
-    status = AJ_RandHex(peerContext.nonce, sizeof(peerContext.nonce), AJ_NONCE_LEN);
+    status = AJ_RandHex(peer->nonce, sizeof(peer->nonce), AJ_NONCE_LEN);
     if (AJ_OK != status) {
         goto Exit;
     }
-    status = KeyGen(msg->sender, AJ_ROLE_KEY_RESPONDER, nonce, peerContext.nonce, (uint8_t*)verifier, sizeof(verifier));
+    if (peer->fastAnswer) {
+        /*
+         * Group keys travel with the nonces instead of in ExchangeGroupKeys
+         */
+        status = ExtractGroupKey(peer, nonce, groupKey);
+        if (AJ_OK != status) {
+            goto Exit;
+        }
+        status = AppendGroupKey(peer);
+        if (AJ_OK != status) {
+            goto Exit;
+        }
+    }
+    status = KeyGen(peer, msg->sender, AJ_ROLE_KEY_RESPONDER, nonce, peer->nonce, (uint8_t*)verifier, sizeof(verifier));
     if (AJ_OK != status) {
         goto Exit;
     }
+    if (peer->fastAnswer) {
+        status = AJ_SetGroupKey(msg->sender, groupKey);
+        if (AJ_OK != status) {
+            goto Exit;
+        }
+    }
     status = AJ_MarshalReplyMsg(msg, reply);
     if (AJ_OK != status) {
         goto Exit;
     }
-    status = AJ_MarshalArgs(reply, "ss", peerContext.nonce, verifier);
+    status = AJ_MarshalArgs(reply, "ss", peer->nonce, verifier);
     if (AJ_OK != status) {
         goto Exit;
     }
-    AJ_ConversationHash_Update_Message(&authContext, CONVERSATION_V4, reply, HASH_MSG_MARSHALED);
+    AJ_ConversationHash_Update_Message(&peer->authContext, CONVERSATION_V4, reply, HASH_MSG_MARSHALED);
+    if (peer->fastAnswer) {
+        GroupKeysExchangedServer(peer, msg);
+    }
     return status;
 
 Exit:
-    HandshakeComplete(AJ_ERR_SECURITY);
+    HandshakeComplete(peer, AJ_ERR_SECURITY);
     status = AJ_MarshalErrorMsg(msg, reply, AJ_ErrSecurityViolation);
     if (AJ_OK == status) {
-        AJ_ConversationHash_Update_Message(&authContext, CONVERSATION_V4, reply, HASH_MSG_MARSHALED);
+        AJ_ConversationHash_Update_Message(&peer->authContext, CONVERSATION_V4, reply, HASH_MSG_MARSHALED);
     }
     return status;
 }
@@ -1471,28 +1883,29 @@ AJ_Status AJ_PeerHandleGenSessionKeyReply(AJ_Message* msg)
     char* nonce;
     char* remVerifier;
     const AJ_GUID* peerGuid = AJ_GUID_Find(msg->sender);
+    PeerContext* peer;
     AJ_Arg key;
     AJ_Message call;
     uint8_t groupKey[AJ_SESSION_KEY_LEN];
 
     AJ_InfoPrintf(("AJ_PeerHandleGenSessionKeyReply(msg=%p)\n", msg));
 
-    status = HandshakeValid(peerGuid);
+    status = HandshakeValid(peerGuid, &peer);
     if (AJ_OK != status) {
         return status;
     }
 
-    AJ_ConversationHash_Update_Message(&authContext, CONVERSATION_V4, msg, HASH_MSG_UNMARSHALED);
+    AJ_ConversationHash_Update_Message(&peer->authContext, CONVERSATION_V4, msg, HASH_MSG_UNMARSHALED);
 
     if (msg->hdr->msgType == AJ_MSG_ERROR) {
         AJ_WarnPrintf(("AJ_PeerHandleGenSessionKeyReply(msg=%p): error=%s.\n", msg, msg->error));
         if (0 == strncmp(msg->error, AJ_ErrResources, sizeof(AJ_ErrResources))) {
             status = AJ_ERR_RESOURCES;
         } else if (0 == strncmp(msg->error, AJ_ErrRejected, sizeof(AJ_ErrRejected))) {
-            status = ExchangeSuites(msg);
+            status = StartKeyExchange(peer, msg);
         } else {
             status = AJ_ERR_SECURITY;
-            HandshakeComplete(status);
+            HandshakeComplete(peer, status);
         }
         return status;
     }
@@ -1502,7 +1915,7 @@ AJ_Status AJ_PeerHandleGenSessionKeyReply(AJ_Message* msg)
         goto Exit;
     }
 
-    status = KeyGen(msg->sender, AJ_ROLE_KEY_INITIATOR, peerContext.nonce, nonce, (uint8_t*)verifier, sizeof(verifier));
+    status = KeyGen(peer, msg->sender, AJ_ROLE_KEY_INITIATOR, peer->nonce, nonce, (uint8_t*)verifier, sizeof(verifier));
     if (AJ_OK != status) {
         goto Exit;
     }
@@ -1515,6 +1928,21 @@ AJ_Status AJ_PeerHandleGenSessionKeyReply(AJ_Message* msg)
         goto Exit;
     }
 
+    if (peer->fastAnswer) {
+        /*
+         * The server's group key came with its nonce
+         */
+        status = ExtractGroupKey(peer, nonce, groupKey);
+        if (AJ_OK != status) {
+            goto Exit;
+        }
+        status = AJ_SetGroupKey(msg->sender, groupKey);
+        if (AJ_OK != status) {
+            goto Exit;
+        }
+        return GroupKeysExchangedClient(peer, msg);
+    }
+
     /*
      * Group keys are exchanged via an encrypted message
      */
@@ -1535,7 +1963,7 @@ AJ_Status AJ_PeerHandleGenSessionKeyReply(AJ_Message* msg)
     return status;
 
 Exit:
-    HandshakeComplete(AJ_ERR_SECURITY);
+    HandshakeComplete(peer, AJ_ERR_SECURITY);
     return AJ_ERR_SECURITY;
 }
 
@@ -1544,6 +1972,7 @@ AJ_Status AJ_PeerHandleExchangeGroupKeys(AJ_Message* msg, AJ_Message* reply)
     AJ_Status status;
     AJ_Arg key;
     const AJ_GUID* peerGuid = AJ_GUID_Find(msg->sender);
+    PeerContext* peer = FindPeerContext(peerGuid);
     uint8_t groupKey[AJ_SESSION_KEY_LEN];
 
     AJ_InfoPrintf(("AJ_PeerHandleExchangeGroupKeys(msg=%p, reply=%p)\n", msg, reply));
@@ -1554,12 +1983,14 @@ AJ_Status AJ_PeerHandleExchangeGroupKeys(AJ_Message* msg, AJ_Message* reply)
             status = AJ_ERR_RESOURCES;
         } else {
             status = AJ_ERR_SECURITY;
-            HandshakeComplete(status);
+            if (peer) {
+                HandshakeComplete(peer, status);
+            }
         }
         return status;
     }
 
-    status = HandshakeValid(peerGuid);
+    status = HandshakeValid(peerGuid, &peer);
     if (AJ_OK != status) {
         return status;
     }
@@ -1591,25 +2022,12 @@ AJ_Status AJ_PeerHandleExchangeGroupKeys(AJ_Message* msg, AJ_Message* reply)
     if (AJ_OK != status) {
         goto Exit;
     }
-    status = AJ_PolicyApply(&authContext, msg->sender);
-    if (AUTH_SUITE_ECDHE_ECDSA != authContext.suite) {
-        HandshakeComplete(status);
-    }
-
-    /* Search for membership certificates from the beginning */
-    authContext.slot = AJ_CREDS_NV_ID_BEGIN;
-    authContext.code = SEND_MEMBERSHIPS_NONE;
-    status = AJ_CredentialGetNext(AJ_CERTIFICATE_MBR_X509 | AJ_CRED_TYPE_CERTIFICATE, NULL, NULL, NULL, &authContext.slot);
-    if (AJ_OK == status) {
-        /* There is at least one cert to send, we don't know if the last yet */
-        authContext.code = SEND_MEMBERSHIPS_MORE;
-    }
-    status = AJ_OK;
+    GroupKeysExchangedServer(peer, msg);
 
     return status;
 
 Exit:
-    HandshakeComplete(AJ_ERR_SECURITY);
+    HandshakeComplete(peer, AJ_ERR_SECURITY);
     return AJ_MarshalErrorMsg(msg, reply, AJ_ErrSecurityViolation);
 }
 
@@ -1618,10 +2036,11 @@ AJ_Status AJ_PeerHandleExchangeGroupKeysReply(AJ_Message* msg)
     AJ_Status status;
     AJ_Arg arg;
     const AJ_GUID* peerGuid = AJ_GUID_Find(msg->sender);
+    PeerContext* peer;
 
     AJ_InfoPrintf(("AJ_PeerHandleExchangeGroupKeysReply(msg=%p)\n", msg));
 
-    status = HandshakeValid(peerGuid);
+    status = HandshakeValid(peerGuid, &peer);
     if (AJ_OK != status) {
         return status;
     }
@@ -1642,30 +2061,10 @@ AJ_Status AJ_PeerHandleExchangeGroupKeysReply(AJ_Message* msg)
         goto Exit;
     }
 
-    status = AJ_PolicyApply(&authContext, msg->sender);
-    if (AJ_OK != status) {
-        goto Exit;
-    }
-    if ((AUTH_SUITE_ECDHE_ECDSA == authContext.suite) && (AJ_UNPACK_AUTH_VERSION(authContext.version) >= CONVERSATION_V4)) {
-        /* Search for membership certificates from the beginning */
-        authContext.slot = AJ_CREDS_NV_ID_BEGIN;
-        authContext.code = SEND_MEMBERSHIPS_NONE;
-        status = AJ_CredentialGetNext(AJ_CERTIFICATE_MBR_X509 | AJ_CRED_TYPE_CERTIFICATE, NULL, NULL, NULL, &authContext.slot);
-        AJ_InfoPrintf(("AJ_PeerHandleExchangeGroupKeysReply(msg=%p): Membership slot %d\n", msg, authContext.slot));
-        if (AJ_OK == status) {
-            /* There is at least one certificate to send, we don't know if the last yet */
-            authContext.code = SEND_MEMBERSHIPS_MORE;
-        }
-
-        status = AJ_PeerSendManifests(msg, FALSE);
-    } else {
-        HandshakeComplete(status);
-    }
-
-    return status;
+    return GroupKeysExchangedClient(peer, msg);
 
 Exit:
-    HandshakeComplete(AJ_ERR_SECURITY);
+    HandshakeComplete(peer, AJ_ERR_SECURITY);
     return AJ_ERR_SECURITY;
 }
 
@@ -1677,24 +2076,32 @@ AJ_Status AJ_PeerSendManifests(AJ_Message* msg, uint8_t outgoing)
     AJ_CredField field = { 0, NULL };
     AJ_ManifestArray* manifests = NULL;
     uint8_t mustClearAuthContext = FALSE;
+    PeerContext* peer = FindPeerContext(peerGuid);
 
     AJ_InfoPrintf(("AJ_PeerSendManifests(msg=%p, outgoing=%u)\n", msg, outgoing));
 
-    if (sentManifests) {
+    if (peer && peer->sentManifests) {
         /* Already sent. */
         return AJ_OK;
     }
 
-    if (NULL == authContext.bus) {
-        status = LoadECDSAContext(peerGuid);
+    if (NULL == peer) {
+        /* Outside a handshake, borrow a slot to hold the stored ECDSA context */
+        peer = AllocPeerContext(msg->bus, AUTH_CLIENT);
+        if (NULL == peer) {
+            return AJ_ERR_RESOURCES;
+        }
+        peer->peerGuid = peerGuid;
+        mustClearAuthContext = TRUE;
+        status = LoadECDSAContext(peer);
         if (AJ_OK != status) {
+            ClearPeerContext(peer);
             AJ_InfoPrintf(("AJ_PeerSendManifests(msg=%p, outgoing=%u): Could not load ECDSA context for peer\n", msg, outgoing));
             return AJ_ERR_SECURITY;
         }
-        mustClearAuthContext = TRUE;
     }
 
-    if (AUTH_SUITE_ECDHE_ECDSA != authContext.suite) {
+    if (AUTH_SUITE_ECDHE_ECDSA != peer->authContext.suite) {
         /* No need to send. */
         status = AJ_OK;
         goto Exit;
@@ -1725,11 +2132,11 @@ Exit:
     if (AJ_OK == status) {
         status = AJ_DeliverMsg(&call);
         if (AJ_OK == status) {
-            sentManifests = TRUE;
+            peer->sentManifests = TRUE;
         }
     }
     if (mustClearAuthContext) {
-        AJ_ClearAuthContext();
+        ClearPeerContext(peer);
     }
 
     return status;
@@ -1742,6 +2149,7 @@ AJ_Status AJ_PeerHandleSendManifests(AJ_Message* msg, AJ_Message* reply)
     const AJ_GUID* peerGuid = AJ_GUID_Find(msg->sender);
     AJ_ManifestArray* manifests = NULL;
     uint8_t mustClearAuthContext = FALSE;
+    PeerContext* peer = FindPeerContext(peerGuid);
 
     AJ_InfoPrintf(("AJ_PeerHandleSendManifests(msg=%p, reply=%p)\n", msg, reply));
 
@@ -1749,13 +2157,19 @@ AJ_Status AJ_PeerHandleSendManifests(AJ_Message* msg, AJ_Message* reply)
      * This might get called during handshake, or after. If after, load the ECDSA context
      * so the identity certificate thumbprint is available.
      */
-    if (NULL == authContext.bus) {
-        status = LoadECDSAContext(peerGuid);
+    if (NULL == peer) {
+        peer = AllocPeerContext(msg->bus, AUTH_SERVER);
+        if (NULL == peer) {
+            return AJ_MarshalErrorMsg(msg, reply, AJ_ErrResources);
+        }
+        peer->peerGuid = peerGuid;
+        mustClearAuthContext = TRUE;
+        status = LoadECDSAContext(peer);
         if (AJ_OK != status) {
+            ClearPeerContext(peer);
             AJ_InfoPrintf(("AJ_PeerHandleSendManifests(msg=%p, reply=%p): Could not load ECDSA context for peer\n", msg, reply));
             return AJ_MarshalErrorMsg(msg, reply, AJ_ErrSecurityViolation);
         }
-        mustClearAuthContext = TRUE;
     }
 
     status = AJ_ManifestArrayUnmarshal(&manifests, msg);
@@ -1763,7 +2177,7 @@ AJ_Status AJ_PeerHandleSendManifests(AJ_Message* msg, AJ_Message* reply)
         AJ_InfoPrintf(("AJ_PeerHandleSendManifests(msg=%p, reply=%p): Manifests unmarshal failed\n", msg, reply));
         goto Exit;
     }
-    AJ_ManifestArrayApply(manifests, msg->sender, &authContext);
+    AJ_ManifestArrayApply(manifests, msg->sender, &peer->authContext);
 
     AJ_ManifestArrayFree(manifests);
     manifests = NULL;
@@ -1793,11 +2207,13 @@ AJ_Status AJ_PeerHandleSendManifests(AJ_Message* msg, AJ_Message* reply)
 Exit:
     AJ_CredFieldFree(&field);
     AJ_ManifestArrayFree(manifests);
+    if (AJ_OK == status) {
+        peer->sentManifests = TRUE;
+    }
     if (mustClearAuthContext) {
-        AJ_ClearAuthContext();
+        ClearPeerContext(peer);
     }
     if (AJ_OK == status) {
-        sentManifests = TRUE;
         return status;
     } else {
         return AJ_MarshalErrorMsg(msg, reply, AJ_ErrSecurityViolation);
@@ -1808,65 +2224,52 @@ AJ_Status AJ_PeerHandleSendManifestsReply(AJ_Message* msg)
 {
     AJ_Status status;
     const AJ_GUID* peerGuid = AJ_GUID_Find(msg->sender);
+    PeerContext* peer = FindPeerContext(peerGuid);
     AJ_ManifestArray* manifests = NULL;
-    uint8_t mustClearAuthContext = FALSE;
 
     AJ_InfoPrintf(("AJ_PeerHandleSendManifestsReply(msg=%p)\n", msg));
 
     if (msg->hdr->msgType == AJ_MSG_ERROR) {
         AJ_WarnPrintf(("AJ_PeerHandleSendManifestsReply(msg=%p): error=%s.\n", msg, msg->error));
+        if (NULL == peer) {
+            return AJ_ERR_SECURITY;
+        }
+        status = AJ_ERR_SECURITY;
         goto Exit;
     }
 
-    status = HandshakeValid(peerGuid);
+    status = HandshakeValid(peerGuid, &peer);
     if (AJ_OK != status) {
         return status;
     }
 
-    /*
-     * This might get called during handshake, or after. If after, load the ECDSA context
-     * so the identity certificate thumbprint is available.
-     */
-    if (NULL == authContext.bus) {
-        status = LoadECDSAContext(peerGuid);
-        if (AJ_OK != status) {
-            AJ_InfoPrintf(("AJ_PeerHandleSendManifestsReply(msg=%p): Could not load ECDSA context for peer\n", msg));
-            status = AJ_ERR_SECURITY;
-            goto Exit;
-        }
-        mustClearAuthContext = TRUE;
-    }
-
     status = AJ_ManifestArrayUnmarshal(&manifests, msg);
     if (AJ_OK != status) {
         AJ_InfoPrintf(("AJ_PeerHandleSendManifestsReply(msg=%p): Manifests unmarshal failed\n", msg));
         goto Exit;
     }
-    AJ_ManifestArrayApply(manifests, msg->sender, &authContext);
+    AJ_ManifestArrayApply(manifests, msg->sender, &peer->authContext);
     AJ_ManifestArrayFree(manifests);
     manifests = NULL;
 
     /* Search for membership certificates from the beginning */
-    authContext.slot = AJ_CREDS_NV_ID_BEGIN;
-    authContext.code = SEND_MEMBERSHIPS_NONE;
-    status = AJ_CredentialGetNext(AJ_CERTIFICATE_MBR_X509 | AJ_CRED_TYPE_CERTIFICATE, NULL, NULL, NULL, &authContext.slot);
-    AJ_InfoPrintf(("AJ_PeerHandleSendManifestsReply(msg=%p): Membership slot %d\n", msg, authContext.slot));
+    peer->authContext.slot = AJ_CREDS_NV_ID_BEGIN;
+    peer->authContext.code = SEND_MEMBERSHIPS_NONE;
+    status = AJ_CredentialGetNext(AJ_CERTIFICATE_MBR_X509 | AJ_CRED_TYPE_CERTIFICATE, NULL, NULL, NULL, &peer->authContext.slot);
+    AJ_InfoPrintf(("AJ_PeerHandleSendManifestsReply(msg=%p): Membership slot %d\n", msg, peer->authContext.slot));
     if (AJ_OK == status) {
         /* There is at least one cert to send, we don't know if the last yet */
-        authContext.code = SEND_MEMBERSHIPS_MORE;
+        peer->authContext.code = SEND_MEMBERSHIPS_MORE;
     }
     status = AJ_OK;
 
 Exit:
     AJ_ManifestArrayFree(manifests);
-    if (mustClearAuthContext) {
-        AJ_ClearAuthContext();
-    }
     if (AJ_OK == status) {
-        sentManifests = TRUE;
-        return SendMemberships(msg);
+        peer->sentManifests = TRUE;
+        return SendMemberships(peer, msg);
     } else {
-        HandshakeComplete(AJ_ERR_SECURITY);
+        HandshakeComplete(peer, AJ_ERR_SECURITY);
         return AJ_ERR_SECURITY;
     }
 }
@@ -1903,23 +2306,23 @@ Exit:
     return status;
 }
 
-static AJ_Status CommonIssuer(X509CertificateChain* root)
+static AJ_Status CommonIssuer(PeerContext* peer, X509CertificateChain* root)
 {
     AJ_Status status = AJ_ERR_UNKNOWN;
     X509CertificateChain* node;
     size_t i;
 
     AJ_ASSERT(root);
-    for (i = 1; i < authContext.kactx.ecdsa.num; i++) {
+    for (i = 1; i < peer->authContext.kactx.ecdsa.num; i++) {
         node = root;
         /* Check if intermediate issuer signed the root */
-        if (AJ_OK == AJ_X509Verify(&node->certificate, &authContext.kactx.ecdsa.key[i])) {
+        if (AJ_OK == AJ_X509Verify(&node->certificate, &peer->authContext.kactx.ecdsa.key[i])) {
             status = AJ_OK;
             goto Exit;
         }
         /* Check if intermediate issuer is a subject */
         while (node && node->certificate.tbs.extensions.ca) {
-            if (0 == memcmp(&node->certificate.tbs.publickey, &authContext.kactx.ecdsa.key[i], sizeof (AJ_ECCPublicKey))) {
+            if (0 == memcmp(&node->certificate.tbs.publickey, &peer->authContext.kactx.ecdsa.key[i], sizeof (AJ_ECCPublicKey))) {
                 status = AJ_OK;
                 goto Exit;
             }
@@ -1931,29 +2334,29 @@ Exit:
     return status;
 }
 
-static AJ_Status MarshalMembership(AJ_Message* msg)
+static AJ_Status MarshalMembership(PeerContext* peer, AJ_Message* msg)
 {
     AJ_Status status = AJ_ERR_UNKNOWN;
     AJ_Arg container;
     AJ_CredField data;
     X509CertificateChain* root = NULL;
 
-    AJ_ASSERT(SEND_MEMBERSHIPS_LAST != authContext.code);
+    AJ_ASSERT(SEND_MEMBERSHIPS_LAST != peer->authContext.code);
 
     data.size = 0;
     data.data = NULL;
-    while ((AJ_ERR_UNKNOWN == status) && (SEND_MEMBERSHIPS_MORE == authContext.code)) {
+    while ((AJ_ERR_UNKNOWN == status) && (SEND_MEMBERSHIPS_MORE == peer->authContext.code)) {
         /*
          * Read membership certificate at current slot, there should be one.
          * We then check if the root issuer is the same as any of the issuers
          * of the identity certificate (ASACORE-2104)
          */
-        status = AJ_CredentialGetNext(AJ_CERTIFICATE_MBR_X509 | AJ_CRED_TYPE_CERTIFICATE, NULL, NULL, &data, &authContext.slot);
-        authContext.slot++;
+        status = AJ_CredentialGetNext(AJ_CERTIFICATE_MBR_X509 | AJ_CRED_TYPE_CERTIFICATE, NULL, NULL, &data, &peer->authContext.slot);
+        peer->authContext.slot++;
         if (AJ_OK == status) {
             status = AJ_X509ChainFromBuffer(&root, &data);
             if (AJ_OK == status) {
-                status = CommonIssuer(root);
+                status = CommonIssuer(peer, root);
                 AJ_InfoPrintf(("MarshalMembership(msg=%p): Common issuer %s\n", msg, AJ_StatusText(status)));
             }
             if (AJ_OK != status) {
@@ -1963,14 +2366,14 @@ static AJ_Status MarshalMembership(AJ_Message* msg)
                 status = AJ_ERR_UNKNOWN;
             }
         } else {
-            authContext.code = SEND_MEMBERSHIPS_NONE;
+            peer->authContext.code = SEND_MEMBERSHIPS_NONE;
             status = AJ_OK;
         }
     }
 
-    if (SEND_MEMBERSHIPS_NONE == authContext.code) {
+    if (SEND_MEMBERSHIPS_NONE == peer->authContext.code) {
         AJ_InfoPrintf(("MarshalMembership(msg=%p): None certificate\n", msg));
-        status = AJ_MarshalArgs(msg, "y", authContext.code);
+        status = AJ_MarshalArgs(msg, "y", peer->authContext.code);
         if (AJ_OK != status) {
             AJ_InfoPrintf(("MarshalMembership(msg=%p): Marshal error\n", msg));
             goto Exit;
@@ -1988,17 +2391,17 @@ static AJ_Status MarshalMembership(AJ_Message* msg)
         return status;
     }
 
-    AJ_ASSERT(SEND_MEMBERSHIPS_MORE == authContext.code);
+    AJ_ASSERT(SEND_MEMBERSHIPS_MORE == peer->authContext.code);
     /* Find slot of next membership certificate (if available) */
-    status = AJ_CredentialGetNext(AJ_CERTIFICATE_MBR_X509 | AJ_CRED_TYPE_CERTIFICATE, NULL, NULL, NULL, &authContext.slot);
+    status = AJ_CredentialGetNext(AJ_CERTIFICATE_MBR_X509 | AJ_CRED_TYPE_CERTIFICATE, NULL, NULL, NULL, &peer->authContext.slot);
     if (AJ_OK != status) {
         AJ_InfoPrintf(("MarshalMembership(msg=%p): Last certificate\n", msg));
-        authContext.code = SEND_MEMBERSHIPS_LAST;
+        peer->authContext.code = SEND_MEMBERSHIPS_LAST;
     } else {
         AJ_InfoPrintf(("MarshalMembership(msg=%p): More certificate\n", msg));
     }
     /* Marshal code and certificate */
-    status = AJ_MarshalArgs(msg, "y", authContext.code);
+    status = AJ_MarshalArgs(msg, "y", peer->authContext.code);
     if (AJ_OK != status) {
         AJ_InfoPrintf(("MarshalMembership(msg=%p): Marshal error\n", msg));
         goto Exit;
@@ -2009,8 +2412,8 @@ static AJ_Status MarshalMembership(AJ_Message* msg)
         goto Exit;
     }
     /* Once we send the last code, set it to none so we don't send any more */
-    if (SEND_MEMBERSHIPS_LAST == authContext.code) {
-        authContext.code = SEND_MEMBERSHIPS_NONE;
+    if (SEND_MEMBERSHIPS_LAST == peer->authContext.code) {
+        peer->authContext.code = SEND_MEMBERSHIPS_NONE;
     }
 
 Exit:
@@ -2019,7 +2422,7 @@ Exit:
     return status;
 }
 
-static AJ_Status SendMemberships(AJ_Message* msg)
+static AJ_Status SendMemberships(PeerContext* peer, AJ_Message* msg)
 {
     AJ_Status status;
     AJ_Message call;
@@ -2032,7 +2435,7 @@ static AJ_Status SendMemberships(AJ_Message* msg)
         goto Exit;
     }
 
-    status = MarshalMembership(&call);
+    status = MarshalMembership(peer, &call);
     if (AJ_OK != status) {
         AJ_InfoPrintf(("SendMemberships(msg=%p): Marshal error\n", msg));
         goto Exit;
@@ -2041,11 +2444,11 @@ static AJ_Status SendMemberships(AJ_Message* msg)
     return AJ_DeliverMsg(&call);
 
 Exit:
-    HandshakeComplete(AJ_ERR_SECURITY);
+    HandshakeComplete(peer, AJ_ERR_SECURITY);
     return AJ_ERR_SECURITY;
 }
 
-static void UnmarshalCertificates(AJ_Message* msg)
+static void UnmarshalCertificates(PeerContext* peer, AJ_Message* msg)
 {
     AJ_Status status;
     AJ_Arg container;
@@ -2088,9 +2491,9 @@ static void UnmarshalCertificates(AJ_Message* msg)
          * Also save the group for authorisation check
          */
         if (NULL == node->next) {
-            AJ_ASSERT(authContext.kactx.ecdsa.key);
-            AJ_ASSERT(authContext.kactx.ecdsa.num);
-            if (0 != memcmp((uint8_t*) &node->certificate.tbs.publickey, (uint8_t*) &authContext.kactx.ecdsa.key[0], sizeof (AJ_ECCPublicKey))) {
+            AJ_ASSERT(peer->authContext.kactx.ecdsa.key);
+            AJ_ASSERT(peer->authContext.kactx.ecdsa.num);
+            if (0 != memcmp((uint8_t*) &node->certificate.tbs.publickey, (uint8_t*) &peer->authContext.kactx.ecdsa.key[0], sizeof (AJ_ECCPublicKey))) {
                 AJ_InfoPrintf(("UnmarshalCertificates(msg=%p): Subject invalid\n", msg));
                 goto Exit;
             }
@@ -2110,7 +2513,7 @@ static void UnmarshalCertificates(AJ_Message* msg)
     /* Initial chain verification to validate intermediate issuers.
      * Type is ignored for auth version < 4.
      */
-    if (AJ_UNPACK_AUTH_VERSION(authContext.version) < CONVERSATION_V4) {
+    if (AJ_UNPACK_AUTH_VERSION(peer->authContext.version) < CONVERSATION_V4) {
         type = 0;
     } else {
         type = AJ_CERTIFICATE_MBR_X509;
@@ -2157,11 +2560,12 @@ AJ_Status AJ_PeerHandleSendMemberships(AJ_Message* msg, AJ_Message* reply)
 {
     AJ_Status status;
     const AJ_GUID* peerGuid = AJ_GUID_Find(msg->sender);
+    PeerContext* peer;
     uint8_t code;
 
     AJ_InfoPrintf(("AJ_PeerHandleSendMemberships(msg=%p, reply=%p)\n", msg, reply));
 
-    status = HandshakeValid(peerGuid);
+    status = HandshakeValid(peerGuid, &peer);
     if (AJ_OK != status) {
         return AJ_MarshalErrorMsg(msg, reply, AJ_ErrResources);
     }
@@ -2178,7 +2582,7 @@ AJ_Status AJ_PeerHandleSendMemberships(AJ_Message* msg, AJ_Message* reply)
          * Unmarshal certificate chain, verify and apply membership rules
          * If failure occured (eg. false certificate), the rules will not be applied.
          */
-        UnmarshalCertificates(msg);
+        UnmarshalCertificates(peer, msg);
         if (SEND_MEMBERSHIPS_LAST == code) {
             code = SEND_MEMBERSHIPS_NONE;
         }
@@ -2192,12 +2596,12 @@ AJ_Status AJ_PeerHandleSendMemberships(AJ_Message* msg, AJ_Message* reply)
         goto Exit;
     }
 
-    status = MarshalMembership(reply);
+    status = MarshalMembership(peer, reply);
     if (AJ_OK != status) {
         goto Exit;
     }
 
-    if ((SEND_MEMBERSHIPS_NONE == authContext.code) && (SEND_MEMBERSHIPS_NONE == code)) {
+    if ((SEND_MEMBERSHIPS_NONE == peer->authContext.code) && (SEND_MEMBERSHIPS_NONE == code)) {
         /*
          * Nothing more to send or receive. Try to send manifests. Don't call HandshakeComplete
          * until after so the authContext is still present.
@@ -2207,14 +2611,14 @@ AJ_Status AJ_PeerHandleSendMemberships(AJ_Message* msg, AJ_Message* reply)
             AJ_InfoPrintf(("AJ_PeerHandleSendMemberships(msg=%p, reply=%p): Couldn't AJ_PeerSendManifests; got %u\n",
                            msg, reply, status));
         }
-        HandshakeComplete(status);
+        HandshakeComplete(peer, status);
 
     }
 
     return status;
 
 Exit:
-    HandshakeComplete(AJ_ERR_SECURITY);
+    HandshakeComplete(peer, AJ_ERR_SECURITY);
     return AJ_MarshalErrorMsg(msg, reply, AJ_ErrSecurityViolation);
 }
 
@@ -2222,16 +2626,20 @@ AJ_Status AJ_PeerHandleSendMembershipsReply(AJ_Message* msg)
 {
     AJ_Status status;
     const AJ_GUID* peerGuid = AJ_GUID_Find(msg->sender);
+    PeerContext* peer = FindPeerContext(peerGuid);
     uint8_t code;
 
     AJ_InfoPrintf(("AJ_PeerHandleSendMembershipsReply(msg=%p)\n", msg));
 
     if (msg->hdr->msgType == AJ_MSG_ERROR) {
         AJ_WarnPrintf(("AJ_PeerHandleSendMembershipsReply(msg=%p): error=%s.\n", msg, msg->error));
+        if (NULL == peer) {
+            return AJ_ERR_SECURITY;
+        }
         goto Exit;
     }
 
-    status = HandshakeValid(peerGuid);
+    status = HandshakeValid(peerGuid, &peer);
     if (AJ_OK != status) {
         return status;
     }
@@ -2246,21 +2654,21 @@ AJ_Status AJ_PeerHandleSendMembershipsReply(AJ_Message* msg)
          * Unmarshal certificate chain, verify and apply membership rules
          * If failure occured (eg. false certificate), the rules will not be applied.
          */
-        UnmarshalCertificates(msg);
+        UnmarshalCertificates(peer, msg);
         if (SEND_MEMBERSHIPS_LAST == code) {
             code = SEND_MEMBERSHIPS_NONE;
         }
     }
 
-    if ((SEND_MEMBERSHIPS_NONE == authContext.code) && (SEND_MEMBERSHIPS_NONE == code)) {
+    if ((SEND_MEMBERSHIPS_NONE == peer->authContext.code) && (SEND_MEMBERSHIPS_NONE == code)) {
         /* Nothing more to send or receive */
-        HandshakeComplete(status);
+        HandshakeComplete(peer, status);
         return status;
     } else {
-        return SendMemberships(msg);
+        return SendMemberships(peer, msg);
     }
 
 Exit:
-    HandshakeComplete(AJ_ERR_SECURITY);
+    HandshakeComplete(peer, AJ_ERR_SECURITY);
     return AJ_ERR_SECURITY;
 }
@@ -821,6 +821,7 @@ Exit:
     AJ_ManifestArrayFree(manifests);
     AJ_CredFieldFree(&manifests_data);
     if (AJ_OK == status) {
+        AJ_X509ClearVerifyCache();
         if (msg->bus->policyChangedCallback) {
             msg->bus->policyChangedCallback();
         }
@@ -898,6 +899,7 @@ AJ_Status AJ_SecurityReset(AJ_BusAttachment* bus)
     /* Clear session keys, can't do it now because we need to reply */
     clear = TRUE;
 
+    AJ_X509ClearVerifyCache();
     if (bus->policyChangedCallback) {
         bus->policyChangedCallback();
     }
@@ -1068,6 +1070,8 @@ AJ_Status AJ_SecurityUpdatePolicyMethod(AJ_Message* msg, AJ_Message* reply)
     /* Clear session keys, can't do it now because we need to reply */
     clear = TRUE;
 
+    AJ_X509ClearVerifyCache();
+
 Exit:
     AJ_PolicyFree(policy);
     AJ_CredFieldFree(&policy_data);
@@ -1093,6 +1097,8 @@ AJ_Status AJ_SecurityResetPolicyMethod(AJ_Message* msg, AJ_Message* reply)
     /* Clear session keys, can't do it now because we need to reply */
     clear = TRUE;
 
+    AJ_X509ClearVerifyCache();
+
     return AJ_MarshalReplyMsg(msg, reply);
 }
 
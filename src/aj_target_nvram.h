@@ -61,6 +61,41 @@ void _AJ_NV_Read(void* src, void* buf, uint16_t size);
  */
 void _AJ_NVRAM_Clear();
 
+/**
+ * Start holding back NVRAM changes until _AJ_NVRAM_CommitTransaction()
+ *
+ * @return AJ_OK if the target supports transactions
+ */
+AJ_Status _AJ_NVRAM_BeginTransaction(void);
+
+/**
+ * Write out the NVRAM changes held back since _AJ_NVRAM_BeginTransaction() atomically
+ *
+ * @return AJ_OK if the changes were written
+ */
+AJ_Status _AJ_NVRAM_CommitTransaction(void);
+
+/**
+ * Restore the NVRAM contents from before _AJ_NVRAM_BeginTransaction()
+ */
+void _AJ_NVRAM_AbortTransaction(void);
+
+/**
+ * Discard the RAM index of NVRAM entries. Targets must call this when
+ * the NVRAM contents change other than through aj_nvram.c, for example
+ * when the image is reloaded from a file.
+ */
+void _AJ_NVRAM_Reindex(void);
+
+/**
+ * Count of the times the NVRAM contents were replaced wholesale by clearing
+ * or reloading them. Modules that cache NVRAM contents in RAM compare it to
+ * the value seen when they filled their cache.
+ *
+ * @return  The current NVRAM generation
+ */
+uint32_t _AJ_NVRAM_Generation(void);
+
 /**
  * Load NVRAM data from a file
  */
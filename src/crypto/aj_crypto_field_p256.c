@@ -209,14 +209,89 @@ uint64_t software_umul128(uint64_t u, uint64_t v, uint64_t* high)
     return (t << 32) + w3;
 }
 
-#ifndef _umul128
-#define _umul128 software_umul128
-#endif
-
 #if RADIX_BITS != 64
 #error Unexpected radix bits; expecting 64.
 #endif
 
+/*
+ * Select the double-digit arithmetic backend at compile time.
+ *
+ * Where the compiler provides a native 128-bit integer type (gcc and clang on
+ * x86-64 and AArch64) the digit operations below are expressed directly in
+ * terms of it. A 64x64 -> 128 multiply then compiles to a single MUL (or MULX
+ * when BMI2 is enabled) on x86-64 and a MUL/UMULH pair on AArch64, and carry
+ * and borrow chains compile to ADC/SBB (ADCS/SBCS). None of these have
+ * data-dependent timing, so the constant-time properties of the portable code
+ * are preserved.
+ *
+ * Define AJ_P256_NO_INT128 to force the portable implementation.
+ */
+#if !defined(AJ_P256_NO_INT128) && defined(__SIZEOF_INT128__) && (defined(__x86_64__) || defined(__aarch64__))
+#define AJ_P256_INT128
+#endif
+
+#ifdef AJ_P256_INT128
+
+typedef unsigned __int128 dbldigit_t;
+
+/* 64 x 64 --> 128-bit multiplication
+ * (c1,c0) = a * b
+ */
+#define mul(c0, c1, a, b) { \
+        dbldigit_t _p = (dbldigit_t)(a) * (b); \
+        (c0) = (digit_t)_p; \
+        (c1) = (digit_t)(_p >> RADIX_BITS); }
+
+/* Multiply-and-accumulate
+ * (c1,c0) = a*b+c0
+ */
+#define muladd(c0, c1, a, b) { \
+        dbldigit_t _p = (dbldigit_t)(a) * (b) + (c0); \
+        (c0) = (digit_t)_p; \
+        (c1) = (digit_t)(_p >> RADIX_BITS); }
+
+/* Multiply-and-accumulate-accumulate
+ * (c1,c0) = a*b+c0+c1
+ * Cannot overflow: (2^64-1)^2 + 2*(2^64-1) = 2^128-1.
+ */
+#define muladdadd(c0, c1, a, b) { \
+        dbldigit_t _p = (dbldigit_t)(a) * (b) + (c0) + (c1); \
+        (c0) = (digit_t)_p; \
+        (c1) = (digit_t)(_p >> RADIX_BITS); }
+
+/* Adds two operands, and produces sum of the two inputs and the carry bit. */
+#define ADD(carryOut, sumOut, addend1, addend2) { \
+        dbldigit_t _s = (dbldigit_t)(addend1) + (addend2); \
+        (sumOut) = (digit_t)_s; \
+        (carryOut) = (digit_t)(_s >> RADIX_BITS); }
+
+/* Adds two operands and a carry bit, produces sum of the three inputs and the carry bit. */
+#define ADDC(carryOut, sumOut, addend1, addend2, carryIn) { \
+        dbldigit_t _s = (dbldigit_t)(addend1) + (addend2) + (digit_t)(carryIn); \
+        (sumOut) = (digit_t)_s; \
+        (carryOut) = (digit_t)(_s >> RADIX_BITS); }
+
+/* Subtract operation.
+ * Subtract one number from the other, and return the difference and the borrow (carry) bit.
+ * A borrow wraps the 128-bit difference, which sets its top bit. */
+#define SUB(borrowOut, differenceOut, minuend, subtrahend) { \
+        dbldigit_t _d = (dbldigit_t)(minuend) - (subtrahend); \
+        (differenceOut) = (digit_t)_d; \
+        (borrowOut) = (digit_t)(_d >> (2 * RADIX_BITS - 1)); }
+
+/* Subtraction with borrow (carry).
+ * Subtract one number from the other with borrow (carry), and return the difference and the borrow (carry) bit.*/
+#define SUBC(borrowOut, differenceOut, minuend, subtrahend, borrowIn) { \
+        dbldigit_t _d = (dbldigit_t)(minuend) - (subtrahend) - (digit_t)(borrowIn); \
+        (differenceOut) = (digit_t)_d; \
+        (borrowOut) = (digit_t)(_d >> (2 * RADIX_BITS - 1)); }
+
+#else /* !AJ_P256_INT128 */
+
+#ifndef _umul128
+#define _umul128 software_umul128
+#endif
+
 /*
  * Macros to encapsulate intrinsics when and if they are defined.
  */
@@ -240,12 +315,12 @@ uint64_t software_umul128(uint64_t u, uint64_t v, uint64_t* high)
  * (c1,c0) = a*b+c0+c1
  */
 #define muladdadd(c0, c1, a, b) { \
-        digit_t _C0 = c0, _C1 = c1, carry; \
+        digit_t _C0 = c0, _C1 = c1, _carry; \
         mul(c0, c1, a, b); \
-        ADD(carry, c0, c0, _C0); \
-        ADDC(carry, c1, c1, 0, carry); \
-        ADD(carry, c0, c0, _C1); \
-        ADDC(carry, c1, c1, 0, carry); \
+        ADD(_carry, c0, c0, _C0); \
+        ADDC(_carry, c1, c1, 0, _carry); \
+        ADD(_carry, c0, c0, _C1); \
+        ADDC(_carry, c1, c1, 0, _carry); \
 }
 
 /* Adds two operands, and produces sum of the two inputs and the carry bit.
@@ -277,6 +352,8 @@ uint64_t software_umul128(uint64_t u, uint64_t v, uint64_t* high)
         (differenceOut) = tempReg - (digit_t)(borrowIn); \
         (borrowOut) = borrowReg; }
 
+#endif /* AJ_P256_INT128 */
+
 /* Move if carry is set. */
 #define CMOVC(dest, src, selector) { \
         digit_t mask = is_digit_nonzero_ct(selector) - 1; \
@@ -381,6 +458,60 @@ static void mul_p256(
 
 }
 
+/* Compute c = a^2 for 256-bit a
+ * Private function used to implement fpsqr_p256.
+ * The off-diagonal products a[i]*a[j] (i < j) are computed once and doubled,
+ * which takes 10 digit multiplications instead of the 16 used by mul_p256. */
+static void sqr_p256(
+    digit256_tc a,
+    digit_t* c)             /* Note this must have size at least 2*P256_DIGITS */
+{
+    digit_t A, t, d0, d1, carry;
+
+    AJ_ASSERT(a != NULL);
+    AJ_ASSERT(c != NULL);
+
+    /* Off-diagonal products into c[1..6] */
+    A = a[0];
+    mul(c[1], c[2], A, a[1]);
+    muladd(c[2], c[3], A, a[2]);
+    muladd(c[3], c[4], A, a[3]);
+
+    A = a[1];
+    muladd(c[3], t, A, a[2]);
+    muladdadd(c[4], t, A, a[3]);
+    c[5] = t;
+
+    A = a[2];
+    muladd(c[5], t, A, a[3]);
+    c[6] = t;
+
+    /* Double them into c[1..7] */
+    c[7] = c[6] >> (RADIX_BITS - 1);
+    c[6] = (c[6] << 1) | (c[5] >> (RADIX_BITS - 1));
+    c[5] = (c[5] << 1) | (c[4] >> (RADIX_BITS - 1));
+    c[4] = (c[4] << 1) | (c[3] >> (RADIX_BITS - 1));
+    c[3] = (c[3] << 1) | (c[2] >> (RADIX_BITS - 1));
+    c[2] = (c[2] << 1) | (c[1] >> (RADIX_BITS - 1));
+    c[1] = (c[1] << 1);
+
+    /* Add the diagonal a[i]^2 terms */
+    mul(c[0], d1, a[0], a[0]);
+    ADD(carry, c[1], c[1], d1);
+    mul(d0, d1, a[1], a[1]);
+    ADDC(carry, c[2], c[2], d0, carry);
+    ADDC(carry, c[3], c[3], d1, carry);
+    mul(d0, d1, a[2], a[2]);
+    ADDC(carry, c[4], c[4], d0, carry);
+    ADDC(carry, c[5], c[5], d1, carry);
+    mul(d0, d1, a[3], a[3]);
+    ADDC(carry, c[6], c[6], d0, carry);
+    ADDC(carry, c[7], c[7], d1, carry);
+
+    /* a^2 < 2^512, so there is no carry out of the top digit. */
+    AJ_ASSERT(carry == 0);
+}
+
 /* Compute c = a mod 2^256-2^224+2^192+2^96-1
  * such that 0 <= c < 2^256-2^224+2^192+2^96-1
  * Private function used to implement fpmul_p256. */
@@ -505,7 +636,8 @@ void fpsqr_p256(
     AJ_ASSERT(product != NULL);
     AJ_ASSERT(temps != NULL);
 
-    fpmul_p256(multiplier, multiplier, product, temps);
+    sqr_p256(multiplier, temps);
+    reduce_p256(temps, product);
 }
 
 void fpadd_p256(
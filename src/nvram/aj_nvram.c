@@ -41,12 +41,150 @@ static uint8_t isCompact = FALSE;
 
 #define AJ_NVRAM_END_ADDRESS (AJ_NVRAM_BASE_ADDRESS + AJ_NVRAM_SIZE)
 
+/*
+ * RAM index of the entries in the NVRAM image, mapping an id to the
+ * offset of its entry, plus a summary of the free space. It is built on
+ * first use by walking the image once and is kept up to date by create
+ * and delete. Compaction, clearing and targets reloading the image
+ * discard it. If the index can't be allocated lookups fall back to
+ * walking the image.
+ */
+typedef struct _NV_IndexEntry {
+    uint16_t id;
+    uint16_t next;             /* Index + 1 of the next entry in the bucket */
+    uint32_t offset;
+} NV_IndexEntry;
+
+#define NV_INDEX_BUCKETS 32
+#define NV_INDEX_GROW    16
+
+static NV_IndexEntry* nvIndex = NULL;
+static uint16_t nvBuckets[NV_INDEX_BUCKETS];
+static uint16_t nvIndexCount = 0;
+static uint16_t nvIndexAlloc = 0;
+static uint8_t nvIndexValid = FALSE;
+static uint32_t nvFreeOffset;  /* Offset of the unused space after the last entry */
+static uint32_t nvGarbage;     /* Bytes held by deleted entries */
+static uint32_t nvGeneration = 0;
+
+static uint8_t nvTransactionDepth = 0;
+static uint8_t nvTransactionAborted = FALSE;
+
+static uint16_t nvOpenCount = 0;   /* Open data sets, compaction would move them */
+static uint8_t nvCompacting = FALSE;
+
+void _AJ_NVRAM_Reindex(void)
+{
+    nvIndexValid = FALSE;
+    ++nvGeneration;
+}
+
+uint32_t _AJ_NVRAM_Generation(void)
+{
+    return nvGeneration;
+}
+
+static NV_IndexEntry* NVIndexFind(uint16_t id)
+{
+    uint16_t i = nvBuckets[id % NV_INDEX_BUCKETS];
+
+    while (i) {
+        if (nvIndex[i - 1].id == id) {
+            return &nvIndex[i - 1];
+        }
+        i = nvIndex[i - 1].next;
+    }
+    return NULL;
+}
+
+static AJ_Status NVIndexAdd(uint16_t id, uint32_t offset)
+{
+    NV_IndexEntry* entry;
+
+    if (nvIndexCount == nvIndexAlloc) {
+        entry = (NV_IndexEntry*)AJ_Realloc(nvIndex, (nvIndexAlloc + NV_INDEX_GROW) * sizeof(NV_IndexEntry));
+        if (!entry) {
+            nvIndexValid = FALSE;
+            return AJ_ERR_RESOURCES;
+        }
+        nvIndex = entry;
+        nvIndexAlloc += NV_INDEX_GROW;
+    }
+    entry = &nvIndex[nvIndexCount++];
+    entry->id = id;
+    entry->offset = offset;
+    entry->next = nvBuckets[id % NV_INDEX_BUCKETS];
+    nvBuckets[id % NV_INDEX_BUCKETS] = nvIndexCount;
+    return AJ_OK;
+}
+
+static void NVIndexRemove(uint16_t id)
+{
+    uint16_t* link = &nvBuckets[id % NV_INDEX_BUCKETS];
+    uint16_t i;
+    uint16_t last = nvIndexCount;
+
+    /* Unlink the entry from its bucket */
+    while (*link && (nvIndex[*link - 1].id != id)) {
+        link = &nvIndex[*link - 1].next;
+    }
+    if (!*link) {
+        return;
+    }
+    i = *link;
+    *link = nvIndex[i - 1].next;
+    /* Move the last entry into the hole so the array stays dense */
+    if (i != last) {
+        link = &nvBuckets[nvIndex[last - 1].id % NV_INDEX_BUCKETS];
+        while (*link != last) {
+            link = &nvIndex[*link - 1].next;
+        }
+        *link = i;
+        nvIndex[i - 1] = nvIndex[last - 1];
+    }
+    --nvIndexCount;
+}
+
+static uint8_t NVIndexReady(void)
+{
+    uint16_t* data;
+    uint16_t capacity;
+
+    if (nvIndexValid) {
+        return TRUE;
+    }
+    memset(nvBuckets, 0, sizeof(nvBuckets));
+    nvIndexCount = 0;
+    nvGarbage = 0;
+    nvIndexValid = TRUE;
+    data = (uint16_t*)(AJ_NVRAM_BASE_ADDRESS + SENTINEL_OFFSET);
+    while ((uint8_t*)data < (uint8_t*)AJ_NVRAM_END_ADDRESS && *data != INVALID_DATA) {
+        capacity = *(data + 1);
+        if (*data == INVALID_ID) {
+            nvGarbage += ENTRY_HEADER_SIZE + capacity;
+        } else if (!NVIndexFind(*data)) {
+            /* Only the first entry with an id is ever found */
+            if (AJ_OK != NVIndexAdd(*data, (uint8_t*)data - AJ_NVRAM_BASE_ADDRESS)) {
+                AJ_WarnPrintf(("NVIndexReady(): AJ_ERR_RESOURCES\n"));
+                return FALSE;
+            }
+        }
+        data += (ENTRY_HEADER_SIZE + capacity) >> 1;
+    }
+    nvFreeOffset = (uint8_t*)data - AJ_NVRAM_BASE_ADDRESS;
+    return TRUE;
+}
+
 uint32_t AJ_NVRAM_GetSize(void)
 {
     uint32_t size = 0;
     uint16_t* data = (uint16_t*)(AJ_NVRAM_BASE_ADDRESS + SENTINEL_OFFSET);
     uint16_t entryId = 0;
     uint16_t capacity = 0;
+
+    if (NVIndexReady()) {
+        return nvFreeOffset - nvGarbage;
+    }
     while ((uint8_t*)data < (uint8_t*)AJ_NVRAM_END_ADDRESS && *data != INVALID_DATA) {
         entryId = *data;
         capacity = *(data + 1);
@@ -64,6 +202,7 @@ uint32_t AJ_NVRAM_GetSizeRemaining(void)
 {
     if (!isCompact) {
         _AJ_CompactNVStorage();
+        nvIndexValid = FALSE;
         isCompact = TRUE;
     }
     return AJ_NVRAM_SIZE - AJ_NVRAM_GetSize();
@@ -100,9 +239,18 @@ uint8_t* AJ_FindNVEntry(uint16_t id)
 {
     uint16_t capacity = 0;
     uint16_t* data = (uint16_t*)(AJ_NVRAM_BASE_ADDRESS + SENTINEL_OFFSET);
+    NV_IndexEntry* entry;
 
     AJ_InfoPrintf(("AJ_FindNVEntry(id=%d.)\n", id));
 
+    if ((id != INVALID_ID) && NVIndexReady()) {
+        if (id == INVALID_DATA) {
+            /* Start of the free space */
+            return (nvFreeOffset < AJ_NVRAM_SIZE) ? AJ_NVRAM_BASE_ADDRESS + nvFreeOffset : NULL;
+        }
+        entry = NVIndexFind(id);
+        return entry ? AJ_NVRAM_BASE_ADDRESS + entry->offset : NULL;
+    }
     while ((uint8_t*)data < (uint8_t*)AJ_NVRAM_END_ADDRESS) {
         if (*data != id) {
             capacity = *(data + 1);
@@ -136,7 +284,11 @@ AJ_Status AJ_NVRAM_Create(uint16_t id, uint16_t capacity)
     if (!ptr || (ptr + ENTRY_HEADER_SIZE + capacity > AJ_NVRAM_END_ADDRESS)) {
         if (!isCompact) {
             AJ_InfoPrintf(("AJ_NVRAM_Create(): _AJ_CompactNVStorage()\n"));
+            /* Have file backed targets write the compacted image once */
+            AJ_NVRAM_BeginTransaction();
             _AJ_CompactNVStorage();
+            AJ_NVRAM_CommitTransaction();
+            nvIndexValid = FALSE;
             isCompact = TRUE;
         }
         ptr = AJ_FindNVEntry(INVALID_DATA);
@@ -148,6 +300,10 @@ AJ_Status AJ_NVRAM_Create(uint16_t id, uint16_t capacity)
     header.id = id;
     header.capacity = capacity;
     _AJ_NV_Write(ptr, &header, ENTRY_HEADER_SIZE);
+    if (nvIndexValid) {
+        NVIndexAdd(id, ptr - AJ_NVRAM_BASE_ADDRESS);
+        nvFreeOffset += ENTRY_HEADER_SIZE + capacity;
+    }
     return AJ_OK;
 }
 
@@ -171,6 +327,10 @@ AJ_Status AJ_NVRAM_SecureDelete(uint16_t id)
     newHeader.id = 0;
     _AJ_NV_Write(ptr, &newHeader, ENTRY_HEADER_SIZE);
     isCompact = FALSE;
+    if (nvIndexValid) {
+        NVIndexRemove(id);
+        nvGarbage += ENTRY_HEADER_SIZE + newHeader.capacity;
+    }
 
     uint8_t* buf = AJ_Malloc(newHeader.capacity);
 
@@ -206,6 +366,10 @@ AJ_Status AJ_NVRAM_Delete(uint16_t id)
     newHeader.id = 0;
     _AJ_NV_Write(ptr, &newHeader, ENTRY_HEADER_SIZE);
     isCompact = FALSE;
+    if (nvIndexValid) {
+        NVIndexRemove(id);
+        nvGarbage += ENTRY_HEADER_SIZE + newHeader.capacity;
+    }
 
     return AJ_OK;
 }
@@ -269,6 +433,7 @@ AJ_NV_DATASET* AJ_NVRAM_Open(uint16_t id, const char* mode, uint16_t capacity)
     handle->mode = *mode;
     handle->capacity = ((NV_EntryHeader*)entry)->capacity;
     handle->inode = entry;
+    ++nvOpenCount;
     return handle;
 
 OPEN_ERR_EXIT:
@@ -371,6 +536,9 @@ AJ_Status AJ_NVRAM_Close(AJ_NV_DATASET* handle)
         return AJ_ERR_INVALID;
     }
 
+    if (nvOpenCount) {
+        --nvOpenCount;
+    }
     AJ_Free(handle);
     handle = NULL;
     return AJ_OK;
@@ -390,5 +558,171 @@ uint8_t AJ_NVRAM_Exist(uint16_t id)
 void AJ_NVRAM_Clear()
 {
     _AJ_NVRAM_Clear();
+    _AJ_NVRAM_Reindex();
+}
+
+/*
+ * Copy towards the start of NVRAM through a small buffer, the ranges may overlap
+ */
+static void NVSlideDown(uint8_t* dest, uint8_t* src, uint16_t size)
+{
+    uint8_t buf[32];
+    uint16_t len;
+
+    while (size) {
+        len = min(size, sizeof (buf));
+        _AJ_NV_Read(src, buf, len);
+        _AJ_NV_Write(dest, buf, len);
+        dest += len;
+        src += len;
+        size -= len;
+    }
+}
+
+static void NVErase(uint8_t* dest, uint32_t size)
+{
+    uint8_t buf[32];
+    uint16_t len;
+
+    memset(buf, INVALID_DATA_BYTE, sizeof (buf));
+    while (size) {
+        len = min(size, sizeof (buf));
+        _AJ_NV_Write(dest, buf, len);
+        dest += len;
+        size -= len;
+    }
+}
+
+/*
+ * Each step finds the first run of deleted entries, slides the live entry
+ * that follows it down over the run and leaves the run, as one deleted
+ * entry, after it. When the run reaches the free space it is erased. Every
+ * step leaves a walkable image and runs in a transaction so a crash can't
+ * leave it half done.
+ */
+uint8_t AJ_NVRAM_CompactStep(void)
+{
+    uint16_t* data;
+    uint8_t* hole;
+    uint32_t holeSize;
+    uint32_t moved = 0;
+    uint16_t size;
+    NV_EntryHeader header;
+    NV_IndexEntry* entry;
+
+    if (nvOpenCount || !NVIndexReady()) {
+        return FALSE;
+    }
+    if (!nvGarbage) {
+        nvCompacting = FALSE;
+        isCompact = TRUE;
+        return FALSE;
+    }
+    if (!nvCompacting && (nvGarbage < AJ_NVRAM_COMPACT_THRESHOLD)) {
+        return FALSE;
+    }
+    if (AJ_OK != AJ_NVRAM_BeginTransaction()) {
+        return FALSE;
+    }
+    AJ_InfoPrintf(("AJ_NVRAM_CompactStep(): garbage=%u\n", nvGarbage));
+    nvCompacting = TRUE;
+    data = (uint16_t*)(AJ_NVRAM_BASE_ADDRESS + SENTINEL_OFFSET);
+    while (moved < AJ_NVRAM_COMPACT_STEP) {
+        while ((uint8_t*)data < (uint8_t*)AJ_NVRAM_END_ADDRESS && *data != INVALID_DATA && *data != INVALID_ID) {
+            data += (ENTRY_HEADER_SIZE + *(data + 1)) >> 1;
+        }
+        if ((uint8_t*)data >= (uint8_t*)AJ_NVRAM_END_ADDRESS || *data == INVALID_DATA) {
+            /* The garbage count was wrong */
+            nvIndexValid = FALSE;
+            break;
+        }
+        hole = (uint8_t*)data;
+        while ((uint8_t*)data < (uint8_t*)AJ_NVRAM_END_ADDRESS && *data == INVALID_ID) {
+            data += (ENTRY_HEADER_SIZE + *(data + 1)) >> 1;
+        }
+        holeSize = (uint8_t*)data - hole;
+        if ((uint8_t*)data >= (uint8_t*)AJ_NVRAM_END_ADDRESS || *data == INVALID_DATA) {
+            /* The run reached the free space */
+            NVErase(hole, holeSize);
+            nvFreeOffset -= holeSize;
+            nvGarbage -= holeSize;
+            break;
+        }
+        header.id = *data;
+        size = ENTRY_HEADER_SIZE + *(data + 1);
+        NVSlideDown(hole, (uint8_t*)data, size);
+        entry = NVIndexFind(header.id);
+        if (entry && (entry->offset == ((uint8_t*)data - AJ_NVRAM_BASE_ADDRESS))) {
+            entry->offset = hole - AJ_NVRAM_BASE_ADDRESS;
+        }
+        header.id = INVALID_ID;
+        header.capacity = holeSize - ENTRY_HEADER_SIZE;
+        _AJ_NV_Write(hole + size, &header, ENTRY_HEADER_SIZE);
+        data = (uint16_t*)(hole + size);
+        moved += size;
+    }
+    if (AJ_OK != AJ_NVRAM_CommitTransaction()) {
+        nvIndexValid = FALSE;
+    }
+    return nvGarbage ? TRUE : FALSE;
+}
+
+AJ_Status AJ_NVRAM_BeginTransaction(void)
+{
+    AJ_Status status;
+
+    AJ_InfoPrintf(("AJ_NVRAM_BeginTransaction(depth=%d.)\n", nvTransactionDepth));
+
+    if (!nvTransactionDepth) {
+        status = _AJ_NVRAM_BeginTransaction();
+        if (AJ_OK != status) {
+            AJ_InfoPrintf(("AJ_NVRAM_BeginTransaction(): Not supported\n"));
+            return status;
+        }
+    }
+    ++nvTransactionDepth;
+    return AJ_OK;
+}
+
+AJ_Status AJ_NVRAM_CommitTransaction(void)
+{
+    AJ_InfoPrintf(("AJ_NVRAM_CommitTransaction(depth=%d.)\n", nvTransactionDepth));
+
+    if (!nvTransactionDepth || --nvTransactionDepth) {
+        return AJ_OK;
+    }
+    if (nvTransactionAborted) {
+        /* Discard anything written since the nested abort */
+        nvTransactionAborted = FALSE;
+        _AJ_NVRAM_AbortTransaction();
+        _AJ_NVRAM_Reindex();
+        isCompact = FALSE;
+        AJ_WarnPrintf(("AJ_NVRAM_CommitTransaction(): Transaction was aborted\n"));
+        return AJ_ERR_FAILURE;
+    }
+    if (AJ_OK != _AJ_NVRAM_CommitTransaction()) {
+        AJ_ErrPrintf(("AJ_NVRAM_CommitTransaction(): AJ_ERR_NVRAM_WRITE\n"));
+        return AJ_ERR_NVRAM_WRITE;
+    }
+    return AJ_OK;
+}
+
+void AJ_NVRAM_AbortTransaction(void)
+{
+    AJ_InfoPrintf(("AJ_NVRAM_AbortTransaction(depth=%d.)\n", nvTransactionDepth));
+
+    if (!nvTransactionDepth) {
+        return;
+    }
+    _AJ_NVRAM_AbortTransaction();
+    _AJ_NVRAM_Reindex();
+    isCompact = FALSE;
+    if (--nvTransactionDepth) {
+        /* Keep holding back changes, the outermost commit will fail */
+        nvTransactionAborted = TRUE;
+        _AJ_NVRAM_BeginTransaction();
+    } else {
+        nvTransactionAborted = FALSE;
+    }
 }
 
@@ -50,6 +50,21 @@ void _AJ_NV_Read(void* src, void* buf, uint16_t size)
     memcpy(buf, src, size);
 }
 
+AJ_Status _AJ_NVRAM_BeginTransaction(void)
+{
+    /* Writes go straight to NVRAM so they can't be held back */
+    return AJ_ERR_UNEXPECTED;
+}
+
+AJ_Status _AJ_NVRAM_CommitTransaction(void)
+{
+    return AJ_OK;
+}
+
+void _AJ_NVRAM_AbortTransaction(void)
+{
+}
+
 void _AJ_NVRAM_Clear()
 {
     memset((uint8_t*)AJ_NVRAM_BASE_ADDRESS, INVALID_DATA_BYTE, AJ_NVRAM_SIZE);
@@ -23,6 +23,7 @@
  */
 #define AJ_MODULE TARGET_NVRAM
 
+#include <unistd.h>
 #include <ajtcl/aj_nvram.h>
 #include <ajtcl/aj_debug.h>
 #include "../../aj_target_nvram.h"
@@ -40,6 +41,9 @@ uint8_t* AJ_NVRAM_BASE_ADDRESS;
 
 extern void AJ_NVRAM_Layout_Print();
 
+/* The file isn't rewritten while a transaction is open */
+static uint8_t nvTransaction = FALSE;
+
 void AJ_NVRAM_Init()
 {
     AJ_NVRAM_BASE_ADDRESS = AJ_EMULATED_NVRAM;
@@ -85,22 +89,55 @@ AJ_Status _AJ_LoadNVFromFile()
     memset(AJ_NVRAM_BASE_ADDRESS, INVALID_DATA_BYTE, AJ_NVRAM_SIZE);
     fread(AJ_NVRAM_BASE_ADDRESS, AJ_NVRAM_SIZE, 1, f);
     fclose(f);
+    _AJ_NVRAM_Reindex();
     return AJ_OK;
 }
 
+/*
+ * Writes the whole image to a new file and renames it over the old one so a
+ * crash leaves either the old or the new image intact
+ */
 AJ_Status _AJ_StoreNVToFile()
 {
-    FILE* f = fopen("ajlite.nvram", "wb");
+    FILE* f;
+    int ok;
+
+    if (nvTransaction) {
+        return AJ_OK;
+    }
+    f = fopen("ajlite.nvram.tmp", "wb");
     if (!f) {
-        AJ_ErrPrintf(("_AJ_StireNVToFile(): LoadNVFromFile() failed. status=AJ_ERR_FAILURE\n"));
+        AJ_ErrPrintf(("_AJ_StoreNVToFile(): StoreNVToFile() failed. status=AJ_ERR_FAILURE\n"));
         return AJ_ERR_FAILURE;
     }
 
-    fwrite(AJ_NVRAM_BASE_ADDRESS, AJ_NVRAM_SIZE, 1, f);
-    fclose(f);
+    ok = (fwrite(AJ_NVRAM_BASE_ADDRESS, AJ_NVRAM_SIZE, 1, f) == 1) && !fflush(f) && !fsync(fileno(f));
+    if (fclose(f) || !ok || rename("ajlite.nvram.tmp", "ajlite.nvram")) {
+        AJ_ErrPrintf(("_AJ_StoreNVToFile(): write failed. status=AJ_ERR_FAILURE\n"));
+        unlink("ajlite.nvram.tmp");
+        return AJ_ERR_FAILURE;
+    }
+    return AJ_OK;
+}
+
+AJ_Status _AJ_NVRAM_BeginTransaction(void)
+{
+    nvTransaction = TRUE;
     return AJ_OK;
 }
 
+AJ_Status _AJ_NVRAM_CommitTransaction(void)
+{
+    nvTransaction = FALSE;
+    return _AJ_StoreNVToFile();
+}
+
+void _AJ_NVRAM_AbortTransaction(void)
+{
+    nvTransaction = FALSE;
+    _AJ_LoadNVFromFile();
+}
+
 // Compact the storage by removing invalid entries
 AJ_Status _AJ_CompactNVStorage()
 {
@@ -77,6 +77,21 @@ void _AJ_NV_Read(void* src, void* buf, uint16_t size)
     nvm_read(INT_FLASH, (uint32_t)src, buf, size);
 }
 
+AJ_Status _AJ_NVRAM_BeginTransaction(void)
+{
+    /* Writes go straight to flash so they can't be held back */
+    return AJ_ERR_UNEXPECTED;
+}
+
+AJ_Status _AJ_NVRAM_CommitTransaction(void)
+{
+    return AJ_OK;
+}
+
+void _AJ_NVRAM_AbortTransaction(void)
+{
+}
+
 void AJ_NVRAM_Init()
 {
     nvm_init(INT_FLASH);
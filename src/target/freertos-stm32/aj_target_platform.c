@@ -161,6 +161,22 @@ void _AJ_NV_Write(uint32_t dest, void* data, uint16_t size)
     }
     return AJ_OK;
 }
+
+AJ_Status _AJ_NVRAM_BeginTransaction(void)
+{
+    /* Writes go straight to flash so they can't be held back */
+    return AJ_ERR_UNEXPECTED;
+}
+
+AJ_Status _AJ_NVRAM_CommitTransaction(void)
+{
+    return AJ_OK;
+}
+
+void _AJ_NVRAM_AbortTransaction(void)
+{
+}
+
 AJ_Status _AJ_CompactNVStorage(void) {
 
     AJ_Status status;
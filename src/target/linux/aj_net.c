@@ -23,22 +23,30 @@
  */
 
 #define AJ_MODULE NET
+#define _GNU_SOURCE     /* struct ucred */
 #include <stdio.h>
 #include <stdlib.h>
 #include <sys/types.h>
 #include <sys/socket.h>
+#include <sys/un.h>
 #include <sys/eventfd.h>
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
 #include <sys/fcntl.h>
 #include <arpa/inet.h>
 #include <sys/ioctl.h>
 #include <net/if.h>
 #include <netinet/in.h>
+#include <netinet/udp.h>
 #include <assert.h>
 #include <errno.h>
 #include <time.h>
 #include <unistd.h>
 #include <netdb.h>
 #include <ifaddrs.h>
+#include <limits.h>
+#include <stddef.h>
+#include <pthread.h>
 
 #include <ajtcl/aj_target.h>
 #include <ajtcl/aj_bufio.h>
@@ -53,6 +61,26 @@
 
 #ifdef AJ_ARDP
 #include <ajtcl/aj_ardp.h>
+
+#ifndef UDP_SEGMENT
+#define UDP_SEGMENT 103
+#endif
+#ifndef UDP_GRO
+#define UDP_GRO 104
+#endif
+
+/*
+ * Limits on a datagram the kernel segments or coalesces: the largest UDP payload and the
+ * number of segments older kernels accept in one send
+ */
+#define UDP_GSO_MAX_BYTES 65507
+#define UDP_GSO_MAX_SEGS  64
+
+/*
+ * Coalesced datagrams each need room for the largest the kernel builds, so fewer of them are
+ * received in a batch
+ */
+#define UDP_GRO_RECV_BATCH 4
 #endif
 
 /**
@@ -95,12 +123,40 @@ static const char MDNS_IPV6_MULTICAST_GROUP[] = "ff02::fb";
  */
 #define MDNS_UDP_PORT 5353
 
+/*
+ * Need enough space to receive a complete name service packet when used in UDP
+ * mode.  NS expects MTU of 1500 subtracts UDP, IP and ethertype overhead.
+ * 1500 - 8 -20 - 18 = 1454.  txData buffer size needs to be big enough to hold
+ * max(NS WHO-HAS for one name (4 + 2 + 256 = 262),
+ *     mDNS query for one name (194 + 5 + 5 + 15 + 256 = 475)) = 475
+ */
+#define MCAST_RX_DATA_SIZE 1454
+#define MCAST_TX_DATA_SIZE 475
+
 /**
- * Target-specific contexts for network I/O
+ * Target-specific contexts for network I/O. Each bus attachment connection owns
+ * one, allocated on connect, so a process can run several bus attachments.
  */
-typedef struct {
+typedef struct _NetContext {
     int tcpSock;
     int udpSock;
+    int epollFd;      /* Reactor for the connected socket and the interrupt and timer fds */
+    int timerFd;      /* Periodic timer that wakes an application polling AJ_GetEventFd() */
+    int interruptFd;  /* An eventfd handle used for interrupting a network read blocked in the reactor */
+    uint8_t blocked;  /* Set while a network read is blocked in the reactor */
+    uint8_t unixSock; /* tcpSock is a unix domain socket to a local routing node */
+    AJ_NetSocket* netSock; /* The bus attachment's socket, identifies the connection to _AJ_Net_InterruptSock() */
+    struct _NetContext* next;
+    uint8_t* rxData;  /* Allocated so AJ_BusSetBufferSizes() can resize them */
+    uint8_t* txData;
+#ifdef AJ_ARDP
+    uint8_t segment[UDP_RECV_BATCH][UDP_SEGBMAX];  /* Platform owned ARDP receive buffers filled by one recvmmsg(), avoids double-buffering */
+    uint8_t* gro;     /* UDP_GRO_RECV_BATCH buffers for datagrams coalesced by UDP GRO, NULL if GRO is off */
+    uint8_t gso;      /* Runs of equal segments are sent as one datagram segmented by the kernel */
+#endif
+#ifdef AJ_IO_URING
+    AJ_Uring* uring;  /* Receives in place of the reactor when the kernel supports it */
+#endif
 } NetContext;
 
 typedef struct {
@@ -111,17 +167,95 @@ typedef struct {
     int mDnsRecvSock;
     uint32_t mDnsRecvAddr;
     uint16_t mDnsRecvPort;
+    int epollFd;      /* Reactor for the sockets name service replies are received on */
+    uint8_t rxData[MCAST_RX_DATA_SIZE];
+    uint8_t txData[MCAST_TX_DATA_SIZE];
 } MCastContext;
 
-static NetContext netContext = { INVALID_SOCKET, INVALID_SOCKET };
-static MCastContext mCastContext = { INVALID_SOCKET, INVALID_SOCKET, INVALID_SOCKET, INVALID_SOCKET };
+/*
+ * All open connections, AJ_Net_Interrupt() interrupts any of them blocked in a read. The
+ * lock lets other threads interrupt a connection while it is being closed.
+ */
+static NetContext* netContexts = NULL;
+static pthread_mutex_t netLock = PTHREAD_MUTEX_INITIALIZER;
+
+static NetContext* NewNetContext(AJ_NetSocket* netSock)
+{
+    NetContext* context = (NetContext*)AJ_Malloc(sizeof(NetContext));
+    if (context) {
+        memset(context, 0, sizeof(NetContext));
+        context->rxData = (uint8_t*)AJ_Malloc(AJ_RX_DATA_SIZE);
+        context->txData = (uint8_t*)AJ_Malloc(AJ_TX_DATA_SIZE);
+        if (!context->rxData || !context->txData) {
+            AJ_Free(context->rxData);
+            AJ_Free(context->txData);
+            AJ_Free(context);
+            return NULL;
+        }
+        context->tcpSock = context->udpSock = INVALID_SOCKET;
+        context->epollFd = context->timerFd = context->interruptFd = INVALID_SOCKET;
+        context->netSock = netSock;
+        pthread_mutex_lock(&netLock);
+        context->next = netContexts;
+        netContexts = context;
+        pthread_mutex_unlock(&netLock);
+    }
+    return context;
+}
+
+static void FreeNetContext(NetContext* context)
+{
+    NetContext** link = &netContexts;
+    pthread_mutex_lock(&netLock);
+    while (*link) {
+        if (*link == context) {
+            *link = context->next;
+            break;
+        }
+        link = &(*link)->next;
+    }
+    pthread_mutex_unlock(&netLock);
+    AJ_Free(context->rxData);
+    AJ_Free(context->txData);
+#ifdef AJ_ARDP
+    AJ_Free(context->gro);
+#endif
+    AJ_Free(context);
+}
+
+/*
+ * Returns the connection context if the socket is connected over TCP or UDP
+ */
+static NetContext* GetNetContext(AJ_NetSocket* netSock)
+{
+    NetContext* context;
+    pthread_mutex_lock(&netLock);
+    for (context = netContexts; context != NULL; context = context->next) {
+        if (netSock->rx.context == context) {
+            break;
+        }
+    }
+    pthread_mutex_unlock(&netLock);
+    return context;
+}
+
+/*
+ * Period of the timer tick for a TCP connection. For UDP connections the tick
+ * is UDP_MINIMUM_TIMEOUT so the ARDP timers keep running.
+ */
+#define EVENT_TICK_TCP 1000
+
+/*
+ * Maximum number of events collected from one epoll_wait() call
+ */
+#define REACTOR_MAX_EVENTS 4
 
 #ifdef AJ_ARDP
 /**
  * Need to predeclare a few things for ARDP
  */
 static AJ_Status AJ_Net_ARDP_Connect(AJ_BusAttachment* bus, const AJ_Service* service);
-static void AJ_Net_ARDP_Disconnect(AJ_NetSocket* netSock);
+static void AJ_Net_ARDP_Disconnect(NetContext* context, AJ_NetSocket* netSock);
 
 #endif // AJ_ARDP
 
@@ -164,7 +298,10 @@ static AJ_Status CloseMCastSock(AJ_MCastSocket* mcastSock)
         if (context->mDnsRecvSock != INVALID_SOCKET) {
             close(context->mDnsRecvSock);
         }
-        context->udpSock = context->udp6Sock = context->mDnsSock = context->mDns6Sock = context->mDnsRecvSock = INVALID_SOCKET;
+        if (context->epollFd != INVALID_SOCKET) {
+            close(context->epollFd);
+        }
+        AJ_Free(context);
         memset(mcastSock, 0, sizeof(AJ_MCastSocket));
     }
     return AJ_OK;
@@ -199,61 +336,237 @@ AJ_Status AJ_Net_Send(AJ_IOBuffer* buf)
 #endif
 
 /*
- * An eventfd handle used for interrupting a network read blocked on select
+ * This function is called to cancel a pending select.
  */
-static int interruptFd = INVALID_SOCKET;
+void AJ_Net_Interrupt()
+{
+    _AJ_Net_InterruptSock(NULL);
+}
+
+void _AJ_Net_InterruptSock(AJ_NetSocket* netSock)
+{
+    NetContext* context;
+
+    _AJ_ShmInterrupt(netSock);
+    _AJ_IOThreadInterrupt(netSock);
+    pthread_mutex_lock(&netLock);
+    for (context = netContexts; context != NULL; context = context->next) {
+        if ((!netSock || (context->netSock == netSock)) && context->blocked) {
+            uint64_t u64 = 1;
+            if (write(context->interruptFd, &u64, sizeof(u64)) < 0) {
+                AJ_ErrPrintf(("_AJ_Net_InterruptSock(): write() failed. errno=\"%s\"\n", strerror(errno)));
+            }
+        }
+    }
+    pthread_mutex_unlock(&netLock);
+}
 
 /*
- * The socket that is blocked in select
+ * Sockets are registered with a reactor once when they are opened rather than
+ * being collected into an fd_set on every read.
  */
-static uint8_t blocked;
+static int ReactorAdd(int epollFd, int fd)
+{
+    struct epoll_event ev;
+
+    memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN;
+    ev.data.fd = fd;
+    return epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &ev);
+}
+
+static int ReactorWait(int epollFd, struct epoll_event* events, uint32_t timeout)
+{
+    return epoll_wait(epollFd, events, REACTOR_MAX_EVENTS, (int)min(timeout, (uint32_t)INT_MAX));
+}
+
+static void ReactorDown(NetContext* context)
+{
+#ifdef AJ_IO_URING
+    if (context->uring) {
+        _AJ_UringDestroy(context->uring);
+        context->uring = NULL;
+    }
+#endif
+    if (context->epollFd != INVALID_SOCKET) {
+        close(context->epollFd);
+        context->epollFd = INVALID_SOCKET;
+    }
+    if (context->timerFd != INVALID_SOCKET) {
+        close(context->timerFd);
+        context->timerFd = INVALID_SOCKET;
+    }
+    if (context->interruptFd != INVALID_SOCKET) {
+        close(context->interruptFd);
+        context->interruptFd = INVALID_SOCKET;
+    }
+}
 
 /*
- * This function is called to cancel a pending select.
+ * Create the reactor for a connection with the interrupt and timer fds registered
  */
-void AJ_Net_Interrupt()
+static AJ_Status ReactorUp(NetContext* context)
+{
+    context->epollFd = epoll_create1(EPOLL_CLOEXEC);
+    context->interruptFd = eventfd(0, O_NONBLOCK);  // Use O_NONBLOCK instead of EFD_NONBLOCK due to bug in OpenWrt's uCLibc
+    context->timerFd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if ((context->epollFd == INVALID_SOCKET) || (context->interruptFd == INVALID_SOCKET) || (context->timerFd == INVALID_SOCKET) ||
+        ReactorAdd(context->epollFd, context->interruptFd) || ReactorAdd(context->epollFd, context->timerFd)) {
+        AJ_ErrPrintf(("ReactorUp(): failed to create reactor. errno=\"%s\"\n", strerror(errno)));
+        ReactorDown(context);
+        return AJ_ERR_RESOURCES;
+    }
+    return AJ_OK;
+}
+
+/*
+ * Wait for the connected socket to become readable. Timer ticks are consumed
+ * here and do not end the wait.
+ */
+static AJ_Status ReactorWaitForSock(NetContext* context, int sock, uint32_t timeout)
 {
-    if (blocked) {
-        uint64_t u64;
-        if (write(interruptFd, &u64, sizeof(u64)) < 0) {
-            AJ_ErrPrintf(("AJ_Net_Interrupt(): write() failed. errno=\"%s\"\n", strerror(errno)));
+    struct epoll_event events[REACTOR_MAX_EVENTS];
+    AJ_Time timer;
+    uint32_t elapsed = 0;
+    uint64_t u64;
+    int rc;
+    int i;
+
+    AJ_InitTimer(&timer);
+    while (TRUE) {
+        context->blocked = TRUE;
+        rc = ReactorWait(context->epollFd, events, timeout - elapsed);
+        context->blocked = FALSE;
+        if (rc < 0) {
+            if (errno != EINTR) {
+                AJ_ErrPrintf(("ReactorWaitForSock(): epoll_wait() failed. errno=\"%s\"\n", strerror(errno)));
+                return AJ_ERR_READ;
+            }
+            rc = 0;
+        } else if (rc == 0) {
+            return AJ_ERR_TIMEOUT;
+        }
+        for (i = 0; i < rc; ++i) {
+            if (events[i].data.fd == context->interruptFd) {
+                if (read(context->interruptFd, &u64, sizeof(u64)) < 0) {
+                    AJ_ErrPrintf(("ReactorWaitForSock(): read() failed during interrupt. errno=\"%s\"\n", strerror(errno)));
+                }
+                return AJ_ERR_INTERRUPTED;
+            }
+        }
+        for (i = 0; i < rc; ++i) {
+            if (events[i].data.fd == sock) {
+                return AJ_OK;
+            }
+            if (events[i].data.fd == context->timerFd) {
+                if (read(context->timerFd, &u64, sizeof(u64)) < 0) {
+                    AJ_WarnPrintf(("ReactorWaitForSock(): read() failed for timer. errno=\"%s\"\n", strerror(errno)));
+                }
+            }
+        }
+        elapsed = AJ_GetElapsedTime(&timer, TRUE);
+        if (elapsed >= timeout) {
+            return AJ_ERR_TIMEOUT;
         }
     }
 }
 
+#ifdef AJ_IO_URING
+/*
+ * TCP reads are copied out of buffers of this size
+ */
+#define URING_TCP_BUF_SIZE 4096
+
+/*
+ * Receive through an io_uring if the kernel supports it, otherwise the reactor is used
+ */
+static void UringUp(NetContext* context, int sock, uint32_t bufSize)
+{
+    context->uring = _AJ_UringCreate(sock, context->interruptFd, context->timerFd, bufSize);
+    if (context->uring) {
+        /*
+         * The multishot receive drains the socket so a reactor has to wait on the ring instead,
+         * AJ_GetEventFd() registers it
+         */
+        epoll_ctl(context->epollFd, EPOLL_CTL_DEL, sock, NULL);
+    } else {
+        AJ_InfoPrintf(("UringUp(): io_uring not available, using epoll\n"));
+    }
+}
+
+/*
+ * Wait for data from the ring and copy it into the buffer
+ */
+static AJ_Status UringRecv(NetContext* context, AJ_IOBuffer* buf, uint32_t len, uint32_t timeout)
+{
+    AJ_Status status;
+    uint8_t* data;
+    uint32_t avail;
+
+    context->blocked = TRUE;
+    status = _AJ_UringRecv(context->uring, &data, &avail, timeout);
+    context->blocked = FALSE;
+    if (status == AJ_OK) {
+        len = min(len, AJ_IO_BUF_SPACE(buf));
+        len = min(len, avail);
+        memcpy(buf->writePtr, data, len);
+        buf->writePtr += len;
+        _AJ_UringConsume(context->uring, len);
+    }
+    return status;
+}
+#endif
+
+int AJ_GetEventFd(AJ_BusAttachment* bus)
+{
+    NetContext* context = GetNetContext(&bus->sock);
+    struct itimerspec tick;
+    uint32_t period = EVENT_TICK_TCP;
+
+    if ((context == NULL) || (context->epollFd == INVALID_SOCKET)) {
+        return INVALID_SOCKET;
+    }
+#ifdef AJ_ARDP
+    if (context->udpSock != INVALID_SOCKET) {
+        period = UDP_MINIMUM_TIMEOUT;
+    }
+#endif
+    /*
+     * The tick makes sure AJ_ProcessEvents() gets called to run timers while no data arrives
+     */
+    tick.it_interval.tv_sec = period / 1000;
+    tick.it_interval.tv_nsec = (period % 1000) * 1000000;
+    tick.it_value = tick.it_interval;
+    if (timerfd_settime(context->timerFd, 0, &tick, NULL) < 0) {
+        AJ_WarnPrintf(("AJ_GetEventFd(): timerfd_settime() failed. errno=\"%s\"\n", strerror(errno)));
+    }
+#ifdef AJ_IO_URING
+    if (context->uring && ReactorAdd(context->epollFd, _AJ_UringFd(context->uring)) && (errno != EEXIST)) {
+        AJ_WarnPrintf(("AJ_GetEventFd(): epoll_ctl() failed. errno=\"%s\"\n", strerror(errno)));
+    }
+#endif
+    return context->epollFd;
+}
+
 #ifdef AJ_TCP
 AJ_Status AJ_Net_Recv(AJ_IOBuffer* buf, uint32_t len, uint32_t timeout)
 {
     NetContext* context = (NetContext*) buf->context;
     AJ_Status status = AJ_OK;
     size_t rx = AJ_IO_BUF_SPACE(buf);
-    fd_set fds;
-    int rc = 0;
-    int maxFd = context->tcpSock;
-    struct timeval tv = { timeout / 1000, 1000 * (timeout % 1000) };
 
     // AJ_InfoPrintf(("AJ_Net_Recv(buf=0x%p, len=%d, timeout=%d)\n", buf, len, timeout));
 
     assert(buf->direction == AJ_IO_BUF_RX);
 
-    FD_ZERO(&fds);
-    FD_SET(context->tcpSock, &fds);
-    if (interruptFd >= 0) {
-        FD_SET(interruptFd, &fds);
-        maxFd = max(maxFd, interruptFd);
+#ifdef AJ_IO_URING
+    if (context->uring) {
+        return UringRecv(context, buf, len, timeout);
     }
-    blocked = TRUE;
-    rc = select(maxFd + 1, &fds, NULL, NULL, &tv);
-    blocked = FALSE;
-    if (rc == 0) {
-        return AJ_ERR_TIMEOUT;
-    }
-    if ((interruptFd >= 0) && FD_ISSET(interruptFd, &fds)) {
-        uint64_t u64;
-        if (read(interruptFd, &u64, sizeof(u64)) < 0) {
-            AJ_ErrPrintf(("AJ_Net_Recv(): read() failed during interrupt. errno=\"%s\"\n", strerror(errno)));
-        }
-        return AJ_ERR_INTERRUPTED;
+#endif
+    status = ReactorWaitForSock(context, context->tcpSock, timeout);
+    if (status != AJ_OK) {
+        return status;
     }
     rx = min(rx, len);
     if (rx) {
@@ -270,9 +583,6 @@ AJ_Status AJ_Net_Recv(AJ_IOBuffer* buf, uint32_t len, uint32_t timeout)
 }
 #endif
 
-static uint8_t rxData[AJ_RX_DATA_SIZE];
-static uint8_t txData[AJ_TX_DATA_SIZE];
-
 #ifdef AJ_TCP
 static AJ_Status AJ_TCP_Connect(AJ_BusAttachment* bus, const AJ_Service* service)
 {
@@ -280,9 +590,9 @@ static AJ_Status AJ_TCP_Connect(AJ_BusAttachment* bus, const AJ_Service* service
     struct sockaddr_storage addrBuf;
     socklen_t addrSize;
     int tcpSock = INVALID_SOCKET;
+    NetContext* context = NewNetContext(&bus->sock);
 
-    interruptFd = eventfd(0, O_NONBLOCK);  // Use O_NONBLOCK instead of EFD_NONBLOCK due to bug in OpenWrt's uCLibc
-    if (interruptFd < 0) {
+    if (!context || (ReactorUp(context) != AJ_OK)) {
         AJ_ErrPrintf(("AJ_TCP_Connect(): failed to created interrupt event\n"));
         goto ConnectError;
     }
@@ -317,11 +627,19 @@ static AJ_Status AJ_TCP_Connect(AJ_BusAttachment* bus, const AJ_Service* service
     if (ret < 0) {
         AJ_ErrPrintf(("AJ_TCP_Connect(): connect() failed. errno=\"%s\", status=AJ_ERR_CONNECT\n", strerror(errno)));
         goto ConnectError;
+    } else if (ReactorAdd(context->epollFd, tcpSock)) {
+        AJ_ErrPrintf(("AJ_TCP_Connect(): epoll_ctl() failed. errno=\"%s\", status=AJ_ERR_CONNECT\n", strerror(errno)));
+        goto ConnectError;
     } else {
-        netContext.tcpSock = tcpSock;
-        AJ_IOBufInit(&bus->sock.rx, rxData, sizeof(rxData), AJ_IO_BUF_RX, &netContext);
+        context->tcpSock = tcpSock;
+#ifdef AJ_IO_URING
+        UringUp(context, tcpSock, URING_TCP_BUF_SIZE);
+#endif
+        AJ_IOBufInit(&bus->sock.rx, context->rxData, AJ_RX_DATA_SIZE, AJ_IO_BUF_RX, context);
+        bus->sock.rx.bufMax = AJ_RX_DATA_SIZE;
         bus->sock.rx.recv = AJ_Net_Recv;
-        AJ_IOBufInit(&bus->sock.tx, txData, sizeof(txData), AJ_IO_BUF_TX, &netContext);
+        AJ_IOBufInit(&bus->sock.tx, context->txData, AJ_TX_DATA_SIZE, AJ_IO_BUF_TX, context);
+        bus->sock.tx.bufMax = AJ_TX_DATA_SIZE;
         bus->sock.tx.send = AJ_Net_Send;
         AJ_InfoPrintf(("AJ_TCP_Connect(): status=AJ_OK\n"));
     }
@@ -329,9 +647,9 @@ static AJ_Status AJ_TCP_Connect(AJ_BusAttachment* bus, const AJ_Service* service
     return AJ_OK;
 
 ConnectError:
-    if (interruptFd != INVALID_SOCKET) {
-        close(interruptFd);
-        interruptFd = INVALID_SOCKET;
+    if (context) {
+        ReactorDown(context);
+        FreeNetContext(context);
     }
 
     if (tcpSock != INVALID_SOCKET) {
@@ -340,6 +658,114 @@ ConnectError:
 
     return AJ_ERR_CONNECT;
 }
+
+/*
+ * Connect to a routing node on the same host over a unix domain socket. The stream carries the
+ * same bytes as TCP so AJ_Net_Send() and AJ_Net_Recv() are used unchanged.
+ */
+static AJ_Status AJ_Unix_Connect(AJ_BusAttachment* bus)
+{
+    struct sockaddr_un addr;
+    socklen_t addrSize;
+    size_t pathLen = strlen(AJ_ROUTING_NODE_UNIX_PATH);
+    int unixSock = INVALID_SOCKET;
+    NetContext* context;
+
+    if (!pathLen || (pathLen >= sizeof(addr.sun_path))) {
+        return AJ_ERR_CONNECT;
+    }
+    context = NewNetContext(&bus->sock);
+    if (!context || (ReactorUp(context) != AJ_OK)) {
+        AJ_ErrPrintf(("AJ_Unix_Connect(): failed to created interrupt event\n"));
+        goto ConnectError;
+    }
+    unixSock = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (unixSock == INVALID_SOCKET) {
+        AJ_ErrPrintf(("AJ_Unix_Connect(): socket() failed.  status=AJ_ERR_CONNECT\n"));
+        goto ConnectError;
+    }
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    memcpy(addr.sun_path, AJ_ROUTING_NODE_UNIX_PATH, pathLen);
+    /*
+     * A leading '@' names a socket in the abstract namespace
+     */
+    if (addr.sun_path[0] == '@') {
+        addr.sun_path[0] = '\0';
+    }
+    addrSize = (socklen_t)(offsetof(struct sockaddr_un, sun_path) + pathLen);
+    AJ_InfoPrintf(("AJ_Unix_Connect(): Connect to \"%s\"\n", AJ_ROUTING_NODE_UNIX_PATH));
+
+    if (connect(unixSock, (struct sockaddr*)&addr, addrSize) < 0) {
+        AJ_InfoPrintf(("AJ_Unix_Connect(): connect() failed. errno=\"%s\", status=AJ_ERR_CONNECT\n", strerror(errno)));
+        goto ConnectError;
+    } else if (ReactorAdd(context->epollFd, unixSock)) {
+        AJ_ErrPrintf(("AJ_Unix_Connect(): epoll_ctl() failed. errno=\"%s\", status=AJ_ERR_CONNECT\n", strerror(errno)));
+        goto ConnectError;
+    }
+    context->tcpSock = unixSock;
+    context->unixSock = TRUE;
+#ifdef AJ_IO_URING
+    UringUp(context, unixSock, URING_TCP_BUF_SIZE);
+#endif
+    AJ_IOBufInit(&bus->sock.rx, context->rxData, AJ_RX_DATA_SIZE, AJ_IO_BUF_RX, context);
+    bus->sock.rx.bufMax = AJ_RX_DATA_SIZE;
+    bus->sock.rx.recv = AJ_Net_Recv;
+    AJ_IOBufInit(&bus->sock.tx, context->txData, AJ_TX_DATA_SIZE, AJ_IO_BUF_TX, context);
+    bus->sock.tx.bufMax = AJ_TX_DATA_SIZE;
+    bus->sock.tx.send = AJ_Net_Send;
+    AJ_InfoPrintf(("AJ_Unix_Connect(): status=AJ_OK\n"));
+    return AJ_OK;
+
+ConnectError:
+    if (context) {
+        ReactorDown(context);
+        FreeNetContext(context);
+    }
+    if (unixSock != INVALID_SOCKET) {
+        close(unixSock);
+    }
+    return AJ_ERR_CONNECT;
+}
+
+AJ_Status AJ_Net_SendCredentials(AJ_NetSocket* netSock, uint32_t* uid)
+{
+    NetContext* context = GetNetContext(netSock);
+    uint8_t nul = 0;
+    struct iovec iov;
+    struct msghdr msg;
+    struct ucred* cred;
+    union {
+        struct cmsghdr hdr;
+        uint8_t buf[CMSG_SPACE(sizeof(struct ucred))];
+    } control;
+
+    if (!context || !context->unixSock) {
+        return AJ_ERR_DISALLOWED;
+    }
+    iov.iov_base = &nul;
+    iov.iov_len = 1;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control.buf;
+    msg.msg_controllen = sizeof(control.buf);
+    memset(&control, 0, sizeof(control));
+    control.hdr.cmsg_level = SOL_SOCKET;
+    control.hdr.cmsg_type = SCM_CREDENTIALS;
+    control.hdr.cmsg_len = CMSG_LEN(sizeof(struct ucred));
+    cred = (struct ucred*)CMSG_DATA(&control.hdr);
+    cred->pid = getpid();
+    cred->uid = getuid();
+    cred->gid = getgid();
+
+    if (sendmsg(context->tcpSock, &msg, MSG_NOSIGNAL) != 1) {
+        AJ_ErrPrintf(("AJ_Net_SendCredentials(): sendmsg() failed. errno=\"%s\", status=AJ_ERR_WRITE\n", strerror(errno)));
+        return AJ_ERR_WRITE;
+    }
+    *uid = (uint32_t)cred->uid;
+    return AJ_OK;
+}
 #endif
 
 
@@ -359,6 +785,12 @@ AJ_Status AJ_Net_Connect(AJ_BusAttachment* bus, const AJ_Service* service)
 #endif
 
 #ifdef AJ_TCP
+    if (service->addrTypes & AJ_ADDR_UNIX) {
+        status = AJ_Unix_Connect(bus);
+        if (status == AJ_OK) {
+            return status;
+        }
+    }
     if (service->addrTypes & (AJ_ADDR_TCP4 | AJ_ADDR_TCP6)) {
         status = AJ_TCP_Connect(bus, service);
     }
@@ -369,22 +801,33 @@ AJ_Status AJ_Net_Connect(AJ_BusAttachment* bus, const AJ_Service* service)
 
 void AJ_Net_Disconnect(AJ_NetSocket* netSock)
 {
-    if (interruptFd >= 0) {
-        close(interruptFd);
-        interruptFd = INVALID_SOCKET;
-    }
+    NetContext* context;
+
+    _AJ_StopIOThread(netSock);
+    _AJ_ShmDisconnect(netSock);
+    context = GetNetContext(netSock);
 
-    if (netContext.udpSock != INVALID_SOCKET) {
+    if (!context) {
+        return;
+    }
+    /*
+     * The buffers may have been reallocated
+     */
+    context->rxData = netSock->rx.bufStart;
+    context->txData = netSock->tx.bufStart;
+    if (context->udpSock != INVALID_SOCKET) {
 #ifdef AJ_ARDP
         // we are using UDP!
-        AJ_Net_ARDP_Disconnect(netSock);
+        AJ_Net_ARDP_Disconnect(context, netSock);
         memset(netSock, 0, sizeof(AJ_NetSocket));
 #endif
-    } else if (netContext.tcpSock != INVALID_SOCKET) {
+    } else if (context->tcpSock != INVALID_SOCKET) {
 #ifdef AJ_TCP
         CloseNetSock(netSock);
 #endif
     }
+    ReactorDown(context);
+    FreeNetContext(context);
 }
 
 static uint8_t sendToBroadcast(int sock, uint16_t port, void* ptr, size_t tx)
@@ -627,40 +1070,37 @@ AJ_Status AJ_Net_RecvFrom(AJ_IOBuffer* buf, uint32_t len, uint32_t timeout)
     AJ_Status status = AJ_OK;
     ssize_t ret;
     size_t rx;
-    fd_set fds;
-    int maxFd = INVALID_SOCKET;
+    struct epoll_event events[REACTOR_MAX_EVENTS];
+    uint8_t mDnsRecvReady = FALSE;
+    uint8_t udpReady = FALSE;
+    uint8_t udp6Ready = FALSE;
     int rc = 0;
-    struct timeval tv = { timeout / 1000, 1000 * (timeout % 1000) };
+    int i;
 
     // AJ_InfoPrintf(("AJ_Net_RecvFrom(buf=0x%p, len=%d, timeout=%d)\n", buf, len, timeout));
 
     assert(buf->direction == AJ_IO_BUF_RX);
     assert(context->mDnsRecvSock != INVALID_SOCKET);
 
-    FD_ZERO(&fds);
-    FD_SET(context->mDnsRecvSock, &fds);
-    maxFd = context->mDnsRecvSock;
-
-    if (context->udpSock != INVALID_SOCKET) {
-        FD_SET(context->udpSock, &fds);
-        maxFd = max(maxFd, context->udpSock);
-    }
-
-    if (context->udp6Sock != INVALID_SOCKET) {
-        FD_SET(context->udp6Sock, &fds);
-        maxFd = max(maxFd, context->udp6Sock);
-    }
-
-    rc = select(maxFd + 1, &fds, NULL, NULL, &tv);
+    rc = ReactorWait(context->epollFd, events, timeout);
     if (rc == 0) {
-        AJ_InfoPrintf(("AJ_Net_RecvFrom(): select() timed out. status=AJ_ERR_TIMEOUT\n"));
+        AJ_InfoPrintf(("AJ_Net_RecvFrom(): epoll_wait() timed out. status=AJ_ERR_TIMEOUT\n"));
         return AJ_ERR_TIMEOUT;
     }
+    for (i = 0; i < rc; ++i) {
+        if (events[i].data.fd == context->mDnsRecvSock) {
+            mDnsRecvReady = TRUE;
+        } else if (events[i].data.fd == context->udpSock) {
+            udpReady = TRUE;
+        } else if (events[i].data.fd == context->udp6Sock) {
+            udp6Ready = TRUE;
+        }
+    }
 
     // we need to read from the first socket that has data available.
 
     rx = AJ_IO_BUF_SPACE(buf);
-    if (context->mDnsRecvSock != INVALID_SOCKET && FD_ISSET(context->mDnsRecvSock, &fds)) {
+    if (mDnsRecvReady) {
         rx = min(rx, len);
         if (rx) {
             ret = recvfrom(context->mDnsRecvSock, buf->writePtr, rx, 0, NULL, 0);
@@ -678,7 +1118,7 @@ AJ_Status AJ_Net_RecvFrom(AJ_IOBuffer* buf, uint32_t len, uint32_t timeout)
     }
 
     rx = AJ_IO_BUF_SPACE(buf);
-    if (context->udp6Sock != INVALID_SOCKET && FD_ISSET(context->udp6Sock, &fds)) {
+    if (udp6Ready) {
         rx = min(rx, len);
         if (rx) {
             ret = recvfrom(context->udp6Sock, buf->writePtr, rx, 0, NULL, 0);
@@ -696,7 +1136,7 @@ AJ_Status AJ_Net_RecvFrom(AJ_IOBuffer* buf, uint32_t len, uint32_t timeout)
     }
 
     rx = AJ_IO_BUF_SPACE(buf);
-    if (context->udpSock != INVALID_SOCKET && FD_ISSET(context->udpSock, &fds)) {
+    if (udpReady) {
         rx = min(rx, len);
         if (rx) {
             ret = recvfrom(context->udpSock, buf->writePtr, rx, 0, NULL, 0);
@@ -720,16 +1160,6 @@ Finished:
     return status;
 }
 
-/*
- * Need enough space to receive a complete name service packet when used in UDP
- * mode.  NS expects MTU of 1500 subtracts UDP, IP and ethertype overhead.
- * 1500 - 8 -20 - 18 = 1454.  txData buffer size needs to be big enough to hold
- * max(NS WHO-HAS for one name (4 + 2 + 256 = 262),
- *     mDNS query for one name (194 + 5 + 5 + 15 + 256 = 475)) = 475
- */
-static uint8_t rxDataMCast[1454];
-static uint8_t txDataMCast[475];
-
 static int MCastUp4(const char group[], uint16_t port)
 {
     int ret;
@@ -907,45 +1337,68 @@ AJ_Status AJ_Net_MCastUp(AJ_MCastSocket* mcastSock)
     socklen_t addrLen = sizeof(addrBuf);
     struct sockaddr_in* sin;
     AJ_Status status = AJ_ERR_READ;
+    MCastContext* context = (MCastContext*)AJ_Malloc(sizeof(MCastContext));
+
+    if (!context) {
+        AJ_ErrPrintf(("AJ_Net_MCastUp(): failed to allocate context\n"));
+        return AJ_ERR_RESOURCES;
+    }
+    context->udpSock = context->udp6Sock = context->mDnsSock = context->mDns6Sock = INVALID_SOCKET;
+    context->epollFd = INVALID_SOCKET;
 
-    mCastContext.mDnsRecvSock = MDnsRecvUp();
-    if (mCastContext.mDnsRecvSock == INVALID_SOCKET) {
+    context->mDnsRecvSock = MDnsRecvUp();
+    if (context->mDnsRecvSock == INVALID_SOCKET) {
         AJ_ErrPrintf(("AJ_Net_MCastUp(): MDnsRecvUp for mDnsRecvPort failed"));
+        AJ_Free(context);
         return status;
     }
-    if (getsockname(mCastContext.mDnsRecvSock, (struct sockaddr*) &addrBuf, &addrLen)) {
+    if (getsockname(context->mDnsRecvSock, (struct sockaddr*) &addrBuf, &addrLen)) {
         AJ_ErrPrintf(("AJ_Net_MCastUp(): getsockname for mDnsRecvPort failed"));
         goto ExitError;
     }
     sin = (struct sockaddr_in*) &addrBuf;
-    mCastContext.mDnsRecvPort = ntohs(sin->sin_port);
+    context->mDnsRecvPort = ntohs(sin->sin_port);
 
-    mCastContext.mDnsRecvAddr = ntohl(chooseMDnsRecvAddr());
-    if (mCastContext.mDnsRecvAddr == 0) {
+    context->mDnsRecvAddr = ntohl(chooseMDnsRecvAddr());
+    if (context->mDnsRecvAddr == 0) {
         AJ_ErrPrintf(("AJ_Net_MCastUp(): no mDNS recv address"));
         goto ExitError;
     }
-    AJ_InfoPrintf(("AJ_Net_MCastUp(): mDNS recv on %d.%d.%d.%d:%d\n", ((mCastContext.mDnsRecvAddr >> 24) & 0xFF), ((mCastContext.mDnsRecvAddr >> 16) & 0xFF), ((mCastContext.mDnsRecvAddr >> 8) & 0xFF), (mCastContext.mDnsRecvAddr & 0xFF), mCastContext.mDnsRecvPort));
+    AJ_InfoPrintf(("AJ_Net_MCastUp(): mDNS recv on %d.%d.%d.%d:%d\n", ((context->mDnsRecvAddr >> 24) & 0xFF), ((context->mDnsRecvAddr >> 16) & 0xFF), ((context->mDnsRecvAddr >> 8) & 0xFF), (context->mDnsRecvAddr & 0xFF), context->mDnsRecvPort));
 
-    mCastContext.mDnsSock = MCastUp4(MDNS_IPV4_MULTICAST_GROUP, MDNS_UDP_PORT);
-    mCastContext.mDns6Sock = MCastUp6(MDNS_IPV6_MULTICAST_GROUP, MDNS_UDP_PORT);
+    context->mDnsSock = MCastUp4(MDNS_IPV4_MULTICAST_GROUP, MDNS_UDP_PORT);
+    context->mDns6Sock = MCastUp6(MDNS_IPV6_MULTICAST_GROUP, MDNS_UDP_PORT);
     if (AJ_GetMinProtoVersion() < 10) {
-        mCastContext.udpSock = MCastUp4(AJ_IPV4_MULTICAST_GROUP, 0);
-        mCastContext.udp6Sock = MCastUp6(AJ_IPV6_MULTICAST_GROUP, 0);
+        context->udpSock = MCastUp4(AJ_IPV4_MULTICAST_GROUP, 0);
+        context->udp6Sock = MCastUp6(AJ_IPV6_MULTICAST_GROUP, 0);
     }
 
-    if (mCastContext.udpSock != INVALID_SOCKET || mCastContext.udp6Sock != INVALID_SOCKET ||
-        mCastContext.mDnsSock != INVALID_SOCKET || mCastContext.mDns6Sock != INVALID_SOCKET) {
-        AJ_IOBufInit(&mcastSock->rx, rxDataMCast, sizeof(rxDataMCast), AJ_IO_BUF_RX, &mCastContext);
+    context->epollFd = epoll_create1(EPOLL_CLOEXEC);
+    if ((context->epollFd == INVALID_SOCKET) || ReactorAdd(context->epollFd, context->mDnsRecvSock) ||
+        ((context->udpSock != INVALID_SOCKET) && ReactorAdd(context->epollFd, context->udpSock)) ||
+        ((context->udp6Sock != INVALID_SOCKET) && ReactorAdd(context->epollFd, context->udp6Sock))) {
+        AJ_ErrPrintf(("AJ_Net_MCastUp(): failed to create reactor. errno=\"%s\"\n", strerror(errno)));
+        mcastSock->rx.context = context;
+        CloseMCastSock(mcastSock);
+        return status;
+    }
+
+    if (context->udpSock != INVALID_SOCKET || context->udp6Sock != INVALID_SOCKET ||
+        context->mDnsSock != INVALID_SOCKET || context->mDns6Sock != INVALID_SOCKET) {
+        AJ_IOBufInit(&mcastSock->rx, context->rxData, sizeof(context->rxData), AJ_IO_BUF_RX, context);
         mcastSock->rx.recv = AJ_Net_RecvFrom;
-        AJ_IOBufInit(&mcastSock->tx, txDataMCast, sizeof(txDataMCast), AJ_IO_BUF_TX, &mCastContext);
+        AJ_IOBufInit(&mcastSock->tx, context->txData, sizeof(context->txData), AJ_IO_BUF_TX, context);
         mcastSock->tx.send = AJ_Net_SendTo;
         status = AJ_OK;
+    } else {
+        mcastSock->rx.context = context;
+        CloseMCastSock(mcastSock);
     }
     return status;
 
 ExitError:
-    close(mCastContext.mDnsRecvSock);
+    close(context->mDnsRecvSock);
+    AJ_Free(context);
     return status;
 }
 
@@ -1006,60 +1459,226 @@ static AJ_Status AJ_ARDP_UDP_Send(void* context, uint8_t* buf, size_t len, size_
     return status;
 }
 
-static AJ_Status AJ_ARDP_UDP_Recv(void* context, uint8_t** data, uint32_t* recved, uint32_t timeout)
+/*
+ * Enable UDP segmentation offload on the connected socket if the kernel supports it.
+ * Coalesced datagrams need a buffer for the largest the kernel builds, and aren't received
+ * through io_uring whose buffers hold one datagram.
+ */
+static void UdpOffloadUp(NetContext* context)
 {
-    fd_set fds;
-    struct timeval tv = { timeout / 1000, 1000 * (timeout % 1000) };
-    int ret;
-    NetContext* ctx = (NetContext*) context;
-    int maxFd = max(ctx->udpSock, interruptFd);
-
-    /**
-     * Let the platform code own this buffer.  This makes it easier to avoid double-buffering
-     * on platforms that allow it.
-     */
-    static uint8_t buffer[UDP_SEGBMAX];
+    int zero = 0;
+    int one = 1;
 
-    *data = NULL;
+    context->gso = (setsockopt(context->udpSock, SOL_UDP, UDP_SEGMENT, &zero, sizeof(zero)) == 0);
+#ifdef AJ_IO_URING
+    if (context->uring) {
+        return;
+    }
+#endif
+    context->gro = (uint8_t*)AJ_Malloc(UDP_GRO_RECV_BATCH * UDP_GSO_MAX_BYTES);
+    if (context->gro && setsockopt(context->udpSock, SOL_UDP, UDP_GRO, &one, sizeof(one))) {
+        AJ_Free(context->gro);
+        context->gro = NULL;
+    }
+    AJ_InfoPrintf(("UdpOffloadUp(): GSO %s, GRO %s\n", context->gso ? "on" : "off", context->gro ? "on" : "off"));
+}
 
-    AJ_InfoPrintf(("AJ_ARDP_UDP_Recv(data=0x%p, recved=0x%p, timeout=%u)\n", data, recved, timeout));
+/*
+ * All the segments ARDP has ready go out with one sendmmsg(). With GSO each run of segments
+ * of the same size, the last of the run may be shorter, is one message the kernel segments.
+ */
+static AJ_Status AJ_ARDP_UDP_SendBatch(void* context, uint8_t** bufs, uint16_t* lens, uint16_t count, uint16_t* sent, uint8_t confirm)
+{
+    struct mmsghdr msgs[UDP_SEGMAX];
+    struct iovec iov[UDP_SEGMAX];
+    union {
+        struct cmsghdr hdr;
+        uint8_t buf[CMSG_SPACE(sizeof(uint16_t))];
+    } ctrl[UDP_SEGMAX];
+    uint16_t segs[UDP_SEGMAX];  /* Number of segments in each message */
+    uint32_t bytes = 0;
+    NetContext* ctx = (NetContext*) context;
+    uint16_t nmsgs = 0;
+    uint16_t m = 0;
+    uint16_t i;
+    int ret;
 
-    FD_ZERO(&fds);
-    FD_SET(ctx->udpSock, &fds);
-    if (interruptFd > 0) {
-        FD_SET(interruptFd, &fds);
+    AJ_InfoPrintf(("AJ_ARDP_UDP_SendBatch(bufs=0x%p, count=%u)\n", bufs, count));
+
+    AJ_ASSERT(count <= UDP_SEGMAX);
+    *sent = 0;
+    memset(msgs, 0, count * sizeof(struct mmsghdr));
+    for (i = 0; i < count; ++i) {
+        iov[i].iov_base = bufs[i];
+        iov[i].iov_len = lens[i];
+        if (ctx->gso && nmsgs && (lens[i - 1] == lens[i - segs[nmsgs - 1]]) && (lens[i] <= lens[i - 1]) &&
+            (segs[nmsgs - 1] < UDP_GSO_MAX_SEGS) && ((bytes + lens[i]) <= UDP_GSO_MAX_BYTES)) {
+            msgs[nmsgs - 1].msg_hdr.msg_iovlen++;
+            segs[nmsgs - 1]++;
+            bytes += lens[i];
+        } else {
+            msgs[nmsgs].msg_hdr.msg_iov = &iov[i];
+            msgs[nmsgs].msg_hdr.msg_iovlen = 1;
+            segs[nmsgs++] = 1;
+            bytes = lens[i];
+        }
+    }
+    for (i = 0; i < nmsgs; ++i) {
+        if (segs[i] > 1) {
+            struct cmsghdr* cmsg = &ctrl[i].hdr;
+            uint16_t size = (uint16_t)msgs[i].msg_hdr.msg_iov[0].iov_len;
+            memset(&ctrl[i], 0, sizeof(ctrl[i]));
+            cmsg->cmsg_level = SOL_UDP;
+            cmsg->cmsg_type = UDP_SEGMENT;
+            cmsg->cmsg_len = CMSG_LEN(sizeof(uint16_t));
+            memcpy(CMSG_DATA(cmsg), &size, sizeof(uint16_t));
+            msgs[i].msg_hdr.msg_control = ctrl[i].buf;
+            msgs[i].msg_hdr.msg_controllen = sizeof(ctrl[i].buf);
+        }
     }
+    while (m < nmsgs) {
+        ret = sendmmsg(ctx->udpSock, msgs + m, nmsgs - m, (confirm == TRUE) ? MSG_CONFIRM : 0);
+        if (ret == -1) {
+            if (ctx->gso && ((errno == EIO) || (errno == EINVAL))) {
+                uint16_t more = 0;
+                AJ_Status status;
+                /*
+                 * The route doesn't support segmentation offload (no checksum offload or an
+                 * MTU below the segment size) so send one datagram per segment from now on
+                 */
+                AJ_WarnPrintf(("AJ_ARDP_UDP_SendBatch(): UDP_SEGMENT failed. errno=\"%s\", GSO off\n", strerror(errno)));
+                ctx->gso = FALSE;
+                status = AJ_ARDP_UDP_SendBatch(context, bufs + *sent, lens + *sent, count - *sent, &more, confirm);
+                *sent += more;
+                return status;
+            }
+            AJ_ErrPrintf(("AJ_ARDP_UDP_SendBatch(): sendmmsg() failed. errno=\"%s\", status=AJ_ERR_WRITE\n", strerror(errno)));
+            return AJ_ERR_WRITE;
+        }
+        while (ret--) {
+            *sent += segs[m++];
+        }
+    }
+    return AJ_OK;
+}
 
-    blocked = TRUE;
-    ret = select(maxFd + 1, &fds, NULL, NULL, &tv);
-    blocked = FALSE;
+/*
+ * Receive the datagrams that are waiting, up to max, with one recvmmsg()
+ */
+static AJ_Status AJ_ARDP_UDP_RecvBatch(void* context, uint8_t** bufs, uint32_t* recved, uint16_t* segsz, uint16_t max, uint16_t* count, uint32_t timeout)
+{
+    AJ_Status status;
+    struct mmsghdr msgs[UDP_RECV_BATCH];
+    struct iovec iov[UDP_RECV_BATCH];
+    union {
+        struct cmsghdr hdr;
+        uint8_t buf[CMSG_SPACE(sizeof(int))];
+    } ctrl[UDP_GRO_RECV_BATCH];
+    NetContext* ctx = (NetContext*) context;
+    uint16_t i;
+    uint16_t n = 0;
+    int ret;
 
-    if (ret == 0) {
-        // timeout!
-        return AJ_ERR_TIMEOUT;
-    } else if (ret == -1) {
-        perror("select");
-        return AJ_ERR_READ;
-    } else if ((interruptFd > 0) && FD_ISSET(interruptFd, &fds)) {
-        uint64_t u64;
-        read(interruptFd, &u64, sizeof(u64));
-        return AJ_ERR_INTERRUPTED;
-    } else if (FD_ISSET(ctx->udpSock, &fds)) {
-        ret = recvfrom(ctx->udpSock, buffer, sizeof(buffer), 0, NULL, 0);
+    *count = 0;
 
-        if (ret == -1) {
-            // this will only happen if we are on a local machine
-            perror("recvfrom");
-            return AJ_ERR_READ;
-        }
+    AJ_InfoPrintf(("AJ_ARDP_UDP_RecvBatch(bufs=0x%p, max=%u, timeout=%u)\n", bufs, max, timeout));
 
-        *recved = ret;
-        *data = buffer;
+#ifdef AJ_IO_URING
+    if (ctx->uring) {
+        /*
+         * The ring queues datagrams without a syscall per datagram already, they are handed
+         * out one at a time since a buffer is recycled on the next receive
+         */
+        ctx->blocked = TRUE;
+        status = _AJ_UringRecv(ctx->uring, &bufs[0], &recved[0], timeout);
+        ctx->blocked = FALSE;
+        if (status == AJ_OK) {
+            _AJ_UringConsume(ctx->uring, recved[0]);
+            segsz[0] = 0;
+            *count = 1;
+        }
+        return status;
     }
-
+#endif
+    status = ReactorWaitForSock(ctx, ctx->udpSock, timeout);
+    if (status != AJ_OK) {
+        return status;
+    }
+    if (ctx->gro) {
+        /*
+         * A coalesced datagram holds many segments and must not be truncated so each is
+         * received into a buffer big enough for the largest
+         */
+        max = min(max, UDP_GRO_RECV_BATCH);
+        memset(msgs, 0, max * sizeof(struct mmsghdr));
+        for (i = 0; i < max; ++i) {
+            iov[i].iov_base = ctx->gro + i * UDP_GSO_MAX_BYTES;
+            iov[i].iov_len = UDP_GSO_MAX_BYTES;
+            msgs[i].msg_hdr.msg_control = ctrl[i].buf;
+            msgs[i].msg_hdr.msg_controllen = sizeof(ctrl[i].buf);
+        }
+    } else {
+        max = min(max, UDP_RECV_BATCH);
+        memset(msgs, 0, max * sizeof(struct mmsghdr));
+        for (i = 0; i < max; ++i) {
+            iov[i].iov_base = ctx->segment[i];
+            iov[i].iov_len = UDP_SEGBMAX;
+        }
+    }
+    for (i = 0; i < max; ++i) {
+        msgs[i].msg_hdr.msg_iov = &iov[i];
+        msgs[i].msg_hdr.msg_iovlen = 1;
+    }
+    ret = recvmmsg(ctx->udpSock, msgs, max, MSG_DONTWAIT, NULL);
+    if (ret == -1) {
+        if ((errno == EAGAIN) || (errno == EWOULDBLOCK)) {
+            /*
+             * A datagram that failed its checksum can make the socket look readable
+             */
+            return AJ_ERR_TIMEOUT;
+        }
+        // this will only happen if we are on a local machine
+        perror("recvmmsg");
+        return AJ_ERR_READ;
+    }
+    for (i = 0; i < ret; ++i) {
+        struct cmsghdr* cmsg;
+        int size = 0;
+        for (cmsg = CMSG_FIRSTHDR(&msgs[i].msg_hdr); cmsg != NULL; cmsg = CMSG_NXTHDR(&msgs[i].msg_hdr, cmsg)) {
+            if ((cmsg->cmsg_level == SOL_UDP) && (cmsg->cmsg_type == UDP_GRO)) {
+                memcpy(&size, CMSG_DATA(cmsg), sizeof(size));
+            }
+        }
+        /*
+         * ARDP segments are never larger than UDP_SEGBMAX, drop anything that doesn't split
+         * into segments that fit or didn't fit our buffer
+         */
+        if ((msgs[i].msg_hdr.msg_flags & MSG_TRUNC) || (size < 0) || (size > UDP_SEGBMAX) ||
+            (!size && (msgs[i].msg_len > UDP_SEGBMAX))) {
+            AJ_WarnPrintf(("AJ_ARDP_UDP_RecvBatch(): dropped datagram len=%u segsz=%d\n", msgs[i].msg_len, size));
+            continue;
+        }
+        bufs[n] = (uint8_t*)iov[i].iov_base;
+        recved[n] = msgs[i].msg_len;
+        segsz[n] = (uint16_t)size;
+        ++n;
+    }
+    if (!n) {
+        return AJ_ERR_TIMEOUT;
+    }
+    *count = n;
     return AJ_OK;
 }
 
+static AJ_Status AJ_ARDP_UDP_Recv(void* context, uint8_t** data, uint32_t* recved, uint32_t timeout)
+{
+    uint16_t count;
+    uint16_t segsz;
+
+    *data = NULL;
+    return AJ_ARDP_UDP_RecvBatch(context, data, recved, &segsz, 1, &count, timeout);
+}
+
 static AJ_Status AJ_Net_ARDP_Connect(AJ_BusAttachment* bus, const AJ_Service* service)
 {
     int udpSock = INVALID_SOCKET;
@@ -1067,13 +1686,14 @@ static AJ_Status AJ_Net_ARDP_Connect(AJ_BusAttachment* bus, const AJ_Service* se
     struct sockaddr_storage addrBuf;
     socklen_t addrSize;
     int ret;
+    NetContext* context = NewNetContext(&bus->sock);
 
     AJ_ARDP_InitFunctions(AJ_ARDP_UDP_Recv, AJ_ARDP_UDP_Send);
+    AJ_ARDP_InitBatchFunctions(AJ_ARDP_UDP_RecvBatch, AJ_ARDP_UDP_SendBatch);
 
     memset(&addrBuf, 0, sizeof(addrBuf));
 
-    interruptFd = eventfd(0, O_NONBLOCK);  // Use O_NONBLOCK instead of EFD_NONBLOCK due to bug in OpenWrt's uCLibc
-    if (interruptFd < 0) {
+    if (!context || (ReactorUp(context) != AJ_OK)) {
         AJ_ErrPrintf(("AJ_Net_ARDP_Connect(): failed to created interrupt event\n"));
         goto ConnectError;
     }
@@ -1105,20 +1725,32 @@ static AJ_Status AJ_Net_ARDP_Connect(AJ_BusAttachment* bus, const AJ_Service* se
         addrSize = sizeof(struct sockaddr_in6);
     } else {
         AJ_ErrPrintf(("AJ_Net_ARDP_Connect(): Invalid addrTypes %u, status=AJ_ERR_CONNECT\n", service->addrTypes));
-        return AJ_ERR_CONNECT;
+        goto ConnectError;
     }
 
     // When you 'connect' a UDP socket, it means that this is the default sendto address.
     // Therefore, we don't have to make the address a global variable and can
     // simply use send() rather than sendto().  See: man 7 udp
     ret = connect(udpSock, (struct sockaddr*) &addrBuf, addrSize);
+    if (ret == 0) {
+        ret = ReactorAdd(context->epollFd, udpSock);
+    }
 
     // must do this before calling AJ_MarshalMethodCall!
     if (ret == 0) {
-        netContext.udpSock = udpSock;
-        AJ_IOBufInit(&bus->sock.rx, rxData, sizeof(rxData), AJ_IO_BUF_RX, &netContext);
+        context->udpSock = udpSock;
+        udpSock = INVALID_SOCKET;
+#ifdef AJ_IO_URING
+        UringUp(context, context->udpSock, UDP_SEGBMAX);
+#endif
+        UdpOffloadUp(context);
+        AJ_IOBufInit(&bus->sock.rx, context->rxData, AJ_RX_DATA_SIZE, AJ_IO_BUF_RX, context);
+        bus->sock.rx.bufMax = AJ_RX_DATA_SIZE;
         bus->sock.rx.recv = AJ_ARDP_Recv;
-        AJ_IOBufInit(&bus->sock.tx, txData, sizeof(txData), AJ_IO_BUF_TX, &netContext);
+        /*
+         * The transmit buffer sizes the smallest ARDP window so it can't be resized
+         */
+        AJ_IOBufInit(&bus->sock.tx, context->txData, AJ_TX_DATA_SIZE, AJ_IO_BUF_TX, context);
         bus->sock.tx.send = AJ_ARDP_Send;
     } else {
         AJ_ErrPrintf(("AJ_Net_ARDP_Connect(): Error connecting\n"));
@@ -1126,18 +1758,18 @@ static AJ_Status AJ_Net_ARDP_Connect(AJ_BusAttachment* bus, const AJ_Service* se
         goto ConnectError;
     }
 
-    status = AJ_ARDP_UDP_Connect(bus, &netContext, service, &bus->sock);
+    status = AJ_ARDP_UDP_Connect(bus, context, service, &bus->sock);
     if (status != AJ_OK) {
-        AJ_Net_ARDP_Disconnect(&bus->sock);
+        AJ_Net_ARDP_Disconnect(context, &bus->sock);
         goto ConnectError;
     }
 
     return AJ_OK;
 
 ConnectError:
-    if (interruptFd != INVALID_SOCKET) {
-        close(interruptFd);
-        interruptFd = INVALID_SOCKET;
+    if (context) {
+        ReactorDown(context);
+        FreeNetContext(context);
     }
 
     if (udpSock != INVALID_SOCKET) {
@@ -1147,12 +1779,12 @@ ConnectError:
     return AJ_ERR_CONNECT;
 }
 
-static void AJ_Net_ARDP_Disconnect(AJ_NetSocket* netSock)
+static void AJ_Net_ARDP_Disconnect(NetContext* context, AJ_NetSocket* netSock)
 {
-    AJ_ARDP_Disconnect(FALSE);
+    AJ_ARDP_Disconnect(context, FALSE);
 
-    close(netContext.udpSock);
-    netContext.udpSock = INVALID_SOCKET;
+    close(context->udpSock);
+    context->udpSock = INVALID_SOCKET;
     memset(netSock, 0, sizeof(AJ_NetSocket));
 }
 
@@ -67,6 +67,20 @@ int AJ_SetLogFile(const char* file, uint32_t maxLen);
 
 void AJ_Printf(const char* fmat, ...);
 
+struct _AJ_BusAttachment;
+
+/**
+ * Get a file descriptor that becomes readable when the bus attachment has events to process.
+ * Use it to multiplex the bus with other I/O in an application event loop and call
+ * AJ_ProcessEvents() when it is readable. The descriptor also becomes readable periodically
+ * so that transport and method call timers run while no data arrives.
+ *
+ * @param bus  The connected bus attachment
+ *
+ * @return The file descriptor or -1 if the bus attachment is not connected over TCP or UDP
+ */
+int AJ_GetEventFd(struct _AJ_BusAttachment* bus);
+
 #ifndef NDEBUG
 extern uint8_t dbgCONFIGUREME;
 extern uint8_t dbgINIT;
@@ -76,6 +90,10 @@ extern uint8_t dbgTARGET_NVRAM;
 extern uint8_t dbgTARGET_SERIAL;
 extern uint8_t dbgTARGET_TIMER;
 extern uint8_t dbgTARGET_UTIL;
+extern uint8_t dbgTARGET_DISPATCH;
+extern uint8_t dbgTARGET_IOTHREAD;
+extern uint8_t dbgTARGET_SHM;
+extern uint8_t dbgTARGET_URING;
 
 #endif
 
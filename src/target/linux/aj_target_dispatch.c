@@ -0,0 +1,370 @@
+/**
+ * @file
+ */
+/******************************************************************************
+ * Copyright AllSeen Alliance. All rights reserved.
+ *
+ *    Permission to use, copy, modify, and/or distribute this software for any
+ *    purpose with or without fee is hereby granted, provided that the above
+ *    copyright notice and this permission notice appear in all copies.
+ *
+ *    THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ *    WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ *    MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ *    ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ *    WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ *    ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ *    OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ ******************************************************************************/
+
+/**
+ * Per-module definition of the current module for debug logging.  Must be defined
+ * prior to first inclusion of aj_debug.h
+ */
+#define AJ_MODULE TARGET_DISPATCH
+
+#include "aj_target.h"
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/eventfd.h>
+#include <ajtcl/aj_dispatch.h>
+#include <ajtcl/aj_net.h>
+#include <ajtcl/aj_util.h>
+#include <ajtcl/aj_debug.h>
+
+/**
+ * Turn on per-module debug printing by setting this variable to non-zero value
+ * (usually in debugger).
+ */
+#ifndef NDEBUG
+uint8_t dbgTARGET_DISPATCH = 0;
+#endif
+
+/*
+ * Work is serialized per object, the object is identified by the object list and object index
+ */
+#define OBJECT_OF(msgId) ((msgId) >> 16)
+
+typedef struct _DispatchWork {
+    struct _DispatchWork* next;
+    const AJ_DispatchHandler* handler;
+    void* work;
+    AJ_MsgReplyContext replyCtx;
+    AJ_Status status;
+    uint32_t object;
+} DispatchWork;
+
+typedef struct {
+    DispatchWork* head;
+    DispatchWork* tail;
+} WorkList;
+
+/*
+ * An object with work running, later work for the object waits here until it finishes
+ */
+typedef struct _DispatchObject {
+    struct _DispatchObject* next;
+    uint32_t object;
+    WorkList waiting;
+} DispatchObject;
+
+struct _AJ_Dispatcher {
+    AJ_BusAttachment* bus;
+    const AJ_DispatchHandler* handlers;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    WorkList ready;             /* Work that can be picked up by a worker */
+    WorkList done;              /* Work waiting for AJ_DispatchCompletions() */
+    DispatchObject* objects;
+    int fd;
+    uint8_t stopping;
+    uint8_t numWorkers;
+    pthread_t workers[];
+};
+
+static void Append(WorkList* list, DispatchWork* item)
+{
+    item->next = NULL;
+    if (list->tail) {
+        list->tail->next = item;
+    } else {
+        list->head = item;
+    }
+    list->tail = item;
+}
+
+static DispatchWork* Remove(WorkList* list)
+{
+    DispatchWork* item = list->head;
+    if (item) {
+        list->head = item->next;
+        if (!list->head) {
+            list->tail = NULL;
+        }
+    }
+    return item;
+}
+
+/*
+ * Called with the lock held when an object's running work has finished
+ */
+static void ReleaseObject(AJ_Dispatcher* dispatcher, uint32_t object)
+{
+    DispatchObject** link = &dispatcher->objects;
+
+    while (*link) {
+        DispatchObject* obj = *link;
+        if (obj->object == object) {
+            DispatchWork* next = Remove(&obj->waiting);
+            if (next) {
+                Append(&dispatcher->ready, next);
+                pthread_cond_signal(&dispatcher->cond);
+            } else {
+                *link = obj->next;
+                AJ_Free(obj);
+            }
+            return;
+        }
+        link = &obj->next;
+    }
+}
+
+static void* RunWorker(void* arg)
+{
+    AJ_Dispatcher* dispatcher = (AJ_Dispatcher*)arg;
+    uint64_t u64 = 1;
+
+    pthread_mutex_lock(&dispatcher->lock);
+    while (TRUE) {
+        DispatchWork* item;
+
+        while (!dispatcher->stopping && !dispatcher->ready.head) {
+            pthread_cond_wait(&dispatcher->cond, &dispatcher->lock);
+        }
+        if (dispatcher->stopping) {
+            break;
+        }
+        item = Remove(&dispatcher->ready);
+        pthread_mutex_unlock(&dispatcher->lock);
+
+        item->status = item->handler->Run ? item->handler->Run(item->work) : AJ_OK;
+
+        pthread_mutex_lock(&dispatcher->lock);
+        Append(&dispatcher->done, item);
+        ReleaseObject(dispatcher, item->object);
+        if (write(dispatcher->fd, &u64, sizeof(u64)) < 0) {
+            AJ_ErrPrintf(("RunWorker(): write() failed. errno=\"%s\"\n", strerror(errno)));
+        }
+        /*
+         * Wake the bus thread so the reply goes out without waiting for the next message. Only
+         * the socket's address is used, the bus attachment may be disconnecting meanwhile.
+         */
+        _AJ_Net_InterruptSock(&dispatcher->bus->sock);
+    }
+    pthread_mutex_unlock(&dispatcher->lock);
+    return NULL;
+}
+
+/*
+ * Completes a work item on the bus thread and frees it
+ */
+static AJ_Status CompleteWork(DispatchWork* item)
+{
+    AJ_Status status = AJ_OK;
+
+    if (item->handler->Complete) {
+        status = item->handler->Complete(&item->replyCtx, item->work, item->status);
+    } else if (item->replyCtx.msgId) {
+        AJ_Message reply;
+        if (item->status == AJ_OK) {
+            status = AJ_MarshalReplyMsgAsync(&item->replyCtx, &reply);
+        } else {
+            status = AJ_MarshalStatusMsgAsync(&item->replyCtx, &reply, item->status);
+        }
+        if (status == AJ_OK) {
+            status = AJ_DeliverMsg(&reply);
+        }
+    }
+    AJ_Free(item);
+    return status;
+}
+
+AJ_Dispatcher* AJ_CreateDispatcher(AJ_BusAttachment* bus, const AJ_DispatchHandler* handlers, uint8_t numWorkers)
+{
+    AJ_Dispatcher* dispatcher;
+
+    if (!numWorkers || !handlers) {
+        return NULL;
+    }
+    dispatcher = (AJ_Dispatcher*)AJ_Malloc(sizeof(AJ_Dispatcher) + numWorkers * sizeof(pthread_t));
+    if (!dispatcher) {
+        return NULL;
+    }
+    memset(dispatcher, 0, sizeof(AJ_Dispatcher));
+    dispatcher->bus = bus;
+    dispatcher->handlers = handlers;
+    dispatcher->fd = eventfd(0, O_NONBLOCK);
+    if (dispatcher->fd < 0) {
+        AJ_ErrPrintf(("AJ_CreateDispatcher(): eventfd() failed. errno=\"%s\"\n", strerror(errno)));
+        AJ_Free(dispatcher);
+        return NULL;
+    }
+    pthread_mutex_init(&dispatcher->lock, NULL);
+    pthread_cond_init(&dispatcher->cond, NULL);
+    while (dispatcher->numWorkers < numWorkers) {
+        if (pthread_create(&dispatcher->workers[dispatcher->numWorkers], NULL, RunWorker, dispatcher)) {
+            AJ_ErrPrintf(("AJ_CreateDispatcher(): pthread_create() failed\n"));
+            AJ_DestroyDispatcher(dispatcher);
+            return NULL;
+        }
+        ++dispatcher->numWorkers;
+    }
+    return dispatcher;
+}
+
+void AJ_DestroyDispatcher(AJ_Dispatcher* dispatcher)
+{
+    DispatchWork* item;
+    uint8_t i;
+
+    if (!dispatcher) {
+        return;
+    }
+    pthread_mutex_lock(&dispatcher->lock);
+    dispatcher->stopping = TRUE;
+    pthread_cond_broadcast(&dispatcher->cond);
+    pthread_mutex_unlock(&dispatcher->lock);
+    for (i = 0; i < dispatcher->numWorkers; ++i) {
+        pthread_join(dispatcher->workers[i], NULL);
+    }
+    /*
+     * Let the application release the work items without replying
+     */
+    while ((item = Remove(&dispatcher->done)) != NULL) {
+        memset(&item->replyCtx, 0, sizeof(item->replyCtx));
+        CompleteWork(item);
+    }
+    while (dispatcher->objects) {
+        DispatchObject* obj = dispatcher->objects;
+        while ((item = Remove(&obj->waiting)) != NULL) {
+            Append(&dispatcher->ready, item);
+        }
+        dispatcher->objects = obj->next;
+        AJ_Free(obj);
+    }
+    while ((item = Remove(&dispatcher->ready)) != NULL) {
+        memset(&item->replyCtx, 0, sizeof(item->replyCtx));
+        item->status = AJ_ERR_INTERRUPTED;
+        CompleteWork(item);
+    }
+    pthread_cond_destroy(&dispatcher->cond);
+    pthread_mutex_destroy(&dispatcher->lock);
+    close(dispatcher->fd);
+    AJ_Free(dispatcher);
+}
+
+AJ_Status AJ_DispatchMsg(AJ_Dispatcher* dispatcher, AJ_Message* msg)
+{
+    const AJ_DispatchHandler* handler;
+    DispatchWork* item;
+    DispatchObject* obj;
+    AJ_Status status;
+    uint8_t replyExpected;
+
+    for (handler = dispatcher->handlers; handler->msgId; ++handler) {
+        if (handler->msgId == msg->msgId) {
+            break;
+        }
+    }
+    if (!handler->msgId) {
+        return AJ_ERR_NO_MATCH;
+    }
+    replyExpected = (msg->hdr->msgType == AJ_MSG_METHOD_CALL) && !(msg->hdr->flags & AJ_FLAG_NO_REPLY_EXPECTED);
+
+    item = (DispatchWork*)AJ_Malloc(sizeof(DispatchWork));
+    if (!item) {
+        status = AJ_ERR_RESOURCES;
+    } else {
+        memset(item, 0, sizeof(DispatchWork));
+        item->handler = handler;
+        item->object = OBJECT_OF(msg->msgId);
+        status = handler->Unmarshal ? handler->Unmarshal(msg, &item->work) : AJ_OK;
+    }
+    if (status != AJ_OK) {
+        AJ_InfoPrintf(("AJ_DispatchMsg(): msgId=0x%08x %s\n", msg->msgId, AJ_StatusText(status)));
+        if (replyExpected) {
+            AJ_Message reply;
+            if (AJ_MarshalStatusMsg(msg, &reply, status) == AJ_OK) {
+                AJ_DeliverMsg(&reply);
+            }
+        }
+        AJ_Free(item);
+        AJ_CloseMsg(msg);
+        return AJ_OK;
+    }
+    AJ_CloseMsgAndSaveReplyContext(msg, &item->replyCtx);
+    if (!replyExpected) {
+        memset(&item->replyCtx, 0, sizeof(item->replyCtx));
+    }
+
+    pthread_mutex_lock(&dispatcher->lock);
+    for (obj = dispatcher->objects; obj != NULL; obj = obj->next) {
+        if (obj->object == item->object) {
+            break;
+        }
+    }
+    if (obj) {
+        /*
+         * Wait behind the work already running for this object
+         */
+        Append(&obj->waiting, item);
+    } else {
+        obj = (DispatchObject*)AJ_Malloc(sizeof(DispatchObject));
+        if (obj) {
+            memset(obj, 0, sizeof(DispatchObject));
+            obj->object = item->object;
+            obj->next = dispatcher->objects;
+            dispatcher->objects = obj;
+            Append(&dispatcher->ready, item);
+            pthread_cond_signal(&dispatcher->cond);
+        } else {
+            status = AJ_ERR_RESOURCES;
+        }
+    }
+    pthread_mutex_unlock(&dispatcher->lock);
+
+    if (status != AJ_OK) {
+        item->status = status;
+        CompleteWork(item);
+    }
+    return AJ_OK;
+}
+
+AJ_Status AJ_DispatchCompletions(AJ_Dispatcher* dispatcher)
+{
+    WorkList done;
+    DispatchWork* item;
+    AJ_Status status = AJ_OK;
+    uint64_t u64;
+
+    pthread_mutex_lock(&dispatcher->lock);
+    done = dispatcher->done;
+    dispatcher->done.head = dispatcher->done.tail = NULL;
+    if (read(dispatcher->fd, &u64, sizeof(u64)) < 0) {
+        /* EAGAIN, nothing finished */
+    }
+    pthread_mutex_unlock(&dispatcher->lock);
+
+    while ((item = Remove(&done)) != NULL) {
+        AJ_Status completeStatus = CompleteWork(item);
+        if (status == AJ_OK) {
+            status = completeStatus;
+        }
+    }
+    return status;
+}
+
+int AJ_GetDispatcherFd(AJ_Dispatcher* dispatcher)
+{
+    return dispatcher->fd;
+}
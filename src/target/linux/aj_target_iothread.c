@@ -0,0 +1,600 @@
+/**
+ * @file
+ */
+/******************************************************************************
+ * Copyright AllSeen Alliance. All rights reserved.
+ *
+ *    Permission to use, copy, modify, and/or distribute this software for any
+ *    purpose with or without fee is hereby granted, provided that the above
+ *    copyright notice and this permission notice appear in all copies.
+ *
+ *    THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ *    WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ *    MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ *    ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ *    WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ *    ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ *    OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ ******************************************************************************/
+
+/**
+ * Per-module definition of the current module for debug logging.  Must be defined
+ * prior to first inclusion of aj_debug.h
+ */
+#define AJ_MODULE TARGET_IOTHREAD
+
+#include "aj_target.h"
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <byteswap.h>
+#include <sys/eventfd.h>
+#include <ajtcl/aj_bufio.h>
+#include <ajtcl/aj_bus.h>
+#include <ajtcl/aj_msg.h>
+#include <ajtcl/aj_msg_priv.h>
+#include <ajtcl/aj_net.h>
+#include <ajtcl/aj_util.h>
+#include <ajtcl/aj_debug.h>
+#ifdef AJ_ARDP
+#include <ajtcl/aj_ardp.h>
+#endif
+
+/**
+ * Turn on per-module debug printing by setting this variable to non-zero value
+ * (usually in debugger).
+ */
+#ifndef NDEBUG
+uint8_t dbgTARGET_IOTHREAD = 0;
+#endif
+
+/*
+ * Maximum number of received bytes the I/O thread queues before it stops reading the socket
+ * and lets the transport apply backpressure to the sender.
+ */
+#ifndef AJ_IO_THREAD_QUEUE_LIMIT
+#define AJ_IO_THREAD_QUEUE_LIMIT (64 * 1024)
+#endif
+
+/*
+ * A chunk of the byte stream passed between threads. Inbound chunks hold complete messages
+ * unless a message is too large for the receive buffer.
+ */
+typedef struct _IOChunk {
+    struct _IOChunk* next;
+    uint32_t len;
+    uint32_t offset;    /* Bytes already consumed, only touched by the consumer */
+    uint8_t data[];
+} IOChunk;
+
+/*
+ * Lock-free multi-producer single-consumer queue (Vyukov). Producers never wait on each other
+ * or on the consumer; the consumer is the only one that touches the tail.
+ */
+typedef struct {
+    IOChunk* head;
+    IOChunk* tail;
+    IOChunk stub;
+} IOQueue;
+
+typedef struct _IOThread {
+    AJ_NetSocket sock;      /* The transport as it was before the I/O thread took it over */
+    AJ_IOBuffer appRx;      /* The application side transport, restored when the thread stops */
+    AJ_IOBuffer appTx;
+    IOQueue inbound;        /* I/O thread to application, single producer */
+    IOQueue outbound;       /* Application threads to I/O thread */
+    IOChunk* current;       /* Inbound chunk being consumed by the application */
+    uint32_t queued;        /* Inbound bytes queued and not yet consumed */
+    uint64_t passThrough;   /* Bytes left of a received message too large to queue whole */
+    int inFd;               /* Signalled when inbound data is queued or the link fails */
+    int outFd;              /* Signalled when outbound data is queued, space frees up or on stop */
+    int eventFd;            /* The transport's event descriptor */
+    AJ_Status status;       /* First transport error seen by the I/O thread */
+    uint8_t running;
+    uint8_t waiting;        /* Set while the application is blocked waiting for inbound data */
+    uint8_t interrupted;    /* Set by AJ_Net_Interrupt() while the application was waiting */
+    pthread_t thread;
+    AJ_NetSocket* netSock;  /* The bus attachment's socket */
+    struct _IOThread* next;
+} IOThread;
+
+/*
+ * Running I/O threads, AJ_Net_Interrupt() wakes an application waiting on any of them
+ */
+static IOThread* ioThreads = NULL;
+static pthread_mutex_t ioLock = PTHREAD_MUTEX_INITIALIZER;
+
+static void QueueInit(IOQueue* queue)
+{
+    queue->stub.next = NULL;
+    queue->head = &queue->stub;
+    queue->tail = &queue->stub;
+}
+
+static void QueuePush(IOQueue* queue, IOChunk* chunk)
+{
+    IOChunk* prev;
+
+    chunk->next = NULL;
+    prev = __atomic_exchange_n(&queue->head, chunk, __ATOMIC_ACQ_REL);
+    __atomic_store_n(&prev->next, chunk, __ATOMIC_RELEASE);
+}
+
+/*
+ * Returns NULL if the queue is empty or a producer is part way through a push
+ */
+static IOChunk* QueuePop(IOQueue* queue)
+{
+    IOChunk* tail = queue->tail;
+    IOChunk* next = __atomic_load_n(&tail->next, __ATOMIC_ACQUIRE);
+
+    if (tail == &queue->stub) {
+        if (!next) {
+            return NULL;
+        }
+        queue->tail = next;
+        tail = next;
+        next = __atomic_load_n(&tail->next, __ATOMIC_ACQUIRE);
+    }
+    if (next) {
+        queue->tail = next;
+        return tail;
+    }
+    if (tail != __atomic_load_n(&queue->head, __ATOMIC_ACQUIRE)) {
+        return NULL;
+    }
+    QueuePush(queue, &queue->stub);
+    next = __atomic_load_n(&tail->next, __ATOMIC_ACQUIRE);
+    if (next) {
+        queue->tail = next;
+        return tail;
+    }
+    return NULL;
+}
+
+static IOChunk* NewChunk(const uint8_t* data, uint32_t len)
+{
+    IOChunk* chunk = (IOChunk*)AJ_Malloc(sizeof(IOChunk) + len);
+    if (chunk) {
+        chunk->len = len;
+        chunk->offset = 0;
+        memcpy(chunk->data, data, len);
+    }
+    return chunk;
+}
+
+static void Signal(int fd)
+{
+    uint64_t u64 = 1;
+    if (write(fd, &u64, sizeof(u64)) < 0) {
+        AJ_ErrPrintf(("Signal(): write() failed. errno=\"%s\"\n", strerror(errno)));
+    }
+}
+
+static void ClearSignal(int fd)
+{
+    uint64_t u64;
+    if (read(fd, &u64, sizeof(u64)) < 0) {
+        /* EAGAIN, nothing was signalled */
+    }
+}
+
+/*
+ * Length of the message starting at hdr
+ */
+static uint64_t MessageLength(const uint8_t* hdr)
+{
+    const AJ_MsgHeader* msgHdr = (const AJ_MsgHeader*)hdr;
+    uint32_t headerLen = msgHdr->headerLen;
+    uint32_t bodyLen = msgHdr->bodyLen;
+
+    if (msgHdr->endianess != HOST_ENDIANESS) {
+        headerLen = bswap_32(headerLen);
+        bodyLen = bswap_32(bodyLen);
+    }
+    return (uint64_t)sizeof(AJ_MsgHeader) + headerLen + HEADERPAD(headerLen) + bodyLen;
+}
+
+/*
+ * Hand whatever complete messages are in the I/O thread's receive buffer to the application.
+ * Messages too large for the buffer are passed through as they arrive.
+ */
+static AJ_Status QueueInbound(IOThread* io)
+{
+    AJ_IOBuffer* rx = &io->sock.rx;
+    uint32_t len;
+
+    while ((len = AJ_IO_BUF_AVAIL(rx)) != 0) {
+        IOChunk* chunk;
+        if (!io->passThrough) {
+            uint64_t msgLen;
+            if (len < sizeof(AJ_MsgHeader)) {
+                break;
+            }
+            msgLen = MessageLength(rx->readPtr);
+            if (msgLen <= rx->bufSize) {
+                if (msgLen > len) {
+                    break;
+                }
+                len = (uint32_t)msgLen;
+            } else {
+                io->passThrough = msgLen;
+            }
+        }
+        if (io->passThrough) {
+            len = (uint32_t)min(len, io->passThrough);
+            io->passThrough -= len;
+        }
+        chunk = NewChunk(rx->readPtr, len);
+        if (!chunk) {
+            return AJ_ERR_RESOURCES;
+        }
+        rx->readPtr += len;
+        __atomic_add_fetch(&io->queued, len, __ATOMIC_RELEASE);
+        QueuePush(&io->inbound, chunk);
+        Signal(io->inFd);
+    }
+    AJ_IOBufRebase(rx, 0);
+    return AJ_OK;
+}
+
+static AJ_Status SendOutbound(IOThread* io)
+{
+    AJ_IOBuffer* tx = &io->sock.tx;
+    IOChunk* chunk;
+    AJ_Status status = AJ_OK;
+
+    while ((chunk = QueuePop(&io->outbound)) != NULL) {
+        while ((status == AJ_OK) && (chunk->offset < chunk->len)) {
+            uint32_t len = min(AJ_IO_BUF_SPACE(tx), chunk->len - chunk->offset);
+            memcpy(tx->writePtr, chunk->data + chunk->offset, len);
+            tx->writePtr += len;
+            chunk->offset += len;
+            while ((status == AJ_OK) && AJ_IO_BUF_AVAIL(tx)) {
+                status = tx->send(tx);
+            }
+        }
+        AJ_Free(chunk);
+    }
+    return status;
+}
+
+static void* RunIOThread(void* arg)
+{
+    IOThread* io = (IOThread*)arg;
+    AJ_IOBuffer* rx = &io->sock.rx;
+    struct pollfd fds[2];
+    AJ_Status status = AJ_OK;
+
+    AJ_InfoPrintf(("RunIOThread(): started\n"));
+
+    fds[0].fd = io->outFd;
+    fds[0].events = POLLIN;
+    fds[1].fd = io->eventFd;
+    fds[1].events = POLLIN;
+
+    while (__atomic_load_n(&io->running, __ATOMIC_ACQUIRE)) {
+        /*
+         * Stop reading the socket while the application is too far behind
+         */
+        nfds_t nfds = (__atomic_load_n(&io->queued, __ATOMIC_ACQUIRE) < AJ_IO_THREAD_QUEUE_LIMIT) ? 2 : 1;
+
+        if ((poll(fds, nfds, -1) < 0) && (errno != EINTR)) {
+            AJ_ErrPrintf(("RunIOThread(): poll() failed. errno=\"%s\"\n", strerror(errno)));
+            status = AJ_ERR_READ;
+            break;
+        }
+        if (fds[0].revents & POLLIN) {
+            ClearSignal(io->outFd);
+            status = SendOutbound(io);
+            if (status != AJ_OK) {
+                status = AJ_ERR_WRITE;
+                break;
+            }
+        }
+        if ((nfds == 2) && (fds[1].revents & POLLIN)) {
+            /*
+             * Doesn't block, also consumes transport timer ticks and interrupts
+             */
+            status = rx->recv(rx, AJ_IO_BUF_SPACE(rx), 0);
+            if ((status != AJ_OK) && (status != AJ_ERR_TIMEOUT) && (status != AJ_ERR_INTERRUPTED)) {
+                break;
+            }
+            status = QueueInbound(io);
+            if (status != AJ_OK) {
+                break;
+            }
+        }
+    }
+    if (status != AJ_OK) {
+        AJ_ErrPrintf(("RunIOThread(): %s\n", AJ_StatusText(status)));
+        __atomic_store_n(&io->status, status, __ATOMIC_RELEASE);
+        Signal(io->inFd);
+    } else {
+        /*
+         * Flush anything marshalled before the thread was stopped
+         */
+        SendOutbound(io);
+    }
+    AJ_InfoPrintf(("RunIOThread(): exiting\n"));
+    return NULL;
+}
+
+/*
+ * Receive function installed in the bus attachment while the I/O thread owns the transport
+ */
+static AJ_Status QueueRecv(AJ_IOBuffer* buf, uint32_t len, uint32_t timeout)
+{
+    IOThread* io = (IOThread*)buf->context;
+    uint32_t rx = min(len, AJ_IO_BUF_SPACE(buf));
+    uint32_t recvd = 0;
+    AJ_Time timer;
+    uint32_t elapsed = 0;
+
+    AJ_InitTimer(&timer);
+    while (TRUE) {
+        while (recvd < rx) {
+            uint32_t n;
+            uint32_t queued;
+            if (!io->current) {
+                io->current = QueuePop(&io->inbound);
+                if (!io->current) {
+                    break;
+                }
+            }
+            n = min(rx - recvd, io->current->len - io->current->offset);
+            memcpy(buf->writePtr, io->current->data + io->current->offset, n);
+            buf->writePtr += n;
+            recvd += n;
+            io->current->offset += n;
+            if (io->current->offset == io->current->len) {
+                AJ_Free(io->current);
+                io->current = NULL;
+            }
+            queued = __atomic_sub_fetch(&io->queued, n, __ATOMIC_ACQ_REL);
+            if ((queued < AJ_IO_THREAD_QUEUE_LIMIT) && ((queued + n) >= AJ_IO_THREAD_QUEUE_LIMIT)) {
+                /*
+                 * Wake the I/O thread, it had stopped reading
+                 */
+                Signal(io->outFd);
+            }
+        }
+        if (recvd || !rx) {
+            return AJ_OK;
+        }
+        if (__atomic_load_n(&io->status, __ATOMIC_ACQUIRE) != AJ_OK) {
+            return (io->status == AJ_ERR_WRITE) ? AJ_ERR_READ : io->status;
+        }
+        if (elapsed >= timeout) {
+            return AJ_ERR_TIMEOUT;
+        } else {
+            struct pollfd fds;
+            fds.fd = io->inFd;
+            fds.events = POLLIN;
+            __atomic_store_n(&io->waiting, TRUE, __ATOMIC_SEQ_CST);
+            if (poll(&fds, 1, timeout - elapsed) > 0) {
+                ClearSignal(io->inFd);
+            }
+            __atomic_store_n(&io->waiting, FALSE, __ATOMIC_SEQ_CST);
+            if (__atomic_exchange_n(&io->interrupted, FALSE, __ATOMIC_ACQ_REL)) {
+                return AJ_ERR_INTERRUPTED;
+            }
+            elapsed = AJ_GetElapsedTime(&timer, TRUE);
+        }
+    }
+}
+
+/*
+ * Send function installed in the bus attachment while the I/O thread owns the transport. It
+ * never waits on the socket.
+ */
+static AJ_Status QueueSend(AJ_IOBuffer* buf)
+{
+    IOThread* io = (IOThread*)buf->context;
+    uint32_t tx = AJ_IO_BUF_AVAIL(buf);
+
+    if (__atomic_load_n(&io->status, __ATOMIC_ACQUIRE) != AJ_OK) {
+        return AJ_ERR_WRITE;
+    }
+    if (tx) {
+        IOChunk* chunk = NewChunk(buf->readPtr, tx);
+        if (!chunk) {
+            return AJ_ERR_RESOURCES;
+        }
+        QueuePush(&io->outbound, chunk);
+        Signal(io->outFd);
+    }
+    AJ_IO_BUF_RESET(buf);
+    return AJ_OK;
+}
+
+AJ_Status AJ_StartIOThread(AJ_BusAttachment* bus)
+{
+    IOThread* io;
+    uint8_t* buffers;
+    int eventFd;
+
+    if ((bus->sock.rx.recv == QueueRecv) || !bus->sock.rx.bufStart || !bus->sock.tx.bufStart) {
+        return AJ_ERR_DISALLOWED;
+    }
+#ifdef AJ_ARDP
+    /*
+     * ARDP timers and windows are driven from the message marshalling path
+     */
+    if (bus->sock.tx.send == AJ_ARDP_Send) {
+        return AJ_ERR_DISALLOWED;
+    }
+#endif
+    eventFd = AJ_GetEventFd(bus);
+    if (eventFd < 0) {
+        return AJ_ERR_DISALLOWED;
+    }
+    io = (IOThread*)AJ_Malloc(sizeof(IOThread) + bus->sock.rx.bufSize + bus->sock.tx.bufSize);
+    if (!io) {
+        return AJ_ERR_RESOURCES;
+    }
+    memset(io, 0, sizeof(IOThread));
+    QueueInit(&io->inbound);
+    QueueInit(&io->outbound);
+    io->eventFd = eventFd;
+    io->netSock = &bus->sock;
+    io->inFd = eventfd(0, O_NONBLOCK);
+    io->outFd = eventfd(0, O_NONBLOCK);
+    if ((io->inFd < 0) || (io->outFd < 0)) {
+        AJ_ErrPrintf(("AJ_StartIOThread(): eventfd() failed. errno=\"%s\"\n", strerror(errno)));
+        goto ExitError;
+    }
+    /*
+     * The I/O thread gets its own buffers on the transport, the application keeps the existing ones
+     */
+    io->sock = bus->sock;
+    io->appRx = bus->sock.rx;
+    io->appTx = bus->sock.tx;
+    buffers = (uint8_t*)(io + 1);
+    AJ_IOBufInit(&io->sock.rx, buffers, bus->sock.rx.bufSize, AJ_IO_BUF_RX, bus->sock.rx.context);
+    io->sock.rx.recv = bus->sock.rx.recv;
+    AJ_IOBufInit(&io->sock.tx, buffers + bus->sock.rx.bufSize, bus->sock.tx.bufSize, AJ_IO_BUF_TX, bus->sock.tx.context);
+    io->sock.tx.send = bus->sock.tx.send;
+    /*
+     * Move anything the application hasn't consumed or sent yet across
+     */
+    if (AJ_IO_BUF_AVAIL(&bus->sock.rx)) {
+        memcpy(io->sock.rx.writePtr, bus->sock.rx.readPtr, AJ_IO_BUF_AVAIL(&bus->sock.rx));
+        io->sock.rx.writePtr += AJ_IO_BUF_AVAIL(&bus->sock.rx);
+    }
+    if (QueueInbound(io) != AJ_OK) {
+        goto ExitError;
+    }
+    if (AJ_IO_BUF_AVAIL(&bus->sock.tx)) {
+        IOChunk* chunk = NewChunk(bus->sock.tx.readPtr, AJ_IO_BUF_AVAIL(&bus->sock.tx));
+        if (!chunk) {
+            goto ExitError;
+        }
+        QueuePush(&io->outbound, chunk);
+        Signal(io->outFd);
+    }
+    io->running = TRUE;
+    if (pthread_create(&io->thread, NULL, RunIOThread, io)) {
+        AJ_ErrPrintf(("AJ_StartIOThread(): pthread_create() failed\n"));
+        goto ExitError;
+    }
+    AJ_IO_BUF_RESET(&bus->sock.rx);
+    bus->sock.rx.recv = QueueRecv;
+    bus->sock.rx.context = io;
+    AJ_IO_BUF_RESET(&bus->sock.tx);
+    bus->sock.tx.send = QueueSend;
+    bus->sock.tx.context = io;
+    pthread_mutex_lock(&ioLock);
+    io->next = ioThreads;
+    ioThreads = io;
+    pthread_mutex_unlock(&ioLock);
+    return AJ_OK;
+
+ExitError:
+    while ((io->current = QueuePop(&io->inbound)) != NULL) {
+        AJ_Free(io->current);
+    }
+    while ((io->current = QueuePop(&io->outbound)) != NULL) {
+        AJ_Free(io->current);
+    }
+    if (io->inFd >= 0) {
+        close(io->inFd);
+    }
+    if (io->outFd >= 0) {
+        close(io->outFd);
+    }
+    AJ_Free(io);
+    return AJ_ERR_RESOURCES;
+}
+
+void _AJ_IOThreadInterrupt(AJ_NetSocket* netSock)
+{
+    IOThread* io;
+
+    pthread_mutex_lock(&ioLock);
+    for (io = ioThreads; io != NULL; io = io->next) {
+        if ((!netSock || (io->netSock == netSock)) && __atomic_load_n(&io->waiting, __ATOMIC_SEQ_CST)) {
+            __atomic_store_n(&io->interrupted, TRUE, __ATOMIC_RELEASE);
+            Signal(io->inFd);
+        }
+    }
+    pthread_mutex_unlock(&ioLock);
+}
+
+/*
+ * Stop the I/O thread and hand the transport back. Received data that was not consumed is
+ * returned to the application's receive buffer, growing it if necessary. If it can't be grown
+ * the thread is restarted when keepData is set, otherwise the data is discarded.
+ */
+static AJ_Status StopIOThread(AJ_NetSocket* netSock, uint8_t keepData)
+{
+    IOThread* io;
+    IOThread** link;
+    AJ_IOBuffer* rx = &netSock->rx;
+    uint32_t pending;
+
+    if (rx->recv != QueueRecv) {
+        return AJ_OK;
+    }
+    io = (IOThread*)rx->context;
+    __atomic_store_n(&io->running, FALSE, __ATOMIC_RELEASE);
+    Signal(io->outFd);
+    pthread_join(io->thread, NULL);
+    /*
+     * Queued chunks, then whatever the thread received after the last complete message. The
+     * application buffers may have been reallocated while the thread was running.
+     */
+    pending = __atomic_load_n(&io->queued, __ATOMIC_ACQUIRE) + AJ_IO_BUF_AVAIL(&io->sock.rx);
+    AJ_IOBufRebase(rx, 0);
+    if (AJ_IOBufGrow(rx, AJ_IO_BUF_AVAIL(rx) + pending) != AJ_OK) {
+        if (keepData && (__atomic_load_n(&io->status, __ATOMIC_ACQUIRE) == AJ_OK)) {
+            io->running = TRUE;
+            if (!pthread_create(&io->thread, NULL, RunIOThread, io)) {
+                AJ_WarnPrintf(("StopIOThread(): %u received bytes don't fit, still running\n", pending));
+                return AJ_ERR_RESOURCES;
+            }
+            AJ_ErrPrintf(("StopIOThread(): pthread_create() failed\n"));
+        }
+        AJ_WarnPrintf(("StopIOThread(): discarded received data\n"));
+    }
+    pthread_mutex_lock(&ioLock);
+    for (link = &ioThreads; *link != NULL; link = &(*link)->next) {
+        if (*link == io) {
+            *link = io->next;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&ioLock);
+    rx->recv = io->appRx.recv;
+    rx->context = io->appRx.context;
+    netSock->tx.send = io->appTx.send;
+    netSock->tx.context = io->appTx.context;
+    AJ_IO_BUF_RESET(&netSock->tx);
+    while (io->current || ((io->current = QueuePop(&io->inbound)) != NULL)) {
+        uint32_t len = min(io->current->len - io->current->offset, AJ_IO_BUF_SPACE(rx));
+        memcpy(rx->writePtr, io->current->data + io->current->offset, len);
+        rx->writePtr += len;
+        AJ_Free(io->current);
+        io->current = NULL;
+    }
+    pending = min(AJ_IO_BUF_AVAIL(&io->sock.rx), AJ_IO_BUF_SPACE(rx));
+    memcpy(rx->writePtr, io->sock.rx.readPtr, pending);
+    rx->writePtr += pending;
+    close(io->inFd);
+    close(io->outFd);
+    AJ_Free(io);
+    return AJ_OK;
+}
+
+void _AJ_StopIOThread(AJ_NetSocket* netSock)
+{
+    /*
+     * The transport is being disconnected, anything that doesn't fit is of no use
+     */
+    StopIOThread(netSock, FALSE);
+}
+
+AJ_Status AJ_StopIOThread(AJ_BusAttachment* bus)
+{
+    return StopIOThread(&bus->sock, TRUE);
+}
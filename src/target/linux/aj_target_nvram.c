@@ -26,6 +26,8 @@
 #include <ajtcl/aj_nvram.h>
 #include <ajtcl/aj_debug.h>
 #include "../../aj_target_nvram.h"
+#include <fcntl.h>
+#include <errno.h>
 
 /**
  * Turn on per-module debug printing by setting this variable to non-zero value
@@ -44,6 +46,48 @@ extern void AJ_NVRAM_Layout_Print();
 
 const char* nvFile = NV_FILE;
 
+/*
+ * NVRAM writes are appended to a journal file next to the NVRAM file
+ * rather than rewriting the whole image each time. The image is only
+ * rewritten (to a temporary file that is renamed over the old one) when
+ * the journal grows larger than the image itself, after compaction and
+ * when the NVRAM is cleared. On load the journal is replayed over the
+ * image; each record carries a checksum so a record torn by a crash is
+ * discarded along with anything after it. The journal starts with a
+ * checksum of the image it applies to, so a journal left behind by a
+ * crash just after the image was rewritten is recognised as stale.
+ *
+ * Outside a transaction each record is synced as soon as it is written.
+ * While a transaction is open nothing is written, the range of the image
+ * that changed is tracked instead and journaled as a single record that is
+ * synced when the transaction commits, so callers making several related
+ * writes should batch them in a transaction. Aborting reloads the image and
+ * journal.
+ */
+#define NV_JOURNAL_SUFFIX ".jnl"
+#define NV_JOURNAL_LIMIT  AJ_NVRAM_SIZE
+#define NV_JOURNAL_MAGIC  0x4A4E
+
+typedef struct _NV_JournalHeader {
+    uint32_t magic;
+    uint32_t base;
+} NV_JournalHeader;
+
+typedef struct _NV_JournalRecord {
+    uint16_t magic;
+    uint16_t size;
+    uint32_t offset;
+    uint32_t check;
+} NV_JournalRecord;
+
+static int journalFd = -1;
+static size_t journalLen = 0;
+
+static uint8_t txnActive = FALSE;
+static uint32_t txnStart;
+static uint32_t txnEnd;
+static uint8_t txnFlush = FALSE;
+
 void AJ_SetNVRAM_FilePath(const char* path)
 {
     if (path) {
@@ -51,6 +95,156 @@ void AJ_SetNVRAM_FilePath(const char* path)
     }
 }
 
+static char* JournalPath(void)
+{
+    char* path = (char*) AJ_Malloc(strlen(nvFile) + sizeof (NV_JOURNAL_SUFFIX));
+
+    if (path) {
+        strcpy(path, nvFile);
+        strcat(path, NV_JOURNAL_SUFFIX);
+    }
+    return path;
+}
+
+static uint32_t JournalCheck(uint32_t offset, const uint8_t* data, uint32_t size)
+{
+    /* Fletcher-32 over the offset, size and data */
+    uint32_t a = offset ^ ((uint32_t) size << 16);
+    uint32_t b = a;
+
+    while (size--) {
+        a = (a + *data++) % 65535;
+        b = (b + a) % 65535;
+    }
+    return (b << 16) | a;
+}
+
+static uint32_t ImageCheck(void)
+{
+    return JournalCheck(0, AJ_NVRAM_BASE_ADDRESS, AJ_NVRAM_SIZE);
+}
+
+static AJ_Status JournalOpen(int truncate)
+{
+    NV_JournalHeader hdr;
+    char* path;
+
+    if (journalFd >= 0) {
+        close(journalFd);
+        journalFd = -1;
+    }
+    path = JournalPath();
+    if (!path) {
+        return AJ_ERR_RESOURCES;
+    }
+    journalFd = open(path, O_WRONLY | O_CREAT | O_APPEND | (truncate ? O_TRUNC : 0), 0666);
+    AJ_Free(path);
+    if (journalFd < 0) {
+        AJ_ErrPrintf(("JournalOpen(): open failed errno=%d\n", errno));
+        return AJ_ERR_FAILURE;
+    }
+    if (truncate) {
+        hdr.magic = AJ_NV_SENTINEL;
+        hdr.base = ImageCheck();
+        if (write(journalFd, &hdr, sizeof (hdr)) != sizeof (hdr)) {
+            AJ_ErrPrintf(("JournalOpen(): write failed errno=%d\n", errno));
+            close(journalFd);
+            journalFd = -1;
+            return AJ_ERR_FAILURE;
+        }
+        journalLen = sizeof (hdr);
+    }
+    return AJ_OK;
+}
+
+/*
+ * Replays the journal over the image, stopping at the first record that
+ * doesn't check out. Returns the length of the valid part of the journal,
+ * zero if there is no journal for this image.
+ */
+static size_t JournalReplay(void)
+{
+    NV_JournalHeader hdr;
+    NV_JournalRecord rec;
+    uint8_t* data;
+    size_t valid = 0;
+    char* path;
+    FILE* f;
+
+    path = JournalPath();
+    if (!path) {
+        return 0;
+    }
+    f = fopen(path, "r");
+    AJ_Free(path);
+    if (!f) {
+        return 0;
+    }
+    if ((fread(&hdr, sizeof (hdr), 1, f) != 1) || (AJ_NV_SENTINEL != hdr.magic) || (ImageCheck() != hdr.base)) {
+        AJ_InfoPrintf(("JournalReplay(): No journal for this image\n"));
+        fclose(f);
+        return 0;
+    }
+    valid = sizeof (hdr);
+    while (fread(&rec, sizeof (rec), 1, f) == 1) {
+        if ((NV_JOURNAL_MAGIC != rec.magic) || !rec.size || (rec.offset > AJ_NVRAM_SIZE) || (rec.size > AJ_NVRAM_SIZE - rec.offset)) {
+            break;
+        }
+        data = (uint8_t*) AJ_Malloc(rec.size);
+        if (!data) {
+            break;
+        }
+        /* Verify the whole record before applying any of it */
+        if ((fread(data, rec.size, 1, f) != 1) || (JournalCheck(rec.offset, data, rec.size) != rec.check)) {
+            AJ_WarnPrintf(("JournalReplay(): Torn record at %u\n", (uint32_t) valid));
+            AJ_Free(data);
+            break;
+        }
+        memcpy(AJ_NVRAM_BASE_ADDRESS + rec.offset, data, rec.size);
+        AJ_Free(data);
+        valid += sizeof (rec) + rec.size;
+    }
+    fclose(f);
+    return valid;
+}
+
+/*
+ * Records a range of the image that has just been written
+ */
+static void JournalAppend(const uint8_t* dest, uint16_t size)
+{
+    NV_JournalRecord rec;
+    uint32_t offset = (uint32_t) (dest - AJ_NVRAM_BASE_ADDRESS);
+
+    if (!size) {
+        return;
+    }
+    if (txnActive) {
+        txnStart = min(txnStart, offset);
+        txnEnd = max(txnEnd, offset + size);
+        return;
+    }
+    if ((journalFd < 0) || (journalLen + sizeof (rec) + size > NV_JOURNAL_LIMIT)) {
+        /* Fold the journal into the image */
+        _AJ_StoreNVToFile();
+        return;
+    }
+    rec.magic = NV_JOURNAL_MAGIC;
+    rec.size = size;
+    rec.offset = offset;
+    rec.check = JournalCheck(rec.offset, dest, size);
+    if ((write(journalFd, &rec, sizeof (rec)) != sizeof (rec)) || (write(journalFd, dest, size) != size)) {
+        AJ_ErrPrintf(("JournalAppend(): write failed errno=%d\n", errno));
+        /* The image is still intact in memory, write it out in full */
+        _AJ_StoreNVToFile();
+        return;
+    }
+    journalLen += sizeof (rec) + size;
+    if (!txnFlush && fdatasync(journalFd)) {
+        AJ_ErrPrintf(("JournalAppend(): fdatasync failed errno=%d\n", errno));
+    }
+}
+
 void AJ_NVRAM_Init()
 {
     AJ_NVRAM_BASE_ADDRESS = AJ_EMULATED_NVRAM;
@@ -64,13 +258,13 @@ void AJ_NVRAM_Init()
 void _AJ_NV_Write(void* dest, const void* buf, uint16_t size)
 {
     memcpy(dest, buf, size);
-    _AJ_StoreNVToFile();
+    JournalAppend((const uint8_t*) dest, size);
 }
 
 void _AJ_NV_Move(void* dest, const void* buf, uint16_t size)
 {
     memmove(dest, buf, size);
-    _AJ_StoreNVToFile();
+    JournalAppend((const uint8_t*) dest, size);
 }
 
 void _AJ_NV_Read(void* src, void* buf, uint16_t size)
@@ -96,22 +290,133 @@ AJ_Status _AJ_LoadNVFromFile()
     memset(AJ_NVRAM_BASE_ADDRESS, INVALID_DATA_BYTE, AJ_NVRAM_SIZE);
     fread(AJ_NVRAM_BASE_ADDRESS, AJ_NVRAM_SIZE, 1, f);
     fclose(f);
+    /* Apply any writes made since the image was last stored */
+    journalLen = JournalReplay();
+    if (!journalLen) {
+        JournalOpen(TRUE);
+    } else if (AJ_OK == JournalOpen(FALSE)) {
+        /* Drop any torn record from the end so new records follow the last good one */
+        if (ftruncate(journalFd, journalLen)) {
+            AJ_WarnPrintf(("_AJ_LoadNVFromFile(): ftruncate failed errno=%d\n", errno));
+        }
+    }
+    _AJ_NVRAM_Reindex();
     return AJ_OK;
 }
 
+/*
+ * Syncs the directory holding a file so a rename into it survives a crash
+ */
+static void SyncDirectory(const char* path)
+{
+    const char* sep = strrchr(path, '/');
+    char* dir;
+    int fd;
+
+    if (!sep) {
+        fd = open(".", O_RDONLY | O_DIRECTORY);
+    } else {
+        dir = (char*) AJ_Malloc(sep - path + 2);
+        if (!dir) {
+            return;
+        }
+        memcpy(dir, path, sep - path + 1);
+        dir[sep - path + 1] = '\0';
+        fd = open(dir, O_RDONLY | O_DIRECTORY);
+        AJ_Free(dir);
+    }
+    if (fd < 0) {
+        AJ_WarnPrintf(("SyncDirectory(): open failed errno=%d\n", errno));
+        return;
+    }
+    if (fsync(fd)) {
+        AJ_WarnPrintf(("SyncDirectory(): fsync failed errno=%d\n", errno));
+    }
+    close(fd);
+}
+
+/*
+ * Writes the whole image to a new file, syncs it and renames it over the
+ * old one so a crash leaves either the old or the new image intact, then
+ * empties the journal.
+ */
 AJ_Status _AJ_StoreNVToFile()
 {
-    FILE* f = fopen(nvFile, "w");
-    if (!f) {
+    AJ_Status status = AJ_ERR_FAILURE;
+    char* tmp;
+    int fd;
+
+    if (txnActive) {
+        /* Written out in full on commit */
+        txnStart = 0;
+        txnEnd = AJ_NVRAM_SIZE;
+        return AJ_OK;
+    }
+    tmp = (char*) AJ_Malloc(strlen(nvFile) + sizeof (".tmp"));
+    if (!tmp) {
+        return AJ_ERR_RESOURCES;
+    }
+    strcpy(tmp, nvFile);
+    strcat(tmp, ".tmp");
+    fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+    if (fd < 0) {
         AJ_ErrPrintf(("_AJ_StoreNVToFile(): StoreNVToFile() failed. status=AJ_ERR_FAILURE\n"));
-        return AJ_ERR_FAILURE;
+        goto Exit;
+    }
+    if ((write(fd, AJ_NVRAM_BASE_ADDRESS, AJ_NVRAM_SIZE) != AJ_NVRAM_SIZE) || fsync(fd)) {
+        AJ_ErrPrintf(("_AJ_StoreNVToFile(): write failed errno=%d\n", errno));
+        close(fd);
+        unlink(tmp);
+        goto Exit;
     }
+    close(fd);
+    if (rename(tmp, nvFile)) {
+        AJ_ErrPrintf(("_AJ_StoreNVToFile(): rename failed errno=%d\n", errno));
+        unlink(tmp);
+        goto Exit;
+    }
+    /* Make the rename itself durable before the journal it replaces is emptied */
+    SyncDirectory(nvFile);
+    status = JournalOpen(TRUE);
 
-    fwrite(AJ_NVRAM_BASE_ADDRESS, AJ_NVRAM_SIZE, 1, f);
-    fclose(f);
+Exit:
+    AJ_Free(tmp);
+    return status;
+}
+
+AJ_Status _AJ_NVRAM_BeginTransaction(void)
+{
+    txnActive = TRUE;
+    txnStart = AJ_NVRAM_SIZE;
+    txnEnd = 0;
     return AJ_OK;
 }
 
+AJ_Status _AJ_NVRAM_CommitTransaction(void)
+{
+    txnActive = FALSE;
+    if (txnStart >= txnEnd) {
+        return AJ_OK;
+    }
+    if ((txnEnd - txnStart) > 0xFFFF) {
+        return _AJ_StoreNVToFile();
+    }
+    txnFlush = TRUE;
+    JournalAppend(AJ_NVRAM_BASE_ADDRESS + txnStart, (uint16_t) (txnEnd - txnStart));
+    txnFlush = FALSE;
+    if ((journalFd >= 0) && fdatasync(journalFd)) {
+        AJ_ErrPrintf(("_AJ_NVRAM_CommitTransaction(): fdatasync failed errno=%d\n", errno));
+        return AJ_ERR_FAILURE;
+    }
+    return AJ_OK;
+}
+
+void _AJ_NVRAM_AbortTransaction(void)
+{
+    txnActive = FALSE;
+    _AJ_LoadNVFromFile();
+}
+
 // Compact the storage by removing invalid entries
 AJ_Status _AJ_CompactNVStorage()
 {
@@ -127,7 +432,8 @@ AJ_Status _AJ_CompactNVStorage()
         capacity = *(data + 1);
         entrySize = ENTRY_HEADER_SIZE + capacity;
         if (id != INVALID_ID) {
-            _AJ_NV_Move(writePtr, data, entrySize);
+            /* Moved entries are written out in one go below rather than journaled */
+            memmove(writePtr, data, entrySize);
             writePtr += entrySize;
         } else {
             garbage += entrySize;
@@ -0,0 +1,397 @@
+/**
+ * @file
+ */
+/******************************************************************************
+ * Copyright AllSeen Alliance. All rights reserved.
+ *
+ *    Permission to use, copy, modify, and/or distribute this software for any
+ *    purpose with or without fee is hereby granted, provided that the above
+ *    copyright notice and this permission notice appear in all copies.
+ *
+ *    THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ *    WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ *    MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ *    ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ *    WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ *    ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ *    OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ ******************************************************************************/
+
+/**
+ * Per-module definition of the current module for debug logging.  Must be defined
+ * prior to first inclusion of aj_debug.h
+ */
+#define AJ_MODULE TARGET_SHM
+
+#define _GNU_SOURCE     /* memfd_create */
+#include "aj_target.h"
+#include <errno.h>
+#include <limits.h>
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+#include <linux/futex.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <ajtcl/aj_bufio.h>
+#include <ajtcl/aj_bus.h>
+#include <ajtcl/aj_config.h>
+#include <ajtcl/aj_net.h>
+#include <ajtcl/aj_util.h>
+#include <ajtcl/aj_debug.h>
+
+/**
+ * Turn on per-module debug printing by setting this variable to non-zero value
+ * (usually in debugger).
+ */
+#ifndef NDEBUG
+uint8_t dbgTARGET_SHM = 0;
+#endif
+
+/*
+ * How long a send waits for the peer to make space in a full ring
+ */
+#define SHM_SEND_TIMEOUT 5000
+
+#define SHM_MAGIC 0x4D48534A  /* "AJSHM" */
+
+#define SHM_CACHE_LINE 64
+
+/*
+ * One direction of the transport. The producer only writes head and the consumer only writes
+ * tail, both are free-running byte counts. Each side sets its waiting flag before sleeping on
+ * the other side's counter so a wakeup is only needed when the ring goes from empty to
+ * non-empty or from full to not full with the other side asleep.
+ */
+typedef struct {
+    uint32_t head;              /* Bytes written, futex word the consumer sleeps on */
+    uint32_t consumerWaiting;
+    uint8_t pad0[SHM_CACHE_LINE - 8];
+    uint32_t tail;              /* Bytes read, futex word the producer sleeps on */
+    uint32_t producerWaiting;
+    uint8_t pad1[SHM_CACHE_LINE - 8];
+} ShmRing;
+
+/*
+ * Start of the shared mapping, the ring data follows
+ */
+typedef struct {
+    uint32_t magic;
+    uint32_t ringSize;          /* Power of two */
+    uint32_t attached;          /* Number of sides that have attached */
+    uint32_t closed[2];         /* Set by a side when it detaches */
+    uint8_t pad[SHM_CACHE_LINE - 20];
+    ShmRing ring[2];
+} ShmHeader;
+
+/*
+ * Per-process state for an attached side
+ */
+typedef struct _ShmContext {
+    ShmHeader* shm;
+    size_t mapSize;
+    uint8_t side;
+    ShmRing* rxRing;
+    uint8_t* rxData;
+    ShmRing* txRing;
+    uint8_t* txData;
+    uint32_t interrupted;
+    AJ_NetSocket* netSock;  /* The bus attachment's socket */
+    struct _ShmContext* next;
+} ShmContext;
+
+/*
+ * Attached contexts, so AJ_Net_Interrupt() can wake a blocked read
+ */
+static ShmContext* shmContexts = NULL;
+static pthread_mutex_t shmLock = PTHREAD_MUTEX_INITIALIZER;
+
+static int FutexWait(uint32_t* word, uint32_t val, uint32_t timeout)
+{
+    struct timespec ts;
+    ts.tv_sec = timeout / 1000;
+    ts.tv_nsec = (timeout % 1000) * 1000000;
+    return (int)syscall(SYS_futex, word, FUTEX_WAIT, val, &ts, NULL, 0);
+}
+
+static void FutexWake(uint32_t* word)
+{
+    syscall(SYS_futex, word, FUTEX_WAKE, INT_MAX, NULL, NULL, 0);
+}
+
+static uint32_t ShmPeerClosed(ShmContext* ctx)
+{
+    return __atomic_load_n(&ctx->shm->closed[ctx->side ^ 1], __ATOMIC_ACQUIRE);
+}
+
+/*
+ * Sleep until the counter moves away from val, the peer detaches or the timeout expires
+ */
+static void ShmWait(ShmContext* ctx, uint32_t* counter, uint32_t* waiting, uint32_t val, uint32_t timeout)
+{
+    __atomic_store_n(waiting, 1, __ATOMIC_SEQ_CST);
+    if ((__atomic_load_n(counter, __ATOMIC_SEQ_CST) == val) && !ShmPeerClosed(ctx) &&
+        !__atomic_load_n(&ctx->interrupted, __ATOMIC_ACQUIRE)) {
+        FutexWait(counter, val, timeout);
+    }
+    __atomic_store_n(waiting, 0, __ATOMIC_RELAXED);
+}
+
+static AJ_Status ShmRecv(AJ_IOBuffer* buf, uint32_t len, uint32_t timeout)
+{
+    ShmContext* ctx = (ShmContext*)buf->context;
+    ShmRing* ring = ctx->rxRing;
+    uint32_t mask = ctx->shm->ringSize - 1;
+    uint32_t tail = ring->tail;
+    uint32_t head;
+    uint32_t avail;
+    uint32_t off;
+    AJ_Time timer;
+
+    AJ_ASSERT(buf->direction == AJ_IO_BUF_RX);
+    AJ_InitTimer(&timer);
+    while ((head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE)) == tail) {
+        uint32_t elapsed;
+        if (__atomic_exchange_n(&ctx->interrupted, 0, __ATOMIC_ACQ_REL)) {
+            return AJ_ERR_INTERRUPTED;
+        }
+        if (ShmPeerClosed(ctx)) {
+            AJ_ErrPrintf(("ShmRecv(): peer detached, status=AJ_ERR_READ\n"));
+            return AJ_ERR_READ;
+        }
+        elapsed = AJ_GetElapsedTime(&timer, TRUE);
+        if (elapsed >= timeout) {
+            return AJ_ERR_TIMEOUT;
+        }
+        ShmWait(ctx, &ring->head, &ring->consumerWaiting, tail, timeout - elapsed);
+    }
+    /*
+     * Data arrived so an interrupt that raced with it has nothing left to wake
+     */
+    __atomic_store_n(&ctx->interrupted, 0, __ATOMIC_RELAXED);
+    avail = head - tail;
+    len = min(len, AJ_IO_BUF_SPACE(buf));
+    len = min(len, avail);
+    /*
+     * Copy out in up to two pieces if the data wraps around the end of the ring
+     */
+    off = tail & mask;
+    if (off + len > mask + 1) {
+        uint32_t first = mask + 1 - off;
+        memcpy(buf->writePtr, ctx->rxData + off, first);
+        memcpy(buf->writePtr + first, ctx->rxData, len - first);
+    } else {
+        memcpy(buf->writePtr, ctx->rxData + off, len);
+    }
+    buf->writePtr += len;
+    __atomic_store_n(&ring->tail, tail + len, __ATOMIC_SEQ_CST);
+    /*
+     * Only a producer that found the ring full is asleep
+     */
+    if (__atomic_load_n(&ring->producerWaiting, __ATOMIC_SEQ_CST)) {
+        FutexWake(&ring->tail);
+    }
+    return AJ_OK;
+}
+
+static AJ_Status ShmSend(AJ_IOBuffer* buf)
+{
+    ShmContext* ctx = (ShmContext*)buf->context;
+    ShmRing* ring = ctx->txRing;
+    uint32_t size = ctx->shm->ringSize;
+    uint32_t head = ring->head;
+    AJ_Time timer;
+
+    AJ_ASSERT(buf->direction == AJ_IO_BUF_TX);
+    AJ_InitTimer(&timer);
+    while (AJ_IO_BUF_AVAIL(buf)) {
+        uint32_t tail = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+        uint32_t space = size - (head - tail);
+        uint32_t len;
+        uint32_t off;
+
+        if (ShmPeerClosed(ctx)) {
+            AJ_ErrPrintf(("ShmSend(): peer detached, status=AJ_ERR_WRITE\n"));
+            return AJ_ERR_WRITE;
+        }
+        if (!space) {
+            uint32_t elapsed = AJ_GetElapsedTime(&timer, TRUE);
+            if (elapsed >= SHM_SEND_TIMEOUT) {
+                AJ_ErrPrintf(("ShmSend(): ring full, status=AJ_ERR_WRITE\n"));
+                return AJ_ERR_WRITE;
+            }
+            ShmWait(ctx, &ring->tail, &ring->producerWaiting, tail, SHM_SEND_TIMEOUT - elapsed);
+            continue;
+        }
+        len = min(space, AJ_IO_BUF_AVAIL(buf));
+        off = head & (size - 1);
+        if (off + len > size) {
+            uint32_t first = size - off;
+            memcpy(ctx->txData + off, buf->readPtr, first);
+            memcpy(ctx->txData, buf->readPtr + first, len - first);
+        } else {
+            memcpy(ctx->txData + off, buf->readPtr, len);
+        }
+        buf->readPtr += len;
+        head += len;
+        __atomic_store_n(&ring->head, head, __ATOMIC_SEQ_CST);
+        /*
+         * The consumer only sleeps on an empty ring so this is the empty to non-empty transition
+         */
+        if (__atomic_load_n(&ring->consumerWaiting, __ATOMIC_SEQ_CST)) {
+            FutexWake(&ring->head);
+        }
+    }
+    AJ_IO_BUF_RESET(buf);
+    return AJ_OK;
+}
+
+int AJ_ShmCreate(uint32_t ringSize)
+{
+    ShmHeader* shm;
+    uint32_t size = SHM_CACHE_LINE;
+    int memFd;
+
+    while (size < ringSize) {
+        size <<= 1;
+    }
+    memFd = memfd_create("ajtcl-shm", MFD_CLOEXEC);
+    if (memFd < 0) {
+        AJ_ErrPrintf(("AJ_ShmCreate(): memfd_create() failed. errno=\"%s\"\n", strerror(errno)));
+        return -1;
+    }
+    if (ftruncate(memFd, sizeof(ShmHeader) + 2 * (size_t)size) < 0) {
+        goto ExitError;
+    }
+    shm = (ShmHeader*)mmap(NULL, sizeof(ShmHeader), PROT_READ | PROT_WRITE, MAP_SHARED, memFd, 0);
+    if (shm == MAP_FAILED) {
+        goto ExitError;
+    }
+    shm->ringSize = size;
+    __atomic_store_n(&shm->magic, SHM_MAGIC, __ATOMIC_RELEASE);
+    munmap(shm, sizeof(ShmHeader));
+    return memFd;
+
+ExitError:
+    AJ_ErrPrintf(("AJ_ShmCreate(): failed. errno=\"%s\"\n", strerror(errno)));
+    close(memFd);
+    return -1;
+}
+
+AJ_Status AJ_ShmConnect(AJ_BusAttachment* bus, int memFd)
+{
+    ShmHeader* shm;
+    ShmContext* ctx;
+    uint8_t* rxBuf;
+    uint8_t* txBuf;
+    uint32_t side;
+    size_t mapSize;
+
+    shm = (ShmHeader*)mmap(NULL, sizeof(ShmHeader), PROT_READ | PROT_WRITE, MAP_SHARED, memFd, 0);
+    if (shm == MAP_FAILED) {
+        AJ_ErrPrintf(("AJ_ShmConnect(): mmap() failed. errno=\"%s\"\n", strerror(errno)));
+        return AJ_ERR_CONNECT;
+    }
+    if (__atomic_load_n(&shm->magic, __ATOMIC_ACQUIRE) != SHM_MAGIC) {
+        munmap(shm, sizeof(ShmHeader));
+        return AJ_ERR_CONNECT;
+    }
+    mapSize = sizeof(ShmHeader) + 2 * (size_t)shm->ringSize;
+    munmap(shm, sizeof(ShmHeader));
+    shm = (ShmHeader*)mmap(NULL, mapSize, PROT_READ | PROT_WRITE, MAP_SHARED, memFd, 0);
+    if (shm == MAP_FAILED) {
+        AJ_ErrPrintf(("AJ_ShmConnect(): mmap() failed. errno=\"%s\"\n", strerror(errno)));
+        return AJ_ERR_CONNECT;
+    }
+    /*
+     * The first side to attach transmits on ring 0, the second on ring 1
+     */
+    side = __atomic_fetch_add(&shm->attached, 1, __ATOMIC_ACQ_REL);
+    if (side > 1) {
+        munmap(shm, mapSize);
+        return AJ_ERR_DISALLOWED;
+    }
+    ctx = (ShmContext*)AJ_Malloc(sizeof(ShmContext));
+    rxBuf = (uint8_t*)AJ_Malloc(AJ_RX_DATA_SIZE);
+    txBuf = (uint8_t*)AJ_Malloc(AJ_TX_DATA_SIZE);
+    if (!ctx || !rxBuf || !txBuf) {
+        AJ_Free(ctx);
+        AJ_Free(rxBuf);
+        AJ_Free(txBuf);
+        __atomic_store_n(&shm->closed[side], 1, __ATOMIC_RELEASE);
+        munmap(shm, mapSize);
+        return AJ_ERR_RESOURCES;
+    }
+    memset(ctx, 0, sizeof(ShmContext));
+    ctx->shm = shm;
+    ctx->mapSize = mapSize;
+    ctx->side = (uint8_t)side;
+    ctx->netSock = &bus->sock;
+    ctx->txRing = &shm->ring[side];
+    ctx->txData = (uint8_t*)(shm + 1) + side * shm->ringSize;
+    ctx->rxRing = &shm->ring[side ^ 1];
+    ctx->rxData = (uint8_t*)(shm + 1) + (side ^ 1) * shm->ringSize;
+
+    AJ_IOBufInit(&bus->sock.rx, rxBuf, AJ_RX_DATA_SIZE, AJ_IO_BUF_RX, ctx);
+    bus->sock.rx.bufMax = AJ_RX_DATA_SIZE;
+    bus->sock.rx.recv = ShmRecv;
+    AJ_IOBufInit(&bus->sock.tx, txBuf, AJ_TX_DATA_SIZE, AJ_IO_BUF_TX, ctx);
+    bus->sock.tx.bufMax = AJ_TX_DATA_SIZE;
+    bus->sock.tx.send = ShmSend;
+
+    pthread_mutex_lock(&shmLock);
+    ctx->next = shmContexts;
+    shmContexts = ctx;
+    pthread_mutex_unlock(&shmLock);
+    AJ_InfoPrintf(("AJ_ShmConnect(): attached side %u, ring size %u\n", side, shm->ringSize));
+    return AJ_OK;
+}
+
+void _AJ_ShmInterrupt(AJ_NetSocket* netSock)
+{
+    ShmContext* ctx;
+
+    pthread_mutex_lock(&shmLock);
+    for (ctx = shmContexts; ctx != NULL; ctx = ctx->next) {
+        if (netSock && (ctx->netSock != netSock)) {
+            continue;
+        }
+        /*
+         * Only a read that is blocked is interrupted, the next read must not see a stale flag
+         */
+        if (__atomic_load_n(&ctx->rxRing->consumerWaiting, __ATOMIC_SEQ_CST)) {
+            __atomic_store_n(&ctx->interrupted, 1, __ATOMIC_RELEASE);
+            FutexWake(&ctx->rxRing->head);
+        }
+    }
+    pthread_mutex_unlock(&shmLock);
+}
+
+void _AJ_ShmDisconnect(AJ_NetSocket* netSock)
+{
+    ShmContext* ctx = (ShmContext*)netSock->rx.context;
+    ShmContext** link;
+
+    if (netSock->rx.recv != ShmRecv) {
+        return;
+    }
+    pthread_mutex_lock(&shmLock);
+    for (link = &shmContexts; *link != NULL; link = &(*link)->next) {
+        if (*link == ctx) {
+            *link = ctx->next;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&shmLock);
+    /*
+     * Wake the peer whichever way it is blocked so it sees the ring has closed
+     */
+    __atomic_store_n(&ctx->shm->closed[ctx->side], 1, __ATOMIC_SEQ_CST);
+    FutexWake(&ctx->txRing->head);
+    FutexWake(&ctx->rxRing->tail);
+    munmap(ctx->shm, ctx->mapSize);
+    AJ_Free(netSock->rx.bufStart);
+    AJ_Free(netSock->tx.bufStart);
+    AJ_Free(ctx);
+    memset(netSock, 0, sizeof(AJ_NetSocket));
+}
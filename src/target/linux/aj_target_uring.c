@@ -0,0 +1,460 @@
+/**
+ * @file
+ */
+/******************************************************************************
+ * Copyright AllSeen Alliance. All rights reserved.
+ *
+ *    Permission to use, copy, modify, and/or distribute this software for any
+ *    purpose with or without fee is hereby granted, provided that the above
+ *    copyright notice and this permission notice appear in all copies.
+ *
+ *    THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ *    WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ *    MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ *    ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ *    WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ *    ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ *    OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ ******************************************************************************/
+
+/**
+ * Per-module definition of the current module for debug logging.  Must be defined
+ * prior to first inclusion of aj_debug.h
+ */
+#define AJ_MODULE TARGET_URING
+
+#include "aj_target.h"
+
+#ifdef AJ_IO_URING
+
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <unistd.h>
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <ajtcl/aj_net.h>
+#include <ajtcl/aj_util.h>
+#include <ajtcl/aj_debug.h>
+
+/**
+ * Turn on per-module debug printing by setting this variable to non-zero value
+ * (usually in debugger).
+ */
+#ifndef NDEBUG
+uint8_t dbgTARGET_URING = 0;
+#endif
+
+/*
+ * Submission queue size, no more than four requests are ever queued at once
+ */
+#define URING_ENTRIES 8
+
+/*
+ * Number of provided receive buffers, must be a power of two
+ */
+#define URING_NUM_BUFS 32
+
+/*
+ * Every receive completion owns a buffer so this is enough to never overflow
+ */
+#define URING_CQ_ENTRIES (2 * URING_NUM_BUFS)
+
+#define URING_BUF_GROUP 0
+
+/*
+ * How long teardown waits for the multishot receive to be cancelled
+ */
+#define URING_CANCEL_TIMEOUT 100
+
+/*
+ * Request tags, the multishot requests index the armed array
+ */
+#define TAG_RECV      0
+#define TAG_INTERRUPT 1
+#define TAG_TIMER     2
+#define TAG_NOP       3
+#define TAG_CANCEL    4
+
+struct _AJ_Uring {
+    int fd;
+    int sock;
+    int interruptFd;
+    int timerFd;
+    uint8_t polled;                 /* The ring fd is registered with an epoll reactor */
+    uint8_t armed[TAG_TIMER + 1];   /* Multishot requests that are still active */
+    uint32_t toSubmit;
+    /*
+     * Shared rings
+     */
+    uint8_t* ringMem;
+    size_t ringSize;
+    struct io_uring_sqe* sqes;
+    size_t sqesSize;
+    uint32_t* sqTail;
+    uint32_t sqMask;
+    uint32_t* sqArray;
+    uint32_t* cqHead;
+    uint32_t* cqTail;
+    uint32_t cqMask;
+    struct io_uring_cqe* cqes;
+    /*
+     * Provided receive buffers, the kernel picks one for each received chunk
+     */
+    struct io_uring_buf_ring* bufRing;
+    uint8_t* bufs;
+    size_t bufMemSize;
+    uint32_t bufSize;
+    /*
+     * The chunk being handed out, its buffer goes back to the kernel on the next receive
+     */
+    int32_t bid;
+    uint8_t* data;
+    uint32_t avail;
+};
+
+static int Enter(AJ_Uring* ring, uint32_t waitFor, uint32_t timeout)
+{
+    struct io_uring_getevents_arg arg;
+    struct __kernel_timespec ts;
+    uint32_t flags = 0;
+    int ret;
+
+    memset(&arg, 0, sizeof(arg));
+    if (waitFor) {
+        ts.tv_sec = timeout / 1000;
+        ts.tv_nsec = (timeout % 1000) * 1000000;
+        arg.sigmask_sz = _NSIG / 8;
+        arg.ts = (uint64_t)(uintptr_t)&ts;
+        flags = IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG;
+    }
+    ret = (int)syscall(__NR_io_uring_enter, ring->fd, ring->toSubmit, waitFor, flags, waitFor ? &arg : NULL, waitFor ? sizeof(arg) : 0);
+    if (ret > 0) {
+        ring->toSubmit -= min((uint32_t)ret, ring->toSubmit);
+    }
+    return ret;
+}
+
+static struct io_uring_sqe* GetSqe(AJ_Uring* ring, uint8_t opcode, int fd, uint64_t tag)
+{
+    uint32_t tail = *ring->sqTail;
+    uint32_t idx = tail & ring->sqMask;
+    struct io_uring_sqe* sqe = &ring->sqes[idx];
+
+    AJ_ASSERT(ring->toSubmit < URING_ENTRIES);
+    memset(sqe, 0, sizeof(struct io_uring_sqe));
+    sqe->opcode = opcode;
+    sqe->fd = fd;
+    sqe->user_data = tag;
+    ring->sqArray[idx] = idx;
+    __atomic_store_n(ring->sqTail, tail + 1, __ATOMIC_RELEASE);
+    ++ring->toSubmit;
+    return sqe;
+}
+
+static void AddBuffer(AJ_Uring* ring, uint16_t bid, uint16_t offset)
+{
+    struct io_uring_buf* buf = &ring->bufRing->bufs[(ring->bufRing->tail + offset) & (URING_NUM_BUFS - 1)];
+
+    buf->addr = (uint64_t)(uintptr_t)(ring->bufs + (size_t)bid * ring->bufSize);
+    buf->len = ring->bufSize;
+    buf->bid = bid;
+}
+
+/*
+ * Give the buffer of a chunk that has been handed out back to the kernel
+ */
+static void Recycle(AJ_Uring* ring)
+{
+    if (ring->bid >= 0) {
+        AddBuffer(ring, (uint16_t)ring->bid, 0);
+        __atomic_store_n(&ring->bufRing->tail, ring->bufRing->tail + 1, __ATOMIC_RELEASE);
+        ring->bid = -1;
+    }
+}
+
+/*
+ * Queue the multishot requests that have stopped, they are submitted with the next wait
+ */
+static void Arm(AJ_Uring* ring)
+{
+    struct io_uring_sqe* sqe;
+
+    if (!ring->armed[TAG_RECV]) {
+        sqe = GetSqe(ring, IORING_OP_RECV, ring->sock, TAG_RECV);
+        sqe->ioprio = IORING_RECV_MULTISHOT;
+        sqe->flags = IOSQE_BUFFER_SELECT;
+        sqe->buf_group = URING_BUF_GROUP;
+        ring->armed[TAG_RECV] = TRUE;
+    }
+    if (!ring->armed[TAG_INTERRUPT]) {
+        sqe = GetSqe(ring, IORING_OP_POLL_ADD, ring->interruptFd, TAG_INTERRUPT);
+        sqe->poll32_events = POLLIN;
+        sqe->len = IORING_POLL_ADD_MULTI;
+        ring->armed[TAG_INTERRUPT] = TRUE;
+    }
+    if (!ring->armed[TAG_TIMER]) {
+        sqe = GetSqe(ring, IORING_OP_POLL_ADD, ring->timerFd, TAG_TIMER);
+        sqe->poll32_events = POLLIN;
+        sqe->len = IORING_POLL_ADD_MULTI;
+        ring->armed[TAG_TIMER] = TRUE;
+    }
+}
+
+/*
+ * Consume completions until a chunk of data or an interrupt turns up.
+ * Returns AJ_ERR_TIMEOUT if the completion queue ran dry first.
+ */
+static AJ_Status Reap(AJ_Uring* ring)
+{
+    AJ_Status status = AJ_ERR_TIMEOUT;
+    uint32_t head = *ring->cqHead;
+    uint64_t u64;
+
+    while ((status == AJ_ERR_TIMEOUT) && (head != __atomic_load_n(ring->cqTail, __ATOMIC_ACQUIRE))) {
+        struct io_uring_cqe* cqe = &ring->cqes[head & ring->cqMask];
+
+        if ((cqe->user_data <= TAG_TIMER) && !(cqe->flags & IORING_CQE_F_MORE)) {
+            ring->armed[cqe->user_data] = FALSE;
+        }
+        switch (cqe->user_data) {
+        case TAG_RECV:
+            if (cqe->res > 0) {
+                ring->bid = (int32_t)(cqe->flags >> IORING_CQE_BUFFER_SHIFT);
+                ring->data = ring->bufs + (size_t)ring->bid * ring->bufSize;
+                ring->avail = (uint32_t)cqe->res;
+                status = AJ_OK;
+            } else if (cqe->res == 0) {
+                AJ_ErrPrintf(("Reap(): connection closed, status=AJ_ERR_READ\n"));
+                status = AJ_ERR_READ;
+            } else if (cqe->res != -ENOBUFS) {
+                /*
+                 * Out of buffers only means the receive is rearmed once a buffer is recycled
+                 */
+                AJ_ErrPrintf(("Reap(): recv failed. errno=\"%s\", status=AJ_ERR_READ\n", strerror(-cqe->res)));
+                status = AJ_ERR_READ;
+            }
+            break;
+
+        case TAG_INTERRUPT:
+            if (read(ring->interruptFd, &u64, sizeof(u64)) < 0) {
+                AJ_ErrPrintf(("Reap(): read() failed during interrupt. errno=\"%s\"\n", strerror(errno)));
+            }
+            status = AJ_ERR_INTERRUPTED;
+            break;
+
+        case TAG_TIMER:
+            if (read(ring->timerFd, &u64, sizeof(u64)) < 0) {
+                AJ_WarnPrintf(("Reap(): read() failed for timer. errno=\"%s\"\n", strerror(errno)));
+            }
+            break;
+        }
+        ++head;
+    }
+    __atomic_store_n(ring->cqHead, head, __ATOMIC_RELEASE);
+    return status;
+}
+
+AJ_Status _AJ_UringRecv(AJ_Uring* ring, uint8_t** data, uint32_t* len, uint32_t timeout)
+{
+    AJ_Status status = AJ_OK;
+    AJ_Time timer;
+    uint32_t elapsed;
+    int ret;
+
+    AJ_InitTimer(&timer);
+    while (!ring->avail) {
+        Recycle(ring);
+        status = Reap(ring);
+        if (status != AJ_ERR_TIMEOUT) {
+            if (status != AJ_OK) {
+                return status;
+            }
+            break;
+        }
+        /*
+         * Armed after reaping since the completions reaped may include a multishot receive
+         * that stopped when it ran out of buffers
+         */
+        Arm(ring);
+        elapsed = AJ_GetElapsedTime(&timer, TRUE);
+        if ((elapsed >= timeout) && !ring->toSubmit) {
+            return AJ_ERR_TIMEOUT;
+        }
+        /*
+         * Rearmed requests are submitted in the same call that waits
+         */
+        ret = Enter(ring, (elapsed < timeout) ? 1 : 0, timeout - min(elapsed, timeout));
+        if ((ret < 0) && (errno != ETIME) && (errno != EINTR) && (errno != EAGAIN) && (errno != EBUSY)) {
+            AJ_ErrPrintf(("_AJ_UringRecv(): io_uring_enter() failed. errno=\"%s\"\n", strerror(errno)));
+            return AJ_ERR_READ;
+        }
+    }
+    *data = ring->data;
+    *len = ring->avail;
+    return AJ_OK;
+}
+
+void _AJ_UringConsume(AJ_Uring* ring, uint32_t len)
+{
+    ring->data += len;
+    ring->avail -= len;
+    /*
+     * A reactor sees the ring fd as readable only while completions are queued so post
+     * one for the data that is left over
+     */
+    if (ring->avail && ring->polled) {
+        GetSqe(ring, IORING_OP_NOP, -1, TAG_NOP);
+        if (Enter(ring, 0, 0) < 0) {
+            AJ_WarnPrintf(("_AJ_UringConsume(): io_uring_enter() failed. errno=\"%s\"\n", strerror(errno)));
+        }
+    }
+}
+
+int _AJ_UringFd(AJ_Uring* ring)
+{
+    ring->polled = TRUE;
+    return ring->fd;
+}
+
+static void Teardown(AJ_Uring* ring)
+{
+    if (ring->fd >= 0) {
+        close(ring->fd);
+    }
+    if (ring->ringMem && (ring->ringMem != MAP_FAILED)) {
+        munmap(ring->ringMem, ring->ringSize);
+    }
+    if (ring->sqes && (ring->sqes != MAP_FAILED)) {
+        munmap(ring->sqes, ring->sqesSize);
+    }
+    if (ring->bufRing && (ring->bufRing != MAP_FAILED)) {
+        munmap(ring->bufRing, ring->bufMemSize);
+    }
+    AJ_Free(ring);
+}
+
+AJ_Uring* _AJ_UringCreate(int sock, int interruptFd, int timerFd, uint32_t bufSize)
+{
+    struct io_uring_params params;
+    struct io_uring_buf_reg reg;
+    AJ_Uring* ring;
+    size_t bufRingSize = (URING_NUM_BUFS * sizeof(struct io_uring_buf) + 4095) & ~(size_t)4095;
+    uint32_t head;
+    uint16_t i;
+
+    ring = (AJ_Uring*)AJ_Malloc(sizeof(AJ_Uring));
+    if (!ring) {
+        return NULL;
+    }
+    memset(ring, 0, sizeof(AJ_Uring));
+    ring->sock = sock;
+    ring->interruptFd = interruptFd;
+    ring->timerFd = timerFd;
+    ring->bufSize = bufSize;
+    ring->bid = -1;
+
+    memset(&params, 0, sizeof(params));
+    params.flags = IORING_SETUP_CQSIZE;
+    params.cq_entries = URING_CQ_ENTRIES;
+    ring->fd = (int)syscall(__NR_io_uring_setup, URING_ENTRIES, &params);
+    if (ring->fd < 0) {
+        AJ_InfoPrintf(("_AJ_UringCreate(): io_uring_setup() failed. errno=\"%s\"\n", strerror(errno)));
+        goto ExitError;
+    }
+    if ((params.features & (IORING_FEAT_SINGLE_MMAP | IORING_FEAT_NODROP | IORING_FEAT_EXT_ARG)) !=
+        (IORING_FEAT_SINGLE_MMAP | IORING_FEAT_NODROP | IORING_FEAT_EXT_ARG)) {
+        AJ_InfoPrintf(("_AJ_UringCreate(): kernel is missing io_uring features 0x%x\n", params.features));
+        goto ExitError;
+    }
+    ring->ringSize = max(params.sq_off.array + params.sq_entries * sizeof(uint32_t),
+                         params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe));
+    ring->ringMem = (uint8_t*)mmap(NULL, ring->ringSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQ_RING);
+    ring->sqesSize = params.sq_entries * sizeof(struct io_uring_sqe);
+    ring->sqes = (struct io_uring_sqe*)mmap(NULL, ring->sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQES);
+    if ((ring->ringMem == MAP_FAILED) || (ring->sqes == MAP_FAILED)) {
+        AJ_ErrPrintf(("_AJ_UringCreate(): mmap() failed. errno=\"%s\"\n", strerror(errno)));
+        goto ExitError;
+    }
+    ring->sqTail = (uint32_t*)(ring->ringMem + params.sq_off.tail);
+    ring->sqMask = *(uint32_t*)(ring->ringMem + params.sq_off.ring_mask);
+    ring->sqArray = (uint32_t*)(ring->ringMem + params.sq_off.array);
+    ring->cqHead = (uint32_t*)(ring->ringMem + params.cq_off.head);
+    ring->cqTail = (uint32_t*)(ring->ringMem + params.cq_off.tail);
+    ring->cqMask = *(uint32_t*)(ring->ringMem + params.cq_off.ring_mask);
+    ring->cqes = (struct io_uring_cqe*)(ring->ringMem + params.cq_off.cqes);
+
+    /*
+     * The buffer ring and the buffers share one page aligned mapping
+     */
+    ring->bufMemSize = bufRingSize + (size_t)URING_NUM_BUFS * bufSize;
+    ring->bufRing = (struct io_uring_buf_ring*)mmap(NULL, ring->bufMemSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (ring->bufRing == MAP_FAILED) {
+        AJ_ErrPrintf(("_AJ_UringCreate(): mmap() failed. errno=\"%s\"\n", strerror(errno)));
+        goto ExitError;
+    }
+    ring->bufs = (uint8_t*)ring->bufRing + bufRingSize;
+    memset(&reg, 0, sizeof(reg));
+    reg.ring_addr = (uint64_t)(uintptr_t)ring->bufRing;
+    reg.ring_entries = URING_NUM_BUFS;
+    reg.bgid = URING_BUF_GROUP;
+    if (syscall(__NR_io_uring_register, ring->fd, IORING_REGISTER_PBUF_RING, &reg, 1) < 0) {
+        AJ_InfoPrintf(("_AJ_UringCreate(): provided buffer rings not supported. errno=\"%s\"\n", strerror(errno)));
+        goto ExitError;
+    }
+    for (i = 0; i < URING_NUM_BUFS; ++i) {
+        AddBuffer(ring, i, i);
+    }
+    __atomic_store_n(&ring->bufRing->tail, URING_NUM_BUFS, __ATOMIC_RELEASE);
+
+    Arm(ring);
+    if (Enter(ring, 0, 0) < 0) {
+        AJ_ErrPrintf(("_AJ_UringCreate(): io_uring_enter() failed. errno=\"%s\"\n", strerror(errno)));
+        goto ExitError;
+    }
+    /*
+     * Kernels without multishot receive or poll fail the request as soon as it is submitted
+     */
+    for (head = *ring->cqHead; head != __atomic_load_n(ring->cqTail, __ATOMIC_ACQUIRE); ++head) {
+        struct io_uring_cqe* cqe = &ring->cqes[head & ring->cqMask];
+        if (cqe->res == -EINVAL) {
+            AJ_InfoPrintf(("_AJ_UringCreate(): multishot requests not supported\n"));
+            goto ExitError;
+        }
+    }
+    AJ_InfoPrintf(("_AJ_UringCreate(): io_uring enabled for socket %d\n", sock));
+    return ring;
+
+ExitError:
+    Teardown(ring);
+    return NULL;
+}
+
+void _AJ_UringDestroy(AJ_Uring* ring)
+{
+    AJ_Time timer;
+
+    /*
+     * Make sure the kernel is done with the receive buffers before they are unmapped
+     */
+    if (ring->armed[TAG_RECV]) {
+        struct io_uring_sqe* sqe = GetSqe(ring, IORING_OP_ASYNC_CANCEL, -1, TAG_CANCEL);
+        sqe->addr = TAG_RECV;
+        AJ_InitTimer(&timer);
+        while (ring->armed[TAG_RECV] && (AJ_GetElapsedTime(&timer, TRUE) < URING_CANCEL_TIMEOUT)) {
+            uint32_t head;
+            Enter(ring, 1, URING_CANCEL_TIMEOUT);
+            for (head = *ring->cqHead; head != __atomic_load_n(ring->cqTail, __ATOMIC_ACQUIRE); ++head) {
+                struct io_uring_cqe* cqe = &ring->cqes[head & ring->cqMask];
+                if ((cqe->user_data == TAG_RECV) && !(cqe->flags & IORING_CQE_F_MORE)) {
+                    ring->armed[TAG_RECV] = FALSE;
+                }
+            }
+            __atomic_store_n(ring->cqHead, head, __ATOMIC_RELEASE);
+        }
+    }
+    Teardown(ring);
+}
+
+#endif // AJ_IO_URING
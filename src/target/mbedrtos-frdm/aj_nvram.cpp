@@ -40,6 +40,14 @@ uint8_t dbgNVRAM = 0;
 
 #define MAX_FNAME_SZ 14
 
+/* Bumped when the entries are removed wholesale, see _AJ_NVRAM_Generation() */
+static uint32_t nvGeneration = 0;
+
+uint32_t _AJ_NVRAM_Generation(void)
+{
+    return nvGeneration;
+}
+
 static void idToString(uint16_t id, char* str)
 {
     sprintf(str, "/sd/%u.ajnv", id);
@@ -375,6 +383,32 @@ size_t AJ_NVRAM_Read(void* ptr, uint16_t size, AJ_NV_DATASET* handle)
     return size;
 }
 
+/*
+ * Deleted entries are removed from the file system, there is nothing to compact
+ */
+uint8_t AJ_NVRAM_CompactStep(void)
+{
+    return FALSE;
+}
+
+/*
+ * Each entry is its own file and is written as it changes, so transactions are not
+ * supported and changes made between begin and commit are not held back
+ */
+AJ_Status AJ_NVRAM_BeginTransaction(void)
+{
+    return AJ_ERR_UNEXPECTED;
+}
+
+AJ_Status AJ_NVRAM_CommitTransaction(void)
+{
+    return AJ_OK;
+}
+
+void AJ_NVRAM_AbortTransaction(void)
+{
+}
+
 AJ_Status AJ_NVRAM_Close(AJ_NV_DATASET* handle)
 {
     if (!handle) {
@@ -411,6 +445,7 @@ void AJ_NVRAM_Clear()
         }
         closedir(dir);
     }
+    ++nvGeneration;
 }
 
 }
@@ -358,7 +358,7 @@ void AJ_Net_Disconnect(AJ_NetSocket* netSock)
 #endif
     } else if (netContext.udpSock != INVALID_SOCKET) {
 #ifdef AJ_ARDP
-        AJ_ARDP_Disconnect(FALSE);
+        AJ_ARDP_Disconnect(&netContext, FALSE);
         shutdown(netContext.udpSock, 0);
         closesocket(netContext.udpSock);
         netContext.udpSock = INVALID_SOCKET;
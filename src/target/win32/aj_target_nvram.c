@@ -23,6 +23,8 @@
  */
 #define AJ_MODULE TARGET_NVRAM
 
+#include <windows.h>
+#include <io.h>
 #include <ajtcl/aj_nvram.h>
 #include <ajtcl/aj_debug.h>
 #include "../../aj_target_nvram.h"
@@ -40,6 +42,9 @@ uint8_t* AJ_NVRAM_BASE_ADDRESS;
 
 extern void AJ_NVRAM_Layout_Print();
 
+/* The file isn't rewritten while a transaction is open */
+static uint8_t nvTransaction = FALSE;
+
 #define NV_FILE "ajtcl.nvram"
 
 const char* nvFile = NV_FILE;
@@ -97,22 +102,67 @@ static AJ_Status _AJ_LoadNVFromFile()
     memset(AJ_NVRAM_BASE_ADDRESS, INVALID_DATA_BYTE, AJ_NVRAM_SIZE);
     fread(AJ_NVRAM_BASE_ADDRESS, AJ_NVRAM_SIZE, 1, f);
     fclose(f);
+    _AJ_NVRAM_Reindex();
     return AJ_OK;
 }
 
+/*
+ * Writes the whole image to a new file and moves it over the old one so a
+ * crash leaves either the old or the new image intact
+ */
 AJ_Status _AJ_StoreNVToFile()
 {
-    FILE* f = fopen(nvFile, "wb");
+    AJ_Status status = AJ_ERR_FAILURE;
+    FILE* f;
+    char* tmp;
+    int ok;
+
+    if (nvTransaction) {
+        return AJ_OK;
+    }
+    tmp = (char*) AJ_Malloc(strlen(nvFile) + sizeof (".tmp"));
+    if (!tmp) {
+        return AJ_ERR_RESOURCES;
+    }
+    strcpy(tmp, nvFile);
+    strcat(tmp, ".tmp");
+    f = fopen(tmp, "wb");
     if (!f) {
+        AJ_AlwaysPrintf(("Error: AJ_StoreNVToFile(\"%s\") failed\n", tmp));
+        goto Exit;
+    }
+
+    ok = (fwrite(AJ_NVRAM_BASE_ADDRESS, AJ_NVRAM_SIZE, 1, f) == 1) && !fflush(f) && !_commit(_fileno(f));
+    if (fclose(f) || !ok || !MoveFileExA(tmp, nvFile, MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH)) {
         AJ_AlwaysPrintf(("Error: AJ_StoreNVToFile(\"%s\") failed\n", nvFile));
-        return AJ_ERR_FAILURE;
+        remove(tmp);
+        goto Exit;
     }
+    status = AJ_OK;
 
-    fwrite(AJ_NVRAM_BASE_ADDRESS, AJ_NVRAM_SIZE, 1, f);
-    fclose(f);
+Exit:
+    AJ_Free(tmp);
+    return status;
+}
+
+AJ_Status _AJ_NVRAM_BeginTransaction(void)
+{
+    nvTransaction = TRUE;
     return AJ_OK;
 }
 
+AJ_Status _AJ_NVRAM_CommitTransaction(void)
+{
+    nvTransaction = FALSE;
+    return _AJ_StoreNVToFile();
+}
+
+void _AJ_NVRAM_AbortTransaction(void)
+{
+    nvTransaction = FALSE;
+    _AJ_LoadNVFromFile();
+}
+
 // Compact the storage by removing invalid entries
 AJ_Status _AJ_CompactNVStorage()
 {
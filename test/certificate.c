@@ -311,6 +311,18 @@ AJ_Status ParseCertificate(X509Certificate* certificate, const char* pem, uint8_
     if (verify) {
         status = AJ_X509SelfVerify(certificate);
         AJ_Printf("Verify: %s\n", AJ_StatusText(status));
+        if (AJ_OK == status) {
+            /* Repeat verification is answered from the cache */
+            status = AJ_X509SelfVerify(certificate);
+            AJ_ASSERT(AJ_OK == status);
+            /* A tampered signature must not be answered from the cache */
+            certificate->signature.r[0] ^= 1;
+            status = AJ_X509SelfVerify(certificate);
+            AJ_ASSERT(AJ_OK != status);
+            certificate->signature.r[0] ^= 1;
+            status = AJ_X509SelfVerify(certificate);
+            AJ_Printf("Cached verify: %s\n", AJ_StatusText(status));
+        }
     }
     if (certificate->der.data) {
         AJ_Free(certificate->der.data);
@@ -0,0 +1,343 @@
+/**
+ * @file
+ */
+/******************************************************************************
+ * Copyright AllSeen Alliance. All rights reserved.
+ *
+ *    Permission to use, copy, modify, and/or distribute this software for any
+ *    purpose with or without fee is hereby granted, provided that the above
+ *    copyright notice and this permission notice appear in all copies.
+ *
+ *    THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ *    WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ *    MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ *    ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ *    WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ *    ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ *    OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ ******************************************************************************/
+
+/*
+ * Exercises the worker pool dispatcher. The service bus attachment is connected over loopback
+ * TCP to a client bus attachment that runs over the raw socket in the same process, so no
+ * routing node is needed. A second connection checks that workers only wake their own bus
+ * attachment.
+ *
+ * Usage: dispatchtest
+ */
+
+#include <stdio.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+
+#include <ajtcl/alljoyn.h>
+#include <ajtcl/aj_net.h>
+#include <ajtcl/aj_dispatch.h>
+#include <ajtcl/aj_debug.h>
+
+#define CHECK(cond, what) \
+    do { \
+        if (!(cond)) { \
+            AJ_AlwaysPrintf(("FAILED: %s\n", what)); \
+            return 1; \
+        } \
+        AJ_AlwaysPrintf(("ok: %s\n", what)); \
+    } while (0)
+
+static const char* const testInterface[] = {
+    "org.alljoyn.test.dispatch",
+    "?Work in<u out>u",
+    "!Notify in>u",
+    NULL
+};
+
+static const AJ_InterfaceDescription testInterfaces[] = {
+    testInterface,
+    NULL
+};
+
+static const AJ_Object AppObjects[] = {
+    { "/org/alljoyn/test/a", testInterfaces },
+    { "/org/alljoyn/test/b", testInterfaces },
+    { NULL }
+};
+
+#define WORK_A   AJ_APP_MESSAGE_ID(0, 0, 0)
+#define WORK_B   AJ_APP_MESSAGE_ID(1, 0, 0)
+#define NOTIFY_B AJ_APP_MESSAGE_ID(1, 0, 1)
+
+#define SLOW_WORK 300
+#define FAST_WORK 20
+#define FAIL_WORK 99
+
+typedef struct {
+    uint32_t msgId;
+    uint32_t in;
+} TestWork;
+
+static AJ_BusAttachment client;
+static AJ_BusAttachment service;
+static AJ_BusAttachment bystander;
+static int clientSock = -1;
+
+static pthread_mutex_t runLock = PTHREAD_MUTEX_INITIALIZER;
+static uint32_t runOrder[16];
+static uint32_t runCount = 0;
+static uint32_t completed = 0;
+static uint32_t discarded = 0;
+
+static AJ_Status ClientSend(AJ_IOBuffer* buf)
+{
+    while (AJ_IO_BUF_AVAIL(buf)) {
+        ssize_t n = send(clientSock, buf->readPtr, AJ_IO_BUF_AVAIL(buf), 0);
+        if (n <= 0) {
+            return AJ_ERR_WRITE;
+        }
+        buf->readPtr += n;
+    }
+    AJ_IO_BUF_RESET(buf);
+    return AJ_OK;
+}
+
+static AJ_Status ClientRecv(AJ_IOBuffer* buf, uint32_t len, uint32_t timeout)
+{
+    struct timeval tv;
+    ssize_t n;
+
+    tv.tv_sec = timeout / 1000;
+    tv.tv_usec = (timeout % 1000) * 1000;
+    setsockopt(clientSock, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    n = recv(clientSock, buf->writePtr, min(len, AJ_IO_BUF_SPACE(buf)), 0);
+    if (n <= 0) {
+        return AJ_ERR_TIMEOUT;
+    }
+    buf->writePtr += n;
+    return AJ_OK;
+}
+
+static AJ_Status UnmarshalWork(AJ_Message* msg, void** work)
+{
+    TestWork* w = (TestWork*)AJ_Malloc(sizeof(TestWork));
+
+    if (!w) {
+        return AJ_ERR_RESOURCES;
+    }
+    w->msgId = msg->msgId;
+    *work = w;
+    return AJ_UnmarshalArgs(msg, "u", &w->in);
+}
+
+static AJ_Status RunWork(void* work)
+{
+    TestWork* w = (TestWork*)work;
+
+    AJ_Sleep((w->msgId == WORK_A) ? SLOW_WORK : FAST_WORK);
+    pthread_mutex_lock(&runLock);
+    runOrder[runCount++] = w->in;
+    pthread_mutex_unlock(&runLock);
+    return (w->in == FAIL_WORK) ? AJ_ERR_INVALID : AJ_OK;
+}
+
+static AJ_Status CompleteWork(AJ_MsgReplyContext* replyCtx, void* work, AJ_Status status)
+{
+    TestWork* w = (TestWork*)work;
+    AJ_Message reply;
+
+    if (!replyCtx->msgId) {
+        ++discarded;
+    } else {
+        ++completed;
+        if (status == AJ_OK) {
+            status = AJ_MarshalReplyMsgAsync(replyCtx, &reply);
+            if (status == AJ_OK) {
+                status = AJ_MarshalArgs(&reply, "u", w->in * 10);
+            }
+        } else {
+            status = AJ_MarshalStatusMsgAsync(replyCtx, &reply, status);
+        }
+        if (status == AJ_OK) {
+            status = AJ_DeliverMsg(&reply);
+        }
+    }
+    AJ_Free(w);
+    return status;
+}
+
+static const AJ_DispatchHandler handlers[] = {
+    { WORK_A, UnmarshalWork, RunWork, CompleteWork },
+    { WORK_B, UnmarshalWork, RunWork, CompleteWork },
+    { NOTIFY_B, UnmarshalWork, RunWork, CompleteWork },
+    { 0 }
+};
+
+/*
+ * Waits on the other connection while work completes, it must not be woken
+ */
+static void* Bystander(void* arg)
+{
+    AJ_Status* status = (AJ_Status*)arg;
+
+    AJ_IO_BUF_RESET(&bystander.sock.rx);
+    *status = bystander.sock.rx.recv(&bystander.sock.rx, 1, 1000);
+    return NULL;
+}
+
+static int Connect(AJ_BusAttachment* bus, int* peer)
+{
+    struct sockaddr_in addr;
+    socklen_t len = sizeof(addr);
+    AJ_Service svc;
+    AJ_Status status;
+    int listener;
+
+    listener = socket(AF_INET, SOCK_STREAM, 0);
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if ((listener < 0) || bind(listener, (struct sockaddr*)&addr, sizeof(addr)) || listen(listener, 1) ||
+        getsockname(listener, (struct sockaddr*)&addr, &len)) {
+        return FALSE;
+    }
+    memset(bus, 0, sizeof(AJ_BusAttachment));
+    memset(&svc, 0, sizeof(svc));
+    svc.addrTypes = AJ_ADDR_TCP4;
+    svc.ipv4 = addr.sin_addr.s_addr;
+    svc.ipv4port = ntohs(addr.sin_port);
+    status = AJ_Net_Connect(bus, &svc);
+    if (status == AJ_OK) {
+        *peer = accept(listener, NULL, NULL);
+    }
+    close(listener);
+    return (status == AJ_OK) && (*peer >= 0);
+}
+
+static void SendCall(uint32_t msgId, uint32_t in)
+{
+    AJ_Message msg;
+
+    if (msgId == NOTIFY_B) {
+        AJ_MarshalSignal(&client, &msg, msgId, service.uniqueName, 0, 0, 0);
+    } else {
+        AJ_MarshalMethodCall(&client, &msg, msgId, service.uniqueName, 0, 0, 5000);
+    }
+    AJ_MarshalArgs(&msg, "u", in);
+    AJ_DeliverMsg(&msg);
+}
+
+int AJ_Main(void)
+{
+    static uint8_t clientRx[4096];
+    static uint8_t clientTx[4096];
+    AJ_Dispatcher* dispatcher;
+    AJ_Message msg;
+    AJ_Status status;
+    AJ_Status bystanderStatus = AJ_OK;
+    AJ_Time timer;
+    pthread_t thread;
+    uint32_t dispatched = 0;
+    uint32_t interrupted = 0;
+    uint32_t replies = 0;
+    uint32_t errors = 0;
+    uint32_t firstReply = 0;
+    uint32_t i;
+    int bystanderPeer = -1;
+    int pos[FAIL_WORK + 1];
+
+    AJ_Initialize();
+    AJ_RegisterObjects(AppObjects, NULL);
+    CHECK(Connect(&service, &clientSock), "connect service");
+    CHECK(Connect(&bystander, &bystanderPeer), "connect second bus attachment");
+    strcpy(service.uniqueName, ":service.1");
+    strcpy(client.uniqueName, ":client.1");
+    AJ_IOBufInit(&client.sock.rx, clientRx, sizeof(clientRx), AJ_IO_BUF_RX, NULL);
+    client.sock.rx.recv = ClientRecv;
+    AJ_IOBufInit(&client.sock.tx, clientTx, sizeof(clientTx), AJ_IO_BUF_TX, NULL);
+    client.sock.tx.send = ClientSend;
+
+    CHECK(AJ_CreateDispatcher(&service, handlers, 0) == NULL, "no workers rejected");
+    dispatcher = AJ_CreateDispatcher(&service, handlers, 3);
+    CHECK(dispatcher != NULL, "create");
+
+    /*
+     * Two slow calls on one object, two fast calls and a signal on another
+     */
+    SendCall(WORK_A, 1);
+    SendCall(WORK_A, 2);
+    SendCall(WORK_B, 3);
+    SendCall(WORK_B, FAIL_WORK);
+    SendCall(NOTIFY_B, 5);
+    pthread_create(&thread, NULL, Bystander, &bystanderStatus);
+    AJ_InitTimer(&timer);
+    while (AJ_GetElapsedTime(&timer, TRUE) < 3 * SLOW_WORK) {
+        status = AJ_UnmarshalMsg(&service, &msg, 3 * SLOW_WORK);
+        if (status == AJ_OK) {
+            if (AJ_DispatchMsg(dispatcher, &msg) == AJ_OK) {
+                ++dispatched;
+            } else {
+                AJ_CloseMsg(&msg);
+            }
+        } else if (status == AJ_ERR_INTERRUPTED) {
+            ++interrupted;
+        }
+        AJ_DispatchCompletions(dispatcher);
+        if (completed && !firstReply) {
+            firstReply = AJ_GetElapsedTime(&timer, TRUE);
+        }
+    }
+    pthread_join(thread, NULL);
+    CHECK(dispatched == 5, "all messages dispatched");
+    CHECK(runCount == 5, "all work ran");
+    for (i = 0; i < runCount; ++i) {
+        pos[runOrder[i]] = i;
+    }
+    CHECK(pos[1] < pos[2], "work for one object runs in order");
+    CHECK(pos[3] < pos[1], "other objects are not held up by a slow one");
+    CHECK(interrupted && (firstReply < SLOW_WORK), "bus thread woken when work completes");
+    CHECK(bystanderStatus == AJ_ERR_TIMEOUT, "other bus attachments are not woken");
+
+    while (AJ_UnmarshalMsg(&client, &msg, 200) == AJ_OK) {
+        if (msg.hdr->msgType == AJ_MSG_METHOD_RET) {
+            uint32_t out = 0;
+            AJ_UnmarshalArgs(&msg, "u", &out);
+            if ((out == 10) || (out == 20) || (out == 30)) {
+                ++replies;
+            }
+        } else if (msg.hdr->msgType == AJ_MSG_ERROR) {
+            ++errors;
+        }
+        AJ_CloseMsg(&msg);
+    }
+    CHECK((replies == 3) && (errors == 1), "method calls answered, signal not");
+
+    /*
+     * Work still queued when the dispatcher is destroyed is released without a reply
+     */
+    completed = 0;
+    discarded = 0;
+    SendCall(WORK_A, 7);
+    SendCall(WORK_A, 8);
+    for (i = 0; i < 2; ++i) {
+        if (AJ_UnmarshalMsg(&service, &msg, 500) == AJ_OK) {
+            AJ_DispatchMsg(dispatcher, &msg);
+        }
+    }
+    AJ_Sleep(FAST_WORK);
+    AJ_DestroyDispatcher(dispatcher);
+    CHECK(!completed && (discarded == 2), "queued work released on destroy");
+
+    AJ_Net_Disconnect(&service.sock);
+    AJ_Net_Disconnect(&bystander.sock);
+    close(clientSock);
+    close(bystanderPeer);
+    AJ_AlwaysPrintf(("dispatchtest passed\n"));
+    return 0;
+}
+
+#ifdef AJ_MAIN
+int main()
+{
+    return AJ_Main();
+}
+#endif
@@ -0,0 +1,275 @@
+/**
+ * @file
+ */
+/******************************************************************************
+ * Copyright AllSeen Alliance. All rights reserved.
+ *
+ *    Permission to use, copy, modify, and/or distribute this software for any
+ *    purpose with or without fee is hereby granted, provided that the above
+ *    copyright notice and this permission notice appear in all copies.
+ *
+ *    THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ *    WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ *    MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ *    ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ *    WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ *    ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ *    OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ ******************************************************************************/
+
+/*
+ * Exercises the I/O thread over a loopback TCP connection. The test stands in for the routing
+ * node on the other end of the socket, so no routing node is needed.
+ *
+ * Usage: iothreadtest
+ */
+
+#include <stdio.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+
+#include <ajtcl/alljoyn.h>
+#include <ajtcl/aj_net.h>
+#include <ajtcl/aj_connect.h>
+#include <ajtcl/aj_msg_priv.h>
+#include <ajtcl/aj_debug.h>
+
+#define MSG_SIZE     24
+#define STREAM_SIZE  150000
+#define LARGE_SIZE   50000
+#define SENDERS      4
+#define SENDS        2000
+
+#define CHECK(cond, what) \
+    do { \
+        if (!(cond)) { \
+            AJ_AlwaysPrintf(("FAILED: %s\n", what)); \
+            return 1; \
+        } \
+        AJ_AlwaysPrintf(("ok: %s\n", what)); \
+    } while (0)
+
+static AJ_BusAttachment bus;
+static int peer = -1;
+static uint8_t out[STREAM_SIZE + LARGE_SIZE];
+static uint8_t in[STREAM_SIZE + LARGE_SIZE];
+
+static void PeerSend(const uint8_t* data, size_t len)
+{
+    while (len) {
+        ssize_t n = send(peer, data, len, 0);
+        if (n <= 0) {
+            return;
+        }
+        data += n;
+        len -= n;
+    }
+}
+
+static int PeerRecv(uint8_t* data, size_t len)
+{
+    while (len) {
+        ssize_t n = recv(peer, data, len, 0);
+        if (n <= 0) {
+            return FALSE;
+        }
+        data += n;
+        len -= n;
+    }
+    return TRUE;
+}
+
+/*
+ * Fill a run of messages with no header fields and an 8 byte body
+ */
+static void FillMessages(uint8_t* data, uint32_t len)
+{
+    uint32_t i;
+
+    for (i = 0; i + MSG_SIZE <= len; i += MSG_SIZE) {
+        AJ_MsgHeader* hdr = (AJ_MsgHeader*)(data + i);
+        memset(data + i, (uint8_t)(i / MSG_SIZE), MSG_SIZE);
+        hdr->endianess = HOST_ENDIANESS;
+        hdr->headerLen = 0;
+        hdr->bodyLen = MSG_SIZE - sizeof(AJ_MsgHeader);
+    }
+}
+
+static void* Sender(void* arg)
+{
+    uint8_t id = (uint8_t)(size_t)arg;
+    uint8_t data[4];
+    AJ_IOBuffer buf;
+    uint32_t i;
+
+    for (i = 0; i < SENDS; ++i) {
+        AJ_IOBufInit(&buf, data, sizeof(data), AJ_IO_BUF_TX, bus.sock.tx.context);
+        buf.send = bus.sock.tx.send;
+        data[0] = id;
+        data[1] = (uint8_t)i;
+        data[2] = (uint8_t)(i >> 8);
+        data[3] = 0xAA;
+        buf.writePtr += sizeof(data);
+        if (buf.send(&buf) != AJ_OK) {
+            break;
+        }
+    }
+    return NULL;
+}
+
+static void* Interrupter(void* arg)
+{
+    AJ_Sleep(100);
+    AJ_Net_Interrupt();
+    return NULL;
+}
+
+static int Connect(void)
+{
+    struct sockaddr_in addr;
+    socklen_t len = sizeof(addr);
+    AJ_Service service;
+    AJ_Status status;
+    int listener;
+
+    listener = socket(AF_INET, SOCK_STREAM, 0);
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if ((listener < 0) || bind(listener, (struct sockaddr*)&addr, sizeof(addr)) || listen(listener, 1) ||
+        getsockname(listener, (struct sockaddr*)&addr, &len)) {
+        return FALSE;
+    }
+    memset(&bus, 0, sizeof(bus));
+    memset(&service, 0, sizeof(service));
+    service.addrTypes = AJ_ADDR_TCP4;
+    service.ipv4 = addr.sin_addr.s_addr;
+    service.ipv4port = ntohs(addr.sin_port);
+    status = AJ_Net_Connect(&bus, &service);
+    if (status == AJ_OK) {
+        peer = accept(listener, NULL, NULL);
+    }
+    close(listener);
+    return (status == AJ_OK) && (peer >= 0);
+}
+
+int AJ_Main(void)
+{
+    AJ_IOBuffer* rx = &bus.sock.rx;
+    AJ_Status status;
+    AJ_Time timer;
+    pthread_t threads[SENDERS];
+    uint16_t next[SENDERS] = { 0 };
+    uint32_t got = 0;
+    uint32_t len;
+    uint32_t i;
+    int ordered = TRUE;
+
+    AJ_Initialize();
+    CHECK(Connect(), "connect over loopback");
+    CHECK(AJ_StartIOThread(&bus) == AJ_OK, "start");
+    CHECK(AJ_StartIOThread(&bus) == AJ_ERR_DISALLOWED, "start twice");
+
+    /*
+     * Small messages followed by one too large for the receive buffer, sent before the
+     * application reads any of them
+     */
+    FillMessages(out, STREAM_SIZE);
+    for (i = STREAM_SIZE; i < sizeof(out); ++i) {
+        out[i] = (uint8_t)(i * 7);
+    }
+    ((AJ_MsgHeader*)(out + STREAM_SIZE))->endianess = HOST_ENDIANESS;
+    ((AJ_MsgHeader*)(out + STREAM_SIZE))->headerLen = 0;
+    ((AJ_MsgHeader*)(out + STREAM_SIZE))->bodyLen = LARGE_SIZE - sizeof(AJ_MsgHeader);
+    PeerSend(out, sizeof(out));
+    AJ_Sleep(200);
+    while (got < sizeof(out)) {
+        AJ_IO_BUF_RESET(rx);
+        status = rx->recv(rx, AJ_IO_BUF_SPACE(rx), 1000);
+        if (status != AJ_OK) {
+            break;
+        }
+        memcpy(in + got, rx->readPtr, AJ_IO_BUF_AVAIL(rx));
+        got += AJ_IO_BUF_AVAIL(rx);
+    }
+    CHECK((got == sizeof(out)) && !memcmp(in, out, sizeof(out)), "inbound stream intact");
+    AJ_IO_BUF_RESET(rx);
+    CHECK(rx->recv(rx, MSG_SIZE, 100) == AJ_ERR_TIMEOUT, "receive times out when idle");
+
+    /*
+     * A receive waiting on the I/O thread is woken by AJ_Net_Interrupt()
+     */
+    pthread_create(&threads[0], NULL, Interrupter, NULL);
+    AJ_InitTimer(&timer);
+    status = rx->recv(rx, MSG_SIZE, 5000);
+    pthread_join(threads[0], NULL);
+    CHECK((status == AJ_ERR_INTERRUPTED) && (AJ_GetElapsedTime(&timer, TRUE) < 5000), "interrupted receive");
+    CHECK(rx->recv(rx, MSG_SIZE, 100) == AJ_ERR_TIMEOUT, "interrupt is not latched");
+
+    /*
+     * Sends from several threads arrive whole and in order per thread
+     */
+    for (i = 0; i < SENDERS; ++i) {
+        pthread_create(&threads[i], NULL, Sender, (void*)(size_t)i);
+    }
+    for (i = 0; i < SENDERS; ++i) {
+        pthread_join(threads[i], NULL);
+    }
+    CHECK(PeerRecv(in, SENDERS * SENDS * 4), "outbound received");
+    for (i = 0; i < SENDERS * SENDS; ++i) {
+        uint8_t* p = in + i * 4;
+        if ((p[3] != 0xAA) || (p[0] >= SENDERS) || ((p[1] | (p[2] << 8)) != next[p[0]])) {
+            ordered = FALSE;
+            break;
+        }
+        next[p[0]]++;
+    }
+    CHECK(ordered, "outbound in order per thread");
+
+    /*
+     * Stopping hands back everything received and not consumed, including part of a message,
+     * and refuses to stop if the receive buffer can't hold it
+     */
+    len = (3 * AJ_RX_DATA_SIZE / 2) - (3 * AJ_RX_DATA_SIZE / 2) % MSG_SIZE;
+    FillMessages(out, len + MSG_SIZE);
+    PeerSend(out, len + MSG_SIZE / 2);
+    AJ_Sleep(200);
+    CHECK(AJ_StopIOThread(&bus) == AJ_ERR_RESOURCES, "stop refused while data doesn't fit");
+    CHECK(rx->recv != AJ_Net_Recv, "still running");
+    CHECK(AJ_BusSetBufferSizes(&bus, 0, 0, 4 * AJ_RX_DATA_SIZE) == AJ_OK, "raise buffer maximum");
+    CHECK(AJ_StopIOThread(&bus) == AJ_OK, "stop");
+    CHECK(rx->recv == AJ_Net_Recv, "transport handed back");
+    CHECK((AJ_IO_BUF_AVAIL(rx) == len + MSG_SIZE / 2) && !memcmp(rx->readPtr, out, len + MSG_SIZE / 2), "unconsumed data kept");
+    PeerSend(out + len + MSG_SIZE / 2, MSG_SIZE / 2);
+    status = rx->recv(rx, MSG_SIZE / 2, 1000);
+    CHECK((status == AJ_OK) && !memcmp(rx->readPtr, out, len + MSG_SIZE), "stream continues after stop");
+
+    /*
+     * Restart, the data left in the receive buffer is handed to the thread, then lose the peer
+     */
+    CHECK(AJ_StartIOThread(&bus) == AJ_OK, "restart");
+    close(peer);
+    got = 0;
+    do {
+        AJ_IO_BUF_RESET(rx);
+        status = rx->recv(rx, AJ_IO_BUF_SPACE(rx), 1000);
+        if (status == AJ_OK) {
+            got += AJ_IO_BUF_AVAIL(rx);
+        }
+    } while (status == AJ_OK);
+    CHECK(got == len + MSG_SIZE, "unconsumed data carried over on restart");
+    CHECK(status != AJ_ERR_TIMEOUT, "peer close reported");
+    AJ_Net_Disconnect(&bus.sock);
+    CHECK(bus.sock.rx.recv == NULL, "disconnected");
+    AJ_AlwaysPrintf(("iothreadtest passed\n"));
+    return 0;
+}
+
+#ifdef AJ_MAIN
+int main()
+{
+    return AJ_Main();
+}
+#endif
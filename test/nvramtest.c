@@ -30,6 +30,8 @@ uint8_t dbgNVT = 0;
 
 AJ_Status TestNVRAM();
 AJ_Status TestCreds();
+AJ_Status TestTransaction();
+AJ_Status TestCompaction();
 extern void AJ_NVRAM_Layout_Print();
 
 static uint16_t tid1 = 15;
@@ -97,6 +99,7 @@ AJ_Status TestCreds()
     AJ_CredField id;
     AJ_CredField data;
     int i = 0;
+    uint16_t slot;
     AJ_GUID peerGuid;
     uint8_t secretLen = 24;
     uint8_t secret[24];
@@ -125,6 +128,12 @@ AJ_Status TestCreds()
         status = AJ_CredentialSet(AJ_CRED_TYPE_GENERIC, &id, (uint32_t) i, &data);
         AJ_ASSERT(AJ_OK == status);
     }
+    /* The newest credential is kept and the oldest was evicted */
+    status = AJ_CredentialGet(AJ_CRED_TYPE_GENERIC, &id, &exp, NULL);
+    AJ_ASSERT((AJ_OK == status) && (exp == (uint32_t) (i - 1)));
+    id.data[0] = 0;
+    status = AJ_CredentialGet(AJ_CRED_TYPE_GENERIC, &id, NULL, NULL);
+    AJ_ASSERT(AJ_ERR_UNKNOWN == status);
 
     AJ_InfoPrintf(("TestCreds() Layout Print\n"));
     AJ_NVRAM_Layout_Print();
@@ -174,6 +183,29 @@ AJ_Status TestCreds()
         return AJ_ERR_FAILURE;
     }
 
+    /* Peer secrets may only be in RAM until flushed */
+    AJ_CredentialFlushPeers();
+    id.data = (uint8_t*) &remoteGuid;
+    id.size = sizeof (remoteGuid);
+    if (AJ_OK != AJ_CredentialGet(AJ_GENERIC_MASTER_SECRET | AJ_CRED_TYPE_GENERIC, &id, NULL, NULL)) {
+        AJ_AlwaysPrintf(("AJ_CredentialFlushPeers did not write secret\n"));
+        AJ_CredFieldFree(&data);
+        return AJ_ERR_FAILURE;
+    }
+
+    /* Deleting the slot directly must not leave the secret cached */
+    slot = 0;
+    if (AJ_OK != AJ_CredentialGetNext(AJ_GENERIC_MASTER_SECRET | AJ_CRED_TYPE_GENERIC, &id, NULL, NULL, &slot)) {
+        AJ_CredFieldFree(&data);
+        return AJ_ERR_FAILURE;
+    }
+    AJ_CredentialDeleteSlot(AJ_CRED_TYPE_GENERIC, slot);
+    if (AJ_ERR_UNKNOWN != AJ_CredentialGetPeer(AJ_GENERIC_MASTER_SECRET, &remoteGuid, NULL, NULL)) {
+        AJ_AlwaysPrintf(("AJ_CredentialDeleteSlot left secret cached\n"));
+        AJ_CredFieldFree(&data);
+        return AJ_ERR_FAILURE;
+    }
+
     AJ_CredentialDeletePeer(&remoteGuid);
     AJ_CredFieldFree(&data);
     if (AJ_ERR_UNKNOWN == AJ_CredentialGetPeer(AJ_GENERIC_MASTER_SECRET, &remoteGuid, NULL, NULL)) {
@@ -190,6 +222,20 @@ AJ_Status TestCreds()
     } else {
         return AJ_ERR_FAILURE;
     }
+
+    /* Clearing NVRAM must not leave a cached secret behind or let a flush write it back */
+    status = AJ_CredentialSetPeer(AJ_GENERIC_MASTER_SECRET, &remoteGuid, expiration, secret, secretLen);
+    AJ_ASSERT(AJ_OK == status);
+    AJ_NVRAM_Clear();
+    if (AJ_ERR_UNKNOWN != AJ_CredentialGetPeer(AJ_GENERIC_MASTER_SECRET, &remoteGuid, NULL, NULL)) {
+        AJ_AlwaysPrintf(("AJ_NVRAM_Clear left secret cached\n"));
+        return AJ_ERR_FAILURE;
+    }
+    AJ_CredentialFlushPeers();
+    if (AJ_ERR_UNKNOWN != AJ_CredentialGet(AJ_GENERIC_MASTER_SECRET | AJ_CRED_TYPE_GENERIC, &id, NULL, NULL)) {
+        AJ_AlwaysPrintf(("AJ_CredentialFlushPeers wrote back a cleared secret\n"));
+        return AJ_ERR_FAILURE;
+    }
     AJ_InfoPrintf(("TestCreds() Layout Print\n"));
     AJ_NVRAM_Layout_Print();
     AJ_AlwaysPrintf(("TestCreds done.\n"));
@@ -236,6 +282,193 @@ AJ_Status TestExist()
 }
 
 
+static uint32_t TransactionValue(uint16_t id)
+{
+    uint32_t value = 0;
+    AJ_NV_DATASET* handle = AJ_NVRAM_Open(id, "r", 0);
+
+    if (handle) {
+        AJ_NVRAM_Read(&value, sizeof (value), handle);
+        AJ_NVRAM_Close(handle);
+    }
+    return value;
+}
+
+static AJ_Status TransactionWrite(uint16_t id, uint32_t value)
+{
+    AJ_Status status = AJ_ERR_FAILURE;
+    AJ_NV_DATASET* handle = AJ_NVRAM_Open(id, "w", sizeof (value));
+
+    if (handle) {
+        if (sizeof (value) == AJ_NVRAM_Write(&value, sizeof (value), handle)) {
+            status = AJ_OK;
+        }
+        AJ_NVRAM_Close(handle);
+    }
+    return status;
+}
+
+AJ_Status TestTransaction()
+{
+    AJ_Status status;
+    uint16_t id = AJ_NVRAM_ID_APPS_BEGIN + 1;
+
+    status = TransactionWrite(id, 1);
+    if (AJ_OK != status) {
+        return status;
+    }
+    if (AJ_OK != AJ_NVRAM_BeginTransaction()) {
+        AJ_AlwaysPrintf(("NVRAM transactions not supported\n"));
+        return AJ_NVRAM_Delete(id);
+    }
+    /* An aborted transaction leaves the old value */
+    TransactionWrite(id, 2);
+    TransactionWrite(id + 1, 2);
+    AJ_NVRAM_AbortTransaction();
+    if ((1 != TransactionValue(id)) || AJ_NVRAM_Exist(id + 1)) {
+        AJ_AlwaysPrintf(("AJ_NVRAM_AbortTransaction did not roll back\n"));
+        return AJ_ERR_FAILURE;
+    }
+    /* Only the outermost commit counts */
+    AJ_NVRAM_BeginTransaction();
+    AJ_NVRAM_BeginTransaction();
+    TransactionWrite(id, 3);
+    status = AJ_NVRAM_CommitTransaction();
+    if (AJ_OK == status) {
+        status = AJ_NVRAM_CommitTransaction();
+    }
+    if ((AJ_OK != status) || (3 != TransactionValue(id))) {
+        AJ_AlwaysPrintf(("AJ_NVRAM_CommitTransaction failed\n"));
+        return AJ_ERR_FAILURE;
+    }
+    /* An inner abort fails the outer commit */
+    AJ_NVRAM_BeginTransaction();
+    AJ_NVRAM_BeginTransaction();
+    TransactionWrite(id, 4);
+    AJ_NVRAM_AbortTransaction();
+    if ((AJ_ERR_FAILURE != AJ_NVRAM_CommitTransaction()) || (3 != TransactionValue(id))) {
+        AJ_AlwaysPrintf(("Nested AJ_NVRAM_AbortTransaction failed\n"));
+        return AJ_ERR_FAILURE;
+    }
+    /* Changes made after an inner abort are discarded with the outer transaction */
+    AJ_NVRAM_BeginTransaction();
+    AJ_NVRAM_BeginTransaction();
+    AJ_NVRAM_AbortTransaction();
+    TransactionWrite(id, 5);
+    if ((AJ_ERR_FAILURE != AJ_NVRAM_CommitTransaction()) || (3 != TransactionValue(id))) {
+        AJ_AlwaysPrintf(("Write after nested AJ_NVRAM_AbortTransaction was kept\n"));
+        return AJ_ERR_FAILURE;
+    }
+    /* Aborting both levels leaves no transaction behind */
+    AJ_NVRAM_BeginTransaction();
+    AJ_NVRAM_BeginTransaction();
+    AJ_NVRAM_AbortTransaction();
+    AJ_NVRAM_AbortTransaction();
+    AJ_NVRAM_BeginTransaction();
+    TransactionWrite(id, 6);
+    if ((AJ_OK != AJ_NVRAM_CommitTransaction()) || (6 != TransactionValue(id))) {
+        AJ_AlwaysPrintf(("AJ_NVRAM_CommitTransaction failed after nested aborts\n"));
+        return AJ_ERR_FAILURE;
+    }
+    return AJ_NVRAM_Delete(id);
+}
+
+#define COMPACTION_DATA_SIZE 60
+
+static AJ_Status CompactionWrite(uint16_t id)
+{
+    AJ_Status status = AJ_ERR_FAILURE;
+    uint8_t data[COMPACTION_DATA_SIZE];
+    AJ_NV_DATASET* handle = AJ_NVRAM_Open(id, "w", sizeof (data));
+
+    memset(data, (uint8_t) id, sizeof (data));
+    if (handle) {
+        if (sizeof (data) == AJ_NVRAM_Write(data, sizeof (data), handle)) {
+            status = AJ_OK;
+        }
+        AJ_NVRAM_Close(handle);
+    }
+    return status;
+}
+
+/*
+ * Odd data sets must hold their own id, even ones must be gone
+ */
+static AJ_Status CompactionCheck(uint16_t id, uint16_t sets)
+{
+    uint8_t data[COMPACTION_DATA_SIZE];
+    uint8_t expect[COMPACTION_DATA_SIZE];
+    AJ_NV_DATASET* handle;
+    uint16_t i;
+
+    for (i = 0; i < sets; i++) {
+        if (!(i & 1)) {
+            if (AJ_NVRAM_Exist(id + i)) {
+                AJ_AlwaysPrintf(("AJ_NVRAM_CompactStep revived data set %u\n", id + i));
+                return AJ_ERR_FAILURE;
+            }
+            continue;
+        }
+        memset(data, 0, sizeof (data));
+        memset(expect, (uint8_t) (id + i), sizeof (expect));
+        handle = AJ_NVRAM_Open(id + i, "r", 0);
+        if (handle) {
+            AJ_NVRAM_Read(data, sizeof (data), handle);
+            AJ_NVRAM_Close(handle);
+        }
+        if (memcmp(data, expect, sizeof (data))) {
+            AJ_AlwaysPrintf(("AJ_NVRAM_CompactStep lost data set %u\n", id + i));
+            return AJ_ERR_FAILURE;
+        }
+    }
+    return AJ_OK;
+}
+
+AJ_Status TestCompaction()
+{
+    AJ_Status status = AJ_OK;
+    uint16_t id = AJ_NVRAM_ID_APPS_BEGIN + 16;
+    uint16_t sets = AJ_NVRAM_COMPACT_THRESHOLD / COMPACTION_DATA_SIZE + 2;
+    uint32_t steps = 0;
+    uint32_t used;
+    uint16_t i;
+
+    /* Interleave live and deleted data sets until compaction kicks in */
+    for (i = 0; (AJ_OK == status) && (i < 2 * sets); i++) {
+        status = CompactionWrite(id + i);
+    }
+    for (i = 0; (AJ_OK == status) && (i < 2 * sets); i += 2) {
+        status = AJ_NVRAM_Delete(id + i);
+    }
+    if (AJ_OK != status) {
+        return status;
+    }
+    used = AJ_NVRAM_GetSize();
+    while (AJ_NVRAM_CompactStep()) {
+        ++steps;
+        status = CompactionCheck(id, 2 * sets);
+        if (AJ_OK != status) {
+            return status;
+        }
+    }
+    AJ_InfoPrintf(("TestCompaction(): %u steps, size %u\n", steps, used));
+    if (!steps) {
+        AJ_AlwaysPrintf(("AJ_NVRAM_CompactStep did not run\n"));
+        return AJ_ERR_FAILURE;
+    }
+    if (used != AJ_NVRAM_GetSize()) {
+        AJ_AlwaysPrintf(("AJ_NVRAM_CompactStep changed the used size\n"));
+        return AJ_ERR_FAILURE;
+    }
+    /* The compacted layout must also be what was stored */
+    AJ_NVRAM_Init();
+    status = CompactionCheck(id, 2 * sets);
+    for (i = 1; (AJ_OK == status) && (i < 2 * sets); i += 2) {
+        status = AJ_NVRAM_Delete(id + i);
+    }
+    return status;
+}
+
 AJ_Status TestObsWrite()
 {
     AJ_Status status = AJ_OK;
@@ -917,6 +1150,14 @@ int AJ_Main()
         AJ_InfoPrintf(("\nNVRAM Big Write STATUS %u\n", status));
         AJ_ASSERT(status == AJ_OK);
 
+        status = TestTransaction();
+        AJ_InfoPrintf(("\nNVRAM Transaction STATUS %u\n", status));
+        AJ_ASSERT(status == AJ_OK);
+
+        status = TestCompaction();
+        AJ_InfoPrintf(("\nNVRAM Compaction STATUS %u\n", status));
+        AJ_ASSERT(status == AJ_OK);
+
     }
     return 0;
 }
@@ -0,0 +1,299 @@
+/**
+ * @file
+ */
+/******************************************************************************
+ * Copyright AllSeen Alliance. All rights reserved.
+ *
+ *    Permission to use, copy, modify, and/or distribute this software for any
+ *    purpose with or without fee is hereby granted, provided that the above
+ *    copyright notice and this permission notice appear in all copies.
+ *
+ *    THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ *    WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ *    MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ *    ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ *    WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ *    ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ *    OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ ******************************************************************************/
+
+/*
+ * Exercises peer authentication handshakes. Several bus attachments run in the same process
+ * and messages are routed between them in memory by destination, so no routing node is
+ * needed. Handshake slots and the name map are shared by every bus attachment in the
+ * process, so each pair of client and server bus attachments only runs one handshake and a
+ * server side handshake takes a slot just like a client side one.
+ *
+ * Usage: peerauthtest
+ */
+
+#include <stdio.h>
+
+#include <ajtcl/alljoyn.h>
+#include <ajtcl/aj_creds.h>
+#include <ajtcl/aj_peer.h>
+#include <ajtcl/aj_debug.h>
+
+#define CHECK(cond, what) \
+    do { \
+        if (!(cond)) { \
+            AJ_AlwaysPrintf(("FAILED: %s\n", what)); \
+            return 1; \
+        } \
+        AJ_AlwaysPrintf(("ok: %s\n", what)); \
+    } while (0)
+
+/* Enough pairs to use up every handshake slot and one more */
+#define PAIRS (AJ_MAX_PEER_HANDSHAKES + 1)
+
+typedef struct {
+    AJ_BusAttachment bus;
+    uint8_t rx[4096];
+    uint8_t tx[4096];
+    uint8_t wire[16 * 1024];   /* Messages waiting to be received */
+    size_t wireLen;
+    uint8_t done;              /* Client's handshake completed */
+    AJ_Status authStatus;
+} TestBus;
+
+static TestBus clients[PAIRS];
+static TestBus servers[PAIRS];
+
+static uint32_t delivered = 0;
+
+/*
+ * Walk the header fields for the destination
+ */
+static const char* Destination(const uint8_t* msg, size_t len)
+{
+    const AJ_MsgHeader* hdr = (const AJ_MsgHeader*)msg;
+    size_t end = sizeof(AJ_MsgHeader) + hdr->headerLen;
+    size_t pos = sizeof(AJ_MsgHeader);
+
+    while ((pos + 4) < min(end, len)) {
+        uint8_t code = msg[pos];
+        char type = (char)msg[pos + 2];
+
+        pos += 4;
+        if ((type == 's') || (type == 'o')) {
+            if (code == AJ_HDR_DESTINATION) {
+                return (const char*)msg + pos + 4;
+            }
+            pos += 4 + *(const uint32_t*)(msg + pos) + 1;
+        } else if (type == 'g') {
+            pos += 1 + msg[pos] + 1;
+        } else {
+            pos += 4;
+        }
+        pos = (pos + 7) & ~7;
+    }
+    return NULL;
+}
+
+static TestBus* FindBus(const char* name)
+{
+    size_t i;
+
+    for (i = 0; name && (i < PAIRS); i++) {
+        if (0 == strcmp(name, clients[i].bus.uniqueName)) {
+            return &clients[i];
+        }
+        if (0 == strcmp(name, servers[i].bus.uniqueName)) {
+            return &servers[i];
+        }
+    }
+    return NULL;
+}
+
+/*
+ * Each message is sent in one go, messages to anyone else (the routing node) are dropped
+ */
+static AJ_Status TxFunc(AJ_IOBuffer* buf)
+{
+    size_t len = AJ_IO_BUF_AVAIL(buf);
+    TestBus* to = FindBus(Destination(buf->readPtr, len));
+
+    if (to) {
+        if ((to->wireLen + len) > sizeof(to->wire)) {
+            return AJ_ERR_WRITE;
+        }
+        memcpy(to->wire + to->wireLen, buf->readPtr, len);
+        to->wireLen += len;
+        ++delivered;
+    }
+    AJ_IO_BUF_RESET(buf);
+    return AJ_OK;
+}
+
+static AJ_Status RxFunc(AJ_IOBuffer* buf, uint32_t len, uint32_t timeout)
+{
+    TestBus* tb = (TestBus*)buf->context;
+    size_t rx = min(min(len, AJ_IO_BUF_SPACE(buf)), tb->wireLen);
+
+    if (!rx) {
+        return AJ_ERR_TIMEOUT;
+    }
+    memcpy(buf->writePtr, tb->wire, rx);
+    memmove(tb->wire, tb->wire + rx, tb->wireLen - rx);
+    tb->wireLen -= rx;
+    buf->writePtr += rx;
+    return AJ_OK;
+}
+
+static AJ_Status AuthListener(uint32_t authmechanism, uint32_t command, AJ_Credential* cred)
+{
+    if (authmechanism == AUTH_SUITE_ECDHE_NULL) {
+        cred->expiration = 0xFFFFFFFF;
+        return AJ_OK;
+    }
+    return AJ_ERR_INVALID;
+}
+
+static void AuthCallback(const void* context, AJ_Status status)
+{
+    TestBus* tb = (TestBus*)context;
+
+    tb->done = TRUE;
+    tb->authStatus = status;
+}
+
+static AJ_Status Setup(TestBus* tb, const char* name)
+{
+    static const uint32_t suites[] = { AUTH_SUITE_ECDHE_NULL };
+    AJ_Status status;
+
+    memset(tb, 0, sizeof(TestBus));
+    strcpy(tb->bus.uniqueName, name);
+    AJ_IOBufInit(&tb->bus.sock.rx, tb->rx, sizeof(tb->rx), AJ_IO_BUF_RX, tb);
+    tb->bus.sock.rx.recv = RxFunc;
+    AJ_IOBufInit(&tb->bus.sock.tx, tb->tx, sizeof(tb->tx), AJ_IO_BUF_TX, tb);
+    tb->bus.sock.tx.send = TxFunc;
+    AJ_BusSetAuthListenerCallback(&tb->bus, AuthListener);
+    status = AJ_BusEnableSecurity(&tb->bus, suites, ArraySize(suites));
+    /* There is no routing node to answer the bind to the security management port */
+    AJ_ReleaseReplyContexts(&tb->bus);
+    return status;
+}
+
+static AJ_Status Authenticate(size_t pair)
+{
+    TestBus* tb = &clients[pair];
+
+    tb->done = FALSE;
+    tb->authStatus = AJ_OK;
+    return AJ_BusAuthenticatePeer(&tb->bus, servers[pair].bus.uniqueName, AuthCallback, tb);
+}
+
+/*
+ * Deliver messages until none are left, counting how the clients' handling of them failed.
+ * Each round the servers go first so they all see the slots as the clients left them.
+ */
+static uint32_t Pump(AJ_Status failure)
+{
+    AJ_Message msg;
+    uint32_t failures = 0;
+    uint8_t busy = TRUE;
+    size_t i;
+
+    while (busy) {
+        busy = FALSE;
+        for (i = 0; i < 2 * PAIRS; i++) {
+            TestBus* tb = (i < PAIRS) ? &servers[i] : &clients[i - PAIRS];
+            if (!tb->wireLen && (tb->bus.sock.rx.writePtr == tb->bus.sock.rx.readPtr)) {
+                continue;
+            }
+            busy = TRUE;
+            if (AJ_OK == AJ_UnmarshalMsg(&tb->bus, &msg, 0)) {
+                if ((failure == AJ_BusHandleBusMessage(&msg)) && (i >= PAIRS)) {
+                    ++failures;
+                }
+                AJ_CloseMsg(&msg);
+            }
+        }
+    }
+    return failures;
+}
+
+/*
+ * Run a full key exchange with the fast handshake enabled as given, returns the
+ * number of messages it took or zero if it failed
+ */
+static uint32_t Handshake(size_t pair, uint8_t clientFast, uint8_t serverFast)
+{
+    AJ_BusEnableFastHandshake(&clients[pair].bus, clientFast);
+    AJ_BusEnableFastHandshake(&servers[pair].bus, serverFast);
+    /* Without a stored master secret the session can't be resumed */
+    AJ_ClearCredentials(AJ_GENERIC_MASTER_SECRET | AJ_CRED_TYPE_GENERIC);
+    delivered = 0;
+    if (AJ_OK != Authenticate(pair)) {
+        return 0;
+    }
+    Pump(AJ_OK);
+    return (clients[pair].done && (AJ_OK == clients[pair].authStatus)) ? delivered : 0;
+}
+
+int AJ_Main(void)
+{
+    char name[16];
+    uint32_t failures;
+    uint32_t full;
+    uint32_t fast;
+    size_t i;
+
+    AJ_Initialize();
+    AJ_RegisterObjects(NULL, NULL);
+    for (i = 0; i < PAIRS; i++) {
+        sprintf(name, ":client%u.1", (unsigned int)i);
+        CHECK(AJ_OK == Setup(&clients[i], name), "set up client");
+        sprintf(name, ":server%u.1", (unsigned int)i);
+        CHECK(AJ_OK == Setup(&servers[i], name), "set up server");
+    }
+
+    /*
+     * Every slot taken by the clients, the next handshake is refused up front and the
+     * servers have no slot for their side so they refuse theirs too
+     */
+    AJ_ClearCredentials(AJ_GENERIC_MASTER_SECRET | AJ_CRED_TYPE_GENERIC);
+    for (i = 0; i < AJ_MAX_PEER_HANDSHAKES; i++) {
+        CHECK(AJ_OK == Authenticate(i), "start handshake");
+    }
+    CHECK(AJ_ERR_RESOURCES == Authenticate(AJ_MAX_PEER_HANDSHAKES), "no slot for another handshake");
+    CHECK(AJ_ERR_RESOURCES == Authenticate(0), "handshake with the same peer refused");
+    failures = Pump(AJ_ERR_RESOURCES);
+    CHECK(failures == AJ_MAX_PEER_HANDSHAKES, "servers without a slot refuse the handshake");
+    for (i = 0; i < PAIRS; i++) {
+        CHECK(!clients[i].done, "refused handshake not reported as complete");
+    }
+
+    /*
+     * Refused handshakes free their slots, two handshakes interleave
+     */
+    CHECK(AJ_OK == Authenticate(0), "start first handshake");
+    CHECK(AJ_OK == Authenticate(1), "start second handshake");
+    Pump(AJ_OK);
+    CHECK(clients[0].done && (AJ_OK == clients[0].authStatus), "first handshake succeeded");
+    CHECK(clients[1].done && (AJ_OK == clients[1].authStatus), "second handshake succeeded");
+
+    /*
+     * The fast handshake needs fewer messages, if either side doesn't offer it they fall
+     * back to the full exchange
+     */
+    full = Handshake(2, FALSE, FALSE);
+    CHECK(full, "full handshake succeeded");
+    fast = Handshake(2, TRUE, TRUE);
+    CHECK(fast, "fast handshake succeeded");
+    CHECK(fast < full, "fast handshake negotiated");
+    CHECK(full == Handshake(2, TRUE, FALSE), "server without fast handshake falls back");
+    CHECK(full == Handshake(2, FALSE, TRUE), "client without fast handshake falls back");
+    AJ_AlwaysPrintf(("full handshake %u messages, fast handshake %u messages\n", full, fast));
+
+    AJ_AlwaysPrintf(("peerauthtest passed\n"));
+    return 0;
+}
+
+#ifdef AJ_MAIN
+int main()
+{
+    return AJ_Main();
+}
+#endif
@@ -0,0 +1,215 @@
+/**
+ * @file
+ */
+/******************************************************************************
+ * Copyright AllSeen Alliance. All rights reserved.
+ *
+ *    Permission to use, copy, modify, and/or distribute this software for any
+ *    purpose with or without fee is hereby granted, provided that the above
+ *    copyright notice and this permission notice appear in all copies.
+ *
+ *    THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ *    WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ *    MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ *    ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ *    WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ *    ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ *    OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ ******************************************************************************/
+
+/*
+ * Measures message round trips over the shared memory transport. A child process stands in
+ * for the peer and echoes every signal back, so no routing node is needed.
+ *
+ * Usage: shmpeer [count] [payload bytes]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#include <ajtcl/alljoyn.h>
+#include <ajtcl/aj_net.h>
+#include <ajtcl/aj_debug.h>
+
+static const char* const echoInterface[] = {
+    "org.alljoyn.test.shm",
+    "!Echo seq>u payload>s",
+    NULL
+};
+
+static const AJ_InterfaceDescription echoInterfaces[] = {
+    echoInterface,
+    NULL
+};
+
+static const AJ_Object AppObjects[] = {
+    { "/org/alljoyn/test/shm", echoInterfaces },
+    { NULL }
+};
+
+#define ECHO_SIGNAL AJ_APP_MESSAGE_ID(0, 0, 0)
+
+#define UNMARSHAL_TIMEOUT 5000
+
+/*
+ * Room for the message header on top of the payload
+ */
+#define HEADER_ROOM 256
+
+static uint32_t payloadSize = 64;
+
+static AJ_Status SendEcho(AJ_BusAttachment* bus, const char* dest, uint32_t seq, const char* payload)
+{
+    AJ_Status status;
+    AJ_Message msg;
+
+    status = AJ_MarshalSignal(bus, &msg, ECHO_SIGNAL, dest, 0, 0, 0);
+    if (status == AJ_OK) {
+        status = AJ_MarshalArgs(&msg, "us", seq, payload);
+    }
+    if (status == AJ_OK) {
+        status = AJ_DeliverMsg(&msg);
+    }
+    return status;
+}
+
+/*
+ * The stand-in peer, echoes signals until the other end detaches
+ */
+static int Peer(int memFd)
+{
+    AJ_BusAttachment bus;
+    AJ_Status status;
+    uint32_t count = 0;
+
+    memset(&bus, 0, sizeof(bus));
+    status = AJ_ShmConnect(&bus, memFd);
+    if (status == AJ_OK) {
+        status = AJ_BusSetBufferSizes(&bus, 0, 0, payloadSize + HEADER_ROOM);
+    }
+    if (status != AJ_OK) {
+        AJ_AlwaysPrintf(("Peer: AJ_ShmConnect failed (%s)\n", AJ_StatusText(status)));
+        return EXIT_FAILURE;
+    }
+    strcpy(bus.uniqueName, ":peer.1");
+    while (TRUE) {
+        AJ_Message msg;
+        uint32_t seq;
+        char* payload;
+
+        status = AJ_UnmarshalMsg(&bus, &msg, UNMARSHAL_TIMEOUT);
+        if (status != AJ_OK) {
+            break;
+        }
+        if (msg.msgId == ECHO_SIGNAL) {
+            status = AJ_UnmarshalArgs(&msg, "us", &seq, &payload);
+            if (status == AJ_OK) {
+                status = SendEcho(&bus, msg.sender, seq, payload);
+            }
+            ++count;
+        }
+        AJ_CloseMsg(&msg);
+        if (status != AJ_OK) {
+            break;
+        }
+    }
+    AJ_Net_Disconnect(&bus.sock);
+    AJ_AlwaysPrintf(("Peer: echoed %u messages\n", count));
+    return (status == AJ_ERR_READ) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+int main(int argc, char** argv)
+{
+    AJ_BusAttachment bus;
+    AJ_Status status;
+    AJ_Time timer;
+    uint32_t count = (argc > 1) ? (uint32_t)atoi(argv[1]) : 100000;
+    uint32_t elapsed;
+    uint32_t i;
+    char* payload;
+    int memFd;
+    int peerStatus;
+    pid_t pid;
+
+    if (argc > 2) {
+        payloadSize = (uint32_t)atoi(argv[2]);
+    }
+    AJ_Initialize();
+    AJ_RegisterObjects(AppObjects, NULL);
+
+    payload = (char*)AJ_Malloc(payloadSize + 1);
+    if (!payload) {
+        return EXIT_FAILURE;
+    }
+    memset(payload, 'x', payloadSize);
+    payload[payloadSize] = '\0';
+
+    memFd = AJ_ShmCreate(64 * 1024);
+    if (memFd < 0) {
+        AJ_AlwaysPrintf(("AJ_ShmCreate failed\n"));
+        goto ErrorExit;
+    }
+    pid = fork();
+    if (pid == 0) {
+        exit(Peer(memFd));
+    }
+    memset(&bus, 0, sizeof(bus));
+    status = AJ_ShmConnect(&bus, memFd);
+    close(memFd);
+    if (status == AJ_OK) {
+        status = AJ_BusSetBufferSizes(&bus, 0, 0, payloadSize + HEADER_ROOM);
+    }
+    if (status != AJ_OK) {
+        AJ_AlwaysPrintf(("AJ_ShmConnect failed (%s)\n", AJ_StatusText(status)));
+        waitpid(pid, &peerStatus, 0);
+        goto ErrorExit;
+    }
+    strcpy(bus.uniqueName, ":bench.1");
+    /*
+     * An interrupt while nothing is waiting must not fail the first round trip
+     */
+    AJ_Net_Interrupt();
+
+    AJ_InitTimer(&timer);
+    for (i = 0; (i < count) && (status == AJ_OK); ++i) {
+        AJ_Message msg;
+        uint32_t seq;
+        char* echo;
+
+        status = SendEcho(&bus, ":peer.1", i, payload);
+        if (status == AJ_OK) {
+            status = AJ_UnmarshalMsg(&bus, &msg, UNMARSHAL_TIMEOUT);
+        }
+        if (status != AJ_OK) {
+            break;
+        }
+        status = AJ_UnmarshalArgs(&msg, "us", &seq, &echo);
+        if ((status == AJ_OK) && ((seq != i) || (strcmp(echo, payload) != 0))) {
+            AJ_AlwaysPrintf(("Echo %u does not match\n", i));
+            status = AJ_ERR_INVALID;
+        }
+        AJ_CloseMsg(&msg);
+    }
+    elapsed = AJ_GetElapsedTime(&timer, FALSE);
+    AJ_Net_Disconnect(&bus.sock);
+    waitpid(pid, &peerStatus, 0);
+
+    if (status != AJ_OK) {
+        AJ_AlwaysPrintf(("Round trip %u failed (%s)\n", i, AJ_StatusText(status)));
+        goto ErrorExit;
+    }
+    if (!elapsed) {
+        elapsed = 1;
+    }
+    AJ_AlwaysPrintf(("%u round trips of %u bytes in %u ms: %u msgs/sec, %u us per round trip\n",
+                     count, payloadSize, elapsed, (uint32_t)((uint64_t)count * 2000 / elapsed),
+                     (uint32_t)((uint64_t)elapsed * 1000 / (count ? count : 1))));
+    AJ_Free(payload);
+    return (WIFEXITED(peerStatus) && (WEXITSTATUS(peerStatus) == EXIT_SUCCESS)) ? EXIT_SUCCESS : EXIT_FAILURE;
+
+ErrorExit:
+    AJ_Free(payload);
+    return EXIT_FAILURE;
+}
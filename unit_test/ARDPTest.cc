@@ -33,6 +33,7 @@
 #define ARDP_FLAG_SDM  0x0001  /**< Sequenced delivery mode option. Indicates in-order sequence delivery is in force. */
 
 #define ARDP_SYN_HEADER_SIZE 28
+#define ARDP_MAX_DLEN (UDP_SEGBMAX - (UDP_HEADER_SIZE + ARDP_HEADER_SIZE))
 
 #define FLAGS_OFFSET   0
 #define HLEN_OFFSET    1
@@ -64,6 +65,9 @@ static enum {
 
 static uint16_t local_port;
 
+static uint32_t DataSent;     // data segments sent, including retransmits
+static uint32_t LastDataSeq;  // sequence number of the last data segment sent
+
 static uint8_t ConnectedResponse[] = {
     ARDP_FLAG_SYN | ARDP_FLAG_ACK | ARDP_FLAG_VER,   // flags
     0x0E,       // HLEN
@@ -95,7 +99,7 @@ static AJ_Status AJ_ARDP_UDP_Send(void* context, uint8_t* txbuf, size_t len, siz
         memcpy(ConnectedResponse + ACK_OFFSET, txbuf + SEQ_OFFSET, sizeof(uint32_t));
 
         EXPECT_EQ(*((uint32_t*) (txbuf + ACK_OFFSET)), 0);
-        EXPECT_EQ(*((uint16_t*) (txbuf + SEGMAX_OFFSET)), htons(UDP_SEGMAX));
+        EXPECT_EQ(*((uint16_t*) (txbuf + SEGMAX_OFFSET)), htons(AJ_ARDP_SEGMAX));
         EXPECT_EQ(*((uint16_t*) (txbuf + SEGBMAX_OFFSET)), htons(UDP_SEGBMAX));
         EXPECT_EQ(*((uint32_t*) (txbuf + DACKT_OFFSET)), htonl(UDP_DELAYED_ACK_TIMEOUT));
         EXPECT_EQ(*((uint16_t*) (txbuf + OPTIONS_OFFSET)), htons(ARDP_FLAG_SIMPLE_MODE | ARDP_FLAG_SDM));
@@ -115,6 +119,10 @@ static AJ_Status AJ_ARDP_UDP_Send(void* context, uint8_t* txbuf, size_t len, siz
         EXPECT_EQ(*(txbuf + HLEN_OFFSET), 18);
         EXPECT_EQ(*((uint16_t*) (txbuf + SRC_OFFSET)), htons(local_port));
         EXPECT_EQ(*((uint16_t*) (txbuf + DST_OFFSET)), 0);
+        if (*((uint16_t*) (txbuf + DLEN_OFFSET))) {
+            DataSent++;
+            LastDataSeq = ntohl(*((uint32_t*) (txbuf + SEQ_OFFSET)));
+        }
         break;
 
     case Disconnecting:
@@ -134,10 +142,19 @@ static AJ_Status AJ_ARDP_UDP_Send(void* context, uint8_t* txbuf, size_t len, siz
     return AJ_OK;
 }
 
+/*
+ * The datagram the next receive returns, NULL to time out
+ */
+static uint8_t* RecvData = ConnectedResponse;
+static uint32_t RecvLen = sizeof(ConnectedResponse);
+
 static AJ_Status AJ_ARDP_UDP_Recv(void* context, uint8_t** data, uint32_t* recved, uint32_t timeout)
 {
-    *data = ConnectedResponse;
-    *recved = sizeof(ConnectedResponse);
+    if (!RecvData) {
+        return AJ_ERR_TIMEOUT;
+    }
+    *data = RecvData;
+    *recved = RecvLen;
     return AJ_OK;
 }
 
@@ -148,19 +165,23 @@ class ARDPTest : public testing::Test {
 
     virtual void SetUp() {
         AJ_ARDP_InitFunctions(&AJ_ARDP_UDP_Recv, &AJ_ARDP_UDP_Send);
+        RecvData = ConnectedResponse;
+        RecvLen = sizeof(ConnectedResponse);
+        DataSent = 0;
     }
     virtual void TearDown() {
 
     }
 };
 
-void SendBackConnected()
+void SendBackConnected(uint16_t segmax = 93)
 {
     uint8_t rxData[1024];
     AJ_Status status;
     AJ_IOBuffer buf;
 
     *((uint16_t*) (ConnectedResponse + DST_OFFSET)) = htons(local_port);
+    *((uint16_t*) (ConnectedResponse + SEGMAX_OFFSET)) = htons(segmax);
 
     AJ_IOBufInit(&buf, rxData, sizeof(rxData), AJ_IO_BUF_RX, NULL);
     status = AJ_ARDP_Recv(&buf, sizeof(rxData), 0);
@@ -181,8 +202,209 @@ TEST_F(ARDPTest, TestSynAck)
     // now maybe do some send and receive
 
     State = Disconnecting;
-    AJ_ARDP_Disconnect(TRUE);
+    AJ_ARDP_Disconnect(NULL, TRUE);
+}
+
+/*
+ * Send a message of whole segments, at most a transmit buffer at a time
+ */
+static void SendSegments(uint32_t count)
+{
+    static uint8_t txData[(UDP_SEGMAX - 1) * ARDP_MAX_DLEN];
+    uint32_t perCall = sizeof(txData) / ARDP_MAX_DLEN;
+    AJ_MsgHeader* hdr = (AJ_MsgHeader*) txData;
+    AJ_IOBuffer buf;
+    AJ_Status status;
+
+    status = AJ_ARDP_StartMsgSend(NULL, ARDP_TTL_INFINITE);
+    EXPECT_EQ(AJ_OK, status) << "  Actual Status: " << AJ_StatusText(status);
+    memset(txData, 0, sizeof(txData));
+    hdr->endianess = HOST_ENDIANESS;
+    hdr->bodyLen = count * ARDP_MAX_DLEN - sizeof(AJ_MsgHeader);
+    while (count) {
+        uint32_t segs = (count < perCall) ? count : perCall;
+        AJ_IOBufInit(&buf, txData, sizeof(txData), AJ_IO_BUF_TX, NULL);
+        buf.writePtr += segs * ARDP_MAX_DLEN;
+        status = AJ_ARDP_Send(&buf);
+        EXPECT_EQ(AJ_OK, status) << "  Actual Status: " << AJ_StatusText(status);
+        count -= segs;
+    }
+}
+
+/*
+ * Acknowledge and consume everything sent up to seq, by default everything sent so far
+ */
+static void AckSegments(uint32_t seq = LastDataSeq)
+{
+    uint8_t ack[ARDP_HEADER_SIZE];
+    uint8_t rxData[1024];
+    AJ_IOBuffer buf;
+    AJ_Status status;
+
+    memset(ack, 0, sizeof(ack));
+    ack[FLAGS_OFFSET] = ARDP_FLAG_ACK | ARDP_FLAG_VER;
+    ack[HLEN_OFFSET] = ARDP_HEADER_SIZE >> 1;
+    *((uint16_t*) (ack + DST_OFFSET)) = htons(local_port);
+    *((uint32_t*) (ack + SEQ_OFFSET)) = htonl(1);
+    *((uint32_t*) (ack + ACK_OFFSET)) = htonl(seq);
+    *((uint32_t*) (ack + LCS_OFFSET)) = htonl(seq);
+    *((uint32_t*) (ack + ACKNXT_OFFSET)) = htonl(1);
+    RecvData = ack;
+    RecvLen = sizeof(ack);
+
+    AJ_IOBufInit(&buf, rxData, sizeof(rxData), AJ_IO_BUF_RX, NULL);
+    status = AJ_ARDP_Recv(&buf, sizeof(rxData), 0);
+    EXPECT_EQ(AJ_ERR_TIMEOUT, status) << "  Actual Status: " << AJ_StatusText(status);
+    RecvData = NULL;
+}
+
+#ifndef NDEBUG
+static void ExpectWindow(uint16_t size, uint16_t cwnd, uint16_t ssthresh)
+{
+    uint16_t s, c, t;
+    AJ_Status status = AJ_ARDP_GetSendWindow(NULL, &s, &c, &t);
+    EXPECT_EQ(AJ_OK, status) << "  Actual Status: " << AJ_StatusText(status);
+    EXPECT_EQ(size, s);
+    EXPECT_EQ(cwnd, c);
+    EXPECT_EQ(ssthresh, t);
+}
+
+TEST_F(ARDPTest, TestSegmaxTrim)
+{
+    State = Connecting;
+    AJ_Status status = AJ_ARDP_Connect((uint8_t*) TestHelloData, sizeof(TestHelloData), NULL, NULL);
+    EXPECT_EQ(AJ_OK, status) << "  Actual Status: " << AJ_StatusText(status);
+
+    // the remote can only buffer a couple of segments more than the smallest window
+    SendBackConnected(UDP_SEGMAX + 2);
+    ExpectWindow(UDP_SEGMAX + 2, UDP_SEGMAX, UDP_SEGMAX + 2);
+
+    // slow start doesn't open the window past what the remote can buffer
+    SendSegments(UDP_SEGMAX - 1);
+    AckSegments();
+    ExpectWindow(UDP_SEGMAX + 2, UDP_SEGMAX + 2, UDP_SEGMAX + 2);
+    EXPECT_EQ(UDP_SEGMAX - 1, DataSent);
+
+    State = Disconnecting;
+    AJ_ARDP_Disconnect(NULL, TRUE);
+}
+
+TEST_F(ARDPTest, TestWindowGrowth)
+{
+    uint32_t inFlight = UDP_SEGMAX - 1;
+    uint16_t cwnd = UDP_SEGMAX;
+
+    State = Connecting;
+    AJ_Status status = AJ_ARDP_Connect((uint8_t*) TestHelloData, sizeof(TestHelloData), NULL, NULL);
+    EXPECT_EQ(AJ_OK, status) << "  Actual Status: " << AJ_StatusText(status);
+
+    // the remote buffers more than we do so our SEGMAX is the limit
+    SendBackConnected();
+    ExpectWindow(AJ_ARDP_SEGMAX, UDP_SEGMAX, AJ_ARDP_SEGMAX);
+
+    // in slow start the window grows by a segment for each segment acknowledged
+    while (cwnd < AJ_ARDP_SEGMAX) {
+        SendSegments(inFlight);
+        AckSegments();
+        cwnd = (cwnd + inFlight < AJ_ARDP_SEGMAX) ? cwnd + inFlight : AJ_ARDP_SEGMAX;
+        ExpectWindow(AJ_ARDP_SEGMAX, cwnd, AJ_ARDP_SEGMAX);
+        inFlight = cwnd - 1;
+    }
+
+    State = Disconnecting;
+    AJ_ARDP_Disconnect(NULL, TRUE);
 }
 
+TEST_F(ARDPTest, TestRetransmitCloseWindow)
+{
+    const uint32_t inFlight = 4 * UDP_SEGMAX - 4;
+    uint8_t rxData[1024];
+    AJ_IOBuffer buf;
+    AJ_Time timer;
+    uint32_t sent;
+
+    State = Connecting;
+    AJ_Status status = AJ_ARDP_Connect((uint8_t*) TestHelloData, sizeof(TestHelloData), NULL, NULL);
+    EXPECT_EQ(AJ_OK, status) << "  Actual Status: " << AJ_StatusText(status);
+    SendBackConnected();
+
+    // open the window then leave more than a batch of segments unacknowledged
+    SendSegments(UDP_SEGMAX - 1);
+    AckSegments();
+    SendSegments(2 * UDP_SEGMAX - 2);
+    AckSegments();
+    ExpectWindow(AJ_ARDP_SEGMAX, 4 * UDP_SEGMAX - 3, AJ_ARDP_SEGMAX);
+    SendSegments(inFlight);
+    sent = DataSent;
+
+    // wait for the retransmit timer, every segment in flight goes out again
+    RecvData = NULL;
+    AJ_InitTimer(&timer);
+    while ((DataSent == sent) && (AJ_GetElapsedTime(&timer, TRUE) < 10 * UDP_INITIAL_DATA_TIMEOUT)) {
+        AJ_IOBufInit(&buf, rxData, sizeof(rxData), AJ_IO_BUF_RX, NULL);
+        AJ_ARDP_Recv(&buf, 0, UDP_MINIMUM_TIMEOUT);
+    }
+    EXPECT_EQ(sent + inFlight, DataSent) << "  Not all segments retransmitted";
+
+    // the threshold is half what was in flight and slow start begins again
+    ExpectWindow(AJ_ARDP_SEGMAX, UDP_SEGMAX, 2 * UDP_SEGMAX - 2);
+
+    // acknowledge half, the rest times out again but it is the same loss
+    AckSegments(LastDataSeq - inFlight / 2);
+    ExpectWindow(AJ_ARDP_SEGMAX, 3 * UDP_SEGMAX - 2, 2 * UDP_SEGMAX - 2);
+    sent = DataSent;
+    AJ_InitTimer(&timer);
+    while ((DataSent == sent) && (AJ_GetElapsedTime(&timer, TRUE) < 10 * UDP_INITIAL_DATA_TIMEOUT)) {
+        AJ_IOBufInit(&buf, rxData, sizeof(rxData), AJ_IO_BUF_RX, NULL);
+        AJ_ARDP_Recv(&buf, 0, UDP_MINIMUM_TIMEOUT);
+    }
+    EXPECT_EQ(sent + inFlight / 2, DataSent) << "  Not all segments retransmitted";
+    ExpectWindow(AJ_ARDP_SEGMAX, 3 * UDP_SEGMAX - 2, 2 * UDP_SEGMAX - 2);
+
+    State = Disconnecting;
+    AJ_ARDP_Disconnect(NULL, TRUE);
+}
+#endif
+
+TEST_F(ARDPTest, TestOversizeSegment)
+{
+    uint8_t segment[UDP_SEGBMAX + 64];
+    uint8_t rxData[1024];
+    AJ_IOBuffer buf;
+
+    State = Connecting;
+    AJ_Status status = AJ_ARDP_Connect((uint8_t*) TestHelloData, sizeof(TestHelloData), NULL, NULL);
+    EXPECT_EQ(AJ_OK, status) << "  Actual Status: " << AJ_StatusText(status);
+    SendBackConnected();
+
+    // let the acknowledgement of the SYN-ACK go out
+    RecvData = NULL;
+    AJ_IOBufInit(&buf, rxData, sizeof(rxData), AJ_IO_BUF_RX, NULL);
+    status = AJ_ARDP_Recv(&buf, sizeof(rxData), 0);
+    EXPECT_EQ(AJ_ERR_TIMEOUT, status) << "  Actual Status: " << AJ_StatusText(status);
+
+    // a data segment that is in sequence but too large for a receive buffer
+    memset(segment, 0, sizeof(segment));
+    segment[FLAGS_OFFSET] = ARDP_FLAG_ACK | ARDP_FLAG_VER;
+    segment[HLEN_OFFSET] = ARDP_HEADER_SIZE >> 1;
+    *((uint16_t*) (segment + SRC_OFFSET)) = *((uint16_t*) (ConnectedResponse + SRC_OFFSET));
+    *((uint16_t*) (segment + DST_OFFSET)) = htons(local_port);
+    *((uint16_t*) (segment + DLEN_OFFSET)) = htons(sizeof(segment) - ARDP_HEADER_SIZE);
+    *((uint32_t*) (segment + SEQ_OFFSET)) = htonl(1);
+    memcpy(segment + ACK_OFFSET, ConnectedResponse + ACK_OFFSET, sizeof(uint32_t));
+    memcpy(segment + LCS_OFFSET, ConnectedResponse + ACK_OFFSET, sizeof(uint32_t));
+    *((uint32_t*) (segment + ACKNXT_OFFSET)) = htonl(1);
+    *((uint32_t*) (segment + SOM_OFFSET)) = htonl(1);
+    *((uint16_t*) (segment + FCNT_OFFSET)) = htons(1);
+    RecvData = segment;
+    RecvLen = sizeof(segment);
+
+    // the segment is rejected and the connection reset
+    State = Disconnecting;
+    AJ_IOBufInit(&buf, rxData, sizeof(rxData), AJ_IO_BUF_RX, NULL);
+    status = AJ_ARDP_Recv(&buf, sizeof(rxData), 0);
+    EXPECT_EQ(AJ_ERR_READ, status) << "  Actual Status: " << AJ_StatusText(status);
+    EXPECT_EQ(0, AJ_IO_BUF_AVAIL(&buf));
+}
 
 #endif
@@ -594,6 +594,91 @@ TEST_F(MutterTest, StructofInteger_VariantandInteger)
 }
 
 
+TEST_F(MutterTest, VariantInGrowingBuffer)
+{
+    const char* sig;
+    const char* str;
+    uint32_t hdrLen;
+    uint32_t count = 24;
+    uint32_t j;
+    AJ_Status status;
+
+    /*
+     * Find how much of the buffer the header takes so the buffer can be made to grow at
+     * every point while the variant is marshaled
+     */
+    //Index of "v" in testSignature[] is 5
+    status = AJ_MarshalSignal(&testBus, &txMsg, 5, "mutter.service", 0, 0, 0);
+    ASSERT_EQ(AJ_OK, status) << "  Actual Status: " << AJ_StatusText(status);
+    hdrLen = (uint32_t)(testBus.sock.tx.writePtr - testBus.sock.tx.bufStart);
+    AJ_IO_BUF_RESET(&testBus.sock.tx);
+
+    for (uint32_t extra = 0; extra < 64; ++extra) {
+        uint8_t* buffer = (uint8_t*)AJ_Malloc(hdrLen + extra);
+        AJ_IOBufInit(&testBus.sock.tx, buffer, hdrLen + extra, AJ_IO_BUF_TX, NULL);
+        testBus.sock.tx.send = TxFunc;
+        testBus.sock.tx.bufMax = 4096;
+
+        status = AJ_MarshalSignal(&testBus, &txMsg, 5, "mutter.service", 0, 0, 0);
+        EXPECT_EQ(AJ_OK, status) << "  Actual Status: " << AJ_StatusText(status);
+        if (AJ_OK == status) {
+            status = AJ_MarshalVariant(&txMsg, "a(iv)");
+            EXPECT_EQ(AJ_OK, status) << "  Actual Status: " << AJ_StatusText(status);
+            status = AJ_MarshalContainer(&txMsg, &array1, AJ_ARG_ARRAY);
+            EXPECT_EQ(AJ_OK, status) << "  Actual Status: " << AJ_StatusText(status);
+            for (uint32_t i = 0; (AJ_OK == status) && (i < count); ++i) {
+                status = AJ_MarshalContainer(&txMsg, &struct1, AJ_ARG_STRUCT);
+                EXPECT_EQ(AJ_OK, status) << "  Actual Status: " << AJ_StatusText(status);
+                status = AJ_MarshalArgs(&txMsg, "i", i);
+                EXPECT_EQ(AJ_OK, status) << "  Actual Status: " << AJ_StatusText(status);
+                status = AJ_MarshalArgs(&txMsg, "v", "s", Fruits[i % ArraySize(Fruits)]);
+                EXPECT_EQ(AJ_OK, status) << "  Actual Status: " << AJ_StatusText(status);
+                status = AJ_MarshalCloseContainer(&txMsg, &struct1);
+                EXPECT_EQ(AJ_OK, status) << "  Actual Status: " << AJ_StatusText(status);
+            }
+            status = AJ_MarshalCloseContainer(&txMsg, &array1);
+            EXPECT_EQ(AJ_OK, status) << "  Actual Status: " << AJ_StatusText(status);
+            EXPECT_LT(hdrLen + extra, testBus.sock.tx.bufSize) << "  Buffer did not grow";
+            status = AJ_DeliverMsg(&txMsg);
+            EXPECT_EQ(AJ_OK, status) << "  Actual Status: " << AJ_StatusText(status);
+        }
+        AJ_Free(testBus.sock.tx.bufStart);
+        memset(&testBus.sock.tx, 0, sizeof(testBus.sock.tx));
+        if (AJ_OK != status) {
+            break;
+        }
+
+        status = AJ_UnmarshalMsg(&testBus, &rxMsg, ZERO_SECONDS);
+        EXPECT_EQ(AJ_OK, status) << "  Actual Status: " << AJ_StatusText(status);
+        if (AJ_OK == status) {
+            status = AJ_UnmarshalVariant(&rxMsg, &sig);
+            EXPECT_EQ(AJ_OK, status) << "  Actual Status: " << AJ_StatusText(status);
+            EXPECT_STREQ("a(iv)", sig);
+            status = AJ_UnmarshalContainer(&rxMsg, &array1, AJ_ARG_ARRAY);
+            EXPECT_EQ(AJ_OK, status) << "  Actual Status: " << AJ_StatusText(status);
+            for (uint32_t i = 0; (AJ_OK == status) && (i < count); ++i) {
+                status = AJ_UnmarshalContainer(&rxMsg, &struct1, AJ_ARG_STRUCT);
+                EXPECT_EQ(AJ_OK, status) << "  Actual Status: " << AJ_StatusText(status);
+                status = AJ_UnmarshalArgs(&rxMsg, "iv", &j, "s", &str);
+                EXPECT_EQ(AJ_OK, status) << "  Actual Status: " << AJ_StatusText(status);
+                if (AJ_OK == status) {
+                    EXPECT_EQ(i, j);
+                    EXPECT_STREQ(Fruits[i % ArraySize(Fruits)], str);
+                }
+                status = AJ_UnmarshalCloseContainer(&rxMsg, &struct1);
+                EXPECT_EQ(AJ_OK, status) << "  Actual Status: " << AJ_StatusText(status);
+            }
+            status = AJ_UnmarshalCloseContainer(&rxMsg, &array1);
+            EXPECT_EQ(AJ_OK, status) << "  Actual Status: " << AJ_StatusText(status);
+            AJ_CloseMsg(&rxMsg);
+        }
+        if (AJ_OK != status) {
+            break;
+        }
+    }
+}
+
+
 TEST_F(MutterTest, DeepVariant)
 {
     char* str;